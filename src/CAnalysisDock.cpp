@@ -0,0 +1,153 @@
+#include "CAnalysisDock.h"
+#include "CMap.h"
+#include "Constants.h"
+
+#include <QCheckBox>
+#include <QHeaderView>
+#include <QLabel>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+//-----------------------------------------------------------------------------
+namespace {
+    QTableWidgetItem* numberItem(qulonglong value)
+    {
+        QTableWidgetItem* item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, value);
+        item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        return item;
+    }
+}
+
+//-----------------------------------------------------------------------------
+CAnalysisDock::CAnalysisDock(QWidget* parent)
+: QDockWidget(tr("Analysis"), parent)
+{
+    setObjectName("AnalysisDock");
+    m_pool.setMaxThreadCount(1);
+
+    QWidget* content = new QWidget(this);
+    m_summaryLabel = new QLabel(tr("No map"), content);
+    m_summaryLabel->setWordWrap(true);
+
+    m_overlayCheckBox = new QCheckBox(tr("Show regions overlay"), content);
+    connect(m_overlayCheckBox, &QCheckBox::toggled, this, &CAnalysisDock::onOverlayToggled);
+
+    m_table = new QTableWidget(0, 5, content);
+    m_table->setHorizontalHeaderLabels({tr("Tile"), tr("Count"), tr("%"), tr("Regions"), tr("Largest")});
+    m_table->verticalHeader()->hide();
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_table->setSortingEnabled(true);
+
+    QVBoxLayout* layout = new QVBoxLayout(content);
+    layout->addWidget(m_summaryLabel);
+    layout->addWidget(m_overlayCheckBox);
+    layout->addWidget(m_table);
+    setWidget(content);
+
+    // Edits arrive one undo step at a time; coalesce bursts into one pass
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(Constants::ANALYSIS_DELAY_MS);
+    connect(m_timer, &QTimer::timeout, this, &CAnalysisDock::startAnalysis);
+    connect(this, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+        if (visible) mapEdited();
+    });
+}
+
+//-----------------------------------------------------------------------------
+CAnalysisDock::~CAnalysisDock()
+{
+    m_pool.waitForDone();
+}
+
+//-----------------------------------------------------------------------------
+void CAnalysisDock::setMap(const CMap* map)
+{
+    // A running pass may still own m_analysis, so the reset waits for the
+    // next pass to start
+    m_map = map;
+    m_resetPending = true;
+    mapEdited();
+}
+
+//-----------------------------------------------------------------------------
+void CAnalysisDock::mapEdited()
+{
+    if (isVisible())
+        m_timer->start();
+}
+
+//-----------------------------------------------------------------------------
+void CAnalysisDock::onOverlayToggled(bool on)
+{
+    if (!on) {
+        emit overlayChanged(QImage());
+        return;
+    }
+    m_forceRun = true;
+    mapEdited();
+}
+
+//-----------------------------------------------------------------------------
+void CAnalysisDock::startAnalysis()
+{
+    if (!m_map || !isVisible())
+        return;
+    if (m_running) {
+        m_pending = true;
+        return;
+    }
+    if (m_resetPending) {
+        m_analysis.reset();
+        m_resetPending = false;
+    }
+    bool overlay = m_overlayCheckBox->isChecked();
+    if (!m_analysis.sync(*m_map) && !m_forceRun)
+        return;
+    m_forceRun = false;
+
+    m_running = true;
+    m_pool.start([this, overlay]() {
+        CAnalysisResult result = m_analysis.run(overlay);
+        QMetaObject::invokeMethod(this, [this, result]() {
+            m_running = false;
+            showResult(result);
+            if (m_pending) {
+                m_pending = false;
+                startAnalysis();
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CAnalysisDock::showResult(const CAnalysisResult& result)
+{
+    const double total = static_cast<double>(result.width) * result.height;
+    m_summaryLabel->setText(tr("%1x%2 map, %3 regions, %4 tile ids\nRelabeled %5 of %6 bands in %7 ms")
+        .arg(result.width).arg(result.height).arg(result.regionCount).arg(result.tiles.size())
+        .arg(result.bandsRelabeled).arg(result.bandCount).arg(result.milliseconds, 0, 'f', 1));
+
+    m_table->setSortingEnabled(false);
+    m_table->setRowCount(static_cast<int>(result.tiles.size()));
+    int row = 0;
+    for (const auto& [id, stats] : result.tiles) {
+        m_table->setItem(row, 0, numberItem(id));
+        m_table->setItem(row, 1, numberItem(stats.tiles));
+        QTableWidgetItem* percent = new QTableWidgetItem;
+        percent->setData(Qt::DisplayRole, total > 0 ? qRound(stats.tiles * 1000.0 / total) / 10.0 : 0.0);
+        percent->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        m_table->setItem(row, 2, percent);
+        m_table->setItem(row, 3, numberItem(static_cast<qulonglong>(stats.regions)));
+        m_table->setItem(row, 4, numberItem(stats.largestRegion));
+        ++row;
+    }
+    m_table->setSortingEnabled(true);
+
+    if (m_overlayCheckBox->isChecked() && !result.overlay.isNull())
+        emit overlayChanged(result.overlay);
+}
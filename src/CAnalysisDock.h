@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CMapAnalysis.h"
+
+//-----------------------------------------------------------------------------
+#include <QDockWidget>
+#include <QThreadPool>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QCheckBox;
+class QLabel;
+class QTableWidget;
+class QTimer;
+
+//-----------------------------------------------------------------------------
+// Dock showing region and tile statistics for the current map. Analysis runs
+// on a private worker thread; edits are coalesced and only changed row bands
+// are relabeled. Nothing runs while the dock is hidden.
+class CAnalysisDock : public QDockWidget
+{
+    Q_OBJECT
+public:
+    explicit CAnalysisDock(QWidget* parent = nullptr);
+    ~CAnalysisDock() override;
+
+    void setMap(const CMap* map);
+
+public slots:
+    void mapEdited();
+
+signals:
+    void overlayChanged(const QImage& overlay);
+
+private slots:
+    void startAnalysis();
+    void onOverlayToggled(bool on);
+
+private:
+    const CMap* m_map = nullptr;
+    CMapAnalysis m_analysis;
+    QThreadPool m_pool;
+    bool m_running = false;
+    bool m_pending = false;
+    bool m_resetPending = false;
+    bool m_forceRun = false;
+
+    QLabel* m_summaryLabel = nullptr;
+    QTableWidget* m_table = nullptr;
+    QCheckBox* m_overlayCheckBox = nullptr;
+    QTimer* m_timer = nullptr;
+
+    void showResult(const CAnalysisResult& result);
+};
@@ -0,0 +1,167 @@
+#include "CAutotile.h"
+#include "CMap.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <algorithm>
+#include <limits>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Corners only matter when both adjacent edges are set
+    uint8_t reduceMask(uint8_t m)
+    {
+        using A = CAutotile;
+        if (!((m & A::N) && (m & A::E))) m &= ~A::NE;
+        if (!((m & A::S) && (m & A::E))) m &= ~A::SE;
+        if (!((m & A::S) && (m & A::W))) m &= ~A::SW;
+        if (!((m & A::N) && (m & A::W))) m &= ~A::NW;
+        return m;
+    }
+
+    std::array<int8_t, 256> buildBlobTable()
+    {
+        // The 47 distinct reduced masks in ascending order give the
+        // canonical variant order used by rules files
+        std::array<int8_t, 256> table;
+        std::vector<uint8_t> unique;
+        for (int m = 0; m < 256; ++m)
+            unique.push_back(reduceMask(static_cast<uint8_t>(m)));
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        for (int m = 0; m < 256; ++m) {
+            uint8_t r = reduceMask(static_cast<uint8_t>(m));
+            table[m] = static_cast<int8_t>(std::lower_bound(unique.begin(), unique.end(), r) - unique.begin());
+        }
+        return table;
+    }
+}
+
+//-----------------------------------------------------------------------------
+int CAutotile::blobIndex(uint8_t mask)
+{
+    static const std::array<int8_t, 256> table = buildBlobTable();
+    return table[mask];
+}
+
+//-----------------------------------------------------------------------------
+int CAutotile::terrainOf(uint32_t id) const
+{
+    return id < m_terrainOf.size() ? m_terrainOf[id] : -1;
+}
+
+//-----------------------------------------------------------------------------
+void CAutotile::clear()
+{
+    m_terrains.clear();
+    m_terrainOf.clear();
+}
+
+//-----------------------------------------------------------------------------
+uint8_t CAutotile::neighbourMask(const CMap& map, int x, int y, int terrain) const
+{
+    static const int dx[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+    static const int dy[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+    const int w = map.width();
+    const int h = map.height();
+
+    // Outside the map counts as the same terrain so borders stay solid
+    uint8_t mask = 0;
+    for (int i = 0; i < 8; ++i) {
+        int nx = x + dx[i];
+        int ny = y + dy[i];
+        bool same = nx < 0 || ny < 0 || nx >= w || ny >= h
+            || terrainOf(map.tileAt(nx, ny)) == terrain;
+        mask |= static_cast<uint8_t>(same) << i;
+    }
+    return mask;
+}
+
+//-----------------------------------------------------------------------------
+void CAutotile::evaluate(CMap& map, int x, int y) const
+{
+    int terrain = terrainOf(map.tileAt(x, y));
+    if (terrain < 0) return;
+    map.setTile(x, y, m_terrains[terrain].lut[neighbourMask(map, x, y, terrain)]);
+}
+
+//-----------------------------------------------------------------------------
+void CAutotile::applyRect(CMap& map, const QRect& dirty) const
+{
+    if (!hasRules()) return;
+    QRect area = dirty.adjusted(-1, -1, 1, 1).intersected(QRect(0, 0, map.width(), map.height()));
+    for (int y = area.top(); y <= area.bottom(); ++y)
+        for (int x = area.left(); x <= area.right(); ++x)
+            evaluate(map, x, y);
+}
+
+//-----------------------------------------------------------------------------
+void CAutotile::applyTiles(CMap& map, const QVector<QPair<int, int>>& tiles) const
+{
+    if (!hasRules()) return;
+
+    // Changed tiles plus their 8 neighbours, each evaluated once
+    const int w = map.width();
+    const int h = map.height();
+    std::vector<uint32_t> positions;
+    positions.reserve(tiles.size() * 9);
+    for (const auto& tile : tiles) {
+        for (int ny = tile.second - 1; ny <= tile.second + 1; ++ny) {
+            for (int nx = tile.first - 1; nx <= tile.first + 1; ++nx) {
+                if (nx >= 0 && ny >= 0 && nx < w && ny < h)
+                    positions.push_back(static_cast<uint32_t>(ny) * w + nx);
+            }
+        }
+    }
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    for (uint32_t p : positions)
+        evaluate(map, static_cast<int>(p % w), static_cast<int>(p / w));
+}
+
+//-----------------------------------------------------------------------------
+bool CAutotile::fromJson(const QJsonObject& obj, int tileCount)
+{
+    clear();
+    const QJsonArray terrains = obj["terrains"].toArray();
+    if (terrains.size() > std::numeric_limits<int16_t>::max())
+        return false;
+    for (const QJsonValue& v : terrains) {
+        QJsonObject t = v.toObject();
+        QJsonArray variants = t["tiles"].toArray();
+        bool valid = variants.size() == BLOB_VARIANTS;
+        for (int i = 0; valid && i < variants.size(); ++i) {
+            qint64 id = variants[i].toInteger(-1);
+            // 0 is the empty tile, never a terrain variant
+            valid = id >= 1 && id <= tileCount;
+        }
+        if (!valid) {
+            clear();
+            return false;
+        }
+
+        Terrain terrain;
+        terrain.name = t["name"].toString();
+        for (int m = 0; m < 256; ++m)
+            terrain.lut[m] = static_cast<uint32_t>(variants[blobIndex(static_cast<uint8_t>(m))].toInteger());
+
+        int index = static_cast<int>(m_terrains.size());
+        for (const QJsonValue& id : variants) {
+            uint32_t tile = static_cast<uint32_t>(id.toInteger());
+            if (tile >= m_terrainOf.size())
+                m_terrainOf.resize(static_cast<size_t>(tile) + 1, -1);
+            m_terrainOf[tile] = static_cast<int16_t>(index);
+        }
+        m_terrains.push_back(terrain);
+    }
+    return hasRules();
+}
+
+//-----------------------------------------------------------------------------
+QString CAutotile::sidecarPath(const QString& tilesetPath)
+{
+    QFileInfo fi(tilesetPath);
+    return fi.dir().filePath(fi.completeBaseName() + ".autotile.json");
+}
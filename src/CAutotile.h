@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <QPair>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QJsonObject;
+
+//-----------------------------------------------------------------------------
+// Blob (47-tile) autotiling. Each terrain lists its 47 variants in canonical
+// order; at load time they are expanded into a 256-entry table indexed by the
+// raw 8-neighbour mask, so evaluating a tile is one mask build plus a lookup.
+// Only the edited tiles and their one-tile border are ever re-evaluated.
+class CAutotile
+{
+public:
+    enum Neighbour : uint8_t {
+        N = 1 << 0, NE = 1 << 1, E = 1 << 2, SE = 1 << 3,
+        S = 1 << 4, SW = 1 << 5, W = 1 << 6, NW = 1 << 7
+    };
+
+    static constexpr int BLOB_VARIANTS = 47;
+
+    bool hasRules() const { return !m_terrains.empty(); }
+    int terrainOf(uint32_t id) const;
+    void clear();
+
+    void applyRect(CMap& map, const QRect& dirty) const;
+    void applyTiles(CMap& map, const QVector<QPair<int, int>>& tiles) const;
+
+    // Rejects rules naming tile ids outside 1..tileCount
+    bool fromJson(const QJsonObject& obj, int tileCount);
+    static QString sidecarPath(const QString& tilesetPath);
+    static int blobIndex(uint8_t mask);
+
+private:
+    struct Terrain {
+        QString name;
+        std::array<uint32_t, 256> lut;
+    };
+    std::vector<Terrain> m_terrains;
+    std::vector<int16_t> m_terrainOf;   // terrain index per tile id, -1 if none
+
+    uint8_t neighbourMask(const CMap& map, int x, int y, int terrain) const;
+    void evaluate(CMap& map, int x, int y) const;
+};
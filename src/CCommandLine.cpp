@@ -0,0 +1,519 @@
+#include "CCommandLine.h"
+#include "CDocument.h"
+#include "CEditRecording.h"
+#include "CMainWindow.h"
+#include "CMap.h"
+#include "CMapDiff.h"
+#include "CMapPack.h"
+#include "CMapSync.h"
+#include "CPathfinder.h"
+#include "CPayloadPool.h"
+#include "CTileProperties.h"
+#include "Constants.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+namespace {
+    enum ExitCode {
+        EXIT_OK = 0,
+        EXIT_FAILED = 1,
+        EXIT_ERROR = 2
+    };
+
+    QTextStream& out()
+    {
+        static QTextStream stream(stdout);
+        return stream;
+    }
+
+    QTextStream& err()
+    {
+        static QTextStream stream(stderr);
+        return stream;
+    }
+
+    bool loadJson(const QString& path, QJsonObject& obj)
+    {
+        QFile f(path);
+        if (!f.open(QFile::ReadOnly)) {
+            err() << "Cannot open " << path << Qt::endl;
+            return false;
+        }
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            err() << "Cannot parse " << path << ": " << parseError.errorString() << Qt::endl;
+            return false;
+        }
+        obj = doc.object();
+        return true;
+    }
+
+    bool loadMap(const QString& path, CMap& map)
+    {
+        QJsonObject obj;
+        if (!loadJson(path, obj))
+            return false;
+        if (!map.fromJson(obj)) {
+            err() << "Invalid map file " << path << Qt::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool saveMap(const QString& path, const CMap& map)
+    {
+        QFile f(path);
+        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+            err() << "Cannot write " << path << Qt::endl;
+            return false;
+        }
+        f.write(QJsonDocument(map.toJson()).toJson(QJsonDocument::Indented));
+        return true;
+    }
+
+    QString rectText(const QRect& r)
+    {
+        return QString("%1,%2 %3x%4").arg(r.x()).arg(r.y()).arg(r.width()).arg(r.height());
+    }
+
+    // QCommandLineParser::process() would exit with 1, which means "check
+    // failed" here, so errors and --help are handled by hand
+    bool parseArguments(QCommandLineParser& parser, const QStringList& arguments)
+    {
+        if (!parser.parse(arguments)) {
+            err() << parser.errorText() << Qt::endl;
+            return false;
+        }
+        if (parser.isSet("help")) {
+            out() << parser.helpText();
+            return false;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------------------
+    int checkPaths(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Checks that every pair of marker objects is connected by walkable tiles.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("map", "Map file (JSON).");
+        QCommandLineOption blockedOption("blocked", "Blocked tile ids, e.g. \"1,4,10-12\".", "ids");
+        QCommandLineOption propertiesOption("tile-properties", "Block tiles marked solid in a tile properties file.", "file");
+        QCommandLineOption typesOption("types", "Marker object types.", "types", Constants::DEFAULT_PATH_MARKER_TYPES);
+        QCommandLineOption quietOption({"q", "quiet"}, "Only report unreachable pairs.");
+        parser.addOptions({blockedOption, propertiesOption, typesOption, quietOption});
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        if (parser.positionalArguments().size() != 1) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+
+        CMap map;
+        if (!loadMap(parser.positionalArguments().first(), map))
+            return EXIT_ERROR;
+
+        QSet<uint32_t> blocked = CPathfinder::parseIdList(parser.value(blockedOption));
+        if (parser.isSet(propertiesOption)) {
+            QJsonObject obj;
+            CTileProperties properties;
+            if (!loadJson(parser.value(propertiesOption), obj) || !properties.fromJson(obj))
+                return EXIT_ERROR;
+            for (int id = 0; id < properties.size(); ++id)
+                if (properties.flags(id) & CTileProperties::FLAG_SOLID)
+                    blocked.insert(static_cast<uint32_t>(id));
+        }
+
+        static const QRegularExpression separatorRe("[,\\s]+");
+        QStringList types = parser.value(typesOption).split(separatorRe, Qt::SkipEmptyParts);
+        QVector<uint32_t> objectIds;
+        QVector<QPoint> points = CPathfinder::markerTiles(map, types, &objectIds);
+        if (points.size() < 2) {
+            err() << "Need at least two marker objects of type " << types.join(", ") << Qt::endl;
+            return EXIT_ERROR;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        CWalkability grid(map, blocked);
+        QVector<CPathResult> results = CPathfinder::checkAllPairs(grid, points);
+        double ms = timer.nsecsElapsed() / 1.0e6;
+
+        int failed = 0;
+        bool quiet = parser.isSet(quietOption);
+        for (const CPathResult& r : results) {
+            if (r.reachable && quiet)
+                continue;
+            const QPoint& a = points[r.from];
+            const QPoint& b = points[r.to];
+            out() << (r.reachable ? "ok      " : "BLOCKED ")
+                  << objectIds[r.from] << " (" << a.x() << "," << a.y() << ") -> "
+                  << objectIds[r.to] << " (" << b.x() << "," << b.y() << ")";
+            if (r.reachable)
+                out() << " length " << QString::number(r.length, 'f', 1);
+            out() << Qt::endl;
+            if (!r.reachable)
+                ++failed;
+        }
+        out() << results.size() - failed << " of " << results.size() << " pairs reachable ("
+              << QString::number(ms, 'f', 1) << " ms)" << Qt::endl;
+        return failed ? EXIT_FAILED : EXIT_OK;
+    }
+
+    //-------------------------------------------------------------------------
+    // Usable as a git difftool: git difftool -x "MapEditor diff" -- level.json
+    int diffMaps(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Lists the regions where two maps differ.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("old", "Old map file (JSON).");
+        parser.addPositionalArgument("new", "New map file (JSON).");
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        const QStringList files = parser.positionalArguments();
+        if (files.size() != 2) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+        CMap oldMap, newMap;
+        if (!loadMap(files[0], oldMap) || !loadMap(files[1], newMap))
+            return EXIT_ERROR;
+
+        QElapsedTimer timer;
+        timer.start();
+        CMapDiffResult diff = CMapDiff::diff(oldMap, newMap);
+        double ms = timer.nsecsElapsed() / 1.0e6;
+
+        if (diff.sizeChanged)
+            out() << "size " << oldMap.width() << "x" << oldMap.height() << " -> "
+                  << newMap.width() << "x" << newMap.height() << Qt::endl;
+        for (const QRect& r : diff.regions)
+            out() << "changed " << rectText(r) << Qt::endl;
+        out() << diff.changedTiles << " tiles differ in " << diff.regions.size() << " regions ("
+              << QString::number(ms, 'f', 2) << " ms)" << Qt::endl;
+        return diff.isEmpty() ? EXIT_OK : EXIT_FAILED;
+    }
+
+    //-------------------------------------------------------------------------
+    // Usable as a git merge driver (merge base ours theirs -o ours, with %O
+    // %A %B) or a mergetool ($BASE $LOCAL $REMOTE -o $MERGED)
+    int mergeMaps(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Three-way merge of map files; conflicting tiles keep ours.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("base", "Common ancestor (JSON).");
+        parser.addPositionalArgument("ours", "Our version (JSON).");
+        parser.addPositionalArgument("theirs", "Their version (JSON).");
+        QCommandLineOption outputOption({"o", "output"}, "Merged map file (defaults to ours).", "file");
+        parser.addOption(outputOption);
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        const QStringList files = parser.positionalArguments();
+        if (files.size() != 3) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+        CMap base, ours, theirs;
+        if (!loadMap(files[0], base) || !loadMap(files[1], ours) || !loadMap(files[2], theirs))
+            return EXIT_ERROR;
+
+        CMapMergeResult result;
+        QString error;
+        if (!CMapDiff::merge(base, ours, theirs, result, &error)) {
+            err() << error << Qt::endl;
+            return EXIT_ERROR;
+        }
+        if (!saveMap(parser.isSet(outputOption) ? parser.value(outputOption) : files[1], result.merged))
+            return EXIT_ERROR;
+
+        for (const QRect& r : result.conflicts)
+            out() << "conflict " << rectText(r) << Qt::endl;
+        out() << result.tilesFromTheirs << " tiles taken from theirs, " << result.conflictTiles
+              << " conflicting tiles, " << result.objectConflicts << " conflicting objects" << Qt::endl;
+        return result.isClean() ? EXIT_OK : EXIT_FAILED;
+    }
+
+    //-------------------------------------------------------------------------
+    int exportPack(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Writes a map as a chunked runtime pack.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("map", "Map file (JSON).");
+        QCommandLineOption outputOption({"o", "output"}, "Pack file (defaults to the map name with a .mpak suffix).", "file");
+        QCommandLineOption chunkOption("chunk-size", "Chunk width and height in tiles.", "n",
+                                       QString::number(Constants::MAP_CHUNK_SIZE));
+        QCommandLineOption levelOption("level", "zlib level per chunk, 0 to store chunks raw.", "n",
+                                       QString::number(Constants::PACK_COMPRESSION_LEVEL));
+        parser.addOptions({outputOption, chunkOption, levelOption});
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        if (parser.positionalArguments().size() != 1) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+        const QString mapPath = parser.positionalArguments().first();
+        CMap map;
+        if (!loadMap(mapPath, map))
+            return EXIT_ERROR;
+
+        CMapPackOptions options;
+        bool chunkOk = false, levelOk = false;
+        options.chunkSize = parser.value(chunkOption).toInt(&chunkOk);
+        options.compressionLevel = parser.value(levelOption).toInt(&levelOk);
+        if (!chunkOk || !levelOk || options.compressionLevel < 0 || options.compressionLevel > 9) {
+            err() << "Invalid --chunk-size or --level" << Qt::endl;
+            return EXIT_ERROR;
+        }
+        QString output = parser.value(outputOption);
+        if (output.isEmpty()) {
+            QFileInfo info(mapPath);
+            output = info.path() + "/" + info.completeBaseName() + "." + Constants::PACK_FILE_SUFFIX;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        CMapPackStats stats;
+        QString error;
+        if (!CMapPack::write(map, output, options, &stats, &error)) {
+            err() << error << Qt::endl;
+            return EXIT_ERROR;
+        }
+        double ms = timer.nsecsElapsed() / 1.0e6;
+
+        out() << stats.chunks << " chunks: " << stats.emptyChunks << " empty, " << stats.uniformChunks
+              << " uniform, " << stats.compressedChunks << " compressed" << Qt::endl;
+        out() << stats.bytes << " bytes written to " << output << " ("
+              << QString::number(ms, 'f', 1) << " ms)" << Qt::endl;
+        return EXIT_OK;
+    }
+
+    //-------------------------------------------------------------------------
+    // Stand-in for a game runner on a live sync channel: applies every packet
+    // to a map of its own and reports the throughput once a second
+    int syncListen(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Joins a live sync channel and applies the edits it receives.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("channel", "Channel name.", "[channel]");
+        QCommandLineOption secondsOption("seconds", "Stop after this many seconds (default: when the host leaves).", "n");
+        QCommandLineOption outputOption({"o", "output"}, "Write the received map to this file on exit.", "file");
+        parser.addOptions({secondsOption, outputOption});
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        const QStringList positional = parser.positionalArguments();
+        if (positional.size() > 1) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+        QString channel = positional.value(0, Constants::DEFAULT_SYNC_CHANNEL);
+        QLocalSocket socket;
+        socket.connectToServer(channel);
+        if (!socket.waitForConnected(Constants::SYNC_CONNECT_TIMEOUT_MS)) {
+            err() << "Cannot join channel " << channel << ": " << socket.errorString() << Qt::endl;
+            return EXIT_ERROR;
+        }
+
+        CMap map;
+        QByteArray buffer, payload;
+        qint64 limitMs = parser.isSet(secondsOption) ? parser.value(secondsOption).toLongLong() * 1000 : -1;
+        quint64 packets = 0, rects = 0, tiles = 0, bytes = 0;
+        quint64 windowTiles = 0;
+        double applyMs = 0;
+        QElapsedTimer total, window, timer;
+        total.start();
+        window.start();
+        while (limitMs < 0 || total.elapsed() < limitMs) {
+            if (socket.bytesAvailable() || socket.waitForReadyRead(100)) {
+                QByteArray chunk = socket.readAll();
+                bytes += chunk.size();
+                buffer.append(chunk);
+            } else if (socket.state() != QLocalSocket::ConnectedState) {
+                break;
+            }
+
+            bool invalid = false;
+            while (CMapSync::takePacket(buffer, payload, &invalid)) {
+                CSyncDelta delta;
+                if (!CMapSync::decode(payload, delta)) {
+                    invalid = true;
+                    break;
+                }
+                timer.start();
+                if (CMapSync::apply(map, delta))
+                    out() << "size " << map.width() << "x" << map.height() << Qt::endl;
+                applyMs += timer.nsecsElapsed() / 1.0e6;
+                ++packets;
+                rects += delta.rects.size();
+                tiles += delta.tiles.size();
+                windowTiles += delta.tiles.size();
+            }
+            if (invalid) {
+                err() << "Invalid packet on channel " << channel << Qt::endl;
+                return EXIT_FAILED;
+            }
+
+            if (window.elapsed() >= 1000) {
+                out() << packets << " packets, " << tiles << " tiles, "
+                      << qRound64(windowTiles * 1000.0 / window.elapsed()) << " tiles/s" << Qt::endl;
+                windowTiles = 0;
+                window.restart();
+            }
+        }
+
+        out() << packets << " packets, " << rects << " rects, " << tiles << " tiles, " << bytes << " bytes in "
+              << QString::number(total.elapsed() / 1000.0, 'f', 1) << " s (apply "
+              << QString::number(applyMs, 'f', 2) << " ms)" << Qt::endl;
+        if (parser.isSet(outputOption) && !saveMap(parser.value(outputOption), map))
+            return EXIT_ERROR;
+        return EXIT_OK;
+    }
+
+    //-------------------------------------------------------------------------
+    // Plays a recorded edit session through the editor, which runs on the
+    // offscreen platform, and reports latency percentiles per kind of work
+    int replay(const QStringList& arguments)
+    {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Replays a recorded edit session and reports its latencies.");
+        parser.addHelpOption();
+        parser.addPositionalArgument("recording", "Edit recording (.mrec).");
+        QCommandLineOption speedOption("speed", "Play back this many times faster than recorded.", "x", "1");
+        QCommandLineOption tilesetOption("tileset", "Use this tileset instead of the recorded one.", "file");
+        QCommandLineOption outputOption({"o", "output"}, "Write the map as it is after the replay.", "file");
+        parser.addOptions({speedOption, tilesetOption, outputOption});
+        if (!parseArguments(parser, arguments))
+            return parser.isSet("help") ? EXIT_OK : EXIT_ERROR;
+
+        if (parser.positionalArguments().size() != 1) {
+            err() << parser.helpText();
+            return EXIT_ERROR;
+        }
+        bool speedOk = false;
+        const double speed = parser.value(speedOption).toDouble(&speedOk);
+        if (!speedOk || speed <= 0) {
+            err() << "Invalid --speed" << Qt::endl;
+            return EXIT_ERROR;
+        }
+
+        CEditRecording recording;
+        QString error;
+        if (!recording.load(parser.positionalArguments().first(), &error)) {
+            err() << error << Qt::endl;
+            return EXIT_ERROR;
+        }
+        if (parser.isSet(tilesetOption))
+            recording.tilesetPath = parser.value(tilesetOption);
+
+        CMainWindow window;
+        CEditReplayer replayer(window);
+        // Counted from here, so the window's own setup is left out
+        CAllocStats::reset();
+        QElapsedTimer timer;
+        timer.start();
+        if (!replayer.run(recording, speed, &error)) {
+            err() << error << Qt::endl;
+            return EXIT_ERROR;
+        }
+        double ms = timer.nsecsElapsed() / 1.0e6;
+
+        out() << recording.events.size() << " events replayed in " << QString::number(ms, 'f', 1) << " ms" << Qt::endl;
+        for (const char* kind : {"paint", "fill", "undo", "redo", "repaint"}) {
+            const QVector<double> values = replayer.latencies().value(kind);
+            if (values.isEmpty())
+                continue;
+            out() << QString(kind).leftJustified(8) << values.size() << " samples, p50 "
+                  << QString::number(CEditReplayer::percentile(values, 50), 'f', 2) << " ms, p99 "
+                  << QString::number(CEditReplayer::percentile(values, 99), 'f', 2) << " ms, max "
+                  << QString::number(CEditReplayer::percentile(values, 100), 'f', 2) << " ms" << Qt::endl;
+        }
+        out() << "allocations: " << CAllocStats::summary() << "; " << CPayloadPool::cachedBytes() / 1024
+              << " KB cached" << Qt::endl;
+        if (parser.isSet(outputOption) && !saveMap(parser.value(outputOption), *replayer.document()->map))
+            return EXIT_ERROR;
+        return EXIT_OK;
+    }
+
+    //-------------------------------------------------------------------------
+    struct Command {
+        const char* name;
+        const char* summary;
+        int (*run)(const QStringList& arguments);
+        bool widgets = false;       // drives the editor on the offscreen platform
+    };
+
+    const Command commands[] = {
+        {"check-paths", "Verify that marker objects can reach each other", checkPaths},
+        {"diff", "List the regions where two maps differ", diffMaps},
+        {"merge", "Three-way merge of map files", mergeMaps},
+        {"export-pack", "Write a chunked runtime pack for the game", exportPack},
+        {"sync-listen", "Apply the edits sent on a live sync channel", syncListen},
+        {"replay", "Replay a recorded edit session and report latencies", replay, true},
+    };
+
+    void printUsage()
+    {
+        err() << "Usage: MapEditor <command> [options]\n\nCommands:\n";
+        for (const Command& c : commands)
+            err() << "  " << QString(c.name).leftJustified(16) << c.summary << "\n";
+        err() << "\nRun 'MapEditor <command> --help' for command options." << Qt::endl;
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool CCommandLine::isCommand(int argc, char* argv[])
+{
+    if (argc < 2)
+        return false;
+    if (std::strcmp(argv[1], "help") == 0)
+        return true;
+    for (const Command& c : commands)
+        if (std::strcmp(argv[1], c.name) == 0)
+            return true;
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool CCommandLine::usesWidgets(int argc, char* argv[])
+{
+    for (const Command& c : commands)
+        if (argc >= 2 && std::strcmp(argv[1], c.name) == 0)
+            return c.widgets;
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+int CCommandLine::run(const QStringList& arguments)
+{
+    // arguments: program, command, command options...
+    QString name = arguments.value(1);
+    for (const Command& c : commands) {
+        if (name == c.name) {
+            QStringList rest = arguments.mid(2);
+            rest.prepend(arguments.first() + " " + name);
+            return c.run(rest);
+        }
+    }
+    printUsage();
+    return name == "help" ? EXIT_OK : EXIT_ERROR;
+}
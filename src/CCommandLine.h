@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QStringList>
+
+//-----------------------------------------------------------------------------
+// Headless entry points, run instead of the GUI when the first argument names
+// a command ("MapEditor check-paths level.json"). Exit codes: 0 success,
+// 1 check failed, 2 usage or I/O error.
+namespace CCommandLine {
+    bool isCommand(int argc, char* argv[]);
+    // Whether the command needs a QApplication; it gets the offscreen
+    // platform, so it still runs without a display
+    bool usesWidgets(int argc, char* argv[]);
+    int run(const QStringList& arguments);
+}
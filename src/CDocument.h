@@ -0,0 +1,36 @@
+#pragma once
+
+#include "CMap.h"
+#include "CTilesetCache.h"
+#include "Constants.h"
+
+#include <cstdint>
+#include <memory>
+#include <QString>
+
+//-----------------------------------------------------------------------------
+class CMainView;
+class CUndoHistory;
+class QUndoStack;
+
+//-----------------------------------------------------------------------------
+// One open map in the tabbed editor: the model with its view and undo
+// history, plus the file and tileset it is bound to. The tileset is shared
+// through CTilesetCache with every other document using the same file.
+struct CDocument
+{
+    std::unique_ptr<CMap> map;
+    CMainView* view = nullptr;              // owned by the tab widget
+    QUndoStack* undoStack = nullptr;        // owned by the main window
+    CUndoHistory* undoHistory = nullptr;    // owned by the main window
+    QString path;
+    bool modified = false;
+    uint64_t savedHash = 0;
+    QString savedStamp;                     // CMapHash::fileStamp() of path as last saved or loaded
+    int reloadSerial = 0;
+
+    std::shared_ptr<const CTileset> tileset;
+    int tileCount = Constants::PALETTE_TILE_COUNT;
+
+    QString tilesetPath() const { return tileset ? tileset->path : QString(); }
+};
@@ -0,0 +1,333 @@
+#include "CEditRecording.h"
+#include "CDocument.h"
+#include "CMainView.h"
+#include "CMainWindow.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QGraphicsScene>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMouseEvent>
+#include <QSaveFile>
+#include <QTimer>
+#include <QUndoStack>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const int RECORDING_VERSION = 1;
+    const char* const EVENT_NAMES[] = { "press", "move", "release", "wheel", "tool", "tile", "undo", "redo" };
+
+    bool fail(QString* error, const QString& message)
+    {
+        if (error)
+            *error = message;
+        return false;
+    }
+
+    bool isPointer(CEditEvent::Type type)
+    {
+        return type == CEditEvent::PRESS || type == CEditEvent::MOVE || type == CEditEvent::RELEASE
+            || type == CEditEvent::WHEEL;
+    }
+
+    // Runs the event loop for ms, so input frames, renderer refinement and
+    // repaints happen in between as they would in the editor
+    void runFor(double ms)
+    {
+        if (ms < 1.0) {
+            QCoreApplication::processEvents();
+            return;
+        }
+        QEventLoop loop;
+        QTimer::singleShot(qRound(ms), Qt::PreciseTimer, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool CEditRecording::save(const QString& path, QString* error) const
+{
+    QJsonArray list;
+    for (const CEditEvent& event : events) {
+        QJsonObject obj;
+        obj["t"] = std::round(event.ms * 1000.0) / 1000.0;
+        obj["type"] = EVENT_NAMES[event.type];
+        if (isPointer(event.type)) {
+            obj["x"] = event.pos.x();
+            obj["y"] = event.pos.y();
+            obj["buttons"] = event.buttons;
+            obj["modifiers"] = event.modifiers;
+        }
+        if (event.type == CEditEvent::PRESS || event.type == CEditEvent::RELEASE)
+            obj["button"] = event.button;
+        if (event.type == CEditEvent::WHEEL || event.type == CEditEvent::TOOL || event.type == CEditEvent::TILE)
+            obj["value"] = event.value;
+        list.append(obj);
+    }
+
+    QJsonObject view;
+    view["width"] = viewSize.width();
+    view["height"] = viewSize.height();
+    view["zoom"] = zoom;
+    view["centerX"] = center.x();
+    view["centerY"] = center.y();
+
+    QJsonObject root;
+    root["version"] = RECORDING_VERSION;
+    root["map"] = map;
+    root["tileset"] = tilesetPath;
+    root["tileSize"] = tileSize;
+    root["tileCount"] = tileCount;
+    root["autotile"] = autotile;
+    root["view"] = view;
+    root["tool"] = tool;
+    root["tile"] = tile;
+    root["events"] = list;
+
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly))
+        return fail(error, QString("Cannot write %1: %2").arg(path, out.errorString()));
+    out.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!out.commit())
+        return fail(error, QString("Cannot write %1: %2").arg(path, out.errorString()));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CEditRecording::load(const QString& path, QString* error)
+{
+    *this = CEditRecording();
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly))
+        return fail(error, QString("Cannot open %1").arg(path));
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(in.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+        return fail(error, QString("Cannot parse %1: %2").arg(path, parseError.errorString()));
+    const QJsonObject root = doc.object();
+    if (root["version"].toInt() != RECORDING_VERSION)
+        return fail(error, QString("%1 is not an edit recording of a supported version").arg(path));
+
+    map = root["map"].toObject();
+    tilesetPath = root["tileset"].toString();
+    tileSize = root["tileSize"].toInt(Constants::DEFAULT_TILE_SIZE);
+    tileCount = root["tileCount"].toInt(Constants::PALETTE_TILE_COUNT);
+    autotile = root["autotile"].toBool();
+    const QJsonObject view = root["view"].toObject();
+    viewSize = QSize(view["width"].toInt(), view["height"].toInt());
+    zoom = view["zoom"].toDouble(1.0);
+    center = QPointF(view["centerX"].toDouble(), view["centerY"].toDouble());
+    tool = root["tool"].toInt(Constants::TOOL_PAINT);
+    tile = root["tile"].toInt();
+    if (map.isEmpty() || tileSize <= 0)
+        return fail(error, QString("%1 has no starting map").arg(path));
+
+    const QJsonArray list = root["events"].toArray();
+    events.reserve(list.size());
+    double last = 0;
+    for (const QJsonValue& value : list) {
+        const QJsonObject obj = value.toObject();
+        const auto* name = std::find(std::begin(EVENT_NAMES), std::end(EVENT_NAMES), obj["type"].toString());
+        if (name == std::end(EVENT_NAMES))
+            return fail(error, QString("%1: unknown event type '%2'").arg(path, obj["type"].toString()));
+        CEditEvent event;
+        event.type = static_cast<CEditEvent::Type>(name - std::begin(EVENT_NAMES));
+        event.ms = obj["t"].toDouble();
+        event.pos = QPoint(obj["x"].toInt(), obj["y"].toInt());
+        event.button = obj["button"].toInt();
+        event.buttons = obj["buttons"].toInt();
+        event.modifiers = obj["modifiers"].toInt();
+        event.value = obj["value"].toInt();
+        // Hand-trimmed files may have gaps but must stay in order
+        if (event.ms < last)
+            return fail(error, QString("%1: events are not in time order").arg(path));
+        last = event.ms;
+        events.append(event);
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+CEditRecorder::CEditRecorder(const CEditRecording& start)
+    : m_recording(start)
+{
+    m_recording.events.clear();
+    m_clock.start();
+}
+
+//-----------------------------------------------------------------------------
+void CEditRecorder::record(CEditEvent::Type type, const QMouseEvent* event)
+{
+    CEditEvent e;
+    e.type = type;
+    e.ms = m_clock.nsecsElapsed() / 1.0e6;
+    e.pos = event->pos();
+    e.button = static_cast<int>(event->button());
+    e.buttons = static_cast<int>(event->buttons());
+    e.modifiers = static_cast<int>(event->modifiers());
+    m_recording.events.append(e);
+}
+
+//-----------------------------------------------------------------------------
+void CEditRecorder::record(const QWheelEvent* event)
+{
+    CEditEvent e;
+    e.type = CEditEvent::WHEEL;
+    e.ms = m_clock.nsecsElapsed() / 1.0e6;
+    e.pos = event->position().toPoint();
+    e.buttons = static_cast<int>(event->buttons());
+    e.modifiers = static_cast<int>(event->modifiers());
+    e.value = event->angleDelta().y();
+    m_recording.events.append(e);
+}
+
+//-----------------------------------------------------------------------------
+void CEditRecorder::record(CEditEvent::Type type, int value)
+{
+    CEditEvent e;
+    e.type = type;
+    e.ms = m_clock.nsecsElapsed() / 1.0e6;
+    e.value = value;
+    m_recording.events.append(e);
+}
+
+//-----------------------------------------------------------------------------
+CEditReplayer::CEditReplayer(CMainWindow& window)
+    : m_window(window)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool CEditReplayer::run(const CEditRecording& recording, double speed, QString* error)
+{
+    m_latencies.clear();
+    m_doc = m_window.openRecording(recording, error);
+    if (!m_doc)
+        return false;
+    CMainView* view = m_doc->view;
+    QUndoStack* stack = m_doc->undoStack;
+    QWidget* viewport = view->viewport();
+
+    // The same viewport size and view as in the session, so positions land
+    // on the same tiles
+    m_window.show();
+    QCoreApplication::processEvents();
+    if (recording.viewSize.isValid())
+        m_window.resize(m_window.size() + recording.viewSize - viewport->size());
+    QCoreApplication::processEvents();
+    view->setViewState(recording.zoom, recording.center);
+    runFor(Constants::RENDER_IDLE_MS * 2);
+
+    // Moves delivered since the last input frame, by delivery time
+    QElapsedTimer clock;
+    QVector<qint64> pending;
+    int tool = recording.tool;
+    int index = stack->index();
+    auto latency = [this](const QString& kind, double ms) { m_latencies[kind].append(ms); };
+    auto kind = [&tool]() { return QString(tool == Constants::TOOL_FILL ? "fill" : "paint"); };
+
+    const QMetaObject::Connection frames = QObject::connect(view, &CMainView::inputProcessed, view, [&]() {
+        if (stack->index() != index) {
+            const qint64 now = clock.nsecsElapsed();
+            for (qint64 sent : pending)
+                latency(kind(), (now - sent) / 1.0e6);
+            index = stack->index();
+            repaint(view);
+        }
+        pending.clear();
+    });
+
+    speed = speed > 0 ? speed : 1.0;
+    clock.start();
+    for (const CEditEvent& event : recording.events) {
+        runFor(event.ms / speed - clock.nsecsElapsed() / 1.0e6);
+
+        const QPointF global = viewport->mapToGlobal(QPointF(event.pos));
+        const auto button = static_cast<Qt::MouseButton>(event.button);
+        const Qt::MouseButtons buttons(QFlag(event.buttons));
+        const Qt::KeyboardModifiers modifiers(QFlag(event.modifiers));
+        QElapsedTimer timer;
+        timer.start();
+        switch (event.type) {
+        case CEditEvent::PRESS: {
+            // Presses paint or fill right away, so their latency is the call
+            QMouseEvent press(QEvent::MouseButtonPress, QPointF(event.pos), global, button, buttons, modifiers);
+            QCoreApplication::sendEvent(viewport, &press);
+            if (stack->index() != index) {
+                latency(kind(), timer.nsecsElapsed() / 1.0e6);
+                index = stack->index();
+                repaint(view);
+            }
+            break;
+        }
+        case CEditEvent::MOVE: {
+            pending.append(clock.nsecsElapsed());
+            QMouseEvent move(QEvent::MouseMove, QPointF(event.pos), global, Qt::NoButton, buttons, modifiers);
+            QCoreApplication::sendEvent(viewport, &move);
+            break;
+        }
+        case CEditEvent::RELEASE: {
+            QMouseEvent release(QEvent::MouseButtonRelease, QPointF(event.pos), global, button, buttons, modifiers);
+            QCoreApplication::sendEvent(viewport, &release);
+            pending.clear();
+            break;
+        }
+        case CEditEvent::WHEEL: {
+            QWheelEvent wheel(QPointF(event.pos), global, QPoint(), QPoint(0, event.value), buttons, modifiers,
+                              Qt::NoScrollPhase, false);
+            QCoreApplication::sendEvent(viewport, &wheel);
+            repaint(view);
+            break;
+        }
+        case CEditEvent::TOOL:
+            tool = event.value;
+            view->setTool(tool);
+            break;
+        case CEditEvent::TILE:
+            view->setSelectedTile(event.value);
+            break;
+        case CEditEvent::UNDO:
+        case CEditEvent::REDO:
+            if (event.type == CEditEvent::UNDO)
+                stack->undo();
+            else
+                stack->redo();
+            latency(event.type == CEditEvent::UNDO ? "undo" : "redo", timer.nsecsElapsed() / 1.0e6);
+            index = stack->index();
+            repaint(view);
+            break;
+        }
+    }
+
+    // Let the last input frame and the refinement after it finish
+    runFor(Constants::RENDER_IDLE_MS * 2);
+    QObject::disconnect(frames);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// The scene collects item updates in a queued call and the window paints in
+// an update request; both are sent here so the paint is timed on its own
+void CEditReplayer::repaint(CMainView* view)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QCoreApplication::sendPostedEvents(view->scene(), QEvent::MetaCall);
+    QCoreApplication::sendPostedEvents(view->window(), QEvent::UpdateRequest);
+    m_latencies["repaint"].append(timer.nsecsElapsed() / 1.0e6);
+}
+
+//-----------------------------------------------------------------------------
+double CEditReplayer::percentile(QVector<double> values, double p)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    const qsizetype rank = static_cast<qsizetype>(std::ceil(p / 100.0 * values.size()));
+    return values[std::clamp<qsizetype>(rank - 1, 0, values.size() - 1)];
+}
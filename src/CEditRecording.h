@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Constants.h"
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMap>
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMainView;
+class CMainWindow;
+class QMouseEvent;
+class QWheelEvent;
+struct CDocument;
+
+//-----------------------------------------------------------------------------
+struct CEditEvent
+{
+    enum Type { PRESS, MOVE, RELEASE, WHEEL, TOOL, TILE, UNDO, REDO };
+
+    Type type = MOVE;
+    double ms = 0;                  // since the recording started
+    QPoint pos;                     // viewport coordinates
+    int button = 0;                 // Qt::MouseButton of presses and releases
+    int buttons = 0;
+    int modifiers = 0;
+    int value = 0;                  // tool, tile index or vertical wheel angle delta
+};
+
+//-----------------------------------------------------------------------------
+// An edit session as recorded in the editor: the map it started from, the
+// tileset, view and tool it was made with, and every input event of the view
+// with its time. Stored as JSON, so a recording attached to a report can be
+// read and trimmed by hand. Autotile rules and tile properties come from the
+// tileset's sidecar files as usual and are not part of it.
+struct CEditRecording
+{
+    QJsonObject map;
+    QString tilesetPath;
+    int tileSize = Constants::DEFAULT_TILE_SIZE;
+    int tileCount = Constants::PALETTE_TILE_COUNT;
+    bool autotile = false;
+    QSize viewSize;                 // viewport, which positions are relative to
+    double zoom = 1.0;
+    QPointF center;
+    int tool = Constants::TOOL_PAINT;
+    int tile = 0;
+    QVector<CEditEvent> events;
+
+    bool save(const QString& path, QString* error = nullptr) const;
+    bool load(const QString& path, QString* error = nullptr);
+};
+
+//-----------------------------------------------------------------------------
+// Appends events to a recording, stamped with the time since it was created.
+// The view reports its input here before handling it.
+class CEditRecorder
+{
+public:
+    explicit CEditRecorder(const CEditRecording& start);
+
+    void record(CEditEvent::Type type, const QMouseEvent* event);
+    void record(const QWheelEvent* event);
+    void record(CEditEvent::Type type, int value = 0);
+
+    const CEditRecording& recording() const { return m_recording; }
+
+private:
+    CEditRecording m_recording;
+    QElapsedTimer m_clock;
+};
+
+//-----------------------------------------------------------------------------
+// Plays a recording back through a main window, normally on the offscreen
+// platform. Events are sent to the view at their recorded times (scaled by
+// speed), so input frames coalesce moves as they did in the session, and
+// the time the resulting work takes is collected per kind:
+//
+//   paint, fill  from a move or press reaching the view to the end of the
+//                input frame that pushed its edit
+//   undo, redo   the undo stack call
+//   repaint      processing the scene updates and painting the window after
+//                each of the above
+class CEditReplayer
+{
+public:
+    explicit CEditReplayer(CMainWindow& window);
+
+    bool run(const CEditRecording& recording, double speed = 1.0, QString* error = nullptr);
+
+    // Milliseconds per kind of work, in event order
+    const QMap<QString, QVector<double>>& latencies() const { return m_latencies; }
+    // The document the recording was played into
+    CDocument* document() const { return m_doc; }
+
+    // Nearest-rank percentile, 0 for no values
+    static double percentile(QVector<double> values, double p);
+
+private:
+    CMainWindow& m_window;
+    CDocument* m_doc = nullptr;
+    QMap<QString, QVector<double>> m_latencies;
+
+    void repaint(CMainView* view);
+};
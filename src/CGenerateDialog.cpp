@@ -0,0 +1,200 @@
+#include "CGenerateDialog.h"
+#include "Constants.h"
+
+#include <QCheckBox>
+#include <QColor>
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QImage>
+#include <QLabel>
+#include <QPixmap>
+#include <QPushButton>
+#include <QRandomGenerator>
+#include <QSlider>
+#include <QSpinBox>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+CGenerateDialog::CGenerateDialog(const QSize& mapSize, const QRect& selection, uint32_t lowTile, uint32_t highTile, QWidget* parent)
+: QDialog(parent), m_mapSize(mapSize), m_selection(selection)
+{
+    setWindowTitle(tr("Generate"));
+
+    m_modeCombo = new QComboBox(this);
+    m_modeCombo->addItem(tr("Value noise"), CGeneratorSettings::MODE_VALUE_NOISE);
+    m_modeCombo->addItem(tr("Simplex noise"), CGeneratorSettings::MODE_SIMPLEX_NOISE);
+    m_modeCombo->addItem(tr("Cave (cellular automaton)"), CGeneratorSettings::MODE_CAVE);
+    m_modeCombo->setCurrentIndex(1);
+
+    m_seedSpinBox = new QSpinBox(this);
+    m_seedSpinBox->setRange(0, 999999);
+    m_seedSpinBox->setValue(1);
+    QPushButton* randomButton = new QPushButton(tr("Random"), this);
+    connect(randomButton, &QPushButton::clicked, this, [this]() {
+        m_seedSpinBox->setValue(static_cast<int>(QRandomGenerator::global()->bounded(1000000)));
+    });
+    QHBoxLayout* seedLayout = new QHBoxLayout;
+    seedLayout->addWidget(m_seedSpinBox, 1);
+    seedLayout->addWidget(randomButton);
+
+    m_scaleSpinBox = new QDoubleSpinBox(this);
+    m_scaleSpinBox->setRange(1.0, 1024.0);
+    m_scaleSpinBox->setValue(32.0);
+
+    m_octavesSpinBox = new QSpinBox(this);
+    m_octavesSpinBox->setRange(1, 8);
+    m_octavesSpinBox->setValue(4);
+
+    m_thresholdSlider = new QSlider(Qt::Horizontal, this);
+    m_thresholdSlider->setRange(0, 100);
+    m_thresholdSlider->setValue(50);
+
+    m_fillSpinBox = new QSpinBox(this);
+    m_fillSpinBox->setRange(0, 100);
+    m_fillSpinBox->setSuffix("%");
+    m_fillSpinBox->setValue(45);
+
+    m_iterationsSpinBox = new QSpinBox(this);
+    m_iterationsSpinBox->setRange(0, 20);
+    m_iterationsSpinBox->setValue(5);
+
+    m_lowSpinBox = new QSpinBox(this);
+    m_lowSpinBox->setRange(0, 65535);
+    m_lowSpinBox->setValue(static_cast<int>(lowTile));
+
+    m_highSpinBox = new QSpinBox(this);
+    m_highSpinBox->setRange(0, 65535);
+    m_highSpinBox->setValue(static_cast<int>(highTile));
+
+    m_selectionCheckBox = new QCheckBox(this);
+    m_selectionCheckBox->setEnabled(!selection.isEmpty());
+    m_selectionCheckBox->setChecked(!selection.isEmpty());
+
+    m_previewLabel = new QLabel(this);
+    m_previewLabel->setFixedSize(Constants::GENERATOR_PREVIEW_SIZE, Constants::GENERATOR_PREVIEW_SIZE);
+    m_previewLabel->setAlignment(Qt::AlignCenter);
+    m_timingLabel = new QLabel(this);
+
+    QFormLayout* formLayout = new QFormLayout;
+    formLayout->addRow(tr("Generator:"), m_modeCombo);
+    formLayout->addRow(tr("Seed:"), seedLayout);
+    formLayout->addRow(tr("Scale:"), m_scaleSpinBox);
+    formLayout->addRow(tr("Octaves:"), m_octavesSpinBox);
+    formLayout->addRow(tr("Threshold:"), m_thresholdSlider);
+    formLayout->addRow(tr("Initial walls:"), m_fillSpinBox);
+    formLayout->addRow(tr("Iterations:"), m_iterationsSpinBox);
+    formLayout->addRow(tr("Low / floor tile:"), m_lowSpinBox);
+    formLayout->addRow(tr("High / wall tile:"), m_highSpinBox);
+    formLayout->addRow(tr("Selection only:"), m_selectionCheckBox);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QHBoxLayout* contentLayout = new QHBoxLayout;
+    contentLayout->addLayout(formLayout);
+    QVBoxLayout* previewLayout = new QVBoxLayout;
+    previewLayout->addWidget(m_previewLabel);
+    previewLayout->addWidget(m_timingLabel);
+    previewLayout->addStretch();
+    contentLayout->addLayout(previewLayout);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addLayout(contentLayout);
+    mainLayout->addWidget(buttonBox);
+
+    // Slider drags fire many changes; coalesce them into one preview pass
+    m_previewTimer = new QTimer(this);
+    m_previewTimer->setSingleShot(true);
+    m_previewTimer->setInterval(Constants::GENERATOR_PREVIEW_DELAY_MS);
+    connect(m_previewTimer, &QTimer::timeout, this, &CGenerateDialog::updatePreview);
+
+    connect(m_modeCombo, &QComboBox::currentIndexChanged, this, &CGenerateDialog::onModeChanged);
+    connect(m_seedSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_scaleSpinBox, &QDoubleSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_octavesSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_thresholdSlider, &QSlider::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_fillSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_iterationsSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_lowSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_highSpinBox, &QSpinBox::valueChanged, this, &CGenerateDialog::schedulePreview);
+    connect(m_selectionCheckBox, &QCheckBox::toggled, this, &CGenerateDialog::schedulePreview);
+
+    onModeChanged();
+}
+
+//-----------------------------------------------------------------------------
+CGeneratorSettings CGenerateDialog::settings() const
+{
+    CGeneratorSettings s;
+    s.mode = static_cast<CGeneratorSettings::Mode>(m_modeCombo->currentData().toInt());
+    s.seed = static_cast<uint32_t>(m_seedSpinBox->value());
+    s.scale = m_scaleSpinBox->value();
+    s.octaves = m_octavesSpinBox->value();
+    s.threshold = m_thresholdSlider->value() / 100.0;
+    s.fillPercent = m_fillSpinBox->value();
+    s.iterations = m_iterationsSpinBox->value();
+    s.lowTile = static_cast<uint32_t>(m_lowSpinBox->value());
+    s.highTile = static_cast<uint32_t>(m_highSpinBox->value());
+    return s;
+}
+
+//-----------------------------------------------------------------------------
+QRect CGenerateDialog::area() const
+{
+    if (m_selectionCheckBox->isChecked())
+        return m_selection;
+    return QRect(QPoint(0, 0), m_mapSize);
+}
+
+//-----------------------------------------------------------------------------
+void CGenerateDialog::schedulePreview()
+{
+    m_previewTimer->start();
+}
+
+//-----------------------------------------------------------------------------
+void CGenerateDialog::onModeChanged()
+{
+    bool cave = m_modeCombo->currentData().toInt() == CGeneratorSettings::MODE_CAVE;
+    m_scaleSpinBox->setEnabled(!cave);
+    m_octavesSpinBox->setEnabled(!cave);
+    m_thresholdSlider->setEnabled(!cave);
+    m_fillSpinBox->setEnabled(cave);
+    m_iterationsSpinBox->setEnabled(cave);
+    schedulePreview();
+}
+
+//-----------------------------------------------------------------------------
+void CGenerateDialog::updatePreview()
+{
+    QRect target = area();
+    if (target.isEmpty())
+        return;
+
+    // Sample at most GENERATOR_PREVIEW_SIZE tiles along the longer side
+    const int previewSize = Constants::GENERATOR_PREVIEW_SIZE;
+    int step = (std::max(target.width(), target.height()) + previewSize - 1) / previewSize;
+
+    QElapsedTimer timer;
+    timer.start();
+    CTileRegion region = CGenerator::generate(settings(), target, QRect(QPoint(0, 0), m_mapSize), step);
+    double ms = timer.nsecsElapsed() / 1.0e6;
+
+    QImage image(region.width, region.height, QImage::Format_RGB32);
+    for (int y = 0; y < region.height; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const uint32_t* src = region.tiles.data() + static_cast<size_t>(y) * region.width;
+        for (int x = 0; x < region.width; ++x)
+            line[x] = src[x] == 0 ? qRgb(0, 0, 0) : QColor::fromHsv(static_cast<int>(src[x] * 47 % 360), 160, 230).rgb();
+    }
+    m_previewLabel->setPixmap(QPixmap::fromImage(image.scaled(m_previewLabel->size(), Qt::KeepAspectRatio)));
+    m_timingLabel->setText(step > 1 ? tr("Preview 1:%1, %2 ms").arg(step).arg(ms, 0, 'f', 1)
+                                    : tr("Preview %1 ms").arg(ms, 0, 'f', 1));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CGenerator.h"
+
+//-----------------------------------------------------------------------------
+#include <QDialog>
+#include <QRect>
+#include <QSize>
+
+//-----------------------------------------------------------------------------
+class QCheckBox;
+class QComboBox;
+class QDoubleSpinBox;
+class QLabel;
+class QSlider;
+class QSpinBox;
+class QTimer;
+
+//-----------------------------------------------------------------------------
+// Settings for the procedural generators with a live preview. The preview
+// samples the target area at reduced resolution, so it stays interactive for
+// large maps; noise previews are exact subsamples of the final result.
+class CGenerateDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    CGenerateDialog(const QSize& mapSize, const QRect& selection, uint32_t lowTile, uint32_t highTile, QWidget* parent = nullptr);
+
+    CGeneratorSettings settings() const;
+    QRect area() const;
+
+private slots:
+    void schedulePreview();
+    void updatePreview();
+    void onModeChanged();
+
+private:
+    QSize m_mapSize;
+    QRect m_selection;
+
+    QComboBox* m_modeCombo = nullptr;
+    QSpinBox* m_seedSpinBox = nullptr;
+    QDoubleSpinBox* m_scaleSpinBox = nullptr;
+    QSpinBox* m_octavesSpinBox = nullptr;
+    QSlider* m_thresholdSlider = nullptr;
+    QSpinBox* m_fillSpinBox = nullptr;
+    QSpinBox* m_iterationsSpinBox = nullptr;
+    QSpinBox* m_lowSpinBox = nullptr;
+    QSpinBox* m_highSpinBox = nullptr;
+    QCheckBox* m_selectionCheckBox = nullptr;
+    QLabel* m_previewLabel = nullptr;
+    QLabel* m_timingLabel = nullptr;
+    QTimer* m_previewTimer = nullptr;
+};
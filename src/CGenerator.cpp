@@ -0,0 +1,197 @@
+#include "CGenerator.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    uint32_t hash2(int x, int y, uint32_t seed)
+    {
+        uint32_t h = seed * 0x9E3779B1u;
+        h ^= static_cast<uint32_t>(x) * 0x85EBCA77u;
+        h = (h << 13) | (h >> 19);
+        h ^= static_cast<uint32_t>(y) * 0xC2B2AE3Du;
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    int fastFloor(double v)
+    {
+        int i = static_cast<int>(v);
+        return v < i ? i - 1 : i;
+    }
+
+    double smooth(double t)
+    {
+        return t * t * (3.0 - 2.0 * t);
+    }
+
+    // Fractal sum of octaves, normalized back to [0, 1]
+    template <typename Noise>
+    double fbm(Noise noise, double x, double y, const CGeneratorSettings& s)
+    {
+        double sum = 0.0;
+        double amplitude = 1.0;
+        double total = 0.0;
+        double frequency = 1.0 / std::max(1.0, s.scale);
+        for (int o = 0; o < std::max(1, s.octaves); ++o) {
+            sum += amplitude * noise(x * frequency, y * frequency, s.seed + static_cast<uint32_t>(o) * 1013u);
+            total += amplitude;
+            amplitude *= 0.5;
+            frequency *= 2.0;
+        }
+        return sum / total;
+    }
+
+    void generateNoise(const CGeneratorSettings& s, const QRect& area, int step, CTileRegion& region)
+    {
+        const bool simplex = s.mode == CGeneratorSettings::MODE_SIMPLEX_NOISE;
+        CParallel::forBands(region.height, Constants::PARALLEL_MIN_ROWS, [&](int, int begin, int end) {
+            for (int row = begin; row < end; ++row) {
+                uint32_t* dst = region.tiles.data() + static_cast<size_t>(row) * region.width;
+                double y = area.top() + row * step;
+                for (int col = 0; col < region.width; ++col) {
+                    double x = area.left() + col * step;
+                    double v = simplex ? fbm(CGenerator::simplexNoise, x, y, s)
+                                       : fbm(CGenerator::valueNoise, x, y, s);
+                    dst[col] = v < s.threshold ? s.lowTile : s.highTile;
+                }
+            }
+        });
+    }
+
+    void generateCave(const CGeneratorSettings& s, const QRect& area, const QRect& bounds, int step, CTileRegion& region)
+    {
+        // Each iteration reads one more tile out, so the automaton runs over
+        // the area grown by that much; only the map edge keeps a wall border,
+        // as in a whole-map run. Sampling every step-th tile would change the
+        // automaton itself, so the preview is simulated in full and picked.
+        const int pad = std::max(0, s.iterations);
+        const QRect sim = area.adjusted(-pad, -pad, pad, pad).intersected(bounds).united(area);
+
+        // Cells carry a one-cell wall border so neighbour sums need no bounds
+        // checks
+        const int w = sim.width();
+        const int h = sim.height();
+        const size_t stride = static_cast<size_t>(w) + 2;
+        std::vector<uint8_t> cells(stride * (h + 2), 1);
+        std::vector<uint8_t> next(cells);
+
+        CParallel::forBands(h, Constants::PARALLEL_MIN_ROWS, [&](int, int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                uint8_t* row = cells.data() + (y + 1) * stride + 1;
+                for (int x = 0; x < w; ++x)
+                    row[x] = hash2(sim.left() + x, sim.top() + y, s.seed) % 100u < static_cast<uint32_t>(s.fillPercent);
+            }
+        });
+
+        for (int i = 0; i < s.iterations; ++i) {
+            CParallel::forBands(h, Constants::PARALLEL_MIN_ROWS, [&](int, int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                    const uint8_t* above = cells.data() + y * stride + 1;
+                    const uint8_t* row = above + stride;
+                    const uint8_t* below = row + stride;
+                    uint8_t* dst = next.data() + (y + 1) * stride + 1;
+                    for (int x = 0; x < w; ++x) {
+                        int walls = above[x - 1] + above[x] + above[x + 1]
+                                  + row[x - 1] + row[x + 1]
+                                  + below[x - 1] + below[x] + below[x + 1];
+                        dst[x] = walls > 4 ? 1 : (walls < 4 ? 0 : row[x]);
+                    }
+                }
+            });
+            std::swap(cells, next);
+        }
+
+        const int offX = area.left() - sim.left();
+        const int offY = area.top() - sim.top();
+        for (int y = 0; y < region.height; ++y) {
+            const uint8_t* row = cells.data() + (offY + y * step + 1) * stride + 1 + offX;
+            uint32_t* dst = region.tiles.data() + static_cast<size_t>(y) * region.width;
+            for (int x = 0; x < region.width; ++x)
+                dst[x] = row[x * step] ? s.highTile : s.lowTile;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+double CGenerator::valueNoise(double x, double y, uint32_t seed)
+{
+    int x0 = fastFloor(x);
+    int y0 = fastFloor(y);
+    double tx = smooth(x - x0);
+    double ty = smooth(y - y0);
+
+    const double norm = 1.0 / 4294967295.0;
+    double v00 = hash2(x0, y0, seed) * norm;
+    double v10 = hash2(x0 + 1, y0, seed) * norm;
+    double v01 = hash2(x0, y0 + 1, seed) * norm;
+    double v11 = hash2(x0 + 1, y0 + 1, seed) * norm;
+
+    double top = v00 + (v10 - v00) * tx;
+    double bottom = v01 + (v11 - v01) * tx;
+    return top + (bottom - top) * ty;
+}
+
+//-----------------------------------------------------------------------------
+// 2D simplex noise with hashed gradients, remapped from [-1, 1] to [0, 1].
+double CGenerator::simplexNoise(double x, double y, uint32_t seed)
+{
+    static const double F2 = 0.5 * (std::sqrt(3.0) - 1.0);
+    static const double G2 = (3.0 - std::sqrt(3.0)) / 6.0;
+    static const double grad[8][2] = {
+        {1, 1}, {-1, 1}, {1, -1}, {-1, -1}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}
+    };
+
+    double skew = (x + y) * F2;
+    int i = fastFloor(x + skew);
+    int j = fastFloor(y + skew);
+    double unskew = (i + j) * G2;
+    double x0 = x - (i - unskew);
+    double y0 = y - (j - unskew);
+
+    int i1 = x0 > y0 ? 1 : 0;
+    int j1 = 1 - i1;
+    double x1 = x0 - i1 + G2;
+    double y1 = y0 - j1 + G2;
+    double x2 = x0 - 1.0 + 2.0 * G2;
+    double y2 = y0 - 1.0 + 2.0 * G2;
+
+    auto corner = [seed](int ci, int cj, double dx, double dy) {
+        double t = 0.5 - dx * dx - dy * dy;
+        if (t < 0.0) return 0.0;
+        const double* g = grad[hash2(ci, cj, seed) & 7];
+        t *= t;
+        return t * t * (g[0] * dx + g[1] * dy);
+    };
+
+    double n = corner(i, j, x0, y0) + corner(i + i1, j + j1, x1, y1) + corner(i + 1, j + 1, x2, y2);
+    return std::clamp(0.5 + 35.0 * n, 0.0, 1.0);
+}
+
+//-----------------------------------------------------------------------------
+CTileRegion CGenerator::generate(const CGeneratorSettings& settings, const QRect& area, const QRect& bounds, int step)
+{
+    CTileRegion region;
+    step = std::max(1, step);
+    if (area.isEmpty())
+        return region;
+
+    region.width = (area.width() + step - 1) / step;
+    region.height = (area.height() + step - 1) / step;
+    region.tiles.resize(static_cast<size_t>(region.width) * region.height);
+
+    if (settings.mode == CGeneratorSettings::MODE_CAVE)
+        generateCave(settings, area, bounds, step, region);
+    else
+        generateNoise(settings, area, step, region);
+    return region;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CMap.h"
+
+#include <cstdint>
+#include <QRect>
+
+//-----------------------------------------------------------------------------
+struct CGeneratorSettings
+{
+    enum Mode {
+        MODE_VALUE_NOISE,
+        MODE_SIMPLEX_NOISE,
+        MODE_CAVE
+    };
+
+    Mode mode = MODE_SIMPLEX_NOISE;
+    uint32_t seed = 1;
+
+    // Noise: fBm in [0, 1], tiles below the threshold get lowTile
+    double scale = 32.0;        // feature size in tiles
+    int octaves = 4;
+    double threshold = 0.5;
+
+    // Cave: random fill smoothed by the 4-5 rule, walls get highTile
+    int fillPercent = 45;
+    int iterations = 5;
+
+    uint32_t lowTile = 0;
+    uint32_t highTile = 1;
+};
+
+//-----------------------------------------------------------------------------
+// Procedural map generators. Rows are split into bands on the thread pool.
+// Noise samples are a pure function of the seed and their map position; the
+// cave automaton also reads its neighbours, so it runs over the area grown by
+// one tile per iteration and clipped to the map. Either way a selection
+// matches the same area of a whole-map run. Cellular automaton steps
+// ping-pong between two cell buffers.
+namespace CGenerator {
+    // Generates the tiles covering area (map coordinates) of a map covering
+    // bounds. With step > 1 only every step-th tile is returned, which is what
+    // the live preview uses; caves are still simulated at full resolution.
+    CTileRegion generate(const CGeneratorSettings& settings, const QRect& area, const QRect& bounds, int step = 1);
+
+    double valueNoise(double x, double y, uint32_t seed);
+    double simplexNoise(double x, double y, uint32_t seed);
+}
@@ -1,67 +1,53 @@
 #include "CMainView.h"
+#include "CEditRecording.h"
 #include "Constants.h"
 #include "CMap.h"
+#include "CMapRenderer.h"
+#include "CTilesetCache.h"
 
 #include <QGraphicsItem>
+#include <QGraphicsPathItem>
+#include <QGraphicsPixmapItem>
+#include <QGraphicsRectItem>
 #include <QGraphicsScene>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPainterPath>
+#include <QRubberBand>
+#include <QScopeGuard>
+#include <QScreen>
 #include <QScrollBar>
+#include <QShowEvent>
 #include <QSet>
+#include <QStyleOptionGraphicsItem>
+#include <QTimer>
 #include <QWheelEvent>
-#include <stack>
+#include <algorithm>
+#include <cstdlib>
 #include <utility>
 
 //-----------------------------------------------------------------------------
+// Only the exposed part is drawn, from the view's chunk renderer
 class MapItem : public QGraphicsItem {
 public:
-    MapItem(CMap* map, QGraphicsItem* parent = nullptr) : QGraphicsItem(parent), m_map(map) {}
+    MapItem(CMap* map, CMapRenderer* renderer, QGraphicsItem* parent = nullptr)
+        : QGraphicsItem(parent), m_map(map), m_renderer(renderer)
+    {
+        setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+    }
     QRectF boundingRect() const override { 
         if (!m_map) return QRectF();
         return QRectF(0, 0, m_map->width() * Constants::DEFAULT_TILE_SIZE, m_map->height() * Constants::DEFAULT_TILE_SIZE);
     }
-    void setTileset(const QImage& tileset, int tileSize) { 
-        m_tileset = tileset;
-        m_tileSize = tileSize;
-    }
-    void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override {
+    void mapResized() { prepareGeometryChange(); }
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*) override {
         if (!m_map) return;
-        
-        static const QColor colors[] = {
-            Qt::white, Qt::black, Qt::red, Qt::green, Qt::blue, Qt::yellow,
-            Qt::cyan, Qt::magenta, Qt::gray, Qt::darkRed, Qt::darkGreen, Qt::darkBlue
-        };
-        
-        for (int y = 0; y < m_map->height(); ++y) {
-            for (int x = 0; x < m_map->width(); ++x) {
-                uint32_t tile = m_map->tileAt(x, y);
-                if (tile == 0) continue;
-                
-                QRectF rect(x * Constants::DEFAULT_TILE_SIZE, y * Constants::DEFAULT_TILE_SIZE,
-                           Constants::DEFAULT_TILE_SIZE, Constants::DEFAULT_TILE_SIZE);
-                
-                if (m_tileset.isNull()) {
-                    painter->fillRect(rect, colors[(tile - 1) % 12]);
-                } else {
-                    // Extract tile from tileset using configured tile size
-                    int tilesPerRow = m_tileset.width() / m_tileSize;
-                    if (tilesPerRow > 0 && m_tileSize > 0) {
-                        int tileIndex = tile - 1;
-                        int tx = (tileIndex % tilesPerRow) * m_tileSize;
-                        int ty = (tileIndex / tilesPerRow) * m_tileSize;
-                        if (tx + m_tileSize <= m_tileset.width() && ty + m_tileSize <= m_tileset.height()) {
-                            QImage tileImg = m_tileset.copy(tx, ty, m_tileSize, m_tileSize);
-                            painter->drawImage(rect, tileImg);
-                        }
-                    }
-                }
-            }
-        }
+        m_renderer->paint(painter, option->exposedRect,
+                          QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()));
     }
 private:
     CMap* m_map = nullptr;
-    QImage m_tileset;
-    int m_tileSize = 32;
+    CMapRenderer* m_renderer = nullptr;
 };
 
 //-----------------------------------------------------------------------------
@@ -72,6 +58,7 @@ public:
         if (!m_map) return QRectF();
         return QRectF(0, 0, m_map->width() * Constants::DEFAULT_TILE_SIZE, m_map->height() * Constants::DEFAULT_TILE_SIZE);
     }
+    void mapResized() { prepareGeometryChange(); }
     void paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*) override {
         if (!m_map) return;
         int w = m_map->width() * Constants::DEFAULT_TILE_SIZE;
@@ -90,6 +77,50 @@ private:
     CMap* m_map = nullptr;
 };
 
+//-----------------------------------------------------------------------------
+// Draws the whole object layer as one item; only objects intersecting the
+// exposed rect are fetched from the spatial index.
+class ObjectLayerItem : public QGraphicsItem {
+public:
+    ObjectLayerItem(CMap* map, const QSet<uint32_t>* selection, QGraphicsItem* parent = nullptr)
+        : QGraphicsItem(parent), m_map(map), m_selection(selection)
+    {
+        setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+    }
+    QRectF boundingRect() const override {
+        if (!m_map) return QRectF();
+        return QRectF(0, 0, m_map->width() * Constants::DEFAULT_TILE_SIZE, m_map->height() * Constants::DEFAULT_TILE_SIZE);
+    }
+    void mapResized() { prepareGeometryChange(); }
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*) override {
+        if (!m_map) return;
+        const CObjectLayer& layer = m_map->objects();
+        QVector<uint32_t> ids = layer.query(option->exposedRect.toAlignedRect());
+        std::sort(ids.begin(), ids.end());
+
+        QPen selectedPen(Qt::yellow, 2, Qt::DashLine);
+        for (uint32_t id : ids) {
+            const CMapObject* obj = layer.object(id);
+            QColor color = QColor::fromHsv(static_cast<int>(qHash(obj->type) % 360), 200, 220);
+            painter->setPen(m_selection && m_selection->contains(id) ? selectedPen : QPen(color, 1));
+            if (obj->rect.isEmpty()) {
+                // Point objects get a small cross at their origin
+                const QPoint p = obj->rect.topLeft();
+                painter->drawLine(p - QPoint(4, 0), p + QPoint(4, 0));
+                painter->drawLine(p - QPoint(0, 4), p + QPoint(0, 4));
+                continue;
+            }
+            QColor fill = color;
+            fill.setAlpha(80);
+            painter->fillRect(obj->rect, fill);
+            painter->drawRect(obj->rect.adjusted(0, 0, -1, -1));
+        }
+    }
+private:
+    CMap* m_map = nullptr;
+    const QSet<uint32_t>* m_selection = nullptr;
+};
+
 //-----------------------------------------------------------------------------
 CMainView::CMainView(QWidget* parent)
     : QGraphicsView(parent),
@@ -102,6 +133,61 @@ CMainView::CMainView(QWidget* parent)
     setRenderHint(QPainter::Antialiasing, true);
     setMouseTracking(true);
     setBackgroundBrush(QBrush(Qt::gray));
+    m_rubberBand = new QRubberBand(QRubberBand::Rectangle, viewport());
+
+    m_selectionItem = new QGraphicsRectItem;
+    m_selectionItem->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    m_selectionItem->setBrush(QColor(0, 0, 255, 40));
+    m_selectionItem->setZValue(3);
+    m_selectionItem->hide();
+    m_scene->addItem(m_selectionItem);
+
+    m_stampPreviewItem = new QGraphicsRectItem;
+    m_stampPreviewItem->setPen(QPen(Qt::darkGreen, 2));
+    m_stampPreviewItem->setBrush(QColor(0, 128, 0, 40));
+    m_stampPreviewItem->setZValue(4);
+    m_stampPreviewItem->hide();
+    m_scene->addItem(m_stampPreviewItem);
+
+    // One overlay pixel per tile, scaled up without smoothing
+    m_overlayItem = new QGraphicsPixmapItem;
+    m_overlayItem->setScale(Constants::DEFAULT_TILE_SIZE);
+    m_overlayItem->setTransformationMode(Qt::FastTransformation);
+    m_overlayItem->setZValue(1.5);
+    m_overlayItem->hide();
+    m_scene->addItem(m_overlayItem);
+
+    m_pathItem = new QGraphicsPathItem;
+    m_pathItem->setPen(QPen(QColor(0, 200, 0), 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+    m_pathItem->setZValue(3.5);
+    m_scene->addItem(m_pathItem);
+
+    m_pathFailureItem = new QGraphicsPathItem;
+    m_pathFailureItem->setPen(QPen(Qt::red, 3, Qt::DashLine, Qt::RoundCap));
+    m_pathFailureItem->setZValue(3.5);
+    m_scene->addItem(m_pathFailureItem);
+
+    m_diffItem = new QGraphicsPathItem;
+    m_diffItem->setPen(QPen(QColor(255, 140, 0), 2));
+    m_diffItem->setBrush(QColor(255, 140, 0, 60));
+    m_diffItem->setZValue(3.5);
+    m_scene->addItem(m_diffItem);
+
+    m_inputTimer = new QTimer(this);
+    m_inputTimer->setSingleShot(true);
+    m_inputTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_inputTimer, &QTimer::timeout, this, &CMainView::processInput);
+    m_lastInputFrame.start();
+
+    m_renderer = std::make_unique<CMapRenderer>();
+    m_renderer->setFrameBudget(frameIntervalMs() / 2);
+    m_refineTimer = new QTimer(this);
+    m_refineTimer->setSingleShot(true);
+    connect(m_refineTimer, &QTimer::timeout, this, &CMainView::refineStep);
+    m_renderer->setPendingCallback([this]() {
+        if (!m_interactive && !m_refineTimer->isActive())
+            m_refineTimer->start(0);
+    });
 }
 
 //-----------------------------------------------------------------------------
@@ -123,12 +209,23 @@ void CMainView::setMap(CMap* map)
         delete m_mapItem;
         m_mapItem = nullptr;
     }
+    if (m_objectItem) {
+        m_scene->removeItem(m_objectItem);
+        delete m_objectItem;
+        m_objectItem = nullptr;
+    }
+    m_selectedObjects.clear();
+    setSelection(QRect());
     m_gridItem = new GridItem(m_map);
     m_gridItem->setZValue(0);
     m_scene->addItem(m_gridItem);
-    m_mapItem = new MapItem(m_map);
+    m_renderer->setMap(m_map);
+    m_mapItem = new MapItem(m_map, m_renderer.get());
     m_mapItem->setZValue(1);
     m_scene->addItem(m_mapItem);
+    m_objectItem = new ObjectLayerItem(m_map, &m_selectedObjects);
+    m_objectItem->setZValue(2);
+    m_scene->addItem(m_objectItem);
     
     if (m_map) {
         QRectF mapRect(0, 0, m_map->width() * Constants::DEFAULT_TILE_SIZE, m_map->height() * Constants::DEFAULT_TILE_SIZE);
@@ -137,23 +234,118 @@ void CMainView::setMap(CMap* map)
 }
 
 //-----------------------------------------------------------------------------
-void CMainView::setTileset(const QImage& tileset)
+// Keeps the existing scene items (undo commands refer to them) and only
+// refreshes their geometry after the map dimensions changed.
+void CMainView::mapResized(const QPoint& offset)
 {
-    m_tileset = tileset;
-    if (m_mapItem) {
-        m_mapItem->setTileset(tileset, m_tileSize);
-        m_scene->update();
+    if (!m_map) return;
+    static_cast<GridItem*>(m_gridItem)->mapResized();
+    m_mapItem->mapResized();
+    m_renderer->reset();
+    m_objectItem->mapResized();
+    // The selection stays on the tiles it covered
+    setSelection(m_selection.translated(offset).intersected(QRect(0, 0, m_map->width(), m_map->height())));
+    QRectF mapRect(0, 0, m_map->width() * Constants::DEFAULT_TILE_SIZE, m_map->height() * Constants::DEFAULT_TILE_SIZE);
+    m_scene->setSceneRect(mapRect);
+    m_scene->update();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setRegionOverlay(const QImage& overlay)
+{
+    if (overlay.isNull()) {
+        m_overlayItem->hide();
+        m_overlayItem->setPixmap(QPixmap());
+        return;
     }
+    m_overlayItem->setPixmap(QPixmap::fromImage(overlay));
+    m_overlayItem->show();
 }
 
 //-----------------------------------------------------------------------------
-void CMainView::setTileSize(int tileSize)
+void CMainView::setPathOverlay(const QVector<QVector<QPoint>>& paths, const QVector<QLine>& failures)
 {
-    m_tileSize = tileSize;
-    if (m_mapItem && !m_tileset.isNull()) {
-        m_mapItem->setTileset(m_tileset, m_tileSize);
-        m_scene->update();
+    const double ts = Constants::DEFAULT_TILE_SIZE;
+    auto centre = [ts](const QPoint& tile) { return QPointF((tile.x() + 0.5) * ts, (tile.y() + 0.5) * ts); };
+
+    QPainterPath reachable;
+    for (const QVector<QPoint>& path : paths) {
+        if (path.isEmpty())
+            continue;
+        reachable.moveTo(centre(path.first()));
+        for (int i = 1; i < path.size(); ++i)
+            reachable.lineTo(centre(path[i]));
+    }
+    m_pathItem->setPath(reachable);
+
+    QPainterPath unreachable;
+    for (const QLine& line : failures) {
+        unreachable.moveTo(centre(line.p1()));
+        unreachable.lineTo(centre(line.p2()));
     }
+    m_pathFailureItem->setPath(unreachable);
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setDiffOverlay(const QVector<QRect>& regions)
+{
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    QPainterPath path;
+    for (const QRect& r : regions)
+        path.addRect(r.x() * ts, r.y() * ts, r.width() * ts, r.height() * ts);
+    m_diffItem->setPath(path);
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setTileset(const std::shared_ptr<const CTileset>& tileset)
+{
+    m_renderer->setTileset(tileset);
+    if (m_mapItem)
+        m_scene->update();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setSelectedTile(int tile)
+{
+    if (m_recorder && tile != m_selectedTile)
+        m_recorder->record(CEditEvent::TILE, tile);
+    m_selectedTile = tile;
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setTool(int tool)
+{
+    if (m_recorder && tool != m_currentTool)
+        m_recorder->record(CEditEvent::TOOL, tool);
+    m_currentTool = tool;
+    if (tool != Constants::TOOL_STAMP)
+        m_stampPreviewItem->hide();
+}
+
+//-----------------------------------------------------------------------------
+QGraphicsItem* CMainView::mapItem() const
+{
+    return m_mapItem;
+}
+
+//-----------------------------------------------------------------------------
+QGraphicsItem* CMainView::objectItem() const
+{
+    return m_objectItem;
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setSelection(const QRect& rect)
+{
+    m_selection = rect;
+    updateSelectionItem();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setStamp(const CTileRegion& stamp)
+{
+    m_stamp = stamp;
+    m_stampPreviewItem->hide();
 }
 
 //-----------------------------------------------------------------------------
@@ -181,6 +373,45 @@ void CMainView::resetZoom()
     applyZoom();
 }
 
+//-----------------------------------------------------------------------------
+QPointF CMainView::viewCenter() const
+{
+    if (m_hasPendingCenter)
+        return m_pendingCenter;
+    return mapToScene(viewport()->rect().center());
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::setViewState(double zoom, const QPointF& center)
+{
+    m_zoom = std::clamp(zoom, Constants::MIN_ZOOM, Constants::MAX_ZOOM);
+    applyZoom();
+    m_pendingCenter = center;
+    m_hasPendingCenter = true;
+    if (isVisible()) {
+        centerOn(center);
+        m_hasPendingCenter = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::showEvent(QShowEvent* event)
+{
+    QGraphicsView::showEvent(event);
+    m_renderer->setFrameBudget(frameIntervalMs() / 2);
+    if (m_hasPendingCenter) {
+        centerOn(m_pendingCenter);
+        m_hasPendingCenter = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::paintEvent(QPaintEvent* event)
+{
+    QGraphicsView::paintEvent(event);
+    emit framePainted();
+}
+
 //-----------------------------------------------------------------------------
 void CMainView::applyZoom()
 {
@@ -190,56 +421,160 @@ void CMainView::applyZoom()
 }
 
 //-----------------------------------------------------------------------------
+// High-rate mice and tablets send many moves per frame. They are only queued
+// here; processInput() handles them together once per display frame.
 void CMainView::mouseMoveEvent(QMouseEvent* event)
 {
+    if (m_recorder)
+        m_recorder->record(CEditEvent::MOVE, event);
+    m_moveSamples.append(event->pos());
+    if (!m_inputTimer->isActive())
+        m_inputTimer->start(std::max<qint64>(0, frameIntervalMs() - m_lastInputFrame.elapsed()));
+
+    if (m_panning || m_selecting || m_selectingTiles || m_painting) {
+        event->accept();
+        return;
+    }
+    QGraphicsView::mouseMoveEvent(event);
+}
+
+//-----------------------------------------------------------------------------
+int CMainView::frameIntervalMs() const
+{
+    const QScreen* s = screen();
+    const double hz = s && s->refreshRate() > 0 ? s->refreshRate() : Constants::INPUT_DEFAULT_REFRESH_HZ;
+    return std::max(1, qRound(1000.0 / hz));
+}
+
+//-----------------------------------------------------------------------------
+// Pan, rubber bands, selection, hover and the stamp preview only need the
+// latest position; painting walks every sample so no tile is skipped
+void CMainView::processInput()
+{
+    m_lastInputFrame.restart();
+    if (m_moveSamples.isEmpty())
+        return;
+    QVector<QPoint> samples;
+    samples.swap(m_moveSamples);
+    const QPoint pos = samples.last();
+    const auto frameDone = qScopeGuard([this]() { emit inputProcessed(); });
+
     if (m_panning) {
-        QPoint delta = event->pos() - m_lastPanPoint;
-        m_lastPanPoint = event->pos();
+        beginGesture();
+        QPoint delta = pos - m_lastPanPoint;
+        m_lastPanPoint = pos;
         horizontalScrollBar()->setValue(horizontalScrollBar()->value() - delta.x());
         verticalScrollBar()->setValue(verticalScrollBar()->value() - delta.y());
-        event->accept();
         return;
     }
-    
-    // Update tile position
-    QPointF scenePos = mapToScene(event->pos());
-    int tileX = scenePos.x() < 0 ? -1 : static_cast<int>(scenePos.x()) / Constants::DEFAULT_TILE_SIZE;
-    int tileY = scenePos.y() < 0 ? -1 : static_cast<int>(scenePos.y()) / Constants::DEFAULT_TILE_SIZE;
-    
-    // Only emit position if within valid map bounds
-    if (m_map && tileX >= 0 && tileX < m_map->width() && tileY >= 0 && tileY < m_map->height()) {
-        emit mouseTileChanged(tileX, tileY);
-        setCursor(Qt::CrossCursor);
-    } else {
-        setCursor(Qt::ArrowCursor);
+
+    if (m_selecting) {
+        m_rubberBand->setGeometry(QRect(m_rubberBandOrigin, pos).normalized());
+        return;
     }
-    
+
+    const QPoint tile = sceneToTile(mapToScene(pos));
+    updateHover(tile);
+
+    if (m_selectingTiles && m_map) {
+        QPoint corner(std::clamp(tile.x(), 0, m_map->width() - 1), std::clamp(tile.y(), 0, m_map->height() - 1));
+        setSelection(QRect(m_selectionAnchor, corner).normalized());
+        return;
+    }
+
+    if (m_currentTool == Constants::TOOL_STAMP)
+        updateStampPreview(tile);
+
     if (m_painting && m_map) {
-        int tileValue = (event->buttons() & Qt::RightButton) ? 0 : (m_selectedTile + 1);
-        paintTile(scenePos, tileValue);
-        event->accept();
+        for (const QPoint& sample : samples)
+            paintTile(mapToScene(sample), static_cast<int>(m_paintValue));
+        flushPaint();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::updateHover(const QPoint& tile)
+{
+    if (tile == m_hoverTile)
         return;
+    m_hoverTile = tile;
+    const bool inside = m_map && tile.x() >= 0 && tile.x() < m_map->width() && tile.y() >= 0 && tile.y() < m_map->height();
+    if (inside)
+        emit mouseTileChanged(tile.x(), tile.y());
+    if (inside != m_hoverInside) {
+        m_hoverInside = inside;
+        setCursor(inside ? Qt::CrossCursor : Qt::ArrowCursor);
     }
-    
-    QGraphicsView::mouseMoveEvent(event);
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::addPaintTile(const QPoint& tile)
+{
+    if (tile.x() < 0 || tile.x() >= m_map->width() || tile.y() < 0 || tile.y() >= m_map->height())
+        return;
+    if (m_map->tileAt(tile.x(), tile.y()) == m_paintValue)
+        return;
+    const qsizetype capacity = m_paintBatch.capacity();
+    m_paintBatch.append(qMakePair(tile.x(), tile.y()));
+    if (m_paintBatch.capacity() != capacity)
+        CAllocStats::record(CAllocStats::SCRATCH, (m_paintBatch.capacity() - capacity) * qsizetype(sizeof(QPair<int, int>)));
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::flushPaint()
+{
+    if (m_paintBatch.isEmpty())
+        return;
+    std::sort(m_paintBatch.begin(), m_paintBatch.end());
+    m_paintBatch.erase(std::unique(m_paintBatch.begin(), m_paintBatch.end()), m_paintBatch.end());
+    // The batch keeps its capacity for the next frame of the stroke
+    emit tilesPainted(m_paintBatch, m_paintValue, m_mapItem);
+    m_paintBatch.clear();
 }
 
 //-----------------------------------------------------------------------------
 void CMainView::mousePressEvent(QMouseEvent* event)
 {
+    if (m_recorder)
+        m_recorder->record(CEditEvent::PRESS, event);
+    // Moves queued before the press belong before it
+    processInput();
+
     if (event->button() == Qt::MiddleButton) {
         m_panning = true;
         m_lastPanPoint = event->pos();
+        beginGesture();
         setCursor(Qt::ClosedHandCursor);
         event->accept();
         return;
     }
     
+    if (m_currentTool == Constants::TOOL_OBJECT && event->button() == Qt::LeftButton && m_map) {
+        objectPress(event);
+        event->accept();
+        return;
+    }
+    
+    if (m_currentTool == Constants::TOOL_SELECT && event->button() == Qt::LeftButton && m_map) {
+        QPoint tile = sceneToTile(mapToScene(event->pos()));
+        if (tile.x() >= 0 && tile.x() < m_map->width() && tile.y() >= 0 && tile.y() < m_map->height()) {
+            m_selectingTiles = true;
+            m_selectionAnchor = tile;
+            setSelection(QRect(tile, tile));
+        } else {
+            setSelection(QRect());
+        }
+        event->accept();
+        return;
+    }
+    
     if ((event->button() == Qt::LeftButton || event->button() == Qt::RightButton) && m_map) {
         m_painting = true;
-        QPointF scenePos = mapToScene(event->pos());
-        int tileValue = (event->button() == Qt::RightButton) ? 0 : (m_selectedTile + 1);
-        paintTile(scenePos, tileValue);
+        m_strokeStarted = false;
+        m_lastStampTile = QPoint(-1, -1);
+        m_paintValue = (event->button() == Qt::RightButton) ? 0 : static_cast<uint32_t>(m_selectedTile + 1);
+        paintTile(mapToScene(event->pos()), static_cast<int>(m_paintValue));
+        flushPaint();
         event->accept();
         return;
     }
@@ -250,15 +585,35 @@ void CMainView::mousePressEvent(QMouseEvent* event)
 //-----------------------------------------------------------------------------
 void CMainView::mouseReleaseEvent(QMouseEvent* event)
 {
+    if (m_recorder)
+        m_recorder->record(CEditEvent::RELEASE, event);
+    // The stroke or drag ends with the moves that led up to the release
+    processInput();
+
     if (event->button() == Qt::MiddleButton && m_panning) {
         m_panning = false;
         setCursor(Qt::ArrowCursor);
+        m_hoverInside = false;
+        m_hoverTile = QPoint(-1, -1);
+        event->accept();
+        return;
+    }
+
+    if (event->button() == Qt::LeftButton && m_selecting) {
+        finishRubberBand();
+        event->accept();
+        return;
+    }
+
+    if (event->button() == Qt::LeftButton && m_selectingTiles) {
+        m_selectingTiles = false;
         event->accept();
         return;
     }
     
     if ((event->button() == Qt::LeftButton || event->button() == Qt::RightButton) && m_painting) {
         m_painting = false;
+        emit strokeFinished();
         event->accept();
         return;
     }
@@ -266,9 +621,31 @@ void CMainView::mouseReleaseEvent(QMouseEvent* event)
     QGraphicsView::mouseReleaseEvent(event);
 }
 
+//-----------------------------------------------------------------------------
+// Double-clicking an object with the object tool opens its properties
+void CMainView::mouseDoubleClickEvent(QMouseEvent* event)
+{
+    if (m_currentTool == Constants::TOOL_OBJECT && event->button() == Qt::LeftButton && m_map
+            && !(event->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier))) {
+        if (uint32_t hit = m_map->objects().hitTest(mapToScene(event->pos()).toPoint())) {
+            m_selectedObjects.clear();
+            m_selectedObjects.insert(hit);
+            m_objectItem->update();
+            emit objectEditRequested(hit, m_objectItem);
+        }
+        event->accept();
+        return;
+    }
+
+    QGraphicsView::mouseDoubleClickEvent(event);
+}
+
 //-----------------------------------------------------------------------------
 void CMainView::wheelEvent(QWheelEvent* event)
 {
+    if (m_recorder)
+        m_recorder->record(event);
+    beginGesture();
     if (event->modifiers() & Qt::ControlModifier) {
         if (event->angleDelta().y() > 0)
             zoomIn();
@@ -280,6 +657,38 @@ void CMainView::wheelEvent(QWheelEvent* event)
     }
 }
 
+//-----------------------------------------------------------------------------
+// Each step of a pan or zoom restarts the idle timer and drops refinement
+// still queued for the previous position
+void CMainView::beginGesture()
+{
+    m_renderer->cancel();
+    if (!m_interactive) {
+        m_interactive = true;
+        m_renderer->setInteractive(true);
+    }
+    m_refineTimer->start(Constants::RENDER_IDLE_MS);
+}
+
+//-----------------------------------------------------------------------------
+// Once the gesture is idle the view is repainted at full quality, which
+// renders what fits into the frame and queues the rest; queued chunks are
+// then rendered one time slice per event loop pass
+void CMainView::refineStep()
+{
+    if (m_interactive) {
+        m_interactive = false;
+        m_renderer->setInteractive(false);
+        viewport()->update();
+        return;
+    }
+    m_renderer->setFrameBudget(frameIntervalMs() / 2);
+    for (const QRectF& rect : m_renderer->refine(frameIntervalMs() / 2))
+        m_mapItem->update(rect);
+    if (m_renderer->hasPending())
+        m_refineTimer->start(0);
+}
+
 //-----------------------------------------------------------------------------
 void CMainView::paintTile(const QPointF& scenePos, int tileValue)
 {
@@ -288,57 +697,226 @@ void CMainView::paintTile(const QPointF& scenePos, int tileValue)
     int tileX = scenePos.x() < 0 ? -1 : static_cast<int>(scenePos.x()) / Constants::DEFAULT_TILE_SIZE;
     int tileY = scenePos.y() < 0 ? -1 : static_cast<int>(scenePos.y()) / Constants::DEFAULT_TILE_SIZE;
     
-    if (tileX >= 0 && tileX < m_map->width() && tileY >= 0 && tileY < m_map->height()) {
-        if (m_currentTool == Constants::TOOL_FILL) {
+    if (m_currentTool == Constants::TOOL_STAMP && tileValue != 0 && !m_stamp.isEmpty()) {
+        QPoint tile(tileX, tileY);
+        if (tile != m_lastStampTile) {
+            m_lastStampTile = tile;
+            stampAt(tile);
+        }
+        return;
+    }
+    
+    if (m_currentTool == Constants::TOOL_FILL) {
+        if (tileX >= 0 && tileX < m_map->width() && tileY >= 0 && tileY < m_map->height()) {
             uint32_t oldTile = m_map->tileAt(tileX, tileY);
             if (oldTile != static_cast<uint32_t>(tileValue)) {
-                QVector<QPair<int, int>> tiles = collectFillTiles(tileX, tileY, oldTile);
+                const QVector<QPair<int, int>>& tiles = collectFillTiles(tileX, tileY, oldTile);
                 if (!tiles.isEmpty()) {
                     emit fillApplied(tiles, static_cast<uint32_t>(tileValue), m_mapItem);
                 }
             }
-        } else {
-            uint32_t oldValue = m_map->tileAt(tileX, tileY);
-            if (oldValue != static_cast<uint32_t>(tileValue)) {
-                emit tileChanged(tileX, tileY, static_cast<uint32_t>(tileValue), m_mapItem);
-            }
+        }
+        return;
+    }
+
+    // Every tile on the line from the previous sample, so fast strokes leave
+    // no gaps; the batch goes out in flushPaint()
+    QPoint tile(tileX, tileY);
+    QPoint from = m_strokeStarted ? m_lastPaintTile : tile;
+    m_strokeStarted = true;
+    m_lastPaintTile = tile;
+    const int dx = std::abs(tile.x() - from.x()), sx = from.x() < tile.x() ? 1 : -1;
+    const int dy = -std::abs(tile.y() - from.y()), sy = from.y() < tile.y() ? 1 : -1;
+    int err = dx + dy;
+    for (;;) {
+        addPaintTile(from);
+        if (from == tile)
+            break;
+        const int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            from.rx() += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            from.ry() += sy;
         }
     }
 }
 
 //-----------------------------------------------------------------------------
-QVector<QPair<int, int>> CMainView::collectFillTiles(int x, int y, uint32_t targetTile)
+// Visits tiles as they are pushed, so the stack never holds more than the
+// region; only the bits of the filled tiles are cleared afterwards, which
+// keeps a fill in a large map proportional to the region it touches.
+const QVector<QPair<int, int>>& CMainView::collectFillTiles(int x, int y, uint32_t targetTile)
 {
-    QVector<QPair<int, int>> result;
-    if (!m_map)
-        return result;
-    
-    std::stack<std::pair<int, int>> stack;
-    QSet<QPair<int, int>> visited;
-    stack.push({x, y});
-    
-    while (!stack.empty()) {
-        auto [cx, cy] = stack.top();
-        stack.pop();
-        
-        if (cx < 0 || cy < 0 || cx >= m_map->width() || cy >= m_map->height())
-            continue;
-        
-        QPair<int, int> pos(cx, cy);
-        if (visited.contains(pos))
-            continue;
-        
-        if (m_map->tileAt(cx, cy) != targetTile)
-            continue;
-        
-        visited.insert(pos);
-        result.append(pos);
-        
-        stack.push({cx + 1, cy});
-        stack.push({cx - 1, cy});
-        stack.push({cx, cy + 1});
-        stack.push({cx, cy - 1});
+    m_fillTiles.clear();
+    if (!m_map || x < 0 || y < 0 || x >= m_map->width() || y >= m_map->height())
+        return m_fillTiles;
+
+    const int w = m_map->width();
+    const int h = m_map->height();
+    const size_t words = (static_cast<size_t>(w) * h + 63) / 64;
+    if (m_fillVisited.size() != words) {
+        m_fillVisited.resize(words);
+        std::fill(m_fillVisited.begin(), m_fillVisited.end(), 0);
     }
-    
-    return result;
+
+    auto visit = [&](int tx, int ty) {
+        const uint32_t position = static_cast<uint32_t>(ty) * w + tx;
+        uint64_t& word = m_fillVisited[position / 64];
+        const uint64_t bit = 1ULL << (position % 64);
+        if ((word & bit) || m_map->tileAt(tx, ty) != targetTile)
+            return;
+        word |= bit;
+        m_fillStack.append(position);
+    };
+
+    const qsizetype capacity = m_fillTiles.capacity();
+    m_fillStack.clear();
+    visit(x, y);
+    while (!m_fillStack.isEmpty()) {
+        const uint32_t position = m_fillStack.takeLast();
+        const int cx = static_cast<int>(position % w);
+        const int cy = static_cast<int>(position / w);
+        m_fillTiles.append(qMakePair(cx, cy));
+        if (cx + 1 < w)
+            visit(cx + 1, cy);
+        if (cx > 0)
+            visit(cx - 1, cy);
+        if (cy + 1 < h)
+            visit(cx, cy + 1);
+        if (cy > 0)
+            visit(cx, cy - 1);
+    }
+
+    for (const auto& tile : m_fillTiles) {
+        const uint32_t position = static_cast<uint32_t>(tile.second) * w + tile.first;
+        m_fillVisited[position / 64] &= ~(1ULL << (position % 64));
+    }
+    if (m_fillTiles.capacity() != capacity)
+        CAllocStats::record(CAllocStats::SCRATCH, (m_fillTiles.capacity() - capacity) * qsizetype(sizeof(QPair<int, int>)));
+    return m_fillTiles;
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::objectPress(QMouseEvent* event)
+{
+    QPointF scenePos = mapToScene(event->pos());
+    QPoint pos = scenePos.toPoint();
+
+    // Ctrl+click places a new tile-sized object snapped to the grid
+    if (event->modifiers() & Qt::ControlModifier) {
+        int tileX = scenePos.x() < 0 ? -1 : static_cast<int>(scenePos.x()) / Constants::DEFAULT_TILE_SIZE;
+        int tileY = scenePos.y() < 0 ? -1 : static_cast<int>(scenePos.y()) / Constants::DEFAULT_TILE_SIZE;
+        if (tileX >= 0 && tileX < m_map->width() && tileY >= 0 && tileY < m_map->height()) {
+            CMapObject obj;
+            obj.rect = QRect(tileX * Constants::DEFAULT_TILE_SIZE, tileY * Constants::DEFAULT_TILE_SIZE,
+                             Constants::DEFAULT_TILE_SIZE, Constants::DEFAULT_TILE_SIZE);
+            obj.type = m_objectType;
+            emit objectAdded(obj, m_objectItem);
+        }
+        return;
+    }
+
+    bool additive = event->modifiers() & Qt::ShiftModifier;
+    uint32_t hit = m_map->objects().hitTest(pos);
+    if (hit) {
+        if (!additive)
+            m_selectedObjects.clear();
+        if (additive && m_selectedObjects.contains(hit))
+            m_selectedObjects.remove(hit);
+        else
+            m_selectedObjects.insert(hit);
+        m_objectItem->update();
+        return;
+    }
+
+    // Empty space starts a rubber-band selection
+    if (!additive) {
+        m_selectedObjects.clear();
+        m_objectItem->update();
+    }
+    m_selecting = true;
+    m_rubberBandOrigin = event->pos();
+    m_rubberBand->setGeometry(QRect(m_rubberBandOrigin, QSize()));
+    m_rubberBand->show();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::finishRubberBand()
+{
+    m_selecting = false;
+    m_rubberBand->hide();
+    if (!m_map) return;
+
+    QRect area = mapToScene(m_rubberBand->geometry()).boundingRect().toAlignedRect();
+    for (uint32_t id : m_map->objects().query(area))
+        m_selectedObjects.insert(id);
+    m_objectItem->update();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::removeSelectedObjects()
+{
+    if (!m_map) return;
+
+    QVector<uint32_t> ids;
+    for (uint32_t id : m_selectedObjects) {
+        if (m_map->objects().object(id))
+            ids.append(id);
+    }
+    m_selectedObjects.clear();
+    if (!ids.isEmpty())
+        emit objectsRemoved(ids, m_objectItem);
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::editSelectedObject()
+{
+    if (!m_map || m_selectedObjects.size() != 1) return;
+
+    uint32_t id = *m_selectedObjects.constBegin();
+    if (m_map->objects().object(id))
+        emit objectEditRequested(id, m_objectItem);
+}
+
+//-----------------------------------------------------------------------------
+QPoint CMainView::sceneToTile(const QPointF& scenePos) const
+{
+    int tileX = scenePos.x() < 0 ? -1 : static_cast<int>(scenePos.x()) / Constants::DEFAULT_TILE_SIZE;
+    int tileY = scenePos.y() < 0 ? -1 : static_cast<int>(scenePos.y()) / Constants::DEFAULT_TILE_SIZE;
+    return QPoint(tileX, tileY);
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::updateSelectionItem()
+{
+    if (m_selection.isEmpty()) {
+        m_selectionItem->hide();
+        return;
+    }
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    m_selectionItem->setRect(m_selection.x() * ts, m_selection.y() * ts, m_selection.width() * ts, m_selection.height() * ts);
+    m_selectionItem->show();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::updateStampPreview(const QPoint& tile)
+{
+    if (m_stamp.isEmpty() || !m_map || tile.x() < 0 || tile.y() < 0 || tile.x() >= m_map->width() || tile.y() >= m_map->height()) {
+        m_stampPreviewItem->hide();
+        return;
+    }
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    m_stampPreviewItem->setRect(tile.x() * ts, tile.y() * ts, m_stamp.width * ts, m_stamp.height * ts);
+    m_stampPreviewItem->show();
+}
+
+//-----------------------------------------------------------------------------
+void CMainView::stampAt(const QPoint& tile)
+{
+    if (!m_map || m_stamp.isEmpty()) return;
+    if (tile.x() < 0 || tile.y() < 0 || tile.x() >= m_map->width() || tile.y() >= m_map->height()) return;
+    emit regionStamped(tile.x(), tile.y(), m_stamp, m_mapItem);
 }
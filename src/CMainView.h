@@ -1,16 +1,32 @@
 #pragma once
 
 #include "CMap.h"
+#include "CPayloadPool.h"
 #include "Constants.h"
 
+#include <memory>
+#include <QElapsedTimer>
 #include <QGraphicsView>
+#include <QLine>
 #include <QPoint>
+#include <QRect>
+#include <QSet>
 
 //-----------------------------------------------------------------------------
+class CEditRecorder;
+class CMapRenderer;
 class MapItem;
+class ObjectLayerItem;
+struct CTileset;
 class QGraphicsItem;
+class QGraphicsPathItem;
+class QGraphicsPixmapItem;
+class QGraphicsRectItem;
 class QGraphicsScene;
 class QMouseEvent;
+class QRubberBand;
+class QShowEvent;
+class QTimer;
 class QWheelEvent;
 
 //-----------------------------------------------------------------------------
@@ -24,22 +40,60 @@ public:
     void zoomIn();
     void zoomOut();
     void resetZoom();
+
+    // Zoom and the scene point at the centre of the viewport; the centre is
+    // applied once the view is shown and has its final size
+    double zoom() const { return m_zoom; }
+    QPointF viewCenter() const;
+    void setViewState(double zoom, const QPointF& center);
     
     void setMap(CMap* map);
-    void setSelectedTile(int tile) { m_selectedTile = tile; }
-    void setTileset(const QImage& tileset);
-    void setTileSize(int tileSize);
-    void setTool(int tool) { m_currentTool = tool; }
+    // offset is where the old top-left tile went, for content moved with the resize
+    void mapResized(const QPoint& offset = QPoint());
+    void setSelectedTile(int tile);
+    void setTileset(const std::shared_ptr<const CTileset>& tileset);
+    void setTool(int tool);
+    void removeSelectedObjects();
+    // Asks for the properties of the single selected object to be edited
+    void editSelectedObject();
+    // Type given to objects placed with Ctrl+click
+    void setObjectType(const QString& type) { m_objectType = type; }
+
+    QRect selection() const { return m_selection; }
+    void setSelection(const QRect& rect);
+    const CTileRegion& stamp() const { return m_stamp; }
+    QGraphicsItem* mapItem() const;
+    QGraphicsItem* objectItem() const;
+    void setStamp(const CTileRegion& stamp);
+    void setRegionOverlay(const QImage& overlay);
+    // Tile paths drawn through tile centres; failures as straight dashed lines
+    void setPathOverlay(const QVector<QVector<QPoint>>& paths, const QVector<QLine>& failures);
+    void setDiffOverlay(const QVector<QRect>& regions);
+    // Input, tool and tile changes go to the recorder while one is set
+    void setRecorder(CEditRecorder* recorder) { m_recorder = recorder; }
 
 signals:
     void mouseTileChanged(int x, int y);
-    void tileChanged(int x, int y, uint32_t value, QGraphicsItem* mapItem);
+    // Tiles painted during one input frame, in no particular order
+    void tilesPainted(const QVector<QPair<int, int>>& tiles, uint32_t value, QGraphicsItem* mapItem);
     void fillApplied(const QVector<QPair<int, int>>& tiles, uint32_t value, QGraphicsItem* mapItem);
+    void objectAdded(const CMapObject& object, QGraphicsItem* objectItem);
+    void objectsRemoved(const QVector<uint32_t>& ids, QGraphicsItem* objectItem);
+    void objectEditRequested(uint32_t id, QGraphicsItem* objectItem);
+    void regionStamped(int x, int y, const CTileRegion& region, QGraphicsItem* mapItem);
+    // Release of the button that painted, filled or stamped
+    void strokeFinished();
+    // End of an input frame that handled queued moves; the edits they made
+    // are pushed by then
+    void inputProcessed();
+    // End of a paint of the viewport
+    void framePainted();
 
 private:
     QGraphicsScene* m_scene = nullptr;
     QGraphicsItem* m_gridItem = nullptr;
     MapItem* m_mapItem = nullptr;
+    ObjectLayerItem* m_objectItem = nullptr;
     CMap* m_map = nullptr;
     
     // pan state
@@ -47,18 +101,82 @@ private:
     bool m_painting = false;
     QPoint m_lastPanPoint;
     double m_zoom = 1.0;
+    QPointF m_pendingCenter;
+    bool m_hasPendingCenter = false;
     int m_selectedTile = 0;
-    int m_tileSize = 32;
     int m_currentTool = Constants::TOOL_PAINT;
-    QImage m_tileset;
+
+    // object tool state
+    QSet<uint32_t> m_selectedObjects;
+    QString m_objectType = Constants::DEFAULT_OBJECT_TYPE;
+    QRubberBand* m_rubberBand = nullptr;
+    QPoint m_rubberBandOrigin;
+    bool m_selecting = false;
+
+    // selection and stamp tool state
+    QRect m_selection;
+    QPoint m_selectionAnchor;
+    bool m_selectingTiles = false;
+    QGraphicsRectItem* m_selectionItem = nullptr;
+    CTileRegion m_stamp;
+    QPoint m_lastStampTile;
+    QGraphicsRectItem* m_stampPreviewItem = nullptr;
+    QGraphicsPixmapItem* m_overlayItem = nullptr;
+    QGraphicsPathItem* m_pathItem = nullptr;
+    QGraphicsPathItem* m_pathFailureItem = nullptr;
+    QGraphicsPathItem* m_diffItem = nullptr;
+
+    // Input frames: mouse moves are queued and handled once per display
+    // frame; hover feedback only changes with the tile under the pointer
+    QVector<QPoint> m_moveSamples;
+    QTimer* m_inputTimer = nullptr;
+    QElapsedTimer m_lastInputFrame;
+    QPoint m_hoverTile = QPoint(-1, -1);
+    bool m_hoverInside = false;
+    uint32_t m_paintValue = 0;
+    bool m_strokeStarted = false;
+    QPoint m_lastPaintTile;
+    QVector<QPair<int, int>> m_paintBatch;
+    CEditRecorder* m_recorder = nullptr;
+
+    int frameIntervalMs() const;
+    void processInput();
+    void updateHover(const QPoint& tile);
+    void addPaintTile(const QPoint& tile);
+    void flushPaint();
+
+    // Progressive rendering: pan and zoom gestures draw from cached chunk
+    // images and previews, refined in time slices once input is idle
+    std::unique_ptr<CMapRenderer> m_renderer;
+    QTimer* m_refineTimer = nullptr;
+    bool m_interactive = false;
+
+    void beginGesture();
+    void refineStep();
 
     void applyZoom();
     void paintTile(const QPointF& scenePos, int tileValue);
-    QVector<QPair<int, int>> collectFillTiles(int x, int y, uint32_t targetTile);
+    void objectPress(QMouseEvent* event);
+    void finishRubberBand();
+    QPoint sceneToTile(const QPointF& scenePos) const;
+    void updateSelectionItem();
+    void updateStampPreview(const QPoint& tile);
+    void stampAt(const QPoint& tile);
+
+    // Fill scratch, reused across clicks; the bitmap has a bit per map tile
+    // and is all clear between fills
+    CPooledArray<uint64_t> m_fillVisited{CAllocStats::SCRATCH};
+    CPooledArray<uint32_t> m_fillStack{CAllocStats::SCRATCH};
+    QVector<QPair<int, int>> m_fillTiles;
+
+    const QVector<QPair<int, int>>& collectFillTiles(int x, int y, uint32_t targetTile);
 
 protected:
     void mouseMoveEvent(QMouseEvent* event) override;
     void mousePressEvent(QMouseEvent* event) override;
     void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
 };
@@ -1,34 +1,95 @@
 #include "CMainWindow.h"
+#include "CAnalysisDock.h"
+#include "CAutotile.h"
+#include "CEditRecording.h"
 #include "CMainView.h"
 #include "CMap.h"
+#include "CGenerateDialog.h"
+#include "CGenerator.h"
+#include "CMapDiff.h"
+#include "CMapFileDialog.h"
+#include "CMapHash.h"
+#include "CMapPack.h"
 #include "CMapPreferencesDialog.h"
+#include "CMapSync.h"
+#include "CObjectPropertiesDialog.h"
+#include "CPayloadPool.h"
+#include "CPathCheckDialog.h"
+#include "CPhaseLog.h"
+#include "CReplaceTilesDialog.h"
+#include "CScriptDock.h"
+#include "CScriptRunner.h"
+#include "CSessionCache.h"
+#include "CThumbnailCache.h"
+#include "CTileReplace.h"
+#include "CUndoHistory.h"
+#include "CTilePropertiesDialog.h"
+#include "CTilesetCache.h"
 #include "CTilesetSettingsDialog.h"
 #include "Constants.h"
 
 #include <QAction>
 #include <QActionGroup>
+#include <QClipboard>
+#include <QComboBox>
 #include <QCloseEvent>
+#include <QDataStream>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QGuiApplication>
 #include <QImage>
+#include <QInputDialog>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QMimeData>
 #include <QPixmap>
+#include <QPointer>
+#include <QSettings>
 #include <QStatusBar>
+#include <QTabWidget>
+#include <QThreadPool>
+#include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
 #include <QUndoCommand>
+#include <QUndoGroup>
 #include <QUndoStack>
 #include <QGraphicsItem>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 //-----------------------------------------------------------------------------
-class SetTileCommand : public QUndoCommand {
+namespace {
+    // Scene rect of a tile rect, so commands repaint only what they changed
+    QRectF tileSceneRect(const QRect& tiles)
+    {
+        const int ts = Constants::DEFAULT_TILE_SIZE;
+        return QRectF(tiles.x() * ts, tiles.y() * ts, tiles.width() * ts, tiles.height() * ts);
+    }
+
+    // Commands holding flat positions only run on the map size they were
+    // recorded at; anything else means the stack missed a resize
+    bool sameMapSize(const CMap* map, const QSize& size)
+    {
+        if (map->width() == size.width() && map->height() == size.height())
+            return true;
+        qWarning() << "Skipping undo step recorded on a" << size << "map, now" << map->width() << "x" << map->height();
+        return false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class SetTileCommand : public CUndoCommand {
 public:
     SetTileCommand(CMap* map, int x, int y, uint32_t newValue, QGraphicsItem* mapItem)
         : m_map(map), m_x(x), m_y(y), m_newValue(newValue), m_mapItem(mapItem)
@@ -37,14 +98,14 @@ public:
         setText(QString("Set tile (%1, %2)").arg(x).arg(y));
     }
     
-    void undo() override {
+    void doUndo() override {
         m_map->setTile(m_x, m_y, m_oldValue);
-        if (m_mapItem) m_mapItem->update();
+        if (m_mapItem) m_mapItem->update(tileSceneRect(QRect(m_x, m_y, 1, 1)));
     }
     
-    void redo() override {
+    void doRedo() override {
         m_map->setTile(m_x, m_y, m_newValue);
-        if (m_mapItem) m_mapItem->update();
+        if (m_mapItem) m_mapItem->update(tileSceneRect(QRect(m_x, m_y, 1, 1)));
     }
     
 private:
@@ -55,40 +116,525 @@ private:
 };
 
 //-----------------------------------------------------------------------------
-class FillCommand : public QUndoCommand {
+class FillCommand : public CUndoCommand {
 public:
-    FillCommand(CMap* map, const QVector<QPair<int, int>>& tiles, uint32_t newValue, QGraphicsItem* mapItem)
-        : m_map(map), m_tiles(tiles), m_newValue(newValue), m_mapItem(mapItem)
+    FillCommand(CMap* map, const QVector<QPair<int, int>>& tiles, uint32_t newValue, QGraphicsItem* mapItem,
+                const QString& text = QString())
+        : m_map(map), m_mapSize(map->width(), map->height()), m_newValue(newValue), m_mapItem(mapItem)
     {
-        setText(QString("Fill %1 tiles").arg(tiles.size()));
-        m_oldValues.reserve(tiles.size());
+        setText(text.isEmpty() ? QString("Fill %1 tiles").arg(tiles.size()) : text);
+        m_positions.reserve(static_cast<size_t>(tiles.size()));
+        m_oldValues.reserve(static_cast<size_t>(tiles.size()));
+        QRect bounds;
         for (const auto& tile : tiles) {
+            m_positions.append(static_cast<uint32_t>(tile.second) * map->width() + tile.first);
             m_oldValues.append(map->tileAt(tile.first, tile.second));
+            bounds |= QRect(tile.first, tile.second, 1, 1);
         }
+        m_dirty = tileSceneRect(bounds);
     }
     
-    void undo() override {
-        for (int i = 0; i < m_tiles.size(); ++i) {
-            m_map->setTile(m_tiles[i].first, m_tiles[i].second, m_oldValues[i]);
-        }
+    void doUndo() override {
+        if (!sameMapSize(m_map, m_mapSize)) return;
+        m_map->setTiles(m_positions.constData(), m_positions.size(), m_oldValues.constData());
+        if (m_mapItem) m_mapItem->update(m_dirty);
+    }
+    
+    void doRedo() override {
+        if (!sameMapSize(m_map, m_mapSize)) return;
+        m_map->setTiles(m_positions.constData(), m_positions.size(), m_newValue);
+        if (m_mapItem) m_mapItem->update(m_dirty);
+    }
+    
+protected:
+    size_t payloadSize() const override {
+        return (m_positions.size() + m_oldValues.size()) * sizeof(uint32_t);
+    }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override { writeRaw(out, m_positions); writeRaw(out, m_oldValues); }
+    void readPayload(QDataStream& in) override { readRaw(in, m_positions); readRaw(in, m_oldValues); }
+    void releasePayload() override { releaseRaw(m_positions); releaseRaw(m_oldValues); }
+    
+private:
+    CMap* m_map;
+    QSize m_mapSize;                        // the positions are only valid at this size
+    CPooledArray<uint32_t> m_positions;     // row-major
+    CPooledArray<uint32_t> m_oldValues;
+    uint32_t m_newValue;
+    QRectF m_dirty;
+    QGraphicsItem* m_mapItem;
+};
+
+//-----------------------------------------------------------------------------
+// Sparse list of tile changes at flat map positions, used for edits whose
+// footprint is irregular (autotiled paint and fill). Takes over the arrays.
+class TileChangesCommand : public CUndoCommand {
+public:
+    TileChangesCommand(CMap* map, CPooledArray<uint32_t>&& positions, CPooledArray<uint32_t>&& oldValues,
+                       CPooledArray<uint32_t>&& newValues, QGraphicsItem* mapItem, const QString& text)
+        : m_map(map), m_mapSize(map->width(), map->height()), m_positions(std::move(positions)), m_oldValues(std::move(oldValues)),
+          m_newValues(std::move(newValues)), m_mapItem(mapItem)
+    {
+        setText(text);
+        QRect bounds;
+        for (uint32_t position : m_positions)
+            bounds |= QRect(static_cast<int>(position % map->width()), static_cast<int>(position / map->width()), 1, 1);
+        m_dirty = tileSceneRect(bounds);
+    }
+    
+    void doUndo() override {
+        apply(m_oldValues);
+    }
+    
+    void doRedo() override {
+        apply(m_newValues);
+    }
+    
+protected:
+    size_t payloadSize() const override {
+        return (m_positions.size() + m_oldValues.size() + m_newValues.size()) * sizeof(uint32_t);
+    }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override { writeRaw(out, m_positions); writeRaw(out, m_oldValues); writeRaw(out, m_newValues); }
+    void readPayload(QDataStream& in) override { readRaw(in, m_positions); readRaw(in, m_oldValues); readRaw(in, m_newValues); }
+    void releasePayload() override { releaseRaw(m_positions); releaseRaw(m_oldValues); releaseRaw(m_newValues); }
+    
+private:
+    void apply(const CPooledArray<uint32_t>& values) {
+        if (!sameMapSize(m_map, m_mapSize)) return;
+        m_map->setTiles(m_positions.constData(), m_positions.size(), values.constData());
+        if (m_mapItem) m_mapItem->update(m_dirty);
+    }
+    
+    CMap* m_map;
+    QSize m_mapSize;
+    CPooledArray<uint32_t> m_positions;
+    CPooledArray<uint32_t> m_oldValues;
+    CPooledArray<uint32_t> m_newValues;
+    QRectF m_dirty;
+    QGraphicsItem* m_mapItem;
+};
+
+//-----------------------------------------------------------------------------
+// Writes a whole region in one step; the overwritten tiles are captured once
+// so paste and stamp are a single undo entry regardless of size.
+class RegionCommand : public CUndoCommand {
+public:
+    RegionCommand(CMap* map, int x, int y, const CTileRegion& region, QGraphicsItem* mapItem, const QString& text)
+        : m_map(map), m_x(x), m_y(y), m_region(region), m_mapItem(mapItem)
+    {
+        m_old = map->copyRegion(x, y, region.width, region.height);
+        m_oldX = std::max(0, x);
+        m_oldY = std::max(0, y);
+        setText(text);
+    }
+    
+    void doUndo() override {
+        m_map->blitRegion(m_oldX, m_oldY, m_old);
         if (m_mapItem) m_mapItem->update();
     }
     
-    void redo() override {
-        for (const auto& tile : m_tiles) {
-            m_map->setTile(tile.first, tile.second, m_newValue);
-        }
+    void doRedo() override {
+        m_map->blitRegion(m_x, m_y, m_region);
+        if (m_mapItem) m_mapItem->update();
+    }
+    
+protected:
+    size_t payloadSize() const override {
+        return (m_region.tiles.size() + m_old.tiles.size()) * sizeof(uint32_t);
+    }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override { writeRaw(out, m_region.tiles); writeRaw(out, m_old.tiles); }
+    void readPayload(QDataStream& in) override { readRaw(in, m_region.tiles); readRaw(in, m_old.tiles); }
+    void releasePayload() override { releaseRaw(m_region.tiles); releaseRaw(m_old.tiles); }
+    
+private:
+    CMap* m_map;
+    int m_x, m_y;
+    int m_oldX, m_oldY;
+    CTileRegion m_region;
+    CTileRegion m_old;
+    QGraphicsItem* m_mapItem;
+};
+
+//-----------------------------------------------------------------------------
+class FillRectCommand : public CUndoCommand {
+public:
+    FillRectCommand(CMap* map, const QRect& rect, uint32_t newValue, QGraphicsItem* mapItem, const QString& text)
+        : m_map(map), m_rect(rect), m_newValue(newValue), m_mapItem(mapItem)
+    {
+        m_old = map->copyRegion(rect.x(), rect.y(), rect.width(), rect.height());
+        setText(text);
+    }
+    
+    void doUndo() override {
+        m_map->blitRegion(m_rect.x(), m_rect.y(), m_old);
         if (m_mapItem) m_mapItem->update();
     }
     
+    void doRedo() override {
+        m_map->fillRect(m_rect.x(), m_rect.y(), m_rect.width(), m_rect.height(), m_newValue);
+        if (m_mapItem) m_mapItem->update();
+    }
+    
+protected:
+    size_t payloadSize() const override { return m_old.tiles.size() * sizeof(uint32_t); }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override { writeRaw(out, m_old.tiles); }
+    void readPayload(QDataStream& in) override { readRaw(in, m_old.tiles); }
+    void releasePayload() override { releaseRaw(m_old.tiles); }
+    
 private:
     CMap* m_map;
-    QVector<QPair<int, int>> m_tiles;
-    QVector<uint32_t> m_oldValues;
+    QRect m_rect;
+    CTileRegion m_old;
     uint32_t m_newValue;
     QGraphicsItem* m_mapItem;
 };
 
+//-----------------------------------------------------------------------------
+// Wraps an already applied replacement; only the changed-position bitmask
+// (and old ids for mapping tables) is kept for undo.
+class ReplaceTilesCommand : public CUndoCommand {
+public:
+    ReplaceTilesCommand(CMap* map, const CTileReplace& replace, const QRect& area, QGraphicsItem* mapItem)
+        : m_map(map), m_replace(replace), m_area(area), m_mapItem(mapItem)
+    {
+        setText(QString("Replace %1 tiles").arg(replace.changedCount()));
+    }
+    
+    void doUndo() override {
+        m_replace.revert(*m_map);
+        if (m_mapItem) m_mapItem->update();
+    }
+    
+    void doRedo() override {
+        if (m_applied) {
+            m_applied = false;
+            return;
+        }
+        m_replace.apply(*m_map, m_area);
+        if (m_mapItem) m_mapItem->update();
+    }
+    
+protected:
+    // The bitmask is already compact, so it is counted but kept resident
+    size_t payloadSize() const override { return m_replace.byteSize(); }
+    
+private:
+    CMap* m_map;
+    CTileReplace m_replace;
+    QRect m_area;
+    QGraphicsItem* m_mapItem;
+    bool m_applied = true;
+};
+
+//-----------------------------------------------------------------------------
+// Resizes around an offset. Only the strips of the old map that fall outside
+// the new bounds are stored; grown areas are simply cropped again on undo.
+class ResizeCommand : public CUndoCommand {
+public:
+    ResizeCommand(CMap* map, int newWidth, int newHeight, int offsetX, int offsetY, CMainView* view)
+        : m_map(map), m_oldWidth(map->width()), m_oldHeight(map->height()),
+          m_newWidth(newWidth), m_newHeight(newHeight), m_offsetX(offsetX), m_offsetY(offsetY), m_view(view)
+    {
+        setText(QString("Resize map to %1x%2").arg(newWidth).arg(newHeight));
+        
+        // Old-map rows [keepY0, keepY1) and columns [keepX0, keepX1) survive
+        int keepY0 = std::clamp(-offsetY, 0, m_oldHeight);
+        int keepY1 = std::clamp(newHeight - offsetY, keepY0, m_oldHeight);
+        int keepX0 = std::clamp(-offsetX, 0, m_oldWidth);
+        int keepX1 = std::clamp(newWidth - offsetX, keepX0, m_oldWidth);
+        addStrip(0, 0, m_oldWidth, keepY0);
+        addStrip(0, keepY1, m_oldWidth, m_oldHeight - keepY1);
+        addStrip(0, keepY0, keepX0, keepY1 - keepY0);
+        addStrip(keepX1, keepY0, m_oldWidth - keepX1, keepY1 - keepY0);
+    }
+    
+    void doUndo() override {
+        m_map->resize(m_oldWidth, m_oldHeight, 0, -m_offsetX, -m_offsetY);
+        for (const Strip& strip : m_strips)
+            m_map->blitRegion(strip.x, strip.y, strip.region);
+        m_map->objects().translate(-m_offsetX * Constants::DEFAULT_TILE_SIZE, -m_offsetY * Constants::DEFAULT_TILE_SIZE);
+        m_view->mapResized(QPoint(-m_offsetX, -m_offsetY));
+    }
+    
+    void doRedo() override {
+        m_map->resize(m_newWidth, m_newHeight, 0, m_offsetX, m_offsetY);
+        m_map->objects().translate(m_offsetX * Constants::DEFAULT_TILE_SIZE, m_offsetY * Constants::DEFAULT_TILE_SIZE);
+        m_view->mapResized(QPoint(m_offsetX, m_offsetY));
+    }
+    
+protected:
+    size_t payloadSize() const override {
+        size_t bytes = 0;
+        for (const Strip& strip : m_strips)
+            bytes += sizeof(Strip) + strip.region.tiles.size() * sizeof(uint32_t);
+        return bytes;
+    }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override {
+        for (const Strip& strip : m_strips)
+            writeRaw(out, strip.region.tiles);
+    }
+    void readPayload(QDataStream& in) override {
+        for (Strip& strip : m_strips)
+            readRaw(in, strip.region.tiles);
+    }
+    void releasePayload() override {
+        for (Strip& strip : m_strips)
+            releaseRaw(strip.region.tiles);
+    }
+    
+private:
+    struct Strip {
+        int x, y;
+        CTileRegion region;
+    };
+    
+    void addStrip(int x, int y, int w, int h) {
+        if (w > 0 && h > 0)
+            m_strips.append({ x, y, m_map->copyRegion(x, y, w, h) });
+    }
+    
+    CMap* m_map;
+    int m_oldWidth, m_oldHeight;
+    int m_newWidth, m_newHeight;
+    int m_offsetX, m_offsetY;
+    CMainView* m_view;
+    QVector<Strip> m_strips;
+};
+
+//-----------------------------------------------------------------------------
+namespace {
+    QByteArray encodeRegion(const CTileRegion& region)
+    {
+        QByteArray data;
+        QDataStream out(&data, QIODevice::WriteOnly);
+        out << qint32(region.width) << qint32(region.height);
+        out.writeRawData(reinterpret_cast<const char*>(region.tiles.data()), static_cast<int>(region.tiles.size() * sizeof(uint32_t)));
+        return data;
+    }
+
+    CTileRegion decodeRegion(const QByteArray& data)
+    {
+        CTileRegion region;
+        QDataStream in(data);
+        qint32 w = 0, h = 0;
+        in >> w >> h;
+        if (w <= 0 || h <= 0 || data.size() - 8 != qint64(w) * h * qint64(sizeof(uint32_t)))
+            return region;
+        region.width = w;
+        region.height = h;
+        region.tiles.resize(static_cast<size_t>(w) * h);
+        in.readRawData(reinterpret_cast<char*>(region.tiles.data()), static_cast<int>(region.tiles.size() * sizeof(uint32_t)));
+        return region;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class AddObjectCommand : public CUndoCommand {
+public:
+    AddObjectCommand(CMap* map, const CMapObject& object, QGraphicsItem* objectItem)
+        : m_map(map), m_object(object), m_objectItem(objectItem)
+    {
+        setText(QString("Add %1 object").arg(object.type));
+    }
+    
+    void doUndo() override {
+        m_map->objects().remove(m_object.id);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+    void doRedo() override {
+        // The first redo assigns the id; later ones reuse it
+        m_object.id = m_map->objects().add(m_object);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+private:
+    CMap* m_map;
+    CMapObject m_object;
+    QGraphicsItem* m_objectItem;
+};
+
+//-----------------------------------------------------------------------------
+class EditObjectCommand : public CUndoCommand {
+public:
+    EditObjectCommand(CMap* map, const CMapObject& before, const CMapObject& after, QGraphicsItem* objectItem)
+        : m_map(map), m_before(before), m_after(after), m_objectItem(objectItem)
+    {
+        setText(QString("Edit %1 object").arg(after.type));
+    }
+    
+    void doUndo() override {
+        m_map->objects().replace(m_before);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+    void doRedo() override {
+        m_map->objects().replace(m_after);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+private:
+    CMap* m_map;
+    CMapObject m_before;
+    CMapObject m_after;
+    QGraphicsItem* m_objectItem;
+};
+
+//-----------------------------------------------------------------------------
+class RemoveObjectsCommand : public CUndoCommand {
+public:
+    RemoveObjectsCommand(CMap* map, const QVector<uint32_t>& ids, QGraphicsItem* objectItem)
+        : m_map(map), m_objectItem(objectItem)
+    {
+        setText(QString("Remove %1 objects").arg(ids.size()));
+        m_objects.reserve(ids.size());
+        for (uint32_t id : ids) {
+            if (const CMapObject* obj = map->objects().object(id))
+                m_objects.append(*obj);
+        }
+    }
+    
+    void doUndo() override {
+        for (const CMapObject& obj : m_objects)
+            m_map->objects().add(obj);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+    void doRedo() override {
+        for (const CMapObject& obj : m_objects)
+            m_map->objects().remove(obj.id);
+        if (m_objectItem) m_objectItem->update();
+    }
+    
+protected:
+    size_t payloadSize() const override { return m_objects.size() * sizeof(CMapObject); }
+    
+private:
+    CMap* m_map;
+    QVector<CMapObject> m_objects;
+    QGraphicsItem* m_objectItem;
+};
+
+//-----------------------------------------------------------------------------
+// Applies another version of the map, such as a file rewritten on disk or the
+// result of a script. Only the diff rects are stored and repainted; a size
+// change stores both maps whole.
+class MapPatchCommand : public CUndoCommand {
+public:
+    MapPatchCommand(CMap* map, const CMap& incoming, const CMapDiffResult& diff, CMainView* view, const QString& text)
+        : m_map(map), m_oldWidth(map->width()), m_oldHeight(map->height()),
+          m_newWidth(incoming.width()), m_newHeight(incoming.height()), m_view(view)
+    {
+        setText(text);
+        if (diff.sizeChanged) {
+            m_oldPatches.append({ QRect(0, 0, m_oldWidth, m_oldHeight), map->copyRegion(0, 0, m_oldWidth, m_oldHeight) });
+            m_newPatches.append({ QRect(0, 0, m_newWidth, m_newHeight), incoming.copyRegion(0, 0, m_newWidth, m_newHeight) });
+        } else {
+            for (const QRect& r : diff.regions) {
+                m_oldPatches.append({ r, map->copyRegion(r.x(), r.y(), r.width(), r.height()) });
+                m_newPatches.append({ r, incoming.copyRegion(r.x(), r.y(), r.width(), r.height()) });
+            }
+        }
+        m_oldObjects = map->objects().objects();
+        m_newObjects = incoming.objects().objects();
+    }
+    
+    bool isEmpty() const { return m_oldPatches.isEmpty() && !objectsChanged(); }
+    
+    void doUndo() override {
+        apply(m_oldWidth, m_oldHeight, m_oldPatches, m_oldObjects);
+    }
+    
+    void doRedo() override {
+        apply(m_newWidth, m_newHeight, m_newPatches, m_newObjects);
+    }
+    
+protected:
+    size_t payloadSize() const override {
+        size_t bytes = 0;
+        for (const Patch& patch : m_oldPatches)
+            bytes += sizeof(Patch) + patch.region.tiles.size() * sizeof(uint32_t);
+        for (const Patch& patch : m_newPatches)
+            bytes += sizeof(Patch) + patch.region.tiles.size() * sizeof(uint32_t);
+        return bytes;
+    }
+    bool compressible() const override { return true; }
+    void writePayload(QDataStream& out) const override {
+        for (const Patch& patch : m_oldPatches)
+            writeRaw(out, patch.region.tiles);
+        for (const Patch& patch : m_newPatches)
+            writeRaw(out, patch.region.tiles);
+    }
+    void readPayload(QDataStream& in) override {
+        for (Patch& patch : m_oldPatches)
+            readRaw(in, patch.region.tiles);
+        for (Patch& patch : m_newPatches)
+            readRaw(in, patch.region.tiles);
+    }
+    void releasePayload() override {
+        for (Patch& patch : m_oldPatches)
+            releaseRaw(patch.region.tiles);
+        for (Patch& patch : m_newPatches)
+            releaseRaw(patch.region.tiles);
+    }
+    
+private:
+    struct Patch {
+        QRect rect;
+        CTileRegion region;
+    };
+    
+    bool objectsChanged() const {
+        if (m_oldObjects.size() != m_newObjects.size())
+            return true;
+        for (size_t i = 0; i < m_oldObjects.size(); ++i) {
+            const CMapObject& a = m_oldObjects[i];
+            const CMapObject& b = m_newObjects[i];
+            if (a.id != b.id || a.rect != b.rect || a.type != b.type || a.properties != b.properties)
+                return true;
+        }
+        return false;
+    }
+    
+    void apply(int w, int h, const QVector<Patch>& patches, const std::vector<CMapObject>& objects) {
+        bool resized = w != m_map->width() || h != m_map->height();
+        if (resized)
+            m_map->resize(w, h);
+        for (const Patch& patch : patches)
+            m_map->blitRegion(patch.rect.x(), patch.rect.y(), patch.region);
+        
+        bool objectsDiffer = objectsChanged();
+        if (objectsDiffer) {
+            m_map->objects().clear();
+            for (const CMapObject& obj : objects)
+                m_map->objects().add(obj);
+        }
+        
+        if (resized) {
+            m_view->mapResized();
+            return;
+        }
+        const int ts = Constants::DEFAULT_TILE_SIZE;
+        for (const Patch& patch : patches)
+            m_view->mapItem()->update(QRectF(patch.rect.x() * ts, patch.rect.y() * ts, patch.rect.width() * ts, patch.rect.height() * ts));
+        if (objectsDiffer)
+            m_view->objectItem()->update();
+    }
+    
+    CMap* m_map;
+    int m_oldWidth, m_oldHeight;
+    int m_newWidth, m_newHeight;
+    CMainView* m_view;
+    QVector<Patch> m_oldPatches;
+    QVector<Patch> m_newPatches;
+    std::vector<CMapObject> m_oldObjects;
+    std::vector<CMapObject> m_newObjects;
+};
+
 //-----------------------------------------------------------------------------
 CMainWindow::CMainWindow(QWidget* parent)
 : QMainWindow(parent)
@@ -97,16 +643,18 @@ CMainWindow::CMainWindow(QWidget* parent)
     resize(Constants::DEFAULT_WINDOW_WIDTH, Constants::DEFAULT_WINDOW_HEIGHT);
     setWindowTitle("MapEditor");
 
-    // central view
-    m_view = new CMainView(this);
-    setCentralWidget(m_view);
-    connect(m_view, &CMainView::mouseTileChanged, this, &CMainWindow::onMouseTileChanged);
-    connect(m_view, &CMainView::tileChanged, this, [this](int x, int y, uint32_t value, QGraphicsItem* item) {
-        m_undoStack->push(new SetTileCommand(m_map, x, y, value, item));
-    });
-    connect(m_view, &CMainView::fillApplied, this, [this](const QVector<QPair<int, int>>& tiles, uint32_t value, QGraphicsItem* item) {
-        m_undoStack->push(new FillCommand(m_map, tiles, value, item));
-    });
+    QSettings settings;
+    m_undoBudgetMB = std::clamp(settings.value("undo/memoryBudgetMB", int(Constants::UNDO_MEMORY_BUDGET >> 20)).toInt(),
+                                1, Constants::UNDO_MAX_LIMIT_MB);
+    m_undoSpillMB = std::clamp(settings.value("undo/spillThresholdMB", int(Constants::UNDO_SPILL_THRESHOLD >> 20)).toInt(),
+                               1, Constants::UNDO_MAX_LIMIT_MB);
+
+    // central tabs, one document per tab
+    m_tabs = new QTabWidget(this);
+    m_tabs->setDocumentMode(true);
+    m_tabs->setTabsClosable(true);
+    m_tabs->setMovable(true);
+    setCentralWidget(m_tabs);
 
     // Create actions
     QAction* newAct = new QAction(QIcon::fromTheme("document-new"), tr("&New map"), this);
@@ -133,10 +681,18 @@ CMainWindow::CMainWindow(QWidget* parent)
     saveAsAct->setShortcut(Qt::Key_F6);
     saveAsAct->setToolTip(tr("Save the map to a new file (F6)"));
     connect(saveAsAct, &QAction::triggered, this, &CMainWindow::onSaveMapAs);
+    
+    QAction* compareAct = new QAction(tr("&Compare with..."), this);
+    compareAct->setToolTip(tr("Highlight the tiles that differ from another map file"));
+    connect(compareAct, &QAction::triggered, this, &CMainWindow::onCompareWithFile);
+
+    QAction* exportPackAct = new QAction(tr("Export runtime &pack..."), this);
+    exportPackAct->setToolTip(tr("Write the map as chunks for streaming in the game"));
+    connect(exportPackAct, &QAction::triggered, this, &CMainWindow::onExportPack);
 
     QAction* prefsAct = new QAction(QIcon::fromTheme("document-properties"), tr("Map &preferences..."), this);
     prefsAct->setShortcut(Qt::Key_F9);
-    prefsAct->setToolTip(tr("Change map dimensions (F9)"));
+    prefsAct->setToolTip(tr("Change map dimensions and undo memory limits (F9)"));
     connect(prefsAct, &QAction::triggered, this, &CMainWindow::onMapPreferences);
 
     QAction* exitAct = new QAction(QIcon::fromTheme("application-exit"), tr("E&xit"), this);
@@ -144,21 +700,45 @@ CMainWindow::CMainWindow(QWidget* parent)
     exitAct->setToolTip(tr("Exit the application (Ctrl+Q)"));
     connect(exitAct, &QAction::triggered, this, &CMainWindow::onExit);
 
-    // Undo/Redo
-    m_undoStack = new QUndoStack(this);
-    QAction* undoAct = m_undoStack->createUndoAction(this, tr("&Undo"));
+    // Undo/Redo; each document has its own stack, the group follows the active one
+    m_undoGroup = new QUndoGroup(this);
+    m_workerPool = new QThreadPool(this);
+    m_workerPool->setMaxThreadCount(1);
+    m_scriptPool = new QThreadPool(this);
+    m_scriptPool->setMaxThreadCount(1);
+    m_thumbnails = new CThumbnailCache(this);
+
+    // External rewrites of the open map or tileset; writers often touch a
+    // file several times, so changes are collected for a short delay
+    m_fileWatcher = new QFileSystemWatcher(this);
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(Constants::FILE_WATCH_DELAY_MS);
+    connect(m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &CMainWindow::onWatchedFileChanged);
+    connect(m_reloadTimer, &QTimer::timeout, this, &CMainWindow::reloadChangedFiles);
+
+    // Live sync follows the document it was started on, not the active tab
+    m_sync = new CMapSync(this);
+    connect(m_sync, &CMapSync::regionsChanged, this, &CMainWindow::onSyncRegionsChanged);
+    connect(m_sync, &CMapSync::stopped, this, &CMainWindow::stopLiveSync);
+    connect(m_sync, &CMapSync::peersChanged, this, [this](int count) {
+        m_statusLabel->setText(tr("Live sync on %1: %2 peer(s)").arg(m_sync->channel()).arg(count));
+    });
+    QAction* undoAct = m_undoGroup->createUndoAction(this, tr("&Undo"));
     undoAct->setShortcut(QKeySequence::Undo);
     undoAct->setIcon(QIcon::fromTheme("edit-undo"));
     undoAct->setToolTip(tr("Undo last action (Ctrl+Z)"));
-    QAction* redoAct = m_undoStack->createRedoAction(this, tr("&Redo"));
+    QAction* redoAct = m_undoGroup->createRedoAction(this, tr("&Redo"));
     redoAct->setShortcut(QKeySequence::Redo);
     redoAct->setIcon(QIcon::fromTheme("edit-redo"));
     redoAct->setToolTip(tr("Redo last undone action (Ctrl+Y)"));
-    connect(m_undoStack, &QUndoStack::cleanChanged, this, [this](bool clean) {
-        if (!clean && !m_modified) {
-            m_modified = true;
-            updateWindowTitle();
-        }
+    connect(undoAct, &QAction::triggered, this, [this]() {
+        if (m_recorder)
+            m_recorder->record(CEditEvent::UNDO);
+    });
+    connect(redoAct, &QAction::triggered, this, [this]() {
+        if (m_recorder)
+            m_recorder->record(CEditEvent::REDO);
     });
 
     QAction* aboutAct = new QAction(QIcon::fromTheme("help-about"), tr("&About..."), this);
@@ -168,17 +748,17 @@ CMainWindow::CMainWindow(QWidget* parent)
     QAction* zoomInAct = new QAction(QIcon::fromTheme("zoom-in"), tr("Zoom &In"), this);
     zoomInAct->setShortcut(QKeySequence::ZoomIn);
     zoomInAct->setToolTip(tr("Zoom in (Ctrl++)"));
-    connect(zoomInAct, &QAction::triggered, m_view, &CMainView::zoomIn);
+    connect(zoomInAct, &QAction::triggered, this, [this]() { m_view->zoomIn(); });
 
     QAction* zoomOutAct = new QAction(QIcon::fromTheme("zoom-out"), tr("Zoom &Out"), this);
     zoomOutAct->setShortcut(QKeySequence::ZoomOut);
     zoomOutAct->setToolTip(tr("Zoom out (Ctrl+-)"));
-    connect(zoomOutAct, &QAction::triggered, m_view, &CMainView::zoomOut);
+    connect(zoomOutAct, &QAction::triggered, this, [this]() { m_view->zoomOut(); });
 
     QAction* resetViewAct = new QAction(QIcon::fromTheme("zoom-original"), tr("&Reset View"), this);
     resetViewAct->setShortcut(Qt::CTRL | Qt::Key_0);
     resetViewAct->setToolTip(tr("Reset zoom to 100% (Ctrl+0)"));
-    connect(resetViewAct, &QAction::triggered, m_view, &CMainView::resetZoom);
+    connect(resetViewAct, &QAction::triggered, this, [this]() { m_view->resetZoom(); });
 
     // Main Toolbar
     m_mainToolBar = addToolBar(tr("Main Toolbar"));
@@ -216,12 +796,129 @@ CMainWindow::CMainWindow(QWidget* parent)
     fillAct->setToolTip(tr("Fill adjacent tiles (F)"));
     connect(fillAct, &QAction::triggered, this, &CMainWindow::onFillTool);
     
+    QAction* objectAct = new QAction(QIcon::fromTheme("edit-select"), tr("&Objects"), this);
+    objectAct->setCheckable(true);
+    objectAct->setShortcut(Qt::Key_O);
+    objectAct->setToolTip(tr("Select objects, Ctrl+click to place (O)"));
+    connect(objectAct, &QAction::triggered, this, &CMainWindow::onObjectTool);
+    
+    QAction* selectAct = new QAction(QIcon::fromTheme("edit-select-all"), tr("&Select"), this);
+    selectAct->setCheckable(true);
+    selectAct->setShortcut(Qt::Key_S);
+    selectAct->setToolTip(tr("Select a rectangle of tiles (S)"));
+    connect(selectAct, &QAction::triggered, this, &CMainWindow::onSelectTool);
+    
+    m_stampToolAct = new QAction(QIcon::fromTheme("insert-image"), tr("S&tamp"), this);
+    m_stampToolAct->setCheckable(true);
+    m_stampToolAct->setShortcut(Qt::Key_B);
+    m_stampToolAct->setToolTip(tr("Stamp the pasted tile region (B)"));
+    connect(m_stampToolAct, &QAction::triggered, this, &CMainWindow::onStampTool);
+    
     QActionGroup* toolGroup = new QActionGroup(this);
     toolGroup->addAction(paintAct);
     toolGroup->addAction(fillAct);
+    toolGroup->addAction(objectAct);
+    toolGroup->addAction(selectAct);
+    toolGroup->addAction(m_stampToolAct);
     
     m_toolsToolBar->addAction(paintAct);
     m_toolsToolBar->addAction(fillAct);
+    m_toolsToolBar->addAction(objectAct);
+    m_toolsToolBar->addAction(selectAct);
+    m_toolsToolBar->addAction(m_stampToolAct);
+
+    QComboBox* objectTypeCombo = new QComboBox(this);
+    objectTypeCombo->setEditable(true);
+    objectTypeCombo->setToolTip(tr("Type of placed objects"));
+    for (const char* type : Constants::OBJECT_TYPES)
+        objectTypeCombo->addItem(QString::fromLatin1(type));
+    objectTypeCombo->setCurrentText(m_objectType);
+    connect(objectTypeCombo, &QComboBox::currentTextChanged, this, [this](const QString& text) {
+        QString type = text.trimmed();
+        if (type.isEmpty()) return;
+        m_objectType = type;
+        for (const auto& doc : m_documents)
+            doc->view->setObjectType(m_objectType);
+    });
+    m_toolsToolBar->addWidget(objectTypeCombo);
+
+    QAction* copyAct = new QAction(QIcon::fromTheme("edit-copy"), tr("&Copy"), this);
+    copyAct->setShortcut(QKeySequence::Copy);
+    copyAct->setToolTip(tr("Copy selected tiles (Ctrl+C)"));
+    connect(copyAct, &QAction::triggered, this, &CMainWindow::onCopy);
+    
+    QAction* cutAct = new QAction(QIcon::fromTheme("edit-cut"), tr("Cu&t"), this);
+    cutAct->setShortcut(QKeySequence::Cut);
+    cutAct->setToolTip(tr("Cut selected tiles (Ctrl+X)"));
+    connect(cutAct, &QAction::triggered, this, &CMainWindow::onCut);
+    
+    QAction* pasteAct = new QAction(QIcon::fromTheme("edit-paste"), tr("&Paste"), this);
+    pasteAct->setShortcut(QKeySequence::Paste);
+    pasteAct->setToolTip(tr("Paste tiles as a stamp brush (Ctrl+V)"));
+    connect(pasteAct, &QAction::triggered, this, &CMainWindow::onPaste);
+    
+    QAction* selectAllAct = new QAction(tr("Select &all"), this);
+    selectAllAct->setShortcut(QKeySequence::SelectAll);
+    selectAllAct->setToolTip(tr("Select the whole map (Ctrl+A)"));
+    connect(selectAllAct, &QAction::triggered, this, &CMainWindow::onSelectAll);
+    
+    QAction* fillSelectionAct = new QAction(tr("Fill s&election"), this);
+    fillSelectionAct->setShortcut(Qt::SHIFT | Qt::Key_F);
+    fillSelectionAct->setToolTip(tr("Fill the selection with the current tile (Shift+F)"));
+    connect(fillSelectionAct, &QAction::triggered, this, &CMainWindow::onFillSelection);
+    
+    QAction* replaceAct = new QAction(QIcon::fromTheme("edit-find-replace"), tr("&Replace tiles..."), this);
+    replaceAct->setShortcut(QKeySequence::Replace);
+    replaceAct->setToolTip(tr("Replace tile ids across the map or selection (Ctrl+H)"));
+    connect(replaceAct, &QAction::triggered, this, &CMainWindow::onReplaceTiles);
+
+    QAction* deleteObjectsAct = new QAction(QIcon::fromTheme("edit-delete"), tr("&Delete objects"), this);
+    deleteObjectsAct->setShortcut(QKeySequence::Delete);
+    deleteObjectsAct->setToolTip(tr("Delete selected objects (Del)"));
+    connect(deleteObjectsAct, &QAction::triggered, this, [this]() { m_view->removeSelectedObjects(); });
+
+    QAction* objectPropertiesAct = new QAction(tr("Object p&roperties..."), this);
+    objectPropertiesAct->setShortcut(Qt::ALT | Qt::Key_Return);
+    objectPropertiesAct->setToolTip(tr("Edit the type and properties of the selected object (Alt+Enter)"));
+    connect(objectPropertiesAct, &QAction::triggered, this, [this]() { m_view->editSelectedObject(); });
+
+    QAction* autotileAct = new QAction(tr("&Autotile"), this);
+    autotileAct->setCheckable(true);
+    autotileAct->setShortcut(Qt::Key_A);
+    autotileAct->setToolTip(tr("Pick terrain variants from their neighbours while painting (A)"));
+    connect(autotileAct, &QAction::toggled, this, [this](bool on) { m_autotileEnabled = on; });
+    
+    QAction* loadAutotileAct = new QAction(tr("Load autotile &rules..."), this);
+    loadAutotileAct->setToolTip(tr("Load blob autotile rules for the current tileset"));
+    connect(loadAutotileAct, &QAction::triggered, this, &CMainWindow::onLoadAutotileRules);
+    
+    QAction* generateAct = new QAction(tr("&Generate..."), this);
+    generateAct->setShortcut(Qt::CTRL | Qt::Key_G);
+    generateAct->setToolTip(tr("Fill the map or selection with noise or caves (Ctrl+G)"));
+    connect(generateAct, &QAction::triggered, this, &CMainWindow::onGenerate);
+    
+    m_checkPathsAct = new QAction(tr("Check &paths..."), this);
+    m_checkPathsAct->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_P);
+    m_checkPathsAct->setToolTip(tr("Check that all marked objects can reach each other (Ctrl+Shift+P)"));
+    connect(m_checkPathsAct, &QAction::triggered, this, &CMainWindow::onCheckPaths);
+    
+    QAction* clearOverlaysAct = new QAction(tr("C&lear overlays"), this);
+    clearOverlaysAct->setToolTip(tr("Remove path and diff overlays from the map"));
+    connect(clearOverlaysAct, &QAction::triggered, this, &CMainWindow::onClearOverlays);
+    
+    m_liveSyncAct = new QAction(tr("&Live sync..."), this);
+    m_liveSyncAct->setCheckable(true);
+    m_liveSyncAct->setToolTip(tr("Share edits to the current map with other editors and game runners on this machine"));
+    connect(m_liveSyncAct, &QAction::triggered, this, &CMainWindow::onLiveSync);
+
+    m_recordAct = new QAction(tr("&Record edit session"), this);
+    m_recordAct->setCheckable(true);
+    m_recordAct->setToolTip(tr("Record input to the current map, to replay it later with 'MapEditor replay'"));
+    connect(m_recordAct, &QAction::triggered, this, &CMainWindow::onRecordSession);
+    
+    QAction* countSolidAct = new QAction(tr("Count &solid tiles"), this);
+    countSolidAct->setToolTip(tr("Count tiles marked solid in the tile properties"));
+    connect(countSolidAct, &QAction::triggered, this, &CMainWindow::onCountSolidTiles);
 
     // Tile selection shortcuts
     for (int i = 0; i < 10; ++i) {
@@ -251,8 +948,17 @@ CMainWindow::CMainWindow(QWidget* parent)
     fileMenu->addAction(openTilesetAct);
     fileMenu->addSeparator();
     fileMenu->addAction(openAct);
+    m_recentMenu = fileMenu->addMenu(tr("Open &recent"));
+    connect(m_recentMenu, &QMenu::aboutToShow, this, &CMainWindow::updateRecentMenu);
+    connect(m_thumbnails, &CThumbnailCache::thumbnailReady, this, [this](const QString& path, const QImage& image) {
+        for (QAction* action : m_recentMenu->actions())
+            if (action->data().toString() == path)
+                action->setIcon(QIcon(QPixmap::fromImage(image)));
+    });
     fileMenu->addAction(saveAct);
     fileMenu->addAction(saveAsAct);
+    fileMenu->addAction(compareAct);
+    fileMenu->addAction(exportPackAct);
     fileMenu->addSeparator();
     fileMenu->addAction(prefsAct);
     fileMenu->addSeparator();
@@ -262,11 +968,36 @@ CMainWindow::CMainWindow(QWidget* parent)
     QMenu* editMenu = menuBar()->addMenu(tr("&Edit"));
     editMenu->addAction(undoAct);
     editMenu->addAction(redoAct);
+    editMenu->addSeparator();
+    editMenu->addAction(cutAct);
+    editMenu->addAction(copyAct);
+    editMenu->addAction(pasteAct);
+    editMenu->addSeparator();
+    editMenu->addAction(selectAllAct);
+    editMenu->addAction(fillSelectionAct);
+    editMenu->addAction(replaceAct);
+    editMenu->addSeparator();
+    editMenu->addAction(deleteObjectsAct);
+    editMenu->addAction(objectPropertiesAct);
     
     // Tools menu
     QMenu* toolsMenu = menuBar()->addMenu(tr("&Tools"));
     toolsMenu->addAction(paintAct);
     toolsMenu->addAction(fillAct);
+    toolsMenu->addAction(objectAct);
+    toolsMenu->addAction(selectAct);
+    toolsMenu->addAction(m_stampToolAct);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(autotileAct);
+    toolsMenu->addAction(loadAutotileAct);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(generateAct);
+    toolsMenu->addAction(countSolidAct);
+    toolsMenu->addAction(m_checkPathsAct);
+    toolsMenu->addAction(clearOverlaysAct);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(m_liveSyncAct);
+    toolsMenu->addAction(m_recordAct);
 
     // View menu
     QMenu* viewMenu = menuBar()->addMenu(tr("&View"));
@@ -282,131 +1013,510 @@ CMainWindow::CMainWindow(QWidget* parent)
     QMenu* helpMenu = menuBar()->addMenu(tr("&Help"));
     helpMenu->addAction(aboutAct);
 
-    // map model
-    m_map = new CMap();
-    m_map->resize(Constants::DEFAULT_NEW_MAP_WIDTH, Constants::DEFAULT_NEW_MAP_HEIGHT, 0);
-    m_view->setMap(m_map);
+    // analysis dock, hidden until asked for; it follows the active document
+    m_analysisDock = new CAnalysisDock(this);
+    addDockWidget(Qt::RightDockWidgetArea, m_analysisDock);
+    m_analysisDock->hide();
+    connect(m_analysisDock, &CAnalysisDock::overlayChanged, this, [this](const QImage& overlay) {
+        m_view->setRegionOverlay(overlay);
+    });
+    QAction* analysisAct = m_analysisDock->toggleViewAction();
+    analysisAct->setShortcut(Qt::Key_F8);
+    viewMenu->addSeparator();
+    viewMenu->addAction(analysisAct);
+
+    // Script console; scripts run on the worker against a copy of the map
+    m_scriptRunner = std::make_unique<CScriptRunner>();
+    m_scriptDock = new CScriptDock(this);
+    addDockWidget(Qt::BottomDockWidgetArea, m_scriptDock);
+    m_scriptDock->hide();
+    connect(m_scriptDock, &CScriptDock::runRequested, this, &CMainWindow::onRunScript);
+    connect(m_scriptDock, &CScriptDock::stopRequested, this, [this]() { m_scriptRunner->interrupt(); });
+    QAction* scriptAct = m_scriptDock->toggleViewAction();
+    scriptAct->setShortcut(Qt::Key_F7);
+    viewMenu->addAction(scriptAct);
 
     // status bar
     m_positionLabel = new QLabel(this);
     m_positionLabel->setMinimumWidth(100);
     statusBar()->addWidget(m_positionLabel);
     
+    m_historyLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_historyLabel);
+    
     m_statusLabel = new QLabel(this);
     statusBar()->addPermanentWidget(m_statusLabel);
     m_statusLabel->setText(tr("Ready"));
+
+    // first document
+    connect(m_tabs, &QTabWidget::currentChanged, this, &CMainWindow::onTabChanged);
+    connect(m_tabs, &QTabWidget::tabCloseRequested, this, &CMainWindow::onTabCloseRequested);
+    setActiveDocument(createDocument());
 }
 
 //-----------------------------------------------------------------------------
 CMainWindow::~CMainWindow()
 {
-    delete m_map;
+    m_scriptRunner->cancel();
+    m_scriptPool->waitForDone();
+    m_workerPool->waitForDone();
+    m_sync->stop();
+
+    // Histories and stacks go before the maps their commands point into
+    for (const std::unique_ptr<CDocument>& doc : m_documents) {
+        delete doc->undoHistory;
+        delete doc->undoStack;
+    }
 }
 
 //-----------------------------------------------------------------------------
-void CMainWindow::onExit()
+// Views only emit while their tab is active, so the handlers work on the
+// active document through m_map and m_undoStack.
+void CMainWindow::connectView(CMainView* view)
 {
-    close();
+    connect(view, &CMainView::mouseTileChanged, this, &CMainWindow::onMouseTileChanged);
+    connect(view, &CMainView::framePainted, this, &CMainWindow::framePainted);
+    auto autotileTiles = [this](const QVector<QPair<int, int>>& tiles, uint32_t value, const QString& text,
+                                QGraphicsItem* item) {
+        m_editPositions.clear();
+        m_editPositions.reserve(static_cast<size_t>(tiles.size()) * 9);
+        for (const auto& tile : tiles)
+            appendRectPositions(QRect(tile.first - 1, tile.second - 1, 3, 3), m_editPositions);
+        pushAutotiledEdit(m_editPositions, [&]() {
+            for (const auto& tile : tiles)
+                m_map->setTile(tile.first, tile.second, value);
+            m_autotile.applyTiles(*m_map, tiles);
+        }, text, item);
+    };
+    // A stroke arrives as one batch per input frame, pushed as one command
+    connect(view, &CMainView::tilesPainted, this, [this, autotileTiles](const QVector<QPair<int, int>>& tiles, uint32_t value, QGraphicsItem* item) {
+        if (autotiling()) {
+            autotileTiles(tiles, value, tiles.size() == 1 ? tr("Autotile (%1, %2)").arg(tiles[0].first).arg(tiles[0].second)
+                                                         : tr("Autotile paint %1 tiles").arg(tiles.size()), item);
+            return;
+        }
+        if (tiles.size() == 1)
+            m_undoStack->push(new SetTileCommand(m_map, tiles[0].first, tiles[0].second, value, item));
+        else
+            m_undoStack->push(new FillCommand(m_map, tiles, value, item, tr("Paint %1 tiles").arg(tiles.size())));
+    });
+    connect(view, &CMainView::fillApplied, this, [this, autotileTiles](const QVector<QPair<int, int>>& tiles, uint32_t value, QGraphicsItem* item) {
+        if (autotiling()) {
+            autotileTiles(tiles, value, tr("Autotile fill %1 tiles").arg(tiles.size()), item);
+            return;
+        }
+        m_undoStack->push(new FillCommand(m_map, tiles, value, item));
+    });
+    // A stamp drag is one undo step, a macro opened by its first stamp
+    connect(view, &CMainView::regionStamped, this, [this](int x, int y, const CTileRegion& region, QGraphicsItem* item) {
+        QString text = tr("Stamp %1x%2").arg(region.width).arg(region.height);
+        if (!m_stampStack) {
+            m_stampStack = m_undoStack;
+            m_stampStack->beginMacro(text);
+        }
+        if (autotiling()) {
+            QRect rect(x, y, region.width, region.height);
+            m_editPositions.clear();
+            appendRectPositions(rect.adjusted(-1, -1, 1, 1), m_editPositions);
+            pushAutotiledEdit(m_editPositions, [&]() {
+                m_map->blitRegion(x, y, region);
+                m_autotile.applyRect(*m_map, rect);
+            }, text, item);
+            return;
+        }
+        m_undoStack->push(new RegionCommand(m_map, x, y, region, item, text));
+    });
+    connect(view, &CMainView::strokeFinished, this, &CMainWindow::endStampStroke);
+    connect(view, &CMainView::objectAdded, this, [this](const CMapObject& object, QGraphicsItem* item) {
+        m_undoStack->push(new AddObjectCommand(m_map, object, item));
+    });
+    connect(view, &CMainView::objectsRemoved, this, [this](const QVector<uint32_t>& ids, QGraphicsItem* item) {
+        m_undoStack->push(new RemoveObjectsCommand(m_map, ids, item));
+    });
+    connect(view, &CMainView::objectEditRequested, this, [this](uint32_t id, QGraphicsItem* item) {
+        const CMapObject* object = m_map->objects().object(id);
+        if (!object) return;
+        CObjectPropertiesDialog dlg(*object, this);
+        if (dlg.exec() != QDialog::Accepted) return;
+        // The dialog is modal, but a live sync or reload may have run meanwhile
+        const CMapObject* current = m_map->objects().object(id);
+        CMapObject edited = dlg.object();
+        if (!current || (current->type == edited.type && current->properties == edited.properties)) return;
+        edited.rect = current->rect;
+        m_undoStack->push(new EditObjectCommand(m_map, *current, edited, item));
+    });
 }
 
 //-----------------------------------------------------------------------------
-void CMainWindow::onAbout()
+// New documents start at the default size and share the active document's
+// tileset, so opening more maps costs no tileset decoding.
+CDocument* CMainWindow::createDocument()
 {
-    QMessageBox::about(this, tr("About MapEditor"), tr("A handy tileset Map Editor\nby Andrzej Pływaczyk (C) 2026\nandrzej.plywaczyk@gmail.com\nGNU General Public License v3.0"));
-}
+    auto doc = std::make_unique<CDocument>();
+    doc->map = std::make_unique<CMap>(Constants::DEFAULT_NEW_MAP_WIDTH, Constants::DEFAULT_NEW_MAP_HEIGHT);
+    doc->savedHash = doc->map->contentHash();
+    if (m_doc) {
+        doc->tileset = m_doc->tileset;
+        doc->tileCount = m_doc->tileCount;
+    }
+
+    doc->view = new CMainView(m_tabs);
+    doc->view->setTileset(doc->tileset);
+    doc->view->setMap(doc->map.get());
+    doc->view->setSelectedTile(m_selectedTile);
+    doc->view->setTool(m_currentTool);
+    doc->view->setObjectType(m_objectType);
+    connectView(doc->view);
+
+    CDocument* raw = doc.get();
+    doc->undoStack = new QUndoStack(this);
+    m_undoGroup->addStack(doc->undoStack);
+    connect(doc->undoStack, &QUndoStack::indexChanged, this, [this, raw]() {
+        updateModified(raw);
+        if (raw == m_doc)
+            m_analysisDock->mapEdited();
+        if (raw == m_syncDoc)
+            m_sync->mapEdited();
+    });
+    doc->undoHistory = new CUndoHistory(doc->undoStack, this);
+    applyUndoLimits(doc->undoHistory);
+    connect(doc->undoHistory, &CUndoHistory::memoryChanged, this, [this, raw](qint64 resident, qint64 compressed, qint64 spilled) {
+        if (raw == m_doc)
+            onHistoryMemoryChanged(resident, compressed, spilled);
+    });
+    connect(doc->undoHistory, &CUndoHistory::historyLost, this, [this, raw]() {
+        m_statusLabel->setText(tr("Undo history of %1 cleared: an old edit could not be read back")
+                                   .arg(m_tabs->tabText(m_tabs->indexOf(raw->view))));
+    });
+
+    m_documents.push_back(std::move(doc));
+    m_tabs->addTab(raw->view, QString());
+    updateTabText(raw);
+    return raw;
+}
 
 //-----------------------------------------------------------------------------
-void CMainWindow::onNewMap()
+void CMainWindow::endStampStroke()
 {
-    if (m_modified) {
-        QMessageBox::StandardButton res = QMessageBox::question(
-            this, tr("Clear map"), tr("This will clear the map. Are you sure?"),
-            QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
-        if (res != QMessageBox::Yes)
-            return;
+    if (!m_stampStack) return;
+    m_stampStack->endMacro();
+    m_stampStack = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::setActiveDocument(CDocument* doc)
+{
+    if (m_tabs->currentWidget() != doc->view) {
+        // Re-enters through onTabChanged
+        m_tabs->setCurrentWidget(doc->view);
+        return;
     }
-    m_currentMapPath.clear();
-    m_map->clear(0);
-    m_view->setMap(m_map);
-    if (!m_tileset.isNull()) {
-        m_view->setTileset(m_tileset);
+    if (doc == m_doc)
+        return;
+    endStampStroke();
+    // A recording covers one view
+    if (m_recordDoc)
+        stopRecording();
+
+    // The stamp brush follows the user across tabs
+    if (m_view) {
+        m_view->setRegionOverlay(QImage());
+        if (!m_view->stamp().isEmpty())
+            doc->view->setStamp(m_view->stamp());
     }
-    m_undoStack->clear();
-    m_modified = false;
-    m_statusLabel->setText(tr("New map"));
+    m_doc = doc;
+    m_map = doc->map.get();
+    m_view = doc->view;
+    m_undoStack = doc->undoStack;
+    m_undoGroup->setActiveStack(m_undoStack);
+    m_view->setSelectedTile(m_selectedTile);
+    m_view->setTool(m_currentTool);
+
+    // Tile properties and autotile rules belong to the tileset file
+    int paletteSize = doc->tileset ? doc->tileCount : Constants::PALETTE_TILE_COUNT;
+    if (doc->tilesetPath() != m_sidecarTilesetPath || m_paletteButtons.size() != paletteSize) {
+        m_sidecarTilesetPath = doc->tilesetPath();
+        loadTileProperties();
+        if (m_sidecarTilesetPath.isEmpty())
+            m_autotile.clear();
+        else
+            loadAutotileRules(CAutotile::sidecarPath(m_sidecarTilesetPath));
+        createPalette();
+    } else {
+        updatePalette();
+    }
+
+    m_analysisDock->setMap(m_map);
+    CUndoHistory* history = doc->undoHistory;
+    onHistoryMemoryChanged(history->residentBytes(), history->compressedBytes(), history->spilledBytes());
     updateWindowTitle();
 }
 
+//-----------------------------------------------------------------------------
+void CMainWindow::onTabChanged(int index)
+{
+    if (CDocument* doc = documentAt(index))
+        setActiveDocument(doc);
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onTabCloseRequested(int index)
+{
+    if (CDocument* doc = documentAt(index))
+        closeDocument(doc);
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::closeDocument(CDocument* doc)
+{
+    if (!maybeSave(doc, tr("%1 has unsaved changes. Save before closing?")))
+        return false;
+
+    // The editor always has a document to work on
+    if (m_documents.size() == 1)
+        createDocument();
+
+    auto it = std::find_if(m_documents.begin(), m_documents.end(),
+                           [doc](const std::unique_ptr<CDocument>& d) { return d.get() == doc; });
+    std::unique_ptr<CDocument> closing = std::move(*it);
+    m_documents.erase(it);
+    if (closing.get() == m_syncDoc)
+        stopLiveSync(tr("Live sync stopped: its map was closed"));
+    if (closing.get() == m_recordDoc)
+        stopRecording();
+    if (closing.get() == m_scriptDoc)
+        m_scriptDoc = nullptr;
+    if (closing->undoStack == m_stampStack)
+        endStampStroke();
+    if (closing.get() == m_doc) {
+        m_doc = nullptr;
+        m_map = nullptr;
+        m_view = nullptr;
+        m_undoStack = nullptr;
+    }
+    m_tabs->removeTab(m_tabs->indexOf(closing->view));
+    m_undoGroup->removeStack(closing->undoStack);
+    delete closing->undoHistory;
+    delete closing->undoStack;
+    delete closing->view;
+    // The closed history's payloads went to the pool's free lists; the
+    // other documents are unlikely to ask for the same sizes
+    CPayloadPool::trim();
+    if (!m_doc)
+        setActiveDocument(documentAt(m_tabs->currentIndex()));
+    watchFiles();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Asks to save a modified document; false means the user cancelled
+bool CMainWindow::maybeSave(CDocument* doc, const QString& question)
+{
+    if (!doc->modified)
+        return true;
+    setActiveDocument(doc);
+    QString name = doc->path.isEmpty() ? tr("The map") : QFileInfo(doc->path).fileName();
+    QMessageBox::StandardButton res = QMessageBox::question(
+        this, tr("Unsaved changes"), question.arg(name),
+        QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel, QMessageBox::Save);
+    if (res == QMessageBox::Save)
+        return onSaveMap();
+    return res == QMessageBox::Discard;
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::isPristine(const CDocument* doc) const
+{
+    return doc && doc->path.isEmpty() && !doc->modified && doc->undoStack->count() == 0;
+}
+
+//-----------------------------------------------------------------------------
+CDocument* CMainWindow::findDocument(const QString& path) const
+{
+    for (const std::unique_ptr<CDocument>& doc : m_documents) {
+        if (!doc->path.isEmpty() && doc->path == path)
+            return doc.get();
+    }
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+CDocument* CMainWindow::documentAt(int tabIndex) const
+{
+    QWidget* widget = m_tabs->widget(tabIndex);
+    for (const std::unique_ptr<CDocument>& doc : m_documents) {
+        if (doc->view == widget)
+            return doc.get();
+    }
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onExit()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onAbout()
+{
+    QMessageBox::about(this, tr("About MapEditor"), tr("A handy tileset Map Editor\nby Andrzej Pływaczyk (C) 2026\nandrzej.plywaczyk@gmail.com\nGNU General Public License v3.0"));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onNewMap()
+{
+    setActiveDocument(createDocument());
+    m_statusLabel->setText(tr("New map"));
+}
+
 //-----------------------------------------------------------------------------
 void CMainWindow::onOpenMap()
 {
-    if (m_modified) {
-        QMessageBox::StandardButton res = QMessageBox::question(
-            this, tr("Unsaved changes"), tr("The map has unsaved changes. Save before opening?"),
-            QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel, QMessageBox::Save);
-        if (res == QMessageBox::Save) {
-            if (!onSaveMap()) {
-                return;
-            }
-        } else if (res == QMessageBox::Cancel) {
-            return;
-        }
+    QString directory = m_doc->path.isEmpty() ? QString() : QFileInfo(m_doc->path).path();
+    CMapFileDialog dlg(m_thumbnails, tr("Open map"), directory, this);
+    if (dlg.exec() == QDialog::Accepted && !dlg.selectedFiles().isEmpty())
+        openMap(dlg.selectedFiles().first());
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::addRecentFile(const QString& path)
+{
+    QSettings settings;
+    QStringList files = settings.value("recentFiles").toStringList();
+    const QString absolute = QFileInfo(path).absoluteFilePath();
+    files.removeAll(absolute);
+    files.prepend(absolute);
+    while (files.size() > Constants::RECENT_FILES_MAX)
+        files.removeLast();
+    settings.setValue("recentFiles", files);
+}
+
+//-----------------------------------------------------------------------------
+// Rebuilt each time the menu opens; thumbnails missing from the cache are
+// requested here and fill in while the menu is open
+void CMainWindow::updateRecentMenu()
+{
+    m_recentMenu->clear();
+    QSettings settings;
+    const QStringList files = settings.value("recentFiles").toStringList();
+    int number = 0;
+    for (const QString& path : files) {
+        if (!QFileInfo::exists(path))
+            continue;
+        ++number;
+        QAction* action = m_recentMenu->addAction(QString("&%1 %2").arg(number).arg(QFileInfo(path).fileName()));
+        action->setData(path);
+        action->setToolTip(path);
+        QImage thumbnail = m_thumbnails->thumbnail(path);
+        if (!thumbnail.isNull())
+            action->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+        connect(action, &QAction::triggered, this, [this, path]() { openMap(path); });
     }
-    QString path = QFileDialog::getOpenFileName(this, tr("Open map"), QString(), tr("Map files (*.json);;All files (*)"));
-    if (!path.isEmpty()) {
-        QFile f(path);
-        if (!f.open(QFile::ReadOnly)) {
-            QMessageBox::warning(this, tr("Open map"), tr("Failed to open file: %1").arg(path));
-            return;
-        }
-        QByteArray data = f.readAll();
-        f.close();
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(data, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject()) {
-            QMessageBox::warning(this, tr("Open map"), tr("Failed to parse JSON: %1").arg(err.errorString()));
-            return;
-        }
-        if (!m_map->fromJson(doc.object())) {
-            QMessageBox::warning(this, tr("Open map"), tr("Invalid map file: %1").arg(path));
-            return;
-        }
-        m_view->setMap(m_map);
-        if (!m_tileset.isNull()) {
-            m_view->setTileset(m_tileset);
-        }
-        m_undoStack->clear();
-        m_currentMapPath = path;
-        m_modified = false;
-        m_statusLabel->setText(tr("Opened: %1").arg(path));
-        updateWindowTitle();
+    if (number == 0) {
+        m_recentMenu->addAction(tr("No recent maps"))->setEnabled(false);
+        return;
+    }
+    m_recentMenu->addSeparator();
+    connect(m_recentMenu->addAction(tr("&Clear list")), &QAction::triggered, this, []() {
+        QSettings().remove("recentFiles");
+    });
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::openMap(const QString& path)
+{
+    if (CDocument* existing = findDocument(path)) {
+        setActiveDocument(existing);
+        return true;
+    }
+
+    // Taken before reading, so a write racing the read shows up as a change
+    QString stamp = CMapHash::fileStamp(path);
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly)) {
+        QMessageBox::warning(this, tr("Open map"), tr("Failed to open file: %1").arg(path));
+        return false;
+    }
+    QByteArray data = f.readAll();
+    f.close();
+    QJsonParseError err;
+    QJsonDocument json = QJsonDocument::fromJson(data, &err);
+    if (err.error != QJsonParseError::NoError || !json.isObject()) {
+        QMessageBox::warning(this, tr("Open map"), tr("Failed to parse JSON: %1").arg(err.errorString()));
+        return false;
+    }
+    CMap loaded;
+    if (!loaded.fromJson(json.object())) {
+        QMessageBox::warning(this, tr("Open map"), tr("Invalid map file: %1").arg(path));
+        return false;
     }
+
+    // An untouched new map is replaced rather than kept in its own tab
+    CDocument* doc = isPristine(m_doc) ? m_doc : createDocument();
+    *doc->map = std::move(loaded);
+    doc->view->setMap(doc->map.get());
+    doc->undoStack->clear();
+    doc->path = path;
+    doc->savedHash = doc->map->contentHash();
+    doc->savedStamp = stamp;
+    doc->modified = false;
+    if (doc == m_syncDoc)
+        m_sync->resync();
+    updateTabText(doc);
+    setActiveDocument(doc);
+    m_analysisDock->setMap(m_map);
+    onClearOverlays();
+    updateWindowTitle();
+    watchFiles();
+    addRecentFile(path);
+    m_statusLabel->setText(tr("Opened: %1").arg(path));
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 bool CMainWindow::onSaveMap()
 {
-    if (m_currentMapPath.isEmpty()) {
+    if (m_doc->path.isEmpty()) {
         onSaveMapAs();
-        return !m_modified;
+        return !m_doc->modified;
+    }
+    const QString& path = m_doc->path;
+
+    // Nothing to write if the map matches what we last saved or loaded and
+    // the file is still the one we wrote or read then.
+    uint64_t hash = m_map->contentHash();
+    if (hash == m_doc->savedHash && !m_doc->savedStamp.isEmpty()
+            && m_doc->savedStamp == CMapHash::fileStamp(path)) {
+        m_undoStack->setClean();
+        m_doc->modified = false;
+        m_statusLabel->setText(tr("No changes to save: %1").arg(path));
+        updateTabText(m_doc);
+        updateWindowTitle();
+        return true;
     }
+
     QJsonObject obj = m_map->toJson();
     QJsonDocument doc(obj);
     QByteArray data = doc.toJson(QJsonDocument::Indented);
-    QFile f(m_currentMapPath);
+    QFile f(path);
     if (!f.open(QFile::WriteOnly)) {
-        QMessageBox::warning(this, tr("Save map"), tr("Failed to open file for writing: %1").arg(m_currentMapPath));
+        QMessageBox::warning(this, tr("Save map"), tr("Failed to open file for writing: %1").arg(path));
         return false;
     }
     if (f.write(data) != data.size()) {
-        QMessageBox::warning(this, tr("Save map"), tr("Failed to write file: %1").arg(m_currentMapPath));
+        QMessageBox::warning(this, tr("Save map"), tr("Failed to write file: %1").arg(path));
         f.close();
         return false;
     }
     f.close();
     m_undoStack->setClean();
-    m_modified = false;
-    m_statusLabel->setText(tr("Saved: %1").arg(m_currentMapPath));
+    m_doc->savedHash = hash;
+    m_doc->savedStamp = CMapHash::fileStamp(path);
+    m_doc->modified = false;
+    watchFiles();
+    m_statusLabel->setText(tr("Saved: %1").arg(path));
+    updateTabText(m_doc);
     updateWindowTitle();
     return true;
 }
@@ -415,31 +1525,31 @@ bool CMainWindow::onSaveMap()
 void CMainWindow::onSaveMapAs()
 {
     QString path = QFileDialog::getSaveFileName(this, tr("Save map as"), QString(), tr("Map files (*.json);;All files (*)"));
-    if (!path.isEmpty()) {
-        m_currentMapPath = path;
-        onSaveMap();
+    if (path.isEmpty())
+        return;
+    CDocument* other = findDocument(path);
+    if (other && other != m_doc) {
+        QMessageBox::warning(this, tr("Save map as"), tr("%1 is open in another tab.").arg(QFileInfo(path).fileName()));
+        return;
     }
+    m_doc->path = path;
+    m_doc->savedStamp.clear();
+    if (onSaveMap())
+        addRecentFile(path);
 }
 
 //-----------------------------------------------------------------------------
 void CMainWindow::closeEvent(QCloseEvent* event)
 {
-    if (m_modified) {
-        QMessageBox::StandardButton res = QMessageBox::question(
-            this, tr("Unsaved changes"), tr("The map has unsaved changes. Save before exit?"),
-            QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel, QMessageBox::Save);
-        if (res == QMessageBox::Save) {
-            if (!onSaveMap()) {
-                event->ignore();
-                return;
-            }
-            event->accept();
-        } else if (res == QMessageBox::Discard) {
-            event->accept();
-        } else {
+    for (const std::unique_ptr<CDocument>& doc : m_documents) {
+        if (!maybeSave(doc.get(), tr("%1 has unsaved changes. Save before exit?"))) {
             event->ignore();
+            return;
         }
     }
+    if (m_recorder)
+        stopRecording();
+    writeSession();
     QMainWindow::closeEvent(event);
 }
 
@@ -448,24 +1558,130 @@ void CMainWindow::onOpenTileset()
 {
     QString path = QFileDialog::getOpenFileName(this, tr("Open tileset"), QString(), tr("Images (*.png *.jpg *.bmp);;All files (*)"));
     if (!path.isEmpty()) {
-        QImage img(path);
+        QImage img = CTilesetCache::image(path);
         if (img.isNull()) {
             QMessageBox::warning(this, tr("Open tileset"), tr("Failed to load image: %1").arg(path));
         } else {
             CTilesetSettingsDialog dlg(img, this);
             if (dlg.exec() == QDialog::Accepted) {
-                m_tileset = img;
-                m_tileSize = dlg.tileSize();
-                m_tileCount = dlg.tileCount();
-                m_view->setTileSize(m_tileSize);
-                m_view->setTileset(img);
-                createPalette();
+                setDocumentTileset(m_doc, CTilesetCache::acquire(path, dlg.tileSize(), img), dlg.tileCount());
                 m_statusLabel->setText(tr("Loaded tileset: %1").arg(path));
             }
         }
     }
 }
 
+//-----------------------------------------------------------------------------
+void CMainWindow::setDocumentTileset(CDocument* doc, const std::shared_ptr<const CTileset>& tileset, int tileCount)
+{
+    doc->tileset = tileset;
+    doc->tileCount = tileCount;
+    doc->view->setTileset(tileset);
+    if (doc == m_doc) {
+        m_sidecarTilesetPath = doc->tilesetPath();
+        loadTileProperties();
+        if (m_sidecarTilesetPath.isEmpty())
+            m_autotile.clear();
+        else
+            loadAutotileRules(CAutotile::sidecarPath(m_sidecarTilesetPath));
+        createPalette();
+    }
+    watchFiles();
+}
+
+//-----------------------------------------------------------------------------
+// Files named on the command line replace the last session
+void CMainWindow::openFiles(const QStringList& maps, const QString& tilesetPath, int tileSize, int tileCount,
+                            CPhaseLog* log)
+{
+    for (const QString& path : maps)
+        openMap(path);
+    if (log)
+        log->mark(tr("%n map(s) opened", nullptr, maps.size()));
+    if (tilesetPath.isEmpty())
+        return;
+
+    std::shared_ptr<const CTileset> tileset = CTilesetCache::acquire(tilesetPath, tileSize);
+    if (!tileset) {
+        QMessageBox::warning(this, tr("Open tileset"), tr("Failed to load image: %1").arg(tilesetPath));
+        return;
+    }
+    if (tileCount <= 0)
+        tileCount = std::clamp(static_cast<int>(tileset->tiles.size()), 1, Constants::MAX_PALETTE_TILE_COUNT);
+    for (const std::unique_ptr<CDocument>& doc : m_documents)
+        setDocumentTileset(doc.get(), tileset, tileCount);
+    if (log)
+        log->mark(tr("tileset loaded"));
+}
+
+//-----------------------------------------------------------------------------
+// Documents come back from the cache's raw cells while their files are
+// unchanged; anything else is opened from disk as usual
+void CMainWindow::restoreSession(CPhaseLog* log)
+{
+    CSession session;
+    QString error;
+    if (!CSessionCache::read(CSessionCache::defaultFile(), session, &error)) {
+        if (!error.isEmpty())
+            qWarning() << "Ignoring session cache:" << error;
+        return;
+    }
+    if (log)
+        log->mark(tr("session read"));
+
+    QVector<CDocument*> restored;
+    int missing = 0;
+    for (CSessionDocument& entry : session.documents) {
+        if (!QFileInfo::exists(entry.path) || findDocument(entry.path)) {
+            ++missing;
+            continue;
+        }
+        if (entry.map) {
+            CDocument* doc = isPristine(m_doc) ? m_doc : createDocument();
+            *doc->map = std::move(*entry.map);
+            doc->view->setMap(doc->map.get());
+            doc->path = entry.path;
+            doc->savedHash = entry.hash;
+            // The cache is only used while the file has the stamp it was cached with
+            doc->savedStamp = CMapHash::fileStamp(entry.path);
+            doc->modified = false;
+            updateTabText(doc);
+            setActiveDocument(doc);
+        } else if (!openMap(entry.path)) {
+            ++missing;
+            continue;
+        }
+        setDocumentTileset(m_doc, entry.tileset, entry.tileset ? entry.tileCount : Constants::PALETTE_TILE_COUNT);
+        m_doc->view->setViewState(entry.zoom, entry.center);
+        restored.append(m_doc);
+    }
+
+    if (restored.isEmpty()) {
+        if (session.tileset)
+            setDocumentTileset(m_doc, session.tileset, session.tileCount);
+    } else {
+        setActiveDocument(restored.value(session.active, restored.first()));
+    }
+    m_analysisDock->setMap(m_map);
+    watchFiles();
+    updateWindowTitle();
+    if (log)
+        log->mark(tr("%n document(s) restored", nullptr, restored.size()));
+    if (missing)
+        m_statusLabel->setText(tr("%n file(s) of the last session could not be reopened", nullptr, missing));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::writeSession()
+{
+    QVector<const CDocument*> documents;
+    for (int i = 0; i < m_tabs->count(); ++i)
+        documents.append(documentAt(i));
+    QString error;
+    if (!CSessionCache::write(CSessionCache::defaultFile(), documents, m_tabs->currentIndex(), &error))
+        qWarning() << "Cannot write session cache:" << error;
+}
+
 //-----------------------------------------------------------------------------
 void CMainWindow::createPalette()
 {
@@ -479,14 +1695,16 @@ void CMainWindow::createPalette()
     m_paletteToolBar = addToolBar(tr("Tile Palette"));
     m_paletteToolBar->setMovable(true);
     
-    int buttonCount = m_tileset.isNull() ? Constants::PALETTE_TILE_COUNT : m_tileCount;
+    int buttonCount = m_doc && m_doc->tileset ? m_doc->tileCount : Constants::PALETTE_TILE_COUNT;
     
     for (int i = 0; i < buttonCount; ++i) {
         QToolButton* btn = new QToolButton(this);
         btn->setCheckable(true);
         btn->setFixedSize(Constants::DEFAULT_TILE_SIZE + 4, Constants::DEFAULT_TILE_SIZE + 4);
         btn->setProperty("tileIndex", i);
+        btn->setContextMenuPolicy(Qt::CustomContextMenu);
         connect(btn, &QToolButton::clicked, this, &CMainWindow::onTileSelected);
+        connect(btn, &QToolButton::customContextMenuRequested, this, [this, i]() { onEditTileProperties(i); });
         m_paletteButtons.append(btn);
         m_paletteToolBar->addWidget(btn);
     }
@@ -499,32 +1717,17 @@ void CMainWindow::createPalette()
 //-----------------------------------------------------------------------------
 void CMainWindow::updatePalette()
 {
-    static const QColor colors[] = {
-        Qt::white, Qt::black, Qt::red, Qt::green, Qt::blue, Qt::yellow,
-        Qt::cyan, Qt::magenta, Qt::gray, Qt::darkRed, Qt::darkGreen, Qt::darkBlue
-    };
-    
     for (int i = 0; i < m_paletteButtons.size(); ++i) {
         QPixmap pixmap(Constants::DEFAULT_TILE_SIZE, Constants::DEFAULT_TILE_SIZE);
         
-        if (m_tileset.isNull()) {
+        const QPixmap* tile = m_doc && m_doc->tileset ? m_doc->tileset->tile(static_cast<uint32_t>(i + 1)) : nullptr;
+        if (!m_doc || !m_doc->tileset) {
             // No tileset - use colors
-            pixmap.fill(colors[i % Constants::PALETTE_TILE_COUNT]);
+            pixmap.fill(QColor::fromRgb(Constants::TILE_COLORS[i % Constants::TILE_COLOR_COUNT]));
+        } else if (tile) {
+            pixmap = tile->scaled(Constants::DEFAULT_TILE_SIZE, Constants::DEFAULT_TILE_SIZE, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
         } else {
-            // Extract tile from tileset using configured tile size
-            int tilesPerRow = m_tileset.width() / m_tileSize;
-            if (tilesPerRow > 0) {
-                int tx = (i % tilesPerRow) * m_tileSize;
-                int ty = (i / tilesPerRow) * m_tileSize;
-                if (tx + m_tileSize <= m_tileset.width() && ty + m_tileSize <= m_tileset.height()) {
-                    QImage tile = m_tileset.copy(tx, ty, m_tileSize, m_tileSize);
-                    pixmap = QPixmap::fromImage(tile.scaled(Constants::DEFAULT_TILE_SIZE, Constants::DEFAULT_TILE_SIZE, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-                } else {
-                    pixmap.fill(Qt::lightGray);
-                }
-            } else {
-                pixmap.fill(Qt::lightGray);
-            }
+            pixmap.fill(Qt::lightGray);
         }
         
         m_paletteButtons[i]->setIcon(QIcon(pixmap));
@@ -549,23 +1752,546 @@ void CMainWindow::onTileSelected()
     btn->setChecked(true);
 }
 
+//-----------------------------------------------------------------------------
+void CMainWindow::onEditTileProperties(int index)
+{
+    uint32_t id = static_cast<uint32_t>(index + 1);
+    CTilePropertiesDialog dlg(id, m_tileProperties.flags(id), m_tileProperties.damage(id), m_tileProperties.cost(id), this);
+    if (dlg.exec() == QDialog::Accepted) {
+        m_tileProperties.setFlags(id, dlg.flags());
+        m_tileProperties.setDamage(id, dlg.damage());
+        m_tileProperties.setCost(id, dlg.cost());
+        if (m_sidecarTilesetPath.isEmpty())
+            m_statusLabel->setText(tr("Tile %1 properties changed (no tileset to save them with)").arg(id));
+        else if (saveTileProperties())
+            m_statusLabel->setText(tr("Saved tile properties: %1").arg(CTileProperties::sidecarPath(m_sidecarTilesetPath)));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::loadTileProperties()
+{
+    m_tileProperties.clear();
+    QFile f(CTileProperties::sidecarPath(m_sidecarTilesetPath));
+    if (f.open(QFile::ReadOnly)) {
+        QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+        if (!doc.isObject() || !m_tileProperties.fromJson(doc.object()))
+            qWarning() << "Ignoring invalid tile properties file" << f.fileName();
+    }
+    m_tileProperties.resize(std::max(m_tileProperties.size(), m_doc->tileCount + 1));
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::saveTileProperties()
+{
+    QString path = CTileProperties::sidecarPath(m_sidecarTilesetPath);
+    QByteArray data = QJsonDocument(m_tileProperties.toJson()).toJson(QJsonDocument::Indented);
+    QFile f(path);
+    if (!f.open(QFile::WriteOnly) || f.write(data) != data.size()) {
+        QMessageBox::warning(this, tr("Tile properties"), tr("Failed to write file: %1").arg(path));
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onCheckPaths()
+{
+    // Solid tiles are blocked unless the user has chosen otherwise
+    if (m_pathBlockedIds.isEmpty()) {
+        QStringList solid;
+        for (int id = 0; id < m_tileProperties.size(); ++id)
+            if (m_tileProperties.flags(id) & CTileProperties::FLAG_SOLID)
+                solid.append(QString::number(id));
+        m_pathBlockedIds = solid.join(", ");
+    }
+
+    CPathCheckDialog dlg(m_pathBlockedIds, m_pathMarkerTypes, this);
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+    m_pathBlockedIds = dlg.blockedIdsText();
+    m_pathMarkerTypes = dlg.markerTypesText();
+
+    QVector<uint32_t> objectIds;
+    QVector<QPoint> points = CPathfinder::markerTiles(*m_map, dlg.markerTypes(), &objectIds);
+    if (points.size() < 2) {
+        QMessageBox::information(this, tr("Check paths"), tr("At least two marker objects are needed."));
+        return;
+    }
+
+    // The bitmap is a snapshot, so the search does not touch the map while
+    // the user keeps editing
+    auto grid = std::make_shared<CWalkability>(*m_map, dlg.blockedIds());
+    m_checkPathsAct->setEnabled(false);
+    m_statusLabel->setText(tr("Checking %1 marker pairs...").arg(points.size() * (points.size() - 1) / 2));
+    QPointer<CMainView> view = m_view;
+    m_workerPool->start([this, view, grid, points, objectIds]() {
+        QElapsedTimer timer;
+        timer.start();
+        QVector<CPathResult> results = CPathfinder::checkAllPairs(*grid, points);
+        double ms = timer.nsecsElapsed() / 1.0e6;
+        QMetaObject::invokeMethod(this, [this, view, results, points, objectIds, ms]() {
+            showPathResults(view, results, points, objectIds, ms);
+        }, Qt::QueuedConnection);
+    });
+}
+
+//-----------------------------------------------------------------------------
+// The view is null when its tab was closed while the search ran
+void CMainWindow::showPathResults(CMainView* view, const QVector<CPathResult>& results, const QVector<QPoint>& points,
+                                  const QVector<uint32_t>& objectIds, double ms)
+{
+    m_checkPathsAct->setEnabled(true);
+
+    QVector<QVector<QPoint>> paths;
+    QVector<QLine> failures;
+    QStringList report;
+    for (const CPathResult& r : results) {
+        if (r.reachable) {
+            paths.append(r.path);
+            continue;
+        }
+        failures.append(QLine(points[r.from], points[r.to]));
+        report.append(tr("Object %1 (%2, %3) cannot reach object %4 (%5, %6)")
+            .arg(objectIds[r.from]).arg(points[r.from].x()).arg(points[r.from].y())
+            .arg(objectIds[r.to]).arg(points[r.to].x()).arg(points[r.to].y()));
+    }
+    if (view)
+        view->setPathOverlay(paths, failures);
+    m_statusLabel->setText(tr("Paths: %1 of %2 pairs reachable (%3 ms)")
+        .arg(paths.size()).arg(results.size()).arg(ms, 0, 'f', 2));
+
+    if (!report.isEmpty()) {
+        const int shown = 20;
+        QString text = report.mid(0, shown).join("\n");
+        if (report.size() > shown)
+            text += tr("\n... and %1 more").arg(report.size() - shown);
+        QMessageBox::warning(this, tr("Check paths"), text);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onClearOverlays()
+{
+    m_view->setPathOverlay({}, {});
+    m_view->setDiffOverlay({});
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onExportPack()
+{
+    QString suggested;
+    if (!m_doc->path.isEmpty()) {
+        QFileInfo info(m_doc->path);
+        suggested = info.path() + "/" + info.completeBaseName() + "." + Constants::PACK_FILE_SUFFIX;
+    }
+    QString path = QFileDialog::getSaveFileName(this, tr("Export runtime pack"), suggested,
+                                                tr("Runtime packs (*.%1);;All files (*)").arg(Constants::PACK_FILE_SUFFIX));
+    if (path.isEmpty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    CMapPackStats stats;
+    QString error;
+    if (!CMapPack::write(*m_map, path, CMapPackOptions(), &stats, &error)) {
+        QMessageBox::warning(this, tr("Export runtime pack"), error);
+        return;
+    }
+    double ms = timer.nsecsElapsed() / 1.0e6;
+    m_statusLabel->setText(tr("Exported %1: %2 chunks (%3 empty, %4 uniform), %5 KB (%6 ms)")
+        .arg(QFileInfo(path).fileName()).arg(stats.chunks).arg(stats.emptyChunks).arg(stats.uniformChunks)
+        .arg((stats.bytes + 1023) / 1024).arg(ms, 0, 'f', 1));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onCompareWithFile()
+{
+    QString path = QFileDialog::getOpenFileName(this, tr("Compare with map"), QString(), tr("Map files (*.json);;All files (*)"));
+    if (path.isEmpty())
+        return;
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly)) {
+        QMessageBox::warning(this, tr("Compare"), tr("Failed to open file: %1").arg(path));
+        return;
+    }
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    CMap other;
+    if (!doc.isObject() || !other.fromJson(doc.object())) {
+        QMessageBox::warning(this, tr("Compare"), tr("Invalid map file: %1").arg(path));
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    CMapDiffResult diff = CMapDiff::diff(other, *m_map);
+    double ms = timer.nsecsElapsed() / 1.0e6;
+    m_view->setDiffOverlay(diff.regions);
+    if (diff.isEmpty())
+        m_statusLabel->setText(tr("No differences from %1 (%2 ms)").arg(QFileInfo(path).fileName()).arg(ms, 0, 'f', 2));
+    else
+        m_statusLabel->setText(tr("%1 tiles differ in %2 regions from %3%4 (%5 ms)")
+            .arg(diff.changedTiles).arg(diff.regions.size()).arg(QFileInfo(path).fileName())
+            .arg(diff.sizeChanged ? tr(", size differs") : QString()).arg(ms, 0, 'f', 2));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onLiveSync(bool enabled)
+{
+    if (!enabled) {
+        stopLiveSync(tr("Live sync stopped"));
+        return;
+    }
+    bool ok = false;
+    QString channel = QInputDialog::getText(this, tr("Live sync"),
+        tr("Channel name (editors on the same channel share the map; joining replaces yours):"),
+        QLineEdit::Normal, Constants::DEFAULT_SYNC_CHANNEL, &ok).trimmed();
+    QString error;
+    if (!ok || channel.isEmpty() || !m_sync->start(channel, m_map, &error)) {
+        m_liveSyncAct->setChecked(false);
+        if (!error.isEmpty())
+            QMessageBox::warning(this, tr("Live sync"), tr("Cannot open channel %1: %2").arg(channel, error));
+        return;
+    }
+    m_syncDoc = m_doc;
+    m_statusLabel->setText(m_sync->isHost() ? tr("Live sync: hosting channel %1").arg(channel)
+                                            : tr("Live sync: joined channel %1").arg(channel));
+}
+
+//-----------------------------------------------------------------------------
+// The script edits a copy on its own thread, so the map stays usable; the
+// cells the copy changed against the snapshot are pushed as one undo step,
+// leaving edits made meanwhile to other cells alone.
+void CMainWindow::onRunScript(const QString& source)
+{
+    if (m_scriptRunning)
+        return;
+    m_scriptRunning = true;
+    m_scriptDoc = m_doc;
+    m_scriptDock->setRunning(true);
+    m_statusLabel->setText(tr("Running script..."));
+
+    auto before = std::make_shared<const CMap>(*m_map);
+    auto work = std::make_shared<CMap>(*before);
+    m_scriptPool->start([this, source, before, work]() {
+        CScriptRunner::Result result = m_scriptRunner->run(source, *work);
+        QMetaObject::invokeMethod(this, [this, result, before, work]() {
+            finishScript(result, *before, *work);
+        }, Qt::QueuedConnection);
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::finishScript(const CScriptRunner::Result& result, const CMap& before, const CMap& after)
+{
+    m_scriptRunning = false;
+    m_scriptDock->setRunning(false);
+    CDocument* doc = m_scriptDoc;
+    m_scriptDoc = nullptr;
+
+    const QString ms = QString::number(result.ms, 'f', 1);
+    if (!result.ok) {
+        m_scriptDock->showResult(result.output, tr("%1 (%2 ms)").arg(result.error, ms));
+        m_statusLabel->setText(tr("Script failed: %1").arg(result.error));
+        return;
+    }
+    CMapDiffResult diff = CMapDiff::diff(before, after);
+    m_scriptDock->showResult(result.output, tr("Done: %1 tiles changed (%2 ms)").arg(diff.changedTiles).arg(ms));
+    if (!doc) {
+        m_statusLabel->setText(tr("Script finished after its map was closed"));
+        return;
+    }
+    if (diff.isEmpty())
+        return;
+    if (doc->map->width() != before.width() || doc->map->height() != before.height()) {
+        m_statusLabel->setText(tr("Script discarded: the map was resized while it ran"));
+        return;
+    }
+
+    // Only the cells the script wrote go onto the map as it is now, so edits
+    // made meanwhile inside the same rects survive. Scripts only write tiles;
+    // objects stay as the document has them.
+    CMap merged(*doc->map);
+    QVector<uint32_t> was, now, row;
+    for (const QRect& r : diff.regions) {
+        was.resize(r.width());
+        now.resize(r.width());
+        row.resize(r.width());
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            before.readRow(y, r.x(), r.width(), was.data());
+            after.readRow(y, r.x(), r.width(), now.data());
+            merged.readRow(y, r.x(), r.width(), row.data());
+            for (int i = 0; i < r.width(); ++i) {
+                if (now[i] != was[i])
+                    row[i] = now[i];
+            }
+            merged.writeRow(y, r.x(), r.width(), row.data());
+        }
+    }
+    CMapDiffResult patch = CMapDiff::diff(*doc->map, merged);
+    if (patch.isEmpty())
+        return;
+    doc->undoStack->push(new MapPatchCommand(doc->map.get(), merged, patch, doc->view,
+                                             tr("Script (%1 tiles)").arg(diff.changedTiles)));
+    m_statusLabel->setText(tr("Script changed %1 tiles in %2 ms").arg(diff.changedTiles).arg(ms));
+}
+
+//-----------------------------------------------------------------------------
+// Recording starts from the map and view as they are now; the events stay in
+// memory until recording stops and they are saved
+void CMainWindow::onRecordSession(bool enabled)
+{
+    if (!enabled) {
+        stopRecording();
+        return;
+    }
+    CEditRecording start;
+    start.map = m_map->toJson();
+    start.tilesetPath = m_doc->tilesetPath();
+    start.tileSize = m_doc->tileset ? m_doc->tileset->tileSize : Constants::DEFAULT_TILE_SIZE;
+    start.tileCount = m_doc->tileCount;
+    start.autotile = m_autotileEnabled;
+    start.viewSize = m_view->viewport()->size();
+    start.zoom = m_view->zoom();
+    start.center = m_view->viewCenter();
+    start.tool = m_currentTool;
+    start.tile = m_selectedTile;
+    m_recorder = std::make_unique<CEditRecorder>(start);
+    m_recordDoc = m_doc;
+    m_view->setRecorder(m_recorder.get());
+    m_statusLabel->setText(tr("Recording edit session"));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::stopRecording()
+{
+    std::unique_ptr<CEditRecorder> recorder = std::move(m_recorder);
+    if (m_recordDoc)
+        m_recordDoc->view->setRecorder(nullptr);
+    m_recordDoc = nullptr;
+    m_recordAct->setChecked(false);
+    if (!recorder)
+        return;
+
+    const CEditRecording& recording = recorder->recording();
+    QString path = QFileDialog::getSaveFileName(this, tr("Save edit recording"), QString(),
+                                                tr("Edit recordings (*.%1)").arg(Constants::RECORDING_FILE_SUFFIX));
+    if (path.isEmpty()) {
+        m_statusLabel->setText(tr("Edit recording discarded"));
+        return;
+    }
+    if (QFileInfo(path).suffix().isEmpty())
+        path += QString(".") + Constants::RECORDING_FILE_SUFFIX;
+    QString error;
+    if (!recording.save(path, &error)) {
+        QMessageBox::warning(this, tr("Save edit recording"), error);
+        return;
+    }
+    m_statusLabel->setText(tr("Recorded %n event(s) to %1", nullptr, static_cast<int>(recording.events.size())).arg(path));
+}
+
+//-----------------------------------------------------------------------------
+// Like opening a map, but from the recording's starting map and with its
+// tileset, tool and view, for CEditReplayer
+CDocument* CMainWindow::openRecording(const CEditRecording& recording, QString* error)
+{
+    CMap loaded;
+    if (!loaded.fromJson(recording.map)) {
+        if (error)
+            *error = QString("Invalid starting map in recording");
+        return nullptr;
+    }
+    std::shared_ptr<const CTileset> tileset;
+    if (!recording.tilesetPath.isEmpty()) {
+        tileset = CTilesetCache::acquire(recording.tilesetPath, recording.tileSize);
+        if (!tileset) {
+            if (error)
+                *error = QString("Cannot load tileset %1").arg(recording.tilesetPath);
+            return nullptr;
+        }
+    }
+
+    CDocument* doc = isPristine(m_doc) ? m_doc : createDocument();
+    *doc->map = std::move(loaded);
+    doc->view->setMap(doc->map.get());
+    doc->undoStack->clear();
+    doc->path.clear();
+    doc->savedHash = doc->map->contentHash();
+    doc->modified = false;
+    setActiveDocument(doc);
+    if (tileset)
+        setDocumentTileset(doc, tileset, recording.tileCount);
+
+    m_autotileEnabled = recording.autotile;
+    m_currentTool = recording.tool;
+    m_selectedTile = recording.tile;
+    doc->view->setTool(m_currentTool);
+    doc->view->setSelectedTile(m_selectedTile);
+    doc->view->setViewState(recording.zoom, recording.center);
+    updateTabText(doc);
+    m_analysisDock->setMap(m_map);
+    updateWindowTitle();
+    return doc;
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::stopLiveSync(const QString& message)
+{
+    m_sync->stop();
+    m_syncDoc = nullptr;
+    m_liveSyncAct->setChecked(false);
+    m_statusLabel->setText(message);
+}
+
+//-----------------------------------------------------------------------------
+// Remote edits are already in the map; only the rects they wrote repaint
+void CMainWindow::onSyncRegionsChanged(const QVector<QRect>& rects, bool resized)
+{
+    CDocument* doc = m_syncDoc;
+    if (resized) {
+        // Local commands address tiles by position in the old size, so they
+        // cannot be replayed over the new one
+        if (doc->undoStack == m_stampStack)
+            endStampStroke();
+        if (doc->undoStack->count() > 0) {
+            doc->undoStack->clear();
+            m_statusLabel->setText(tr("A peer resized the map to %1x%2; undo history cleared")
+                                       .arg(doc->map->width()).arg(doc->map->height()));
+        }
+        doc->view->mapResized();
+    } else {
+        const int ts = Constants::DEFAULT_TILE_SIZE;
+        for (const QRect& r : rects)
+            doc->view->mapItem()->update(QRectF(r.x() * ts, r.y() * ts, r.width() * ts, r.height() * ts));
+    }
+    updateModified(doc);
+    if (doc == m_doc)
+        m_analysisDock->mapEdited();
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::loadAutotileRules(const QString& path)
+{
+    m_autotile.clear();
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return false;
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    if (!doc.isObject() || !m_autotile.fromJson(doc.object(), m_doc->tileCount)) {
+        qWarning() << "Ignoring invalid autotile rules file" << path;
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onLoadAutotileRules()
+{
+    QString path = QFileDialog::getOpenFileName(this, tr("Load autotile rules"), QString(), tr("Autotile rules (*.json);;All files (*)"));
+    if (path.isEmpty())
+        return;
+    if (loadAutotileRules(path))
+        m_statusLabel->setText(tr("Loaded autotile rules: %1").arg(path));
+    else
+        QMessageBox::warning(this, tr("Autotile rules"), tr("Invalid autotile rules file: %1").arg(path));
+}
+
+//-----------------------------------------------------------------------------
+bool CMainWindow::autotiling() const
+{
+    return m_autotileEnabled && m_autotile.hasRules();
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::appendRectPositions(const QRect& rect, CPooledArray<uint32_t>& positions) const
+{
+    QRect area = rect.intersected(QRect(0, 0, m_map->width(), m_map->height()));
+    if (area.isEmpty())
+        return;
+    positions.reserve(positions.size() + static_cast<size_t>(area.width()) * area.height());
+    for (int y = area.top(); y <= area.bottom(); ++y)
+        for (int x = area.left(); x <= area.right(); ++x)
+            positions.append(static_cast<uint32_t>(y) * m_map->width() + x);
+}
+
+//-----------------------------------------------------------------------------
+// Runs an edit plus autotiling on the map, records what actually changed at
+// the given positions, rolls it back and pushes it as one command. positions
+// is sorted in place; the values before the edit go to a scratch buffer kept
+// across edits, so only the command's own arrays come from the pool.
+void CMainWindow::pushAutotiledEdit(CPooledArray<uint32_t>& positions, const std::function<void()>& edit,
+                                    const QString& text, QGraphicsItem* item)
+{
+    std::sort(positions.begin(), positions.end());
+    positions.resize(static_cast<size_t>(std::unique(positions.begin(), positions.end()) - positions.begin()));
+
+    // The edit may promote the map's cells, so tiles are read by position
+    const int w = m_map->width();
+    auto tileAt = [this, w](uint32_t position) {
+        return m_map->tileAt(static_cast<int>(position % w), static_cast<int>(position / w));
+    };
+    CPooledArray<uint32_t>& before = m_editBefore;
+    before.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+        before[i] = tileAt(positions[i]);
+
+    edit();
+
+    CPooledArray<uint32_t> changed, oldValues, newValues;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        uint32_t after = tileAt(positions[i]);
+        if (after != before[i]) {
+            changed.append(positions[i]);
+            oldValues.append(before[i]);
+            newValues.append(after);
+        }
+    }
+    for (size_t i = 0; i < changed.size(); ++i)
+        m_map->setTile(static_cast<int>(changed[i] % w), static_cast<int>(changed[i] / w), oldValues[i]);
+
+    if (!changed.isEmpty())
+        m_undoStack->push(new TileChangesCommand(m_map, std::move(changed), std::move(oldValues), std::move(newValues), item, text));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onCountSolidTiles()
+{
+    QElapsedTimer timer;
+    timer.start();
+    size_t count = m_tileProperties.countFlag(*m_map, CTileProperties::FLAG_SOLID);
+    double ms = timer.nsecsElapsed() / 1.0e6;
+    m_statusLabel->setText(tr("Solid tiles: %1 of %2 (%3 ms)").arg(count).arg(m_map->tileCount()).arg(ms, 0, 'f', 2));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::applyUndoLimits(CUndoHistory* history) const
+{
+    history->setMemoryBudget(qint64(m_undoBudgetMB) << 20);
+    history->setSpillThreshold(qint64(m_undoSpillMB) << 20);
+}
+
 //-----------------------------------------------------------------------------
 void CMainWindow::onMapPreferences()
 {
-    CMapPreferencesDialog dlg(m_map->width(), m_map->height(), this);
+    CMapPreferencesDialog dlg(m_map->width(), m_map->height(), m_undoBudgetMB, m_undoSpillMB, this);
     if (dlg.exec() == QDialog::Accepted) {
+        if (dlg.undoBudgetMB() != m_undoBudgetMB || dlg.undoSpillMB() != m_undoSpillMB) {
+            m_undoBudgetMB = dlg.undoBudgetMB();
+            m_undoSpillMB = dlg.undoSpillMB();
+            QSettings settings;
+            settings.setValue("undo/memoryBudgetMB", m_undoBudgetMB);
+            settings.setValue("undo/spillThresholdMB", m_undoSpillMB);
+            for (const auto& doc : m_documents)
+                applyUndoLimits(doc->undoHistory);
+        }
         int newWidth = dlg.width();
         int newHeight = dlg.height();
         if (newWidth != m_map->width() || newHeight != m_map->height()) {
-            m_map->resize(newWidth, newHeight, 0);
-            m_view->setMap(m_map);
-            if (!m_tileset.isNull()) {
-                m_view->setTileset(m_tileset);
-            }
-            m_undoStack->clear();
-            m_modified = true;
+            // Anchor column/row 0, 1, 2 keep the left/centre/right (top/middle/bottom) edge in place
+            int offsetX = (newWidth - m_map->width()) * dlg.anchorColumn() / 2;
+            int offsetY = (newHeight - m_map->height()) * dlg.anchorRow() / 2;
+            m_undoStack->push(new ResizeCommand(m_map, newWidth, newHeight, offsetX, offsetY, m_view));
             m_statusLabel->setText(tr("Map resized to %1x%2 — Modified").arg(newWidth).arg(newHeight));
-            updateWindowTitle();
         }
     }
 }
@@ -590,15 +2316,314 @@ void CMainWindow::onFillTool()
     m_view->setTool(Constants::TOOL_FILL);
 }
 
+//-----------------------------------------------------------------------------
+void CMainWindow::onObjectTool()
+{
+    m_currentTool = Constants::TOOL_OBJECT;
+    m_view->setTool(Constants::TOOL_OBJECT);
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onSelectTool()
+{
+    m_currentTool = Constants::TOOL_SELECT;
+    m_view->setTool(Constants::TOOL_SELECT);
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onStampTool()
+{
+    m_currentTool = Constants::TOOL_STAMP;
+    m_view->setTool(Constants::TOOL_STAMP);
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onCopy()
+{
+    QRect sel = m_view->selection();
+    if (sel.isEmpty()) return;
+    CTileRegion region = m_map->copyRegion(sel.x(), sel.y(), sel.width(), sel.height());
+    QMimeData* mime = new QMimeData;
+    mime->setData(Constants::REGION_MIME_TYPE, encodeRegion(region));
+    QGuiApplication::clipboard()->setMimeData(mime);
+    m_statusLabel->setText(tr("Copied %1x%2 tiles").arg(region.width).arg(region.height));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onCut()
+{
+    QRect sel = m_view->selection();
+    if (sel.isEmpty()) return;
+    onCopy();
+    m_undoStack->push(new FillRectCommand(m_map, sel, 0, m_view->mapItem(), tr("Cut %1x%2").arg(sel.width()).arg(sel.height())));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onPaste()
+{
+    const QMimeData* mime = QGuiApplication::clipboard()->mimeData();
+    if (!mime || !mime->hasFormat(Constants::REGION_MIME_TYPE)) return;
+    CTileRegion region = decodeRegion(mime->data(Constants::REGION_MIME_TYPE));
+    if (region.isEmpty()) return;
+    m_view->setStamp(region);
+    m_stampToolAct->setChecked(true);
+    onStampTool();
+    m_statusLabel->setText(tr("Stamp brush: %1x%2 tiles").arg(region.width).arg(region.height));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onSelectAll()
+{
+    m_view->setSelection(QRect(0, 0, m_map->width(), m_map->height()));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onFillSelection()
+{
+    QRect sel = m_view->selection();
+    if (sel.isEmpty()) return;
+    uint32_t value = static_cast<uint32_t>(m_selectedTile + 1);
+    m_undoStack->push(new FillRectCommand(m_map, sel, value, m_view->mapItem(), tr("Fill %1x%2").arg(sel.width()).arg(sel.height())));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onReplaceTiles()
+{
+    QRect sel = m_view->selection();
+    // Ids up to the largest one in the map or the palette can be picked
+    const size_t n = m_map->tileCount();
+    const uint32_t mapMaxId = m_map->visitCells([n](const auto* tiles) {
+        return n ? static_cast<uint32_t>(*std::max_element(tiles, tiles + n)) : 0u;
+    });
+    const uint32_t maxTileId = std::max(mapMaxId, static_cast<uint32_t>(m_doc->tileCount));
+    CReplaceTilesDialog dlg(static_cast<uint32_t>(m_selectedTile + 1), 0, maxTileId, !sel.isEmpty(), this);
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+
+    // The dialog only accepts a table that parses
+    QMap<uint32_t, uint32_t> mapping;
+    QString error;
+    if (!dlg.mapping(mapping, &error)) {
+        QMessageBox::warning(this, tr("Replace tiles"), error);
+        return;
+    }
+    CTileReplace replace = mapping.isEmpty() ? CTileReplace::single(dlg.fromTile(), dlg.toTile())
+                                             : CTileReplace::table(mapping);
+    QRect area = dlg.selectionOnly() ? sel : QRect(0, 0, m_map->width(), m_map->height());
+
+    QElapsedTimer timer;
+    timer.start();
+    size_t changed = replace.apply(*m_map, area);
+    double ms = timer.nsecsElapsed() / 1.0e6;
+    if (changed == 0) {
+        m_statusLabel->setText(tr("No tiles replaced"));
+        return;
+    }
+    m_undoStack->push(new ReplaceTilesCommand(m_map, replace, area, m_view->mapItem()));
+    m_view->mapItem()->update();
+    m_statusLabel->setText(tr("Replaced %1 tiles (%2 ms)").arg(changed).arg(ms, 0, 'f', 2));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onGenerate()
+{
+    QRect sel = m_view->selection();
+    CGenerateDialog dlg(QSize(m_map->width(), m_map->height()), sel, 0, static_cast<uint32_t>(m_selectedTile + 1), this);
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+
+    QRect area = dlg.area();
+    QElapsedTimer timer;
+    timer.start();
+    CTileRegion region = CGenerator::generate(dlg.settings(), area, QRect(0, 0, m_map->width(), m_map->height()));
+    double ms = timer.nsecsElapsed() / 1.0e6;
+    if (region.isEmpty())
+        return;
+
+    m_undoStack->push(new RegionCommand(m_map, area.x(), area.y(), region, m_view->mapItem(),
+                                        tr("Generate %1x%2").arg(region.width).arg(region.height)));
+    m_statusLabel->setText(tr("Generated %1x%2 tiles (%3 ms)").arg(region.width).arg(region.height).arg(ms, 0, 'f', 2));
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onHistoryMemoryChanged(qint64 resident, qint64 compressed, qint64 spilled)
+{
+    QString text = tr("History: %1").arg(locale().formattedDataSize(resident));
+    if (compressed > 0)
+        text += tr(" + %1 compressed").arg(locale().formattedDataSize(compressed));
+    if (spilled > 0)
+        text += tr(" + %1 on disk").arg(locale().formattedDataSize(spilled));
+    m_historyLabel->setText(text);
+    // Allocation counters of the payload pool, to check that strokes and
+    // fills stop allocating once their buffers are warm
+    m_historyLabel->setToolTip(CAllocStats::summary());
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::updateModified(CDocument* doc)
+{
+    // Compared by content, so undoing back to the saved state or an edit
+    // that rewrites the same tiles leaves the map clean
+    bool modified = doc->map->contentHash() != doc->savedHash;
+    if (modified != doc->modified) {
+        doc->modified = modified;
+        updateTabText(doc);
+        if (doc == m_doc)
+            updateWindowTitle();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::updateTabText(CDocument* doc)
+{
+    QString text = doc->path.isEmpty() ? tr("Untitled") : QFileInfo(doc->path).fileName();
+    if (doc->modified)
+        text += " *";
+    int index = m_tabs->indexOf(doc->view);
+    m_tabs->setTabText(index, text);
+    m_tabs->setTabToolTip(index, doc->path);
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::watchFiles()
+{
+    QStringList wanted;
+    for (const std::unique_ptr<CDocument>& doc : m_documents) {
+        if (!doc->path.isEmpty())
+            wanted.append(doc->path);
+        QString tilesetPath = doc->tilesetPath();
+        if (!tilesetPath.isEmpty() && !wanted.contains(tilesetPath))
+            wanted.append(tilesetPath);
+    }
+
+    QStringList stale;
+    for (const QString& path : m_fileWatcher->files()) {
+        if (!wanted.contains(path))
+            stale.append(path);
+    }
+    if (!stale.isEmpty())
+        m_fileWatcher->removePaths(stale);
+    for (const QString& path : wanted) {
+        if (!m_fileWatcher->files().contains(path) && QFileInfo::exists(path))
+            m_fileWatcher->addPath(path);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::onWatchedFileChanged(const QString& path)
+{
+    m_changedPaths.insert(path);
+
+    // Writers that replace the file by renaming drop it from the watcher
+    watchFiles();
+    m_reloadTimer->start();
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::reloadChangedFiles()
+{
+    QSet<QString> changed;
+    changed.swap(m_changedPaths);
+    for (const QString& path : changed) {
+        // Every document on the tileset moves to the same new cache entry
+        bool tilesetReloaded = false;
+        for (const std::unique_ptr<CDocument>& doc : m_documents) {
+            if (doc->tilesetPath() != path)
+                continue;
+            std::shared_ptr<const CTileset> tileset = CTilesetCache::acquire(path, doc->tileset->tileSize);
+            if (!tileset)
+                continue;
+            doc->tileset = tileset;
+            doc->view->setTileset(tileset);
+            tilesetReloaded = true;
+        }
+        if (tilesetReloaded) {
+            updatePalette();
+            m_statusLabel->setText(tr("Reloaded tileset: %1").arg(path));
+        }
+
+        if (CDocument* doc = findDocument(path))
+            reloadMap(doc);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::reloadMap(CDocument* doc)
+{
+    // Our own saves land here too; the file then still has the stamp taken
+    // right after writing it. The digest the file declares is not trusted.
+    if (!doc->savedStamp.isEmpty() && CMapHash::fileStamp(doc->path) == doc->savedStamp)
+        return;
+
+    // Parsing is the slow part, so it runs on the worker; a later change
+    // bumps the serial and the stale result is dropped. The document is
+    // looked up again by path in case its tab was closed meanwhile.
+    int serial = ++doc->reloadSerial;
+    QString path = doc->path;
+    m_workerPool->start([this, serial, path]() {
+        auto incoming = std::make_shared<CMap>();
+        QString stamp = CMapHash::fileStamp(path);
+        QFile f(path);
+        bool ok = f.open(QFile::ReadOnly);
+        QJsonDocument json = ok ? QJsonDocument::fromJson(f.readAll()) : QJsonDocument();
+        ok = json.isObject() && incoming->fromJson(json.object());
+        uint64_t hash = ok ? incoming->contentHash() : 0;
+        QMetaObject::invokeMethod(this, [this, serial, path, incoming, ok, hash, stamp]() {
+            CDocument* doc = findDocument(path);
+            if (!doc || serial != doc->reloadSerial)
+                return;
+            if (!ok) {
+                m_statusLabel->setText(tr("Ignored unreadable external change: %1").arg(path));
+                return;
+            }
+            applyExternalMap(doc, *incoming, hash, stamp);
+        }, Qt::QueuedConnection);
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CMainWindow::applyExternalMap(CDocument* doc, const CMap& incoming, uint64_t hash, const QString& stamp)
+{
+    if (hash == doc->map->contentHash()) {
+        doc->savedHash = hash;
+        doc->savedStamp = stamp;
+        updateModified(doc);
+        return;
+    }
+    if (doc->modified) {
+        QMessageBox::StandardButton res = QMessageBox::question(
+            this, tr("File changed on disk"),
+            tr("%1 was changed by another program. Apply its changes? Local edits to the same map will be overwritten, "
+               "but the reload can be undone.").arg(QFileInfo(doc->path).fileName()),
+            QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+        if (res != QMessageBox::Yes)
+            return;
+    }
+
+    // The diff is cheap next to parsing and sees the map as it is now
+    CMapDiffResult diff = CMapDiff::diff(*doc->map, incoming);
+    auto* cmd = new MapPatchCommand(doc->map.get(), incoming, diff, doc->view,
+                                    tr("External change (%1 tiles)").arg(diff.changedTiles));
+    if (cmd->isEmpty()) {
+        delete cmd;
+        return;
+    }
+    doc->savedHash = hash;
+    doc->savedStamp = stamp;
+    doc->undoStack->push(cmd);
+    m_statusLabel->setText(tr("Reloaded %1 changed tiles in %2 regions from %3")
+        .arg(diff.changedTiles).arg(diff.regions.size()).arg(QFileInfo(doc->path).fileName()));
+}
+
 //-----------------------------------------------------------------------------
 void CMainWindow::updateWindowTitle()
 {
     QString title = "MapEditor";
-    if (!m_currentMapPath.isEmpty()) {
-        QFileInfo fi(m_currentMapPath);
+    if (!m_doc->path.isEmpty()) {
+        QFileInfo fi(m_doc->path);
         title += " - " + fi.fileName();
     }
-    if (m_modified)
+    if (m_doc->modified)
         title += " *";
     setWindowTitle(title);
 }
@@ -1,18 +1,47 @@
 #pragma once
 
+#include "CAutotile.h"
+#include "CDocument.h"
+#include "CPayloadPool.h"
+#include "CPathfinder.h"
+#include "CScriptRunner.h"
+#include "CTileProperties.h"
 #include "Constants.h"
 
 #include <QImage>
 #include <QMainWindow>
+#include <QSet>
 #include <QString>
+#include <QStringList>
 #include <QVector>
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
 //-----------------------------------------------------------------------------
+class QAction;
 class QLabel;
 class CMainView;
 class CMap;
+class CAnalysisDock;
+class CEditRecorder;
+struct CEditRecording;
+class CMapSync;
+class CPhaseLog;
+class CScriptDock;
+class CThumbnailCache;
+class CUndoHistory;
+class QFileSystemWatcher;
+class QGraphicsItem;
+class QMenu;
+class QTabWidget;
+class QThreadPool;
+class QTimer;
 class QToolBar;
 class QToolButton;
+class QUndoGroup;
 class QUndoStack;
 
 //-----------------------------------------------------------------------------
@@ -23,6 +52,18 @@ public:
     explicit CMainWindow(QWidget* parent = nullptr);
     ~CMainWindow() override;
 
+    // Startup: either the files given on the command line or the last session
+    void openFiles(const QStringList& maps, const QString& tilesetPath, int tileSize, int tileCount,
+                   CPhaseLog* log = nullptr);
+    void restoreSession(CPhaseLog* log = nullptr);
+    // Opens the starting map of a recorded edit session as the active
+    // document, for replaying it
+    CDocument* openRecording(const CEditRecording& recording, QString* error = nullptr);
+
+signals:
+    // The active document's view finished painting a frame
+    void framePainted();
+
 private slots:
     void onNewMap();
     void onOpenMap();
@@ -33,9 +74,32 @@ private slots:
     void onExit();
     void onAbout();
     void onTileSelected();
+    void onEditTileProperties(int index);
+    void onCountSolidTiles();
+    void onLoadAutotileRules();
     void onMouseTileChanged(int x, int y);
     void onPaintTool();
     void onFillTool();
+    void onObjectTool();
+    void onSelectTool();
+    void onStampTool();
+    void onCopy();
+    void onCut();
+    void onPaste();
+    void onSelectAll();
+    void onFillSelection();
+    void onReplaceTiles();
+    void onGenerate();
+    void onCheckPaths();
+    void onClearOverlays();
+    void onCompareWithFile();
+    void onExportPack();
+    void onLiveSync(bool enabled);
+    void onRecordSession(bool enabled);
+    void onRunScript(const QString& source);
+    void onHistoryMemoryChanged(qint64 resident, qint64 compressed, qint64 spilled);
+    void onTabChanged(int index);
+    void onTabCloseRequested(int index);
     void selectTile(int index);
     void cycleTileNext();
     void cycleTilePrev();
@@ -44,23 +108,94 @@ private:
     void closeEvent(QCloseEvent* event) override;
     void createPalette();
     void updatePalette();
+    CDocument* createDocument();
+    void setActiveDocument(CDocument* doc);
+    void endStampStroke();
+    void applyUndoLimits(CUndoHistory* history) const;
+    bool closeDocument(CDocument* doc);
+    bool maybeSave(CDocument* doc, const QString& question);
+    bool openMap(const QString& path);
+    void addRecentFile(const QString& path);
+    void updateRecentMenu();
+    void setDocumentTileset(CDocument* doc, const std::shared_ptr<const CTileset>& tileset, int tileCount);
+    void writeSession();
+    bool isPristine(const CDocument* doc) const;
+    CDocument* findDocument(const QString& path) const;
+    CDocument* documentAt(int tabIndex) const;
+    void connectView(CMainView* view);
+    void updateModified(CDocument* doc);
+    void updateTabText(CDocument* doc);
+    void watchFiles();
+    void onWatchedFileChanged(const QString& path);
+    void reloadChangedFiles();
+    void reloadMap(CDocument* doc);
+    void applyExternalMap(CDocument* doc, const CMap& incoming, uint64_t hash, const QString& stamp);
+    void finishScript(const CScriptRunner::Result& result, const CMap& before, const CMap& after);
+    void stopLiveSync(const QString& message);
+    void stopRecording();
+    void onSyncRegionsChanged(const QVector<QRect>& rects, bool resized);
     void updateWindowTitle();
+    void loadTileProperties();
+    bool saveTileProperties();
+    bool loadAutotileRules(const QString& path);
+    bool autotiling() const;
+    void appendRectPositions(const QRect& rect, CPooledArray<uint32_t>& positions) const;
+    void showPathResults(CMainView* view, const QVector<CPathResult>& results, const QVector<QPoint>& points,
+                         const QVector<uint32_t>& objectIds, double ms);
+    void pushAutotiledEdit(CPooledArray<uint32_t>& positions, const std::function<void()>& edit,
+                           const QString& text, QGraphicsItem* item);
 
-    bool m_modified = false;
     int m_selectedTile = 0;
-    int m_tileSize = 32;
-    int m_tileCount = 12;
+    int m_undoBudgetMB = 0;            // from the settings, see applyUndoLimits()
+    int m_undoSpillMB = 0;
     int m_currentTool = Constants::TOOL_PAINT;
+    QString m_objectType = Constants::DEFAULT_OBJECT_TYPE;
 
     QLabel* m_statusLabel = nullptr;
     QLabel* m_positionLabel = nullptr;
+    QLabel* m_historyLabel = nullptr;
+    QTabWidget* m_tabs = nullptr;
+    QUndoGroup* m_undoGroup = nullptr;
+    std::vector<std::unique_ptr<CDocument>> m_documents;
+    CDocument* m_doc = nullptr;
+
+    // Shortcuts into the active document, rebound by setActiveDocument()
     CMainView* m_view = nullptr;
     CMap* m_map = nullptr;
     QUndoStack* m_undoStack = nullptr;
-    QString m_currentMapPath;
+
+    CAnalysisDock* m_analysisDock = nullptr;
     QToolBar* m_mainToolBar = nullptr;
     QToolBar* m_toolsToolBar = nullptr;
     QToolBar* m_paletteToolBar = nullptr;
+    QAction* m_stampToolAct = nullptr;
+    QUndoStack* m_stampStack = nullptr;   // stack with the open stamp drag macro
     QVector<QToolButton*> m_paletteButtons;
-    QImage m_tileset;
+    QString m_sidecarTilesetPath;      // tileset whose properties and autotile rules are loaded
+    QString m_pathBlockedIds;
+    QString m_pathMarkerTypes = Constants::DEFAULT_PATH_MARKER_TYPES;
+    QThreadPool* m_workerPool = nullptr;
+    QThreadPool* m_scriptPool = nullptr;   // scripts only, so a long run never delays worker jobs
+    QFileSystemWatcher* m_fileWatcher = nullptr;
+    QTimer* m_reloadTimer = nullptr;
+    QSet<QString> m_changedPaths;
+    QAction* m_checkPathsAct = nullptr;
+    CThumbnailCache* m_thumbnails = nullptr;
+    QMenu* m_recentMenu = nullptr;
+    CMapSync* m_sync = nullptr;
+    CDocument* m_syncDoc = nullptr;
+    QAction* m_liveSyncAct = nullptr;
+    std::unique_ptr<CEditRecorder> m_recorder;
+    CDocument* m_recordDoc = nullptr;
+    QAction* m_recordAct = nullptr;
+    CScriptDock* m_scriptDock = nullptr;
+    std::unique_ptr<CScriptRunner> m_scriptRunner;
+    CDocument* m_scriptDoc = nullptr;
+    bool m_scriptRunning = false;
+    CTileProperties m_tileProperties;
+    CAutotile m_autotile;
+    bool m_autotileEnabled = false;
+    // Scratch for autotiled edits, kept so strokes stop allocating once warm
+    CPooledArray<uint32_t> m_editPositions{CAllocStats::SCRATCH};
+    CPooledArray<uint32_t> m_editBefore{CAllocStats::SCRATCH};
 };
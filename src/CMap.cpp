@@ -1,8 +1,11 @@
 #include "CMap.h"
+#include "Constants.h"
 
 #include <QJsonObject>
 #include <QJsonArray>
 #include <algorithm>
+#include <cstring>
+#include <type_traits>
 #include <utility>
 
 //-----------------------------------------------------------------------------
@@ -21,43 +24,318 @@ bool CMap::isValidPosition(int x, int y) const
 uint32_t CMap::tileAt(int x, int y) const
 {
     if (!isValidPosition(x, y)) return 0;
-    return m_tiles[y * m_width + x];
+    const size_t i = static_cast<size_t>(y) * m_width + x;
+    return visitCells([i](const auto* cells) { return static_cast<uint32_t>(cells[i]); });
 }
 
 //-----------------------------------------------------------------------------
 void CMap::setTile(int x, int y, uint32_t value)
 {
     if (!isValidPosition(x, y)) return;
-    m_tiles[y * m_width + x] = value;
+    reserveValue(value);
+    const size_t i = static_cast<size_t>(y) * m_width + x;
+    visitCells([i, value](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        cells[i] = static_cast<T>(value);
+    });
+    m_rowRevision[y] = ++m_revision;
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    m_chunkRevision[static_cast<size_t>(y / chunk) * m_chunksX + x / chunk] = m_revision;
 }
 
 //-----------------------------------------------------------------------------
-void CMap::resize(int w, int h, uint32_t fill)
+template <typename Value>
+void CMap::scatter(const uint32_t* positions, size_t count, Value valueAt)
+{
+    if (!count) return;
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    const uint64_t revision = ++m_revision;
+    const size_t n = tileCount();
+    visitCells([&](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t p = positions[i];
+            // Positions come from commands recorded against this map; one
+            // past the end means the map shrank under them
+            if (p >= n)
+                continue;
+            const int x = static_cast<int>(p % m_width);
+            const int y = static_cast<int>(p / m_width);
+            cells[p] = static_cast<T>(valueAt(i));
+            m_rowRevision[y] = revision;
+            m_chunkRevision[static_cast<size_t>(y / chunk) * m_chunksX + x / chunk] = revision;
+        }
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CMap::setTiles(const uint32_t* positions, size_t count, const uint32_t* values)
+{
+    if (count)
+        reserveValue(*std::max_element(values, values + count));
+    scatter(positions, count, [values](size_t i) { return values[i]; });
+}
+
+//-----------------------------------------------------------------------------
+void CMap::setTiles(const uint32_t* positions, size_t count, uint32_t value)
+{
+    reserveValue(value);
+    scatter(positions, count, [value](size_t) { return value; });
+}
+
+//-----------------------------------------------------------------------------
+void CMap::reserveCellBytes(int bytes)
+{
+    if (bytes > m_cellBytes)
+        setCellBytes(bytes);
+}
+
+//-----------------------------------------------------------------------------
+// Converts every cell in one pass; narrowing is only used by fromJson(),
+// after checking that every id fits
+void CMap::setCellBytes(int bytes)
+{
+    if (bytes == m_cellBytes) return;
+    const size_t n = tileCount();
+    auto convertTo = [this, n](auto& target) {
+        target.resize(n);
+        visitCells([&target, n](const auto* cells) {
+            using T = typename std::decay_t<decltype(target)>::value_type;
+            std::transform(cells, cells + n, target.begin(), [](auto v) { return static_cast<T>(v); });
+        });
+    };
+    if (bytes == 1)
+        convertTo(cells<uint8_t>());
+    else if (bytes == 2)
+        convertTo(cells<uint16_t>());
+    else
+        convertTo(cells<uint32_t>());
+
+    if (m_cellBytes == 1)
+        std::vector<uint8_t>().swap(cells<uint8_t>());
+    else if (m_cellBytes == 2)
+        std::vector<uint16_t>().swap(cells<uint16_t>());
+    else
+        std::vector<uint32_t>().swap(cells<uint32_t>());
+    m_cellBytes = bytes;
+}
+
+//-----------------------------------------------------------------------------
+void CMap::readRow(int y, int x0, int count, uint32_t* out) const
+{
+    const size_t offset = static_cast<size_t>(y) * m_width + x0;
+    visitCells([offset, count, out](const auto* cells) {
+        std::copy(cells + offset, cells + offset + count, out);
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CMap::writeRow(int y, int x0, int count, const uint32_t* values)
+{
+    if (count <= 0) return;
+    reserveValue(*std::max_element(values, values + count));
+    const size_t offset = static_cast<size_t>(y) * m_width + x0;
+    visitCells([offset, count, values](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        std::transform(values, values + count, cells + offset, [](uint32_t v) { return static_cast<T>(v); });
+    });
+    touchRect(x0, y, count, 1);
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CMap::rowRevision(int y) const
+{
+    if (y < 0 || y >= m_height) return 0;
+    return m_rowRevision[y];
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CMap::chunkRevision(int cx, int cy) const
+{
+    if (cx < 0 || cy < 0 || cx >= m_chunksX || cy >= m_chunksY) return 0;
+    return m_chunkRevision[static_cast<size_t>(cy) * m_chunksX + cx];
+}
+
+//-----------------------------------------------------------------------------
+void CMap::touchRows(int y0, int y1)
+{
+    touchRect(0, y0, m_width, y1 - y0);
+}
+
+//-----------------------------------------------------------------------------
+void CMap::touchRect(int x, int y, int w, int h)
+{
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(m_width, x + w);
+    int y1 = std::min(m_height, y + h);
+    if (x1 <= x0 || y1 <= y0) return;
+
+    ++m_revision;
+    std::fill(m_rowRevision.begin() + y0, m_rowRevision.begin() + y1, m_revision);
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    for (int cy = y0 / chunk; cy <= (y1 - 1) / chunk; ++cy)
+        for (int cx = x0 / chunk; cx <= (x1 - 1) / chunk; ++cx)
+            m_chunkRevision[static_cast<size_t>(cy) * m_chunksX + cx] = m_revision;
+}
+
+//-----------------------------------------------------------------------------
+void CMap::resetRevisions()
+{
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    m_chunksX = (m_width + chunk - 1) / chunk;
+    m_chunksY = (m_height + chunk - 1) / chunk;
+    m_rowRevision.assign(m_height, 0);
+    m_chunkRevision.assign(static_cast<size_t>(m_chunksX) * m_chunksY, 0);
+    touchRows(0, m_height);
+}
+
+//-----------------------------------------------------------------------------
+void CMap::resize(int w, int h, uint32_t fill, int offsetX, int offsetY)
+{
+    reserveValue(fill);
+    visitCells([&](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        resizeCells<T>(w, h, fill, offsetX, offsetY);
+    });
+    resetRevisions();
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void CMap::resizeCells(int w, int h, uint32_t fill, int offsetX, int offsetY)
 {
     int newWidth = std::max(0, w);
     int newHeight = std::max(0, h);
+
+    // Rows stay contiguous when the width and horizontal placement are kept
+    if (newWidth == m_width && offsetX == 0) {
+        resizeRowsInPlace<T>(newHeight, fill, offsetY);
+        return;
+    }
     
-    std::vector<uint32_t> newTiles(newWidth * newHeight, fill);
+    std::vector<T>& tiles = cells<T>();
+    std::vector<T> newTiles(static_cast<size_t>(newWidth) * newHeight, static_cast<T>(fill));
     
-    // Copy existing tiles that fit in new dimensions
-    int copyWidth = std::min(m_width, newWidth);
-    int copyHeight = std::min(m_height, newHeight);
+    // Copy the overlap of old and new map row by row
+    int srcX0 = std::max(0, -offsetX);
+    int srcX1 = std::min(m_width, newWidth - offsetX);
+    int srcY0 = std::max(0, -offsetY);
+    int srcY1 = std::min(m_height, newHeight - offsetY);
     
-    for (int y = 0; y < copyHeight; ++y) {
-        for (int x = 0; x < copyWidth; ++x) {
-            newTiles[y * newWidth + x] = m_tiles[y * m_width + x];
+    if (srcX1 > srcX0) {
+        for (int y = srcY0; y < srcY1; ++y) {
+            std::memcpy(&newTiles[static_cast<size_t>(y + offsetY) * newWidth + srcX0 + offsetX],
+                        &tiles[static_cast<size_t>(y) * m_width + srcX0],
+                        (srcX1 - srcX0) * sizeof(T));
         }
     }
     
     m_width = newWidth;
     m_height = newHeight;
-    m_tiles = std::move(newTiles);
+    tiles = std::move(newTiles);
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void CMap::resizeRowsInPlace(int h, uint32_t fill, int offsetY)
+{
+    std::vector<T>& tiles = cells<T>();
+    const T value = static_cast<T>(fill);
+    const size_t rowSize = static_cast<size_t>(m_width);
+    int srcY0 = std::max(0, -offsetY);
+    int srcY1 = std::min(m_height, h - offsetY);
+    int rows = std::max(0, srcY1 - srcY0);
+    size_t dstBegin = rows ? (srcY0 + offsetY) * rowSize : 0;
+    size_t dstEnd = dstBegin + rows * rowSize;
+    size_t newSize = static_cast<size_t>(h) * rowSize;
+
+    if (newSize > tiles.size())
+        tiles.resize(newSize, value);
+    if (rows)
+        std::memmove(&tiles[dstBegin], &tiles[srcY0 * rowSize], rows * rowSize * sizeof(T));
+    std::fill(tiles.begin(), tiles.begin() + dstBegin, value);
+    std::fill(tiles.begin() + dstEnd, tiles.begin() + newSize, value);
+    tiles.resize(newSize);
+    m_height = h;
 }
 
 //-----------------------------------------------------------------------------
 void CMap::clear(uint32_t fill)
 {
-    std::fill(m_tiles.begin(), m_tiles.end(), fill);
+    reserveValue(fill);
+    const size_t n = tileCount();
+    visitCells([n, fill](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        std::fill_n(cells, n, static_cast<T>(fill));
+    });
+    touchRows(0, m_height);
+}
+
+//-----------------------------------------------------------------------------
+CTileRegion CMap::copyRegion(int x, int y, int w, int h) const
+{
+    CTileRegion region;
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(m_width, x + w);
+    int y1 = std::min(m_height, y + h);
+    if (x1 <= x0 || y1 <= y0)
+        return region;
+
+    region.width = x1 - x0;
+    region.height = y1 - y0;
+    region.tiles.resize(static_cast<size_t>(region.width) * region.height);
+    visitCells([&](const auto* cells) {
+        for (int row = 0; row < region.height; ++row) {
+            const auto* src = cells + static_cast<size_t>(y0 + row) * m_width + x0;
+            std::copy(src, src + region.width, region.tiles.begin() + static_cast<size_t>(row) * region.width);
+        }
+    });
+    return region;
+}
+
+//-----------------------------------------------------------------------------
+void CMap::blitRegion(int x, int y, const CTileRegion& region)
+{
+    int srcX = std::max(0, -x);
+    int srcY = std::max(0, -y);
+    int dstX = std::max(0, x);
+    int dstY = std::max(0, y);
+    int w = std::min(region.width - srcX, m_width - dstX);
+    int h = std::min(region.height - srcY, m_height - dstY);
+    if (w <= 0 || h <= 0)
+        return;
+
+    reserveValue(*std::max_element(region.tiles.begin(), region.tiles.end()));
+    visitCells([&](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        for (int row = 0; row < h; ++row) {
+            const uint32_t* src = &region.tiles[static_cast<size_t>(srcY + row) * region.width + srcX];
+            std::transform(src, src + w, cells + static_cast<size_t>(dstY + row) * m_width + dstX,
+                           [](uint32_t v) { return static_cast<T>(v); });
+        }
+    });
+    touchRect(dstX, dstY, w, h);
+}
+
+//-----------------------------------------------------------------------------
+void CMap::fillRect(int x, int y, int w, int h, uint32_t value)
+{
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(m_width, x + w);
+    int y1 = std::min(m_height, y + h);
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    reserveValue(value);
+    visitCells([&](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        for (int row = y0; row < y1; ++row)
+            std::fill_n(cells + static_cast<size_t>(row) * m_width + x0, x1 - x0, static_cast<T>(value));
+    });
+    touchRect(x0, y0, x1 - x0, y1 - y0);
 }
 
 //-----------------------------------------------------------------------------
@@ -67,13 +345,20 @@ QJsonObject CMap::toJson() const
     obj["width"] = m_width;
     obj["height"] = m_height;
     QJsonArray arr;
-    for (const uint32_t& v : m_tiles)
-        arr.append(static_cast<qint64>(v));
+    const size_t n = tileCount();
+    visitCells([&arr, n](const auto* cells) {
+        for (size_t i = 0; i < n; ++i)
+            arr.append(static_cast<qint64>(cells[i]));
+    });
     obj["tiles"] = arr;
+    if (m_objects.count() > 0)
+        obj["objects"] = m_objects.toJson();
     return obj;
 }
 
 //-----------------------------------------------------------------------------
+// Loading is the one place a map narrows: the cells start at the width the
+// largest id in the file needs
 bool CMap::fromJson(const QJsonObject& obj)
 {
     if (!obj.contains("width") || !obj.contains("height") || !obj.contains("tiles"))
@@ -82,8 +367,24 @@ bool CMap::fromJson(const QJsonObject& obj)
     int h = obj["height"].toInt();
     QJsonArray arr = obj["tiles"].toArray();
     if (arr.size() != w * h) return false;
+    CObjectLayer objects;
+    if (!objects.fromJson(obj["objects"].toArray()))
+        return false;
+
+    std::vector<uint32_t> values(arr.size());
+    uint32_t maxValue = 0;
+    for (int i = 0; i < arr.size(); ++i) {
+        values[i] = static_cast<uint32_t>(arr[i].toInt());
+        maxValue = std::max(maxValue, values[i]);
+    }
+    resize(0, 0);
+    setCellBytes(cellBytesFor(maxValue));
     resize(w, h);
-    for (int i = 0; i < arr.size(); ++i)
-        m_tiles[i] = static_cast<uint32_t>(arr[i].toInt());
+    visitCells([&values](auto* cells) {
+        using T = std::remove_pointer_t<decltype(cells)>;
+        std::transform(values.begin(), values.end(), cells, [](uint32_t v) { return static_cast<T>(v); });
+    });
+    touchRows(0, m_height);
+    m_objects = std::move(objects);
     return true;
 }
@@ -1,12 +1,33 @@
 #pragma once
 
+#include "CMapHash.h"
+#include "CObjectLayer.h"
+
 #include <cstdint>
+#include <tuple>
 #include <vector>
 #include <QString>
 
 //-----------------------------------------------------------------------------
 class QJsonObject;
 
+//-----------------------------------------------------------------------------
+struct CTileRegion
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> tiles;    // row-major, width * height
+
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+};
+
+//-----------------------------------------------------------------------------
+// Smallest cell width in bytes that can store value
+inline int cellBytesFor(uint32_t value)
+{
+    return value <= 0xff ? 1 : value <= 0xffff ? 2 : 4;
+}
+
 //-----------------------------------------------------------------------------
 class CMap
 {
@@ -16,20 +37,109 @@ public:
 
     int width() const { return m_width; }
     int height() const { return m_height; }
+    size_t tileCount() const { return static_cast<size_t>(m_width) * m_height; }
 
     uint32_t tileAt(int x, int y) const;
     void setTile(int x, int y, uint32_t value);
 
-    void resize(int w, int h, uint32_t fill = 0);
+    // Scattered writes at row-major positions (y * width + x) inside the
+    // map, dispatched once for the whole batch; positions past the end are
+    // skipped
+    void setTiles(const uint32_t* positions, size_t count, const uint32_t* values);
+    void setTiles(const uint32_t* positions, size_t count, uint32_t value);
+
+    // Cells are 1, 2 or 4 bytes wide, the narrowest type that holds every id
+    // written so far. Writing a larger id promotes the whole map once; only
+    // loading picks a narrower type again.
+    int cellBytes() const { return m_cellBytes; }
+    void reserveCellBytes(int bytes);
+    void reserveValue(uint32_t value) { reserveCellBytes(cellBytesFor(value)); }
+
+    // Calls fn once with a pointer to the row-major cells as uint8_t*,
+    // uint16_t* or uint32_t*, so bulk kernels are instantiated per cell type
+    // instead of branching per tile. Code writing through the pointer must
+    // call reserveValue() first and touchRect() after.
+    template <typename Fn> auto visitCells(Fn&& fn) const;
+    template <typename Fn> auto visitCells(Fn&& fn);
+
+    // Row access widened to 32 bits, for consumers that mix maps of
+    // different cell types; writeRow() promotes as needed
+    void readRow(int y, int x0, int count, uint32_t* out) const;
+    void writeRow(int y, int x0, int count, const uint32_t* values);
+
+    // The old tile (0, 0) lands at (offsetX, offsetY) in the resized map
+    void resize(int w, int h, uint32_t fill = 0, int offsetX = 0, int offsetY = 0);
     void clear(uint32_t fill = 0);
 
+    // Bulk region operations, clipped to the map and done row by row.
+    // A copied region starts at (max(x, 0), max(y, 0)).
+    CTileRegion copyRegion(int x, int y, int w, int h) const;
+    void blitRegion(int x, int y, const CTileRegion& region);
+    void fillRect(int x, int y, int w, int h, uint32_t value);
+
+    // Every write stamps the rows and MAP_CHUNK_SIZE chunks it touched with a
+    // new map revision, so observers can find what changed since they last
+    // looked. Code writing through visitCells() must call touchRect() itself.
+    uint64_t revision() const { return m_revision; }
+    uint64_t rowRevision(int y) const;
+    int chunksX() const { return m_chunksX; }
+    int chunksY() const { return m_chunksY; }
+    uint64_t chunkRevision(int cx, int cy) const;
+    void touchRows(int y0, int y1);
+    void touchRect(int x, int y, int w, int h);
+
+    // xxHash64 digest of tiles and objects; only chunks written since the
+    // last call are hashed again
+    uint64_t contentHash() const { return m_hash.digest(*this); }
+
+    CObjectLayer& objects() { return m_objects; }
+    const CObjectLayer& objects() const { return m_objects; }
+
     QJsonObject toJson() const;
     bool fromJson(const QJsonObject& obj);
 
 private:
     int m_width = 0;
     int m_height = 0;
-    std::vector<uint32_t> m_tiles;
+    int m_cellBytes = 1;
+    std::tuple<std::vector<uint8_t>, std::vector<uint16_t>, std::vector<uint32_t>> m_cells;
+    std::vector<uint64_t> m_rowRevision;
+    std::vector<uint64_t> m_chunkRevision;
+    int m_chunksX = 0;
+    int m_chunksY = 0;
+    uint64_t m_revision = 0;
+    mutable CMapHash m_hash;
+    CObjectLayer m_objects;
     
+    template <typename T> std::vector<T>& cells() { return std::get<std::vector<T>>(m_cells); }
+    template <typename T> const std::vector<T>& cells() const { return std::get<std::vector<T>>(m_cells); }
+    template <typename T> void resizeCells(int w, int h, uint32_t fill, int offsetX, int offsetY);
+    template <typename T> void resizeRowsInPlace(int h, uint32_t fill, int offsetY);
+    void setCellBytes(int bytes);
+    template <typename Value> void scatter(const uint32_t* positions, size_t count, Value valueAt);
+
     bool isValidPosition(int x, int y) const;
+    void resetRevisions();
 };
+
+//-----------------------------------------------------------------------------
+template <typename Fn>
+auto CMap::visitCells(Fn&& fn) const
+{
+    switch (m_cellBytes) {
+    case 1: return fn(cells<uint8_t>().data());
+    case 2: return fn(cells<uint16_t>().data());
+    default: return fn(cells<uint32_t>().data());
+    }
+}
+
+//-----------------------------------------------------------------------------
+template <typename Fn>
+auto CMap::visitCells(Fn&& fn)
+{
+    switch (m_cellBytes) {
+    case 1: return fn(cells<uint8_t>().data());
+    case 2: return fn(cells<uint16_t>().data());
+    default: return fn(cells<uint32_t>().data());
+    }
+}
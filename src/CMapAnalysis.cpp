@@ -0,0 +1,217 @@
+#include "CMapAnalysis.h"
+#include "CMap.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <QColor>
+#include <QElapsedTimer>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+namespace {
+    int32_t findRoot(std::vector<int32_t>& parent, int32_t i)
+    {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    // The smaller index always becomes the root, so parent[i] <= i holds
+    void unite(std::vector<int32_t>& parent, int32_t a, int32_t b)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a < b) parent[b] = a;
+        else if (b < a) parent[a] = b;
+    }
+
+    QRgb regionColor(uint32_t root)
+    {
+        uint32_t h = root * 0x9E3779B1u;
+        h ^= h >> 15;
+        QColor color = QColor::fromHsv(static_cast<int>(h % 360), 180 + static_cast<int>((h >> 9) % 60), 230,
+                                       Constants::ANALYSIS_OVERLAY_ALPHA);
+        return color.rgba();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CMapAnalysis::reset()
+{
+    m_width = 0;
+    m_height = 0;
+    m_revision = 0;
+    m_tiles.clear();
+    m_bands.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool CMapAnalysis::sync(const CMap& map)
+{
+    if (map.width() != m_width || map.height() != m_height || m_bands.empty()) {
+        m_width = map.width();
+        m_height = map.height();
+        m_tiles.resize(map.tileCount());
+        for (int y = 0; y < m_height; ++y)
+            map.readRow(y, 0, m_width, m_tiles.data() + static_cast<size_t>(y) * m_width);
+        m_bands.clear();
+        for (int y = 0; y < m_height; y += Constants::ANALYSIS_BAND_ROWS) {
+            Band band;
+            band.y0 = y;
+            band.y1 = std::min(m_height, y + Constants::ANALYSIS_BAND_ROWS);
+            m_bands.push_back(std::move(band));
+        }
+        m_revision = map.revision();
+        return true;
+    }
+
+    if (map.revision() == m_revision)
+        return false;
+
+    bool changed = false;
+    for (int y = 0; y < m_height; ++y) {
+        if (map.rowRevision(y) <= m_revision)
+            continue;
+        const size_t offset = static_cast<size_t>(y) * m_width;
+        map.readRow(y, 0, m_width, m_tiles.data() + offset);
+        m_bands[y / Constants::ANALYSIS_BAND_ROWS].dirty = true;
+        changed = true;
+    }
+    m_revision = map.revision();
+    return changed;
+}
+
+//-----------------------------------------------------------------------------
+// Classic two-pass labeling: the first pass links each tile to its left and
+// upper neighbour through a union-find over tile positions, the second
+// resolves roots into dense component numbers and counts their sizes.
+void CMapAnalysis::labelBand(Band& band) const
+{
+    const int w = m_width;
+    const int rows = band.y1 - band.y0;
+    const size_t count = static_cast<size_t>(w) * rows;
+    const uint32_t* tiles = m_tiles.data() + static_cast<size_t>(band.y0) * w;
+
+    std::vector<int32_t> parent(count);
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int32_t i = static_cast<int32_t>(static_cast<size_t>(y) * w + x);
+            parent[i] = i;
+            if (x > 0 && tiles[i - 1] == tiles[i])
+                unite(parent, i - 1, i);
+            if (y > 0 && tiles[i - w] == tiles[i])
+                unite(parent, i - w, i);
+        }
+    }
+
+    band.labels.resize(count);
+    band.sizes.clear();
+    band.tileIds.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (static_cast<size_t>(parent[i]) == i) {
+            band.labels[i] = static_cast<int32_t>(band.sizes.size());
+            band.sizes.push_back(0);
+            band.tileIds.push_back(tiles[i]);
+        } else {
+            // parent[i] < i was already flattened onto its root
+            parent[i] = parent[parent[i]];
+            band.labels[i] = band.labels[parent[i]];
+        }
+        ++band.sizes[band.labels[i]];
+    }
+    band.dirty = false;
+}
+
+//-----------------------------------------------------------------------------
+CAnalysisResult CMapAnalysis::run(bool overlay)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    CAnalysisResult result;
+    result.width = m_width;
+    result.height = m_height;
+    result.bandCount = static_cast<int>(m_bands.size());
+
+    std::vector<int> dirty;
+    for (int b = 0; b < result.bandCount; ++b)
+        if (m_bands[b].dirty)
+            dirty.push_back(b);
+    result.bandsRelabeled = static_cast<int>(dirty.size());
+    CParallel::forBands(static_cast<int>(dirty.size()), 1, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            labelBand(m_bands[dirty[i]]);
+    });
+
+    // Merge step: one union-find over all band components, joined along the
+    // border rows of neighbouring bands
+    std::vector<int32_t> offsets(m_bands.size() + 1, 0);
+    for (size_t b = 0; b < m_bands.size(); ++b)
+        offsets[b + 1] = offsets[b] + static_cast<int32_t>(m_bands[b].sizes.size());
+    std::vector<int32_t> parent(offsets.back());
+    for (size_t i = 0; i < parent.size(); ++i)
+        parent[i] = static_cast<int32_t>(i);
+
+    const int w = m_width;
+    for (size_t b = 0; b + 1 < m_bands.size(); ++b) {
+        const Band& upper = m_bands[b];
+        const Band& lower = m_bands[b + 1];
+        const uint32_t* above = m_tiles.data() + static_cast<size_t>(upper.y1 - 1) * w;
+        const uint32_t* below = m_tiles.data() + static_cast<size_t>(lower.y0) * w;
+        const int32_t* aboveLabels = upper.labels.data() + static_cast<size_t>(upper.y1 - 1 - upper.y0) * w;
+        const int32_t* belowLabels = lower.labels.data();
+        for (int x = 0; x < w; ++x)
+            if (above[x] == below[x])
+                unite(parent, offsets[b] + aboveLabels[x], offsets[b + 1] + belowLabels[x]);
+    }
+
+    // parent[i] <= i, so one ascending pass flattens every chain
+    for (size_t i = 0; i < parent.size(); ++i)
+        parent[i] = parent[parent[i]];
+
+    std::vector<uint64_t> regionSize(parent.size(), 0);
+    for (size_t b = 0; b < m_bands.size(); ++b) {
+        const Band& band = m_bands[b];
+        for (size_t c = 0; c < band.sizes.size(); ++c) {
+            regionSize[parent[offsets[b] + c]] += band.sizes[c];
+            result.tiles[band.tileIds[c]].tiles += band.sizes[c];
+        }
+    }
+    for (size_t b = 0; b < m_bands.size(); ++b) {
+        const Band& band = m_bands[b];
+        for (size_t c = 0; c < band.sizes.size(); ++c) {
+            size_t g = offsets[b] + c;
+            if (static_cast<size_t>(parent[g]) != g)
+                continue;
+            CTileStats& stats = result.tiles[band.tileIds[c]];
+            ++stats.regions;
+            stats.largestRegion = std::max(stats.largestRegion, regionSize[g]);
+            ++result.regionCount;
+        }
+    }
+
+    if (overlay && m_width > 0 && m_height > 0) {
+        std::vector<QRgb> colors(parent.size());
+        for (size_t g = 0; g < parent.size(); ++g)
+            if (static_cast<size_t>(parent[g]) == g)
+                colors[g] = regionColor(static_cast<uint32_t>(g));
+
+        result.overlay = QImage(m_width, m_height, QImage::Format_ARGB32);
+        CParallel::forBands(static_cast<int>(m_bands.size()), 1, [&](int, int begin, int end) {
+            for (int b = begin; b < end; ++b) {
+                const Band& band = m_bands[b];
+                for (int y = band.y0; y < band.y1; ++y) {
+                    QRgb* line = reinterpret_cast<QRgb*>(result.overlay.scanLine(y));
+                    const int32_t* labels = band.labels.data() + static_cast<size_t>(y - band.y0) * w;
+                    for (int x = 0; x < w; ++x)
+                        line[x] = colors[parent[offsets[b] + labels[x]]];
+                }
+            }
+        });
+    }
+
+    result.milliseconds = timer.nsecsElapsed() / 1.0e6;
+    return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <QImage>
+
+//-----------------------------------------------------------------------------
+class CMap;
+
+//-----------------------------------------------------------------------------
+struct CTileStats
+{
+    uint64_t tiles = 0;
+    int regions = 0;
+    uint64_t largestRegion = 0;
+};
+
+//-----------------------------------------------------------------------------
+struct CAnalysisResult
+{
+    int width = 0;
+    int height = 0;
+    int regionCount = 0;
+    std::map<uint32_t, CTileStats> tiles;   // by tile id
+    QImage overlay;                         // one pixel per tile, null unless requested
+    int bandsRelabeled = 0;
+    int bandCount = 0;
+    double milliseconds = 0.0;
+};
+
+//-----------------------------------------------------------------------------
+// Connected regions of equal tile ids (4-connected). The map is split into
+// fixed row bands; each band is labeled on its own with a two-pass union-find
+// and keeps its component sizes, and a merge step joins components across
+// band borders. After an edit only the bands whose rows changed are labeled
+// again, so cost follows the edit rather than the map size.
+//
+// sync() must run on the thread that owns the map; run() may then run on a
+// worker, as long as the two never overlap.
+class CMapAnalysis
+{
+public:
+    // Copies the rows changed since the last sync; returns false if none did
+    bool sync(const CMap& map);
+    void reset();
+
+    CAnalysisResult run(bool overlay);
+
+private:
+    struct Band {
+        int y0 = 0;
+        int y1 = 0;
+        bool dirty = true;
+        std::vector<int32_t> labels;        // local component per tile
+        std::vector<uint32_t> sizes;        // per local component
+        std::vector<uint32_t> tileIds;      // per local component
+    };
+
+    int m_width = 0;
+    int m_height = 0;
+    uint64_t m_revision = 0;
+    std::vector<uint32_t> m_tiles;
+    std::vector<Band> m_bands;
+
+    void labelBand(Band& band) const;
+};
@@ -0,0 +1,264 @@
+#include "CMapDiff.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <type_traits>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const int BLOCK = Constants::DIFF_BLOCK_SIZE;
+
+    bool sameObject(const CMapObject& a, const CMapObject& b)
+    {
+        return a.rect == b.rect && a.type == b.type && a.properties == b.properties;
+    }
+
+    // Joins flagged blocks into rects: runs along each block row, extended
+    // downwards while the row below has the identical run
+    QVector<QRect> groupBlocks(const std::vector<uint8_t>& flags, int blocksX, int blocksY)
+    {
+        QVector<QRect> rects;
+        QVector<int> open;      // indices into rects still growing downwards
+        for (int by = 0; by < blocksY; ++by) {
+            QVector<int> stillOpen;
+            int bx = 0;
+            while (bx < blocksX) {
+                if (!flags[static_cast<size_t>(by) * blocksX + bx]) {
+                    ++bx;
+                    continue;
+                }
+                int start = bx;
+                while (bx < blocksX && flags[static_cast<size_t>(by) * blocksX + bx])
+                    ++bx;
+                auto it = std::find_if(open.begin(), open.end(), [&](int i) {
+                    return rects[i].left() == start && rects[i].width() == bx - start;
+                });
+                if (it != open.end()) {
+                    rects[*it].setBottom(by);
+                    stillOpen.append(*it);
+                } else {
+                    rects.append(QRect(start, by, bx - start, 1));
+                    stillOpen.append(rects.size() - 1);
+                }
+            }
+            open = stillOpen;
+        }
+        return rects;
+    }
+
+    // Block rects to tile rects, shrunk to the tiles the predicate flags
+    QVector<QRect> tighten(const QVector<QRect>& blockRects, int width, int height,
+                           const std::function<bool(size_t)>& differs)
+    {
+        QVector<QRect> result;
+        for (const QRect& b : blockRects) {
+            QRect r = QRect(b.x() * BLOCK, b.y() * BLOCK, b.width() * BLOCK, b.height() * BLOCK)
+                .intersected(QRect(0, 0, width, height));
+            int x0 = r.right() + 1, y0 = r.bottom() + 1, x1 = r.left() - 1, y1 = r.top() - 1;
+            for (int y = r.top(); y <= r.bottom(); ++y) {
+                for (int x = r.left(); x <= r.right(); ++x) {
+                    if (!differs(static_cast<size_t>(y) * width + x))
+                        continue;
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x);
+                    y0 = std::min(y0, y);
+                    y1 = std::max(y1, y);
+                }
+            }
+            if (x1 >= x0)
+                result.append(QRect(QPoint(x0, y0), QPoint(x1, y1)));
+        }
+        return result;
+    }
+}
+
+//-----------------------------------------------------------------------------
+CMapDiffResult CMapDiff::diff(const CMap& a, const CMap& b)
+{
+    CMapDiffResult result;
+    const int w = std::min(a.width(), b.width());
+    const int h = std::min(a.height(), b.height());
+    const int blocksX = (w + BLOCK - 1) / BLOCK;
+    const int blocksY = (h + BLOCK - 1) / BLOCK;
+    std::vector<uint8_t> flags(static_cast<size_t>(blocksX) * blocksY, 0);
+
+    const int strideA = a.width();
+    const int strideB = b.width();
+
+    // One kernel per pair of cell widths, so the compare loop stays branch-free
+    a.visitCells([&](const auto* pa) {
+        b.visitCells([&](const auto* pb) {
+            int bands = CParallel::bandCount(blocksY, 1);
+            std::vector<size_t> bandChanged(std::max(1, bands), 0);
+            CParallel::forBands(blocksY, 1, [&](int band, int begin, int end) {
+                size_t changed = 0;
+                for (int by = begin; by < end; ++by) {
+                    uint8_t* rowFlags = flags.data() + static_cast<size_t>(by) * blocksX;
+                    int y1 = std::min(h, (by + 1) * BLOCK);
+                    for (int y = by * BLOCK; y < y1; ++y) {
+                        const auto* ra = pa + static_cast<size_t>(y) * strideA;
+                        const auto* rb = pb + static_cast<size_t>(y) * strideB;
+                        for (int bx = 0; bx < blocksX; ++bx) {
+                            int x0 = bx * BLOCK;
+                            int x1 = std::min(w, x0 + BLOCK);
+                            uint32_t count = 0;
+                            for (int x = x0; x < x1; ++x)
+                                count += static_cast<uint32_t>(ra[x]) != static_cast<uint32_t>(rb[x]);
+                            rowFlags[bx] |= count != 0;
+                            changed += count;
+                        }
+                    }
+                }
+                bandChanged[band] = changed;
+            });
+            for (size_t c : bandChanged)
+                result.changedTiles += c;
+
+            if (result.changedTiles) {
+                result.regions = tighten(groupBlocks(flags, blocksX, blocksY), w, h, [&](size_t i) {
+                    size_t x = i % w, y = i / w;
+                    return static_cast<uint32_t>(pa[y * strideA + x]) != static_cast<uint32_t>(pb[y * strideB + x]);
+                });
+            }
+        });
+    });
+
+    // Anything outside the common area counts as changed
+    const int maxW = std::max(a.width(), b.width());
+    const int maxH = std::max(a.height(), b.height());
+    if (maxW != w || maxH != h) {
+        result.sizeChanged = true;
+        if (maxW > w)
+            result.regions.append(QRect(w, 0, maxW - w, maxH));
+        if (maxH > h)
+            result.regions.append(QRect(0, h, w, maxH - h));
+        result.changedTiles += static_cast<size_t>(maxW) * maxH - static_cast<size_t>(w) * h;
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapDiff::merge(const CMap& base, const CMap& ours, const CMap& theirs, CMapMergeResult& result, QString* error)
+{
+    if (ours.width() != base.width() || ours.height() != base.height() ||
+        theirs.width() != base.width() || theirs.height() != base.height()) {
+        if (error)
+            *error = QString("Map sizes differ (base %1x%2, ours %3x%4, theirs %5x%6)")
+                .arg(base.width()).arg(base.height()).arg(ours.width()).arg(ours.height())
+                .arg(theirs.width()).arg(theirs.height());
+        return false;
+    }
+
+    const int w = base.width();
+    const int h = base.height();
+    const int blocksX = (w + BLOCK - 1) / BLOCK;
+    const int blocksY = (h + BLOCK - 1) / BLOCK;
+    std::vector<uint8_t> flags(static_cast<size_t>(blocksX) * blocksY, 0);
+
+    result = CMapMergeResult();
+    result.merged = CMap(w, h);
+    // Every merged tile comes from ours or theirs
+    result.merged.reserveCellBytes(std::max(ours.cellBytes(), theirs.cellBytes()));
+
+    // Take theirs where ours kept the base value; both sides changing a tile
+    // to different values is a conflict, which keeps ours. The three inputs
+    // are read a row at a time widened to 32 bits, and the merged cells are
+    // written through one kernel per cell width.
+    int bands = CParallel::bandCount(blocksY, 1);
+    std::vector<size_t> bandConflicts(std::max(1, bands), 0);
+    std::vector<size_t> bandTheirs(std::max(1, bands), 0);
+    result.merged.visitCells([&](auto* pm) {
+        using T = std::remove_pointer_t<decltype(pm)>;
+        CParallel::forBands(blocksY, 1, [&](int band, int begin, int end) {
+            std::vector<uint32_t> rowB(w), rowO(w), rowT(w);
+            size_t conflicts = 0;
+            size_t fromTheirs = 0;
+            for (int by = begin; by < end; ++by) {
+                uint8_t* rowFlags = flags.data() + static_cast<size_t>(by) * blocksX;
+                int y1 = std::min(h, (by + 1) * BLOCK);
+                for (int y = by * BLOCK; y < y1; ++y) {
+                    base.readRow(y, 0, w, rowB.data());
+                    ours.readRow(y, 0, w, rowO.data());
+                    theirs.readRow(y, 0, w, rowT.data());
+                    T* rowM = pm + static_cast<size_t>(y) * w;
+                    for (int bx = 0; bx < blocksX; ++bx) {
+                        int x0 = bx * BLOCK;
+                        int x1 = std::min(w, x0 + BLOCK);
+                        uint32_t blockConflicts = 0;
+                        for (int x = x0; x < x1; ++x) {
+                            uint32_t b = rowB[x], o = rowO[x], t = rowT[x];
+                            bool takeTheirs = o == b;
+                            rowM[x] = static_cast<T>(takeTheirs ? t : o);
+                            fromTheirs += takeTheirs & (t != b);
+                            blockConflicts += (o != t) & (o != b) & (t != b);
+                        }
+                        rowFlags[bx] |= blockConflicts != 0;
+                        conflicts += blockConflicts;
+                    }
+                }
+            }
+            bandConflicts[band] = conflicts;
+            bandTheirs[band] = fromTheirs;
+        });
+    });
+    for (size_t c : bandConflicts)
+        result.conflictTiles += c;
+    for (size_t c : bandTheirs)
+        result.tilesFromTheirs += c;
+    result.merged.touchRect(0, 0, w, h);
+
+    // Conflicts are rare, so the tightening reads single tiles
+    if (result.conflictTiles) {
+        result.conflicts = tighten(groupBlocks(flags, blocksX, blocksY), w, h, [&](size_t i) {
+            int x = static_cast<int>(i % w), y = static_cast<int>(i / w);
+            uint32_t b = base.tileAt(x, y), o = ours.tileAt(x, y), t = theirs.tileAt(x, y);
+            return o != t && o != b && t != b;
+        });
+    }
+
+    // Objects follow the same rule per id; a missing object is a deletion
+    std::map<uint32_t, const CMapObject*> baseObjects, ourObjects, theirObjects;
+    for (const CMapObject& obj : base.objects().objects()) baseObjects[obj.id] = &obj;
+    for (const CMapObject& obj : ours.objects().objects()) ourObjects[obj.id] = &obj;
+    for (const CMapObject& obj : theirs.objects().objects()) theirObjects[obj.id] = &obj;
+
+    auto same = [](const CMapObject* x, const CMapObject* y) {
+        return x == y || (x && y && sameObject(*x, *y));
+    };
+    auto lookup = [](const std::map<uint32_t, const CMapObject*>& m, uint32_t id) -> const CMapObject* {
+        auto it = m.find(id);
+        return it == m.end() ? nullptr : it->second;
+    };
+
+    // Objects both sides added under the same new id are both kept; theirs
+    // gets a fresh id once every other id has been placed
+    std::vector<CMapObject> renumbered;
+    std::map<uint32_t, bool> ids;
+    for (const auto& entry : baseObjects) ids[entry.first] = true;
+    for (const auto& entry : ourObjects) ids[entry.first] = true;
+    for (const auto& entry : theirObjects) ids[entry.first] = true;
+    for (const auto& entry : ids) {
+        const CMapObject* b = lookup(baseObjects, entry.first);
+        const CMapObject* o = lookup(ourObjects, entry.first);
+        const CMapObject* t = lookup(theirObjects, entry.first);
+        const CMapObject* pick = o;
+        if (!b && o && t && !same(o, t)) {
+            renumbered.push_back(*t);
+            renumbered.back().id = 0;
+        } else if (!same(o, t)) {
+            if (same(o, b))
+                pick = t;
+            else if (!same(t, b))
+                ++result.objectConflicts;
+        }
+        if (pick)
+            result.merged.objects().add(*pick);
+    }
+    for (CMapObject& obj : renumbered)
+        result.merged.objects().add(std::move(obj));
+    return true;
+}
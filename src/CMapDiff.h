@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CMap.h"
+
+#include <cstddef>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+struct CMapDiffResult
+{
+    QVector<QRect> regions;     // changed tiles, grouped into rects
+    size_t changedTiles = 0;
+    bool sizeChanged = false;
+
+    bool isEmpty() const { return changedTiles == 0 && !sizeChanged; }
+};
+
+//-----------------------------------------------------------------------------
+struct CMapMergeResult
+{
+    CMap merged;                // "ours" wherever both sides conflict
+    QVector<QRect> conflicts;
+    size_t conflictTiles = 0;
+    size_t tilesFromTheirs = 0;
+    int objectConflicts = 0;
+
+    bool isClean() const { return conflictTiles == 0 && objectConflicts == 0; }
+};
+
+//-----------------------------------------------------------------------------
+// Tile-level diff and three-way merge. Buffers are compared in blocks of
+// DIFF_BLOCK_SIZE x DIFF_BLOCK_SIZE tiles with branch-free inner loops over
+// parallel row bands; flagged blocks are joined into rects and then tightened
+// to the tiles that actually differ.
+namespace CMapDiff {
+    CMapDiffResult diff(const CMap& a, const CMap& b);
+
+    // All three maps must have the same size. Objects merge by id.
+    bool merge(const CMap& base, const CMap& ours, const CMap& theirs, CMapMergeResult& result, QString* error = nullptr);
+}
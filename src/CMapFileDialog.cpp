@@ -0,0 +1,62 @@
+#include "CMapFileDialog.h"
+#include "CThumbnailCache.h"
+#include "Constants.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QGridLayout>
+#include <QLabel>
+#include <QPixmap>
+
+//-----------------------------------------------------------------------------
+CMapFileDialog::CMapFileDialog(CThumbnailCache* thumbnails, const QString& caption, const QString& directory,
+                               QWidget* parent)
+    : QFileDialog(parent, caption, directory, tr("Map files (*.json);;All files (*)")),
+      m_thumbnails(thumbnails)
+{
+    setOption(QFileDialog::DontUseNativeDialog);
+    setFileMode(QFileDialog::ExistingFile);
+    setAcceptMode(QFileDialog::AcceptOpen);
+
+    const int side = Constants::THUMBNAIL_SIZE + 8;
+    m_preview = new QLabel(this);
+    m_preview->setFixedSize(side, side);
+    m_preview->setAlignment(Qt::AlignCenter);
+    m_preview->setFrameStyle(QFrame::StyledPanel | QFrame::Sunken);
+    if (QGridLayout* grid = qobject_cast<QGridLayout*>(layout()))
+        grid->addWidget(m_preview, 0, grid->columnCount(), grid->rowCount(), 1, Qt::AlignTop);
+
+    connect(this, &QFileDialog::currentChanged, this, &CMapFileDialog::showPreview);
+    connect(this, &QFileDialog::directoryEntered, this, &CMapFileDialog::prefetch);
+    connect(m_thumbnails, &CThumbnailCache::thumbnailReady, this, [this](const QString& path, const QImage& image) {
+        if (path == m_current)
+            m_preview->setPixmap(QPixmap::fromImage(image));
+    });
+    connect(m_thumbnails, &CThumbnailCache::thumbnailFailed, this, [this](const QString& path) {
+        if (path == m_current)
+            m_preview->setText(tr("No preview"));
+    });
+    prefetch(this->directory().absolutePath());
+}
+
+//-----------------------------------------------------------------------------
+void CMapFileDialog::showPreview(const QString& path)
+{
+    m_current = path;
+    m_preview->clear();
+    if (!QFileInfo(path).isFile())
+        return;
+    QImage image = m_thumbnails->thumbnail(path);
+    if (image.isNull())
+        m_preview->setText(m_thumbnails->hasFailed(path) ? tr("No preview") : tr("Loading..."));
+    else
+        m_preview->setPixmap(QPixmap::fromImage(image));
+}
+
+//-----------------------------------------------------------------------------
+void CMapFileDialog::prefetch(const QString& directory)
+{
+    QDir dir(directory);
+    for (const QString& name : dir.entryList({"*.json"}, QDir::Files))
+        m_thumbnails->thumbnail(dir.filePath(name), true);
+}
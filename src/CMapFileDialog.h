@@ -0,0 +1,28 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+#include <QFileDialog>
+
+//-----------------------------------------------------------------------------
+class CThumbnailCache;
+class QLabel;
+
+//-----------------------------------------------------------------------------
+// Open dialog for map files with a thumbnail of the selected file. Entering
+// a folder queues thumbnails for all of its maps in the background. Uses
+// Qt's own dialog, as native ones cannot show the preview.
+class CMapFileDialog : public QFileDialog
+{
+    Q_OBJECT
+public:
+    CMapFileDialog(CThumbnailCache* thumbnails, const QString& caption, const QString& directory,
+                   QWidget* parent = nullptr);
+
+private:
+    void showPreview(const QString& path);
+    void prefetch(const QString& directory);
+
+    CThumbnailCache* m_thumbnails;
+    QLabel* m_preview = nullptr;
+    QString m_current;
+};
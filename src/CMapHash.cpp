@@ -0,0 +1,248 @@
+#include "CMapHash.h"
+#include "CMap.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const uint64_t PRIME1 = 11400714785074694791ULL;
+    const uint64_t PRIME2 = 14029467366897019727ULL;
+    const uint64_t PRIME3 = 1609587929392839161ULL;
+    const uint64_t PRIME4 = 9650029242287828579ULL;
+    const uint64_t PRIME5 = 2870177450012600261ULL;
+
+    uint64_t rotl(uint64_t v, int r)
+    {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    uint64_t read64(const unsigned char* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint32_t read32(const unsigned char* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint64_t xxRound(uint64_t acc, uint64_t input)
+    {
+        acc += input * PRIME2;
+        acc = rotl(acc, 31);
+        return acc * PRIME1;
+    }
+
+    uint64_t mergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= xxRound(0, val);
+        return acc * PRIME1 + PRIME4;
+    }
+
+    uint64_t chunkHash(const CMap& map, int cx, int cy)
+    {
+        const int chunk = Constants::MAP_CHUNK_SIZE;
+        int x0 = cx * chunk;
+        int y0 = cy * chunk;
+        int x1 = std::min(map.width(), x0 + chunk);
+        int y1 = std::min(map.height(), y0 + chunk);
+
+        // Rows are hashed as 32-bit ids whatever the cell width, so the
+        // digest of a saved map does not depend on how it is stored
+        uint32_t row[Constants::MAP_CHUNK_SIZE];
+        CXxHash64 hash;
+        for (int y = y0; y < y1; ++y) {
+            map.readRow(y, x0, x1 - x0, row);
+            hash.update(row, (x1 - x0) * sizeof(uint32_t));
+        }
+        return hash.digest();
+    }
+
+    // Objects are hashed in id order so swap-removes and re-adds that end
+    // with the same content give the same digest
+    uint64_t objectsHash(const CObjectLayer& layer)
+    {
+        std::vector<const CMapObject*> sorted;
+        sorted.reserve(layer.objects().size());
+        for (const CMapObject& obj : layer.objects())
+            sorted.push_back(&obj);
+        std::sort(sorted.begin(), sorted.end(), [](const CMapObject* a, const CMapObject* b) {
+            return a->id < b->id;
+        });
+
+        QByteArray bytes;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        QDataStream out(&buffer);
+        for (const CMapObject* obj : sorted)
+            out << obj->id << obj->rect << obj->type << obj->properties;
+        return CXxHash64::hash(bytes.constData(), static_cast<size_t>(bytes.size()));
+    }
+}
+
+//-----------------------------------------------------------------------------
+CXxHash64::CXxHash64(uint64_t seed)
+    : m_seed(seed)
+{
+    m_acc[0] = seed + PRIME1 + PRIME2;
+    m_acc[1] = seed + PRIME2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - PRIME1;
+}
+
+//-----------------------------------------------------------------------------
+void CXxHash64::update(const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    m_total += size;
+
+    if (m_buffered + size < sizeof(m_buffer)) {
+        std::memcpy(m_buffer + m_buffered, p, size);
+        m_buffered += size;
+        return;
+    }
+
+    if (m_buffered > 0) {
+        size_t fill = sizeof(m_buffer) - m_buffered;
+        std::memcpy(m_buffer + m_buffered, p, fill);
+        for (int i = 0; i < 4; ++i)
+            m_acc[i] = xxRound(m_acc[i], read64(m_buffer + i * 8));
+        p += fill;
+        size -= fill;
+        m_buffered = 0;
+    }
+
+    while (size >= 32) {
+        for (int i = 0; i < 4; ++i)
+            m_acc[i] = xxRound(m_acc[i], read64(p + i * 8));
+        p += 32;
+        size -= 32;
+    }
+
+    std::memcpy(m_buffer, p, size);
+    m_buffered = size;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CXxHash64::digest() const
+{
+    uint64_t h;
+    if (m_total >= 32) {
+        h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = mergeRound(h, m_acc[i]);
+    } else {
+        h = m_seed + PRIME5;
+    }
+    h += m_total;
+
+    const unsigned char* p = m_buffer;
+    size_t left = m_buffered;
+    while (left >= 8) {
+        h ^= xxRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+        left -= 8;
+    }
+    if (left >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        left -= 4;
+    }
+    while (left > 0) {
+        h ^= *p * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+        --left;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CXxHash64::hash(const void* data, size_t size, uint64_t seed)
+{
+    CXxHash64 h(seed);
+    h.update(data, size);
+    return h.digest();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CMapHash::digest(const CMap& map)
+{
+    if (map.chunksX() != m_chunksX || map.chunksY() != m_chunksY) {
+        m_chunksX = map.chunksX();
+        m_chunksY = map.chunksY();
+        size_t count = static_cast<size_t>(m_chunksX) * m_chunksY;
+        m_chunkRevision.assign(count, 0);
+        m_chunkHash.assign(count, 0);
+    }
+
+    // Chunk revisions are never 0 once a map is sized, so a fresh cache
+    // rehashes everything
+    std::vector<int> dirty;
+    for (int i = 0; i < static_cast<int>(m_chunkHash.size()); ++i) {
+        if (map.chunkRevision(i % m_chunksX, i / m_chunksX) != m_chunkRevision[i])
+            dirty.push_back(i);
+    }
+
+    int minBand = std::max(1, Constants::PARALLEL_MIN_ROWS / Constants::MAP_CHUNK_SIZE);
+    CParallel::forBands(static_cast<int>(dirty.size()), minBand, [&](int, int begin, int end) {
+        for (int k = begin; k < end; ++k) {
+            int i = dirty[k];
+            m_chunkHash[i] = chunkHash(map, i % m_chunksX, i / m_chunksX);
+            m_chunkRevision[i] = map.chunkRevision(i % m_chunksX, i / m_chunksX);
+        }
+    });
+
+    CXxHash64 hash;
+    int32_t size[2] = { map.width(), map.height() };
+    hash.update(size, sizeof(size));
+    hash.update(m_chunkHash.data(), m_chunkHash.size() * sizeof(uint64_t));
+    uint64_t objects = objectsHash(map.objects());
+    hash.update(&objects, sizeof(objects));
+    return hash.digest();
+}
+
+//-----------------------------------------------------------------------------
+QString CMapHash::toHex(uint64_t digest)
+{
+    return QString("%1").arg(digest, 16, 16, QChar('0'));
+}
+
+//-----------------------------------------------------------------------------
+bool CMapHash::fromHex(const QString& text, uint64_t& digest)
+{
+    if (text.size() != 16) return false;
+    bool ok = false;
+    uint64_t value = text.toULongLong(&ok, 16);
+    if (!ok) return false;
+    digest = value;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+QString CMapHash::fileStamp(const QString& path)
+{
+    QFileInfo fi(path);
+    if (!fi.exists())
+        return QString();
+    return QString("%1|%2").arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.size());
+}
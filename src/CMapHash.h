@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <QString>
+
+//-----------------------------------------------------------------------------
+class CMap;
+
+//-----------------------------------------------------------------------------
+// Streaming xxHash64 (XXH64), matching the reference implementation for
+// little-endian input.
+class CXxHash64
+{
+public:
+    explicit CXxHash64(uint64_t seed = 0);
+
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+
+private:
+    uint64_t m_acc[4];
+    uint64_t m_seed;
+    uint64_t m_total = 0;
+    unsigned char m_buffer[32];
+    size_t m_buffered = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Content digest of a map. Tiles are hashed per MAP_CHUNK_SIZE chunk and the
+// chunk hashes are cached against CMap::chunkRevision(), so after an edit
+// only the touched chunks are read again. Objects are few and are hashed in
+// full every time. Not thread safe; call from the thread that owns the map.
+class CMapHash
+{
+public:
+    uint64_t digest(const CMap& map);
+    const std::vector<uint64_t>& chunks() const { return m_chunkHash; }
+
+    static QString toHex(uint64_t digest);
+    static bool fromHex(const QString& text, uint64_t& digest);
+
+    // Modification time and size of a file, empty if it does not exist; a
+    // stamp taken right after writing identifies our own version of it
+    static QString fileStamp(const QString& path);
+
+private:
+    int m_chunksX = 0;
+    int m_chunksY = 0;
+    std::vector<uint64_t> m_chunkRevision;
+    std::vector<uint64_t> m_chunkHash;
+};
@@ -0,0 +1,345 @@
+#include "CMapPack.h"
+#include "CMap.h"
+#include "CParallel.h"
+
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const quint32 PACK_MAGIC = 0x4b41504d;     // "MPAK" in file order
+    const quint16 PACK_VERSION = 1;
+    const quint32 PACK_ZLIB = 1;
+    const int HEADER_BYTES = 64;
+    const int ENTRY_BYTES = 24;
+    const int MIN_BAND_CHUNKS = 4;
+
+    bool fail(QString* error, const QString& message)
+    {
+        if (error)
+            *error = message;
+        return false;
+    }
+
+    // Encodes the w x h cells at origin, rows stride apart, as a chunk of
+    // Out cells
+    template <typename Out, typename In>
+    void encodeCells(const In* origin, int stride, int w, int h, int size, int level, CMapPackChunk& chunk)
+    {
+        const In first = origin[0];
+        In differs = 0;
+        for (int y = 0; y < h && !differs; ++y) {
+            const In* row = origin + static_cast<size_t>(y) * stride;
+            for (int x = 0; x < w; ++x)
+                differs |= row[x] ^ first;
+        }
+        if (!differs) {
+            chunk.value = first;
+            chunk.flags = CMapPack::CHUNK_UNIFORM | (first == 0 ? CMapPack::CHUNK_EMPTY : 0);
+            return;
+        }
+
+        const int rowBytes = size * static_cast<int>(sizeof(Out));
+        QByteArray raw(rowBytes * size, '\0');
+        for (int y = 0; y < h; ++y) {
+            const In* row = origin + static_cast<size_t>(y) * stride;
+            char* dest = raw.data() + y * rowBytes;
+            if constexpr (std::is_same_v<In, Out>) {
+                qToLittleEndian<Out>(row, w, dest);
+            } else {
+                for (int x = 0; x < w; ++x)
+                    qToLittleEndian<Out>(static_cast<Out>(row[x]), dest + x * sizeof(Out));
+            }
+        }
+
+        if (level > 0) {
+            // qCompress puts the raw size in front of the zlib stream; the
+            // reader knows it from the header
+            QByteArray packed = qCompress(raw, level);
+            if (packed.size() - 4 < raw.size()) {
+                chunk.data = packed.remove(0, 4);
+                chunk.size = static_cast<quint32>(chunk.data.size());
+                chunk.flags = CMapPack::CHUNK_COMPRESSED;
+                return;
+            }
+        }
+        chunk.data = raw;
+        chunk.size = static_cast<quint32>(raw.size());
+    }
+
+    template <typename T>
+    void widenCells(const char* raw, int count, uint32_t* cells)
+    {
+        for (int i = 0; i < count; ++i)
+            cells[i] = qFromLittleEndian<T>(raw + i * sizeof(T));
+    }
+}
+
+//-----------------------------------------------------------------------------
+CMapPackWriter::CMapPackWriter(QIODevice& device, const CMapPackHeader& header)
+: m_device(device),
+  m_header(header)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Header and index are placeholders until every chunk offset is known
+bool CMapPackWriter::begin(QString* error)
+{
+    if (m_device.isSequential())
+        return fail(error, QString("Runtime packs need a seekable output"));
+
+    const qint64 chunks = static_cast<qint64>(m_header.chunksX) * m_header.chunksY;
+    m_header.indexOffset = HEADER_BYTES;
+    m_header.dataOffset = m_header.indexOffset + chunks * ENTRY_BYTES;
+    m_index.clear();
+    m_index.reserve(static_cast<int>(chunks * ENTRY_BYTES));
+    m_offset = m_header.dataOffset;
+    m_stats = CMapPackStats();
+
+    if (!m_device.seek(0) || m_device.write(QByteArray(static_cast<int>(m_header.dataOffset), '\0')) != m_header.dataOffset)
+        return fail(error, m_device.errorString());
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapPackWriter::add(const CMapPackChunk& chunk, QString* error)
+{
+    const qint64 stored = chunk.data.size();
+    if (stored && m_device.write(chunk.data) != stored)
+        return fail(error, m_device.errorString());
+
+    char entry[ENTRY_BYTES];
+    qToLittleEndian<quint64>(stored ? m_offset : 0, entry);
+    qToLittleEndian<quint32>(static_cast<quint32>(stored), entry + 8);
+    qToLittleEndian<quint32>(chunk.value, entry + 12);
+    qToLittleEndian<quint32>(chunk.flags, entry + 16);
+    qToLittleEndian<quint32>(0, entry + 20);
+    m_index.append(entry, ENTRY_BYTES);
+    m_offset += stored;
+
+    ++m_stats.chunks;
+    if (chunk.flags & CMapPack::CHUNK_EMPTY)
+        ++m_stats.emptyChunks;
+    else if (chunk.flags & CMapPack::CHUNK_UNIFORM)
+        ++m_stats.uniformChunks;
+    else if (chunk.flags & CMapPack::CHUNK_COMPRESSED)
+        ++m_stats.compressedChunks;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapPackWriter::finish(const QByteArray& objects, CMapPackStats* stats, QString* error)
+{
+    Q_ASSERT(m_stats.chunks == m_header.chunksX * m_header.chunksY);
+    m_header.objectsOffset = objects.isEmpty() ? 0 : m_offset;
+    m_header.objectsSize = objects.size();
+    if (!objects.isEmpty() && m_device.write(objects) != objects.size())
+        return fail(error, m_device.errorString());
+    m_offset += objects.size();
+
+    QByteArray header;
+    header.reserve(HEADER_BYTES);
+    QDataStream headerOut(&header, QIODevice::WriteOnly);
+    headerOut.setByteOrder(QDataStream::LittleEndian);
+    headerOut << PACK_MAGIC << PACK_VERSION << static_cast<quint16>(m_header.cellBytes)
+              << static_cast<quint32>(m_header.width) << static_cast<quint32>(m_header.height)
+              << static_cast<quint32>(m_header.chunkSize) << static_cast<quint32>(m_header.chunksX)
+              << static_cast<quint32>(m_header.chunksY) << (m_header.compressed ? PACK_ZLIB : quint32(0))
+              << static_cast<quint64>(m_header.indexOffset) << static_cast<quint64>(m_header.dataOffset)
+              << static_cast<quint64>(m_header.objectsOffset) << static_cast<quint32>(m_header.objectsSize)
+              << quint32(0);
+    Q_ASSERT(header.size() == HEADER_BYTES);
+
+    if (!m_device.seek(0) || m_device.write(header) != header.size() || m_device.write(m_index) != m_index.size()
+        || !m_device.seek(m_offset))
+        return fail(error, m_device.errorString());
+
+    m_stats.bytes = m_offset;
+    if (stats)
+        *stats = m_stats;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapPack::write(const CMap& map, QIODevice& device, const CMapPackOptions& options,
+                     CMapPackStats* stats, QString* error)
+{
+    const int size = options.chunkSize;
+    if (size < Constants::PACK_MIN_CHUNK_SIZE || size > Constants::PACK_MAX_CHUNK_SIZE)
+        return fail(error, QString("Chunk size must be between %1 and %2")
+                               .arg(Constants::PACK_MIN_CHUNK_SIZE).arg(Constants::PACK_MAX_CHUNK_SIZE));
+    if (map.width() <= 0 || map.height() <= 0)
+        return fail(error, QString("The map is empty"));
+
+    const int level = std::clamp(options.compressionLevel, 0, 9);
+    CMapPackHeader header;
+    header.cellBytes = map.cellBytes();
+    header.width = map.width();
+    header.height = map.height();
+    header.chunkSize = size;
+    header.chunksX = (map.width() + size - 1) / size;
+    header.chunksY = (map.height() + size - 1) / size;
+    header.compressed = level > 0;
+
+    CMapPackWriter writer(device, header);
+    if (!writer.begin(error))
+        return false;
+
+    std::vector<CMapPackChunk> row(header.chunksX);
+    for (int cy = 0; cy < header.chunksY; ++cy) {
+        map.visitCells([&](const auto* cells) {
+            using T = std::remove_const_t<std::remove_pointer_t<decltype(cells)>>;
+            CParallel::forBands(header.chunksX, MIN_BAND_CHUNKS, [&](int, int begin, int end) {
+                for (int cx = begin; cx < end; ++cx) {
+                    const int x0 = cx * size;
+                    const int y0 = cy * size;
+                    encodeCells<T>(cells + static_cast<size_t>(y0) * map.width() + x0, map.width(),
+                                   std::min(size, map.width() - x0), std::min(size, map.height() - y0),
+                                   size, level, row[cx]);
+                }
+            });
+        });
+
+        for (CMapPackChunk& chunk : row) {
+            if (!writer.add(chunk, error))
+                return false;
+            chunk = CMapPackChunk();
+        }
+    }
+
+    QByteArray objects;
+    if (map.objects().count() > 0)
+        objects = QJsonDocument(map.objects().toJson()).toJson(QJsonDocument::Compact);
+    return writer.finish(objects, stats, error);
+}
+
+//-----------------------------------------------------------------------------
+// Written to a temporary file and renamed, so a game watching the pack never
+// reads a half-written one
+bool CMapPack::write(const CMap& map, const QString& path, const CMapPackOptions& options,
+                     CMapPackStats* stats, QString* error)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(error, QString("Cannot write %1: %2").arg(path, file.errorString()));
+    if (!write(map, file, options, stats, error))
+        return false;
+    if (!file.commit())
+        return fail(error, QString("Cannot write %1: %2").arg(path, file.errorString()));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapPack::readIndex(QIODevice& device, CMapPackHeader& header, QVector<CMapPackChunk>& index, QString* error)
+{
+    if (!device.seek(0))
+        return fail(error, device.errorString());
+    const QByteArray headerBytes = device.read(HEADER_BYTES);
+    if (headerBytes.size() != HEADER_BYTES)
+        return fail(error, QString("Not a runtime pack"));
+
+    QDataStream in(headerBytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic = 0, width = 0, height = 0, chunkSize = 0, chunksX = 0, chunksY = 0, compression = 0;
+    quint32 objectsSize = 0, reserved = 0;
+    quint16 version = 0, cellBytes = 0;
+    quint64 indexOffset = 0, dataOffset = 0, objectsOffset = 0;
+    in >> magic >> version >> cellBytes >> width >> height >> chunkSize >> chunksX >> chunksY >> compression
+       >> indexOffset >> dataOffset >> objectsOffset >> objectsSize >> reserved;
+    if (magic != PACK_MAGIC)
+        return fail(error, QString("Not a runtime pack"));
+    if (version != PACK_VERSION)
+        return fail(error, QString("Unsupported runtime pack version %1").arg(version));
+
+    const qint64 fileSize = device.size();
+    const qint64 chunks = static_cast<qint64>(chunksX) * chunksY;
+    if ((cellBytes != 1 && cellBytes != 2 && cellBytes != 4) || width == 0 || height == 0
+        || chunkSize < static_cast<quint32>(Constants::PACK_MIN_CHUNK_SIZE)
+        || chunkSize > static_cast<quint32>(Constants::PACK_MAX_CHUNK_SIZE)
+        || chunksX != (quint64(width) + chunkSize - 1) / chunkSize
+        || chunksY != (quint64(height) + chunkSize - 1) / chunkSize
+        || compression > PACK_ZLIB || indexOffset + chunks * ENTRY_BYTES > static_cast<quint64>(fileSize)
+        || objectsOffset + objectsSize > static_cast<quint64>(fileSize))
+        return fail(error, QString("Corrupt runtime pack header"));
+
+    header.cellBytes = cellBytes;
+    header.width = static_cast<int>(width);
+    header.height = static_cast<int>(height);
+    header.chunkSize = static_cast<int>(chunkSize);
+    header.chunksX = static_cast<int>(chunksX);
+    header.chunksY = static_cast<int>(chunksY);
+    header.compressed = compression == PACK_ZLIB;
+    header.indexOffset = static_cast<qint64>(indexOffset);
+    header.dataOffset = static_cast<qint64>(dataOffset);
+    header.objectsOffset = static_cast<qint64>(objectsOffset);
+    header.objectsSize = objectsSize;
+
+    if (!device.seek(header.indexOffset))
+        return fail(error, device.errorString());
+    const QByteArray indexBytes = device.read(chunks * ENTRY_BYTES);
+    if (indexBytes.size() != chunks * ENTRY_BYTES)
+        return fail(error, QString("Corrupt runtime pack index"));
+    QDataStream entries(indexBytes);
+    entries.setByteOrder(QDataStream::LittleEndian);
+
+    const quint32 rawBytes = chunkSize * chunkSize * cellBytes;
+    index.resize(static_cast<int>(chunks));
+    for (CMapPackChunk& chunk : index) {
+        quint64 offset = 0;
+        entries >> offset >> chunk.size >> chunk.value >> chunk.flags >> reserved;
+        chunk.offset = static_cast<qint64>(offset);
+        const bool uniform = chunk.flags & CHUNK_UNIFORM;
+        if ((!uniform && (chunk.size == 0 || offset + chunk.size > static_cast<quint64>(fileSize)))
+            || (!uniform && !(chunk.flags & CHUNK_COMPRESSED) && chunk.size != rawBytes))
+            return fail(error, QString("Corrupt runtime pack index"));
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapPack::decodeChunk(const CMapPackHeader& header, const CMapPackChunk& chunk, uint32_t* cells)
+{
+    const int count = header.chunkSize * header.chunkSize;
+    if (chunk.flags & CHUNK_UNIFORM) {
+        std::fill(cells, cells + count, chunk.value);
+        return true;
+    }
+
+    const int rawBytes = count * header.cellBytes;
+    QByteArray raw;
+    if (chunk.flags & CHUNK_COMPRESSED) {
+        QByteArray prefixed(4, '\0');
+        qToBigEndian<quint32>(rawBytes, prefixed.data());
+        raw = qUncompress(prefixed + chunk.data);
+    } else {
+        raw = chunk.data;
+    }
+    if (raw.size() != rawBytes)
+        return false;
+
+    switch (header.cellBytes) {
+    case 1: widenCells<uint8_t>(raw.constData(), count, cells); break;
+    case 2: widenCells<uint16_t>(raw.constData(), count, cells); break;
+    default: widenCells<uint32_t>(raw.constData(), count, cells); break;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+CMapPackChunk CMapPack::encodeChunk(const uint32_t* cells, int w, int h, int chunkSize, int cellBytes, int level)
+{
+    CMapPackChunk chunk;
+    switch (cellBytes) {
+    case 1: encodeCells<uint8_t>(cells, chunkSize, w, h, chunkSize, level, chunk); break;
+    case 2: encodeCells<uint16_t>(cells, chunkSize, w, h, chunkSize, level, chunk); break;
+    default: encodeCells<uint32_t>(cells, chunkSize, w, h, chunkSize, level, chunk); break;
+    }
+    return chunk;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Constants.h"
+
+#include <cstdint>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QIODevice;
+
+//-----------------------------------------------------------------------------
+struct CMapPackOptions
+{
+    int chunkSize = Constants::MAP_CHUNK_SIZE;
+    int compressionLevel = Constants::PACK_COMPRESSION_LEVEL;  // 0 stores chunks raw
+};
+
+//-----------------------------------------------------------------------------
+struct CMapPackStats
+{
+    int chunks = 0;
+    int emptyChunks = 0;
+    int uniformChunks = 0;          // not counting empty ones
+    int compressedChunks = 0;
+    qint64 bytes = 0;
+};
+
+//-----------------------------------------------------------------------------
+struct CMapPackHeader
+{
+    int cellBytes = 1;
+    int width = 0;
+    int height = 0;
+    int chunkSize = 0;
+    int chunksX = 0;
+    int chunksY = 0;
+    bool compressed = false;        // chunks may be zlib streams
+    qint64 indexOffset = 0;
+    qint64 dataOffset = 0;
+    qint64 objectsOffset = 0;       // 0 without objects
+    qint64 objectsSize = 0;
+};
+
+//-----------------------------------------------------------------------------
+// One index entry, or one chunk as encoded for writing, in which case data
+// holds the stored bytes and offset is unused
+struct CMapPackChunk
+{
+    qint64 offset = 0;
+    quint32 size = 0;               // stored bytes, 0 for uniform chunks
+    quint32 value = 0;
+    quint32 flags = 0;
+    QByteArray data;
+};
+
+//-----------------------------------------------------------------------------
+// Runtime pack for games that stream a level in chunks. All fields are
+// little-endian:
+//
+//   header   magic "MPAK", version, cell bytes, map size, chunk size, chunk
+//            grid size, compression, index / data / objects offsets,
+//            objects size
+//   index    one 24-byte entry per chunk in row-major chunk order: data
+//            offset, stored size, uniform value, flags, reserved
+//   data     the chunks that are not uniform, each chunkSize x chunkSize
+//            cells of the map's cell width, optionally as a zlib stream
+//   objects  the object layer as compact JSON
+//
+// Cells past the map edge are stored as 0 and do not count when deciding
+// whether a chunk is uniform; uniform chunks store only their value.
+//
+// The map is read once, one chunk row at a time with the chunks of a row
+// encoded in parallel, and every row is written out before the next is
+// encoded, so the output is never held in memory whole. The device must be
+// seekable, as the index is filled in at the end.
+namespace CMapPack {
+    enum ChunkFlag {
+        CHUNK_UNIFORM = 1,          // every cell holds the entry's value
+        CHUNK_EMPTY = 2,            // uniform with value 0
+        CHUNK_COMPRESSED = 4
+    };
+
+    bool write(const CMap& map, QIODevice& device, const CMapPackOptions& options,
+               CMapPackStats* stats = nullptr, QString* error = nullptr);
+    bool write(const CMap& map, const QString& path, const CMapPackOptions& options,
+               CMapPackStats* stats = nullptr, QString* error = nullptr);
+
+    // Reads the header and chunk index only
+    bool readIndex(QIODevice& device, CMapPackHeader& header, QVector<CMapPackChunk>& index,
+                   QString* error = nullptr);
+    // Expands a chunk, with data holding its stored bytes for chunks that are
+    // not uniform, into chunkSize * chunkSize cells
+    bool decodeChunk(const CMapPackHeader& header, const CMapPackChunk& chunk, uint32_t* cells);
+    // Encodes chunkSize * chunkSize cells of which the w x h at the top left
+    // lie inside the map, narrowed to cellBytes
+    CMapPackChunk encodeChunk(const uint32_t* cells, int w, int h, int chunkSize, int cellBytes, int level);
+}
+
+//-----------------------------------------------------------------------------
+// Writes a pack from chunks supplied one at a time in row-major order, for
+// sources that never hold the whole map
+class CMapPackWriter
+{
+public:
+    // The offsets and the objects size of header are filled in here
+    CMapPackWriter(QIODevice& device, const CMapPackHeader& header);
+
+    bool begin(QString* error = nullptr);
+    bool add(const CMapPackChunk& chunk, QString* error = nullptr);
+    bool finish(const QByteArray& objects, CMapPackStats* stats = nullptr, QString* error = nullptr);
+
+private:
+    QIODevice& m_device;
+    CMapPackHeader m_header;
+    QByteArray m_index;
+    qint64 m_offset = 0;
+    CMapPackStats m_stats;
+};
@@ -1,13 +1,17 @@
 #include "CMapPreferencesDialog.h"
 #include "Constants.h"
 
+#include <QButtonGroup>
 #include <QDialogButtonBox>
 #include <QFormLayout>
+#include <QGridLayout>
 #include <QSpinBox>
+#include <QToolButton>
 #include <QVBoxLayout>
 
 //-----------------------------------------------------------------------------
-CMapPreferencesDialog::CMapPreferencesDialog(int currentWidth, int currentHeight, QWidget* parent)
+CMapPreferencesDialog::CMapPreferencesDialog(int currentWidth, int currentHeight, int undoBudgetMB, int undoSpillMB,
+                                             QWidget* parent)
 : QDialog(parent)
 {
     setWindowTitle(tr("Map Preferences"));
@@ -20,9 +24,37 @@ CMapPreferencesDialog::CMapPreferencesDialog(int currentWidth, int currentHeight
     m_heightSpinBox->setRange(Constants::MIN_MAP_HEIGHT, Constants::MAX_MAP_HEIGHT);
     m_heightSpinBox->setValue(currentHeight);
 
+    // 3x3 anchor grid: the edge or corner the existing tiles stay attached to
+    m_anchorGroup = new QButtonGroup(this);
+    QGridLayout* anchorLayout = new QGridLayout;
+    anchorLayout->setSpacing(2);
+    for (int i = 0; i < 9; ++i) {
+        QToolButton* btn = new QToolButton(this);
+        btn->setCheckable(true);
+        btn->setFixedSize(24, 24);
+        m_anchorGroup->addButton(btn, i);
+        anchorLayout->addWidget(btn, i / 3, i % 3);
+    }
+    m_anchorGroup->button(0)->setChecked(true);
+
+    m_undoBudgetSpinBox = new QSpinBox(this);
+    m_undoBudgetSpinBox->setRange(1, Constants::UNDO_MAX_LIMIT_MB);
+    m_undoBudgetSpinBox->setSuffix(tr(" MB"));
+    m_undoBudgetSpinBox->setValue(undoBudgetMB);
+    m_undoBudgetSpinBox->setToolTip(tr("Older undo steps are compressed past this size"));
+
+    m_undoSpillSpinBox = new QSpinBox(this);
+    m_undoSpillSpinBox->setRange(1, Constants::UNDO_MAX_LIMIT_MB);
+    m_undoSpillSpinBox->setSuffix(tr(" MB"));
+    m_undoSpillSpinBox->setValue(undoSpillMB);
+    m_undoSpillSpinBox->setToolTip(tr("Compressed undo steps move to a temporary file past this size"));
+
     QFormLayout* formLayout = new QFormLayout;
     formLayout->addRow(tr("Width:"), m_widthSpinBox);
     formLayout->addRow(tr("Height:"), m_heightSpinBox);
+    formLayout->addRow(tr("Anchor:"), anchorLayout);
+    formLayout->addRow(tr("Undo memory:"), m_undoBudgetSpinBox);
+    formLayout->addRow(tr("Undo on disk after:"), m_undoSpillSpinBox);
 
     QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
     connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
@@ -44,3 +76,27 @@ int CMapPreferencesDialog::height() const
 {
     return m_heightSpinBox->value();
 }
+
+//-----------------------------------------------------------------------------
+int CMapPreferencesDialog::anchorColumn() const
+{
+    return m_anchorGroup->checkedId() % 3;
+}
+
+//-----------------------------------------------------------------------------
+int CMapPreferencesDialog::anchorRow() const
+{
+    return m_anchorGroup->checkedId() / 3;
+}
+
+//-----------------------------------------------------------------------------
+int CMapPreferencesDialog::undoBudgetMB() const
+{
+    return m_undoBudgetSpinBox->value();
+}
+
+//-----------------------------------------------------------------------------
+int CMapPreferencesDialog::undoSpillMB() const
+{
+    return m_undoSpillSpinBox->value();
+}
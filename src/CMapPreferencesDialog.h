@@ -4,6 +4,7 @@
 #include <QDialog>
 
 //-----------------------------------------------------------------------------
+class QButtonGroup;
 class QSpinBox;
 
 //-----------------------------------------------------------------------------
@@ -11,12 +12,21 @@ class CMapPreferencesDialog : public QDialog
 {
     Q_OBJECT
 public:
-    explicit CMapPreferencesDialog(int currentWidth, int currentHeight, QWidget* parent = nullptr);
+    // Undo limits are in MB and apply to every open map
+    CMapPreferencesDialog(int currentWidth, int currentHeight, int undoBudgetMB, int undoSpillMB,
+                          QWidget* parent = nullptr);
 
     int width() const;
     int height() const;
+    int anchorColumn() const;
+    int anchorRow() const;
+    int undoBudgetMB() const;
+    int undoSpillMB() const;
 
 private:
     QSpinBox* m_widthSpinBox = nullptr;
     QSpinBox* m_heightSpinBox = nullptr;
+    QButtonGroup* m_anchorGroup = nullptr;
+    QSpinBox* m_undoBudgetSpinBox = nullptr;
+    QSpinBox* m_undoSpillSpinBox = nullptr;
 };
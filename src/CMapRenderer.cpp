@@ -0,0 +1,288 @@
+#include "CMapRenderer.h"
+#include "CMap.h"
+#include "CTilesetCache.h"
+#include "Constants.h"
+
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+//-----------------------------------------------------------------------------
+namespace {
+    static_assert(Constants::MAP_CHUNK_SIZE % Constants::RENDER_CHUNK_TILES == 0,
+                  "render chunks must not straddle map chunks");
+
+    quint64 chunkKey(int level, int cx, int cy)
+    {
+        return (static_cast<quint64>(level) << 56) | (static_cast<quint64>(cy) << 28) | static_cast<quint64>(cx);
+    }
+
+    // Smallest scale 1 / 2^level that is still at or above the zoom
+    int levelFor(double levelOfDetail)
+    {
+        int level = 0;
+        while (level < Constants::RENDER_MAX_LEVEL && levelOfDetail <= 1.0 / (2 << level))
+            ++level;
+        return level;
+    }
+
+    QRectF sceneRect(const QRect& tiles)
+    {
+        const int ts = Constants::DEFAULT_TILE_SIZE;
+        return QRectF(tiles.x() * ts, tiles.y() * ts, tiles.width() * ts, tiles.height() * ts);
+    }
+}
+
+//-----------------------------------------------------------------------------
+CMapRenderer::CMapRenderer()
+{
+    m_chunks.setMaxCost(Constants::RENDER_CACHE_KB);
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::setMap(const CMap* map)
+{
+    m_map = map;
+    reset();
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::setTileset(const std::shared_ptr<const CTileset>& tileset)
+{
+    m_tileset = tileset;
+    m_tileColors.clear();
+    m_tileColorKnown.clear();
+    reset();
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::reset()
+{
+    m_chunks.clear();
+    cancel();
+    m_preview = QImage();
+    m_previewRevision.clear();
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::cancel()
+{
+    m_pending.clear();
+    m_queued.clear();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t CMapRenderer::revisionAt(int cx, int cy) const
+{
+    const int perMapChunk = Constants::MAP_CHUNK_SIZE / Constants::RENDER_CHUNK_TILES;
+    return m_map->chunkRevision(cx / perMapChunk, cy / perMapChunk);
+}
+
+//-----------------------------------------------------------------------------
+QRect CMapRenderer::chunkTiles(int cx, int cy) const
+{
+    const int cs = Constants::RENDER_CHUNK_TILES;
+    return QRect(cx * cs, cy * cs, cs, cs).intersected(QRect(0, 0, m_map->width(), m_map->height()));
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::paint(QPainter* painter, const QRectF& exposed, double levelOfDetail)
+{
+    if (!m_map || m_map->width() <= 0 || m_map->height() <= 0)
+        return;
+
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    const QRect tiles = QRect(QPoint(static_cast<int>(std::floor(exposed.left() / ts)),
+                                     static_cast<int>(std::floor(exposed.top() / ts))),
+                              QPoint(static_cast<int>(std::ceil(exposed.right() / ts)) - 1,
+                                     static_cast<int>(std::ceil(exposed.bottom() / ts)) - 1))
+                            .intersected(QRect(0, 0, m_map->width(), m_map->height()));
+    if (tiles.isEmpty())
+        return;
+
+    // Past 1:1 so few tiles are visible that drawing them is cheaper than
+    // scaling chunk images up
+    if (levelOfDetail > 1.0 && !m_interactive) {
+        drawTiles(painter, tiles);
+        return;
+    }
+
+    // Antialiased image edges would show seams between chunks
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing, false);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+
+    const int level = levelFor(levelOfDetail);
+    const int cs = Constants::RENDER_CHUNK_TILES;
+    QElapsedTimer budget;
+    budget.start();
+    bool queued = false;
+    for (int cy = tiles.top() / cs; cy <= tiles.bottom() / cs; ++cy) {
+        for (int cx = tiles.left() / cs; cx <= tiles.right() / cs; ++cx) {
+            const QRect chunkRect = chunkTiles(cx, cy);
+            const uint64_t revision = revisionAt(cx, cy);
+            const quint64 key = chunkKey(level, cx, cy);
+            Chunk* chunk = m_chunks.object(key);
+            const bool current = chunk && chunk->revision >= revision;
+            if (!current && !m_interactive) {
+                if (budget.elapsed() < m_frameBudgetMs) {
+                    chunk = render(level, cx, cy);
+                } else if (!m_queued.contains(key)) {
+                    m_pending.enqueue(key);
+                    m_queued.insert(key);
+                    queued = true;
+                }
+            }
+
+            // Stand-ins until the chunk is rendered: its stale image, one at
+            // another scale, or the preview
+            for (int other = 0; other <= Constants::RENDER_MAX_LEVEL && !chunk; ++other)
+                chunk = other != level ? m_chunks.object(chunkKey(other, cx, cy)) : nullptr;
+            if (chunk)
+                painter->drawPixmap(sceneRect(chunkRect), chunk->pixmap, QRectF(chunk->pixmap.rect()));
+            else
+                drawPreview(painter, chunkRect);
+        }
+    }
+    painter->restore();
+
+    if (queued && m_pendingCallback)
+        m_pendingCallback();
+}
+
+//-----------------------------------------------------------------------------
+QVector<QRectF> CMapRenderer::refine(int budgetMs)
+{
+    QVector<QRectF> rendered;
+    if (!m_map)
+        return rendered;
+
+    const int cs = Constants::RENDER_CHUNK_TILES;
+    const int chunksX = (m_map->width() + cs - 1) / cs;
+    const int chunksY = (m_map->height() + cs - 1) / cs;
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_pending.isEmpty() && timer.elapsed() < budgetMs) {
+        const quint64 key = m_pending.dequeue();
+        m_queued.remove(key);
+        const int level = static_cast<int>(key >> 56);
+        const int cy = static_cast<int>((key >> 28) & 0xfffffff);
+        const int cx = static_cast<int>(key & 0xfffffff);
+        if (cx >= chunksX || cy >= chunksY)
+            continue;
+        const Chunk* chunk = m_chunks.object(key);
+        if (chunk && chunk->revision >= revisionAt(cx, cy))
+            continue;
+        render(level, cx, cy);
+        rendered.append(sceneRect(chunkTiles(cx, cy)));
+    }
+    return rendered;
+}
+
+//-----------------------------------------------------------------------------
+CMapRenderer::Chunk* CMapRenderer::render(int level, int cx, int cy)
+{
+    const QRect tiles = chunkTiles(cx, cy);
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    const double scale = 1.0 / (1 << level);
+
+    auto chunk = new Chunk;
+    chunk->revision = revisionAt(cx, cy);
+    chunk->pixmap = QPixmap(qCeil(tiles.width() * ts * scale), qCeil(tiles.height() * ts * scale));
+    chunk->pixmap.fill(Qt::transparent);
+    QPainter painter(&chunk->pixmap);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, level > 0);
+    painter.scale(scale, scale);
+    painter.translate(-tiles.x() * ts, -tiles.y() * ts);
+    drawTiles(&painter, tiles);
+    painter.end();
+
+    // Null when the image alone is over the cache limit
+    const quint64 key = chunkKey(level, cx, cy);
+    const int cost = std::max(1, static_cast<int>(chunk->pixmap.width() * chunk->pixmap.height() * 4 / 1024));
+    m_chunks.insert(key, chunk, cost);
+    return m_chunks.object(key);
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::drawTiles(QPainter* painter, const QRect& tiles) const
+{
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    const int w = m_map->width();
+    m_map->visitCells([&](const auto* cells) {
+        for (int y = tiles.top(); y <= tiles.bottom(); ++y) {
+            const auto* row = cells + static_cast<size_t>(y) * w;
+            for (int x = tiles.left(); x <= tiles.right(); ++x) {
+                const uint32_t tile = row[x];
+                if (tile == 0)
+                    continue;
+                const QRectF rect(x * ts, y * ts, ts, ts);
+                if (!m_tileset) {
+                    painter->fillRect(rect, QColor::fromRgb(Constants::TILE_COLORS[(tile - 1) % Constants::TILE_COLOR_COUNT]));
+                } else if (const QPixmap* pixmap = m_tileset->tile(tile)) {
+                    // Slices come from the shared tileset cache
+                    painter->drawPixmap(rect, *pixmap, pixmap->rect());
+                }
+            }
+        }
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::drawPreview(QPainter* painter, const QRect& tiles)
+{
+    updatePreview(tiles);
+    painter->drawImage(sceneRect(tiles), m_preview, QRectF(tiles));
+}
+
+//-----------------------------------------------------------------------------
+void CMapRenderer::updatePreview(const QRect& tiles)
+{
+    const int w = m_map->width();
+    if (m_preview.size() != QSize(w, m_map->height())) {
+        m_preview = QImage(w, m_map->height(), QImage::Format_ARGB32_Premultiplied);
+        m_previewRevision.assign(static_cast<size_t>(m_map->chunksX()) * m_map->chunksY(), 0);
+    }
+
+    const int mcs = Constants::MAP_CHUNK_SIZE;
+    for (int mcy = tiles.top() / mcs; mcy <= tiles.bottom() / mcs; ++mcy) {
+        for (int mcx = tiles.left() / mcs; mcx <= tiles.right() / mcs; ++mcx) {
+            uint64_t& stored = m_previewRevision[static_cast<size_t>(mcy) * m_map->chunksX() + mcx];
+            const uint64_t revision = m_map->chunkRevision(mcx, mcy);
+            if (stored >= revision)
+                continue;
+            stored = revision;
+            const QRect block = QRect(mcx * mcs, mcy * mcs, mcs, mcs).intersected(QRect(0, 0, w, m_map->height()));
+            m_map->visitCells([&](const auto* cells) {
+                for (int y = block.top(); y <= block.bottom(); ++y) {
+                    const auto* row = cells + static_cast<size_t>(y) * w;
+                    QRgb* out = reinterpret_cast<QRgb*>(m_preview.scanLine(y));
+                    for (int x = block.left(); x <= block.right(); ++x)
+                        out[x] = row[x] ? tileColor(row[x]) : 0;
+                }
+            });
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+QRgb CMapRenderer::tileColor(uint32_t id)
+{
+    if (!m_tileset)
+        return Constants::TILE_COLORS[(id - 1) % Constants::TILE_COLOR_COUNT];
+    const QPixmap* pixmap = m_tileset->tile(id);
+    if (!pixmap)
+        return 0;
+    if (id >= m_tileColors.size()) {
+        m_tileColors.resize(id + 1);
+        m_tileColorKnown.resize(id + 1);
+    }
+    if (!m_tileColorKnown[id]) {
+        QImage average = pixmap->toImage().scaled(1, 1, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        m_tileColors[id] = qPremultiply(average.pixel(0, 0));
+        m_tileColorKnown[id] = true;
+    }
+    return m_tileColors[id];
+}
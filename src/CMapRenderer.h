@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+#include <QQueue>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMap;
+struct CTileset;
+class QPainter;
+
+//-----------------------------------------------------------------------------
+// Draws a map from cached images of RENDER_CHUNK_TILES square chunks. Each
+// image is rendered at the power-of-two scale at or just above the zoom,
+// never above 1:1, and is redrawn once the map's chunk revision passes the
+// one it was rendered at.
+//
+// While interactive, during a pan or zoom gesture, nothing is rendered:
+// chunks are drawn from whatever image they have, stale or at another scale,
+// or else from a preview with one pixel per tile. Otherwise chunks are
+// rendered while the frame budget lasts and the rest are queued for
+// refine(), which the view runs in time slices between events.
+//
+// GUI thread only, since the chunk images are pixmaps.
+class CMapRenderer
+{
+public:
+    CMapRenderer();
+
+    void setMap(const CMap* map);
+    void setTileset(const std::shared_ptr<const CTileset>& tileset);
+    // Drops every image, e.g. after the map was resized
+    void reset();
+
+    void setInteractive(bool interactive) { m_interactive = interactive; }
+    void setFrameBudget(int ms) { m_frameBudgetMs = ms; }
+    // Called from paint() when it queued chunks
+    void setPendingCallback(std::function<void()> callback) { m_pendingCallback = std::move(callback); }
+
+    // exposed is in scene coordinates, levelOfDetail the scale to the device
+    void paint(QPainter* painter, const QRectF& exposed, double levelOfDetail);
+
+    bool hasPending() const { return !m_pending.isEmpty(); }
+    void cancel();
+    // Renders queued chunks for at most budgetMs and returns the scene rects
+    // of those rendered
+    QVector<QRectF> refine(int budgetMs);
+
+private:
+    struct Chunk
+    {
+        QPixmap pixmap;
+        uint64_t revision = 0;
+    };
+
+    const CMap* m_map = nullptr;
+    std::shared_ptr<const CTileset> m_tileset;
+    QCache<quint64, Chunk> m_chunks;    // by level and position, cost in KB
+    QQueue<quint64> m_pending;
+    QSet<quint64> m_queued;
+    bool m_interactive = false;
+    int m_frameBudgetMs = 8;
+    std::function<void()> m_pendingCallback;
+
+    // One pixel per tile, refreshed per map chunk when its revision moves
+    QImage m_preview;
+    std::vector<uint64_t> m_previewRevision;
+    // Average colour per tile id, filled in on first use
+    std::vector<QRgb> m_tileColors;
+    std::vector<bool> m_tileColorKnown;
+
+    uint64_t revisionAt(int cx, int cy) const;
+    QRect chunkTiles(int cx, int cy) const;
+    Chunk* render(int level, int cx, int cy);
+    void drawTiles(QPainter* painter, const QRect& tiles) const;
+    void drawPreview(QPainter* painter, const QRect& tiles);
+    void updatePreview(const QRect& tiles);
+    QRgb tileColor(uint32_t id);
+};
@@ -0,0 +1,408 @@
+#include "CMapSync.h"
+#include "CMap.h"
+#include "Constants.h"
+
+#include <QDataStream>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const quint32 SYNC_MAGIC = 0x4d535943;     // "MSYC"
+    const quint16 SYNC_VERSION = 1;
+    const int HEADER_BYTES = 4 + 2 + 4 + 4 + 4 + 4;
+    const int RECT_BYTES = 4 * 4;
+
+    QByteArray frame(const QByteArray& payload)
+    {
+        QByteArray packet;
+        packet.reserve(4 + payload.size());
+        QDataStream out(&packet, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out << static_cast<quint32>(payload.size());
+        packet.append(payload);
+        return packet;
+    }
+
+    // Copies the rects' tiles, stored back to back in src, into the shadow
+    void writeRects(uint32_t* dst, int stride, const QVector<QRect>& rects, const uint32_t* src)
+    {
+        for (const QRect& r : rects) {
+            for (int row = 0; row < r.height(); ++row) {
+                std::memcpy(dst + static_cast<size_t>(r.y() + row) * stride + r.x(), src, r.width() * sizeof(uint32_t));
+                src += r.width();
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+CMapSync::CMapSync(QObject* parent)
+    : QObject(parent)
+{
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(0);
+    connect(m_flushTimer, &QTimer::timeout, this, &CMapSync::flush);
+}
+
+//-----------------------------------------------------------------------------
+CMapSync::~CMapSync()
+{
+    stop();
+}
+
+//-----------------------------------------------------------------------------
+bool CMapSync::start(const QString& channel, CMap* map, QString* error)
+{
+    stop();
+    m_map = map;
+    m_channel = channel;
+    resetShadow();
+
+    // Join whoever hosts the channel; the host sends its map right away
+    auto* socket = new QLocalSocket(this);
+    socket->connectToServer(channel);
+    if (socket->waitForConnected(Constants::SYNC_CONNECT_TIMEOUT_MS)) {
+        addPeer(socket);
+        return true;
+    }
+    delete socket;
+
+    // Nobody does, so host it. A server that crashed can leave its socket
+    // file behind, which would make listen() fail.
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(channel);
+    if (!m_server->listen(channel)) {
+        if (error)
+            *error = m_server->errorString();
+        stop();
+        return false;
+    }
+    connect(m_server, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket* peer = m_server->nextPendingConnection()) {
+            // Pending edits go to the existing peers before the newcomer's
+            // snapshot makes them look sent
+            flush();
+            addPeer(peer);
+            peer->write(snapshot());
+        }
+    });
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::stop()
+{
+    m_flushTimer->stop();
+    for (QLocalSocket* socket : m_peers) {
+        disconnect(socket, nullptr, this, nullptr);
+        socket->abort();
+        socket->deleteLater();
+    }
+    bool hadPeers = !m_peers.isEmpty();
+    m_peers.clear();
+    m_buffers.clear();
+    if (m_server) {
+        m_server->close();
+        delete m_server;
+        m_server = nullptr;
+    }
+    m_map = nullptr;
+    m_shadow.clear();
+    m_shadow.shrink_to_fit();
+    m_chunkSeen.clear();
+    m_shadowWidth = m_shadowHeight = 0;
+    if (hadPeers)
+        emit peersChanged(0);
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::mapEdited()
+{
+    if (m_map && !m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+//-----------------------------------------------------------------------------
+// A map assigned over carries the other map's revisions, which the chunk
+// stamps cannot tell apart from ours
+void CMapSync::resync()
+{
+    if (!m_map)
+        return;
+    m_flushTimer->stop();
+    resetShadow();
+    if (!m_peers.isEmpty())
+        send(snapshot());
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::addPeer(QLocalSocket* socket)
+{
+    m_peers.append(socket);
+    connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { receive(socket); });
+    connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { removePeer(socket); });
+    emit peersChanged(m_peers.size());
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::removePeer(QLocalSocket* socket)
+{
+    if (!m_peers.removeOne(socket))
+        return;
+    m_buffers.remove(socket);
+    disconnect(socket, nullptr, this, nullptr);
+    socket->deleteLater();
+    if (isHost()) {
+        emit peersChanged(m_peers.size());
+        return;
+    }
+    stop();
+    emit stopped(tr("The sync host left channel %1").arg(m_channel));
+}
+
+//-----------------------------------------------------------------------------
+// Every dirty chunk is compared with the shadow and contributes the bounding
+// rect of its changed tiles, so a single painted tile costs 20 bytes
+void CMapSync::flush()
+{
+    m_flushTimer->stop();
+    if (!m_map)
+        return;
+    const CMap& map = *m_map;
+    if (map.width() != m_shadowWidth || map.height() != m_shadowHeight) {
+        resetShadow();
+        if (!m_peers.isEmpty())
+            send(snapshot());
+        return;
+    }
+
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    const int w = map.width();
+    const int h = map.height();
+    CSyncDelta delta;
+    map.visitCells([&](const auto* tiles) {
+        for (int cy = 0; cy < map.chunksY(); ++cy) {
+            for (int cx = 0; cx < map.chunksX(); ++cx) {
+                uint64_t& seen = m_chunkSeen[static_cast<size_t>(cy) * map.chunksX() + cx];
+                uint64_t revision = map.chunkRevision(cx, cy);
+                if (revision == seen)
+                    continue;
+                seen = revision;
+
+                const int x0 = cx * chunk, x1 = std::min(w, x0 + chunk);
+                const int y0 = cy * chunk, y1 = std::min(h, y0 + chunk);
+                int minX = x1, minY = y1, maxX = x0 - 1, maxY = y0 - 1;
+                for (int y = y0; y < y1; ++y) {
+                    const size_t row = static_cast<size_t>(y) * w;
+                    for (int x = x0; x < x1; ++x) {
+                        if (tiles[row + x] == m_shadow[row + x])
+                            continue;
+                        minX = std::min(minX, x);
+                        maxX = std::max(maxX, x);
+                        minY = std::min(minY, y);
+                        maxY = std::max(maxY, y);
+                    }
+                }
+                if (maxX < minX)
+                    continue;
+
+                QRect r(QPoint(minX, minY), QPoint(maxX, maxY));
+                delta.rects.append(r);
+                for (int y = r.top(); y <= r.bottom(); ++y) {
+                    const size_t row = static_cast<size_t>(y) * w;
+                    delta.tiles.insert(delta.tiles.end(), tiles + row + r.left(), tiles + row + r.right() + 1);
+                    std::copy(tiles + row + r.left(), tiles + row + r.right() + 1, m_shadow.begin() + row + r.left());
+                }
+            }
+        }
+    });
+    if (delta.rects.isEmpty() || m_peers.isEmpty())
+        return;
+    delta.sequence = ++m_sequence;
+    delta.width = w;
+    delta.height = h;
+    send(encode(delta));
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::receive(QLocalSocket* socket)
+{
+    QByteArray& buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    QVector<QRect> dirty;
+    bool resized = false;
+    QByteArray payload;
+    bool invalid = false;
+    while (m_map && takePacket(buffer, payload, &invalid)) {
+        CSyncDelta delta;
+        if (!decode(payload, delta)) {
+            invalid = true;
+            break;
+        }
+        // Local edits still waiting would look sent once the shadow takes
+        // the incoming tiles
+        if (m_flushTimer->isActive())
+            flush();
+
+        if (apply(*m_map, delta)) {
+            resized = true;
+            resetShadow();
+        } else {
+            writeRects(m_shadow.data(), m_shadowWidth, delta.rects, delta.tiles.data());
+            const int chunk = Constants::MAP_CHUNK_SIZE;
+            for (const QRect& r : delta.rects)
+                for (int cy = r.top() / chunk; cy <= r.bottom() / chunk; ++cy)
+                    for (int cx = r.left() / chunk; cx <= r.right() / chunk; ++cx)
+                        m_chunkSeen[static_cast<size_t>(cy) * m_map->chunksX() + cx] = m_map->chunkRevision(cx, cy);
+        }
+        dirty += delta.rects;
+
+        if (isHost())
+            send(frame(payload), socket);
+    }
+
+    if (resized || !dirty.isEmpty())
+        emit regionsChanged(dirty, resized);
+    if (invalid)
+        removePeer(socket);
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::send(const QByteArray& packet, QLocalSocket* except)
+{
+    for (QLocalSocket* socket : m_peers)
+        if (socket != except)
+            socket->write(packet);
+}
+
+//-----------------------------------------------------------------------------
+QByteArray CMapSync::snapshot()
+{
+    CSyncDelta delta;
+    delta.sequence = ++m_sequence;
+    delta.width = m_map->width();
+    delta.height = m_map->height();
+    if (m_map->tileCount()) {
+        delta.rects.append(QRect(0, 0, delta.width, delta.height));
+        delta.tiles.resize(m_map->tileCount());
+        for (int y = 0; y < delta.height; ++y)
+            m_map->readRow(y, 0, delta.width, delta.tiles.data() + static_cast<size_t>(y) * delta.width);
+    }
+    return encode(delta);
+}
+
+//-----------------------------------------------------------------------------
+void CMapSync::resetShadow()
+{
+    m_shadowWidth = m_map->width();
+    m_shadowHeight = m_map->height();
+    m_shadow.resize(m_map->tileCount());
+    for (int y = 0; y < m_shadowHeight; ++y)
+        m_map->readRow(y, 0, m_shadowWidth, m_shadow.data() + static_cast<size_t>(y) * m_shadowWidth);
+    m_chunkSeen.resize(static_cast<size_t>(m_map->chunksX()) * m_map->chunksY());
+    for (int cy = 0; cy < m_map->chunksY(); ++cy)
+        for (int cx = 0; cx < m_map->chunksX(); ++cx)
+            m_chunkSeen[static_cast<size_t>(cy) * m_map->chunksX() + cx] = m_map->chunkRevision(cx, cy);
+}
+
+//-----------------------------------------------------------------------------
+QByteArray CMapSync::encode(const CSyncDelta& delta)
+{
+    QByteArray payload;
+    payload.reserve(HEADER_BYTES + delta.rects.size() * RECT_BYTES + static_cast<int>(delta.tiles.size() * sizeof(uint32_t)));
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << SYNC_MAGIC << SYNC_VERSION << delta.sequence
+        << static_cast<qint32>(delta.width) << static_cast<qint32>(delta.height)
+        << static_cast<quint32>(delta.rects.size());
+    for (const QRect& r : delta.rects)
+        out << static_cast<qint32>(r.x()) << static_cast<qint32>(r.y())
+            << static_cast<qint32>(r.width()) << static_cast<qint32>(r.height());
+    out.writeRawData(reinterpret_cast<const char*>(delta.tiles.data()),
+                     static_cast<int>(delta.tiles.size() * sizeof(uint32_t)));
+    return frame(payload);
+}
+
+//-----------------------------------------------------------------------------
+bool CMapSync::decode(const QByteArray& payload, CSyncDelta& delta)
+{
+    QDataStream in(payload);
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic = 0, rectCount = 0;
+    quint16 version = 0;
+    qint32 width = 0, height = 0;
+    in >> magic >> version >> delta.sequence >> width >> height >> rectCount;
+    if (in.status() != QDataStream::Ok || magic != SYNC_MAGIC || version != SYNC_VERSION ||
+        rectCount > static_cast<quint32>(payload.size() / RECT_BYTES))
+        return false;
+    // The receiver resizes to this, so it must be a size the whole map could
+    // be sent at in one packet
+    const qint64 maxTiles = Constants::SYNC_MAX_PACKET_BYTES / static_cast<qint64>(sizeof(uint32_t));
+    if (width < Constants::MIN_MAP_WIDTH || height < Constants::MIN_MAP_HEIGHT
+            || static_cast<qint64>(width) * height > maxTiles)
+        return false;
+
+    size_t tileCount = 0;
+    delta.width = width;
+    delta.height = height;
+    delta.rects.clear();
+    delta.rects.reserve(static_cast<int>(rectCount));
+    for (quint32 i = 0; i < rectCount; ++i) {
+        qint32 x, y, w, h;
+        in >> x >> y >> w >> h;
+        // Compared without forming x + w, which could overflow
+        if (x < 0 || y < 0 || w <= 0 || h <= 0 || w > width - x || h > height - y)
+            return false;
+        delta.rects.append(QRect(x, y, w, h));
+        tileCount += static_cast<size_t>(w) * h;
+    }
+    const size_t bytes = tileCount * sizeof(uint32_t);
+    if (in.status() != QDataStream::Ok || bytes != static_cast<size_t>(payload.size()) - HEADER_BYTES - rectCount * RECT_BYTES)
+        return false;
+    delta.tiles.resize(tileCount);
+    return in.readRawData(reinterpret_cast<char*>(delta.tiles.data()), static_cast<int>(bytes)) == static_cast<int>(bytes);
+}
+
+//-----------------------------------------------------------------------------
+bool CMapSync::takePacket(QByteArray& buffer, QByteArray& payload, bool* invalid)
+{
+    if (buffer.size() < 4)
+        return false;
+    quint32 size;
+    std::memcpy(&size, buffer.constData(), 4);
+    size = qFromLittleEndian(size);
+    if (size > static_cast<quint32>(Constants::SYNC_MAX_PACKET_BYTES)) {
+        if (invalid)
+            *invalid = true;
+        return false;
+    }
+    if (static_cast<quint32>(buffer.size()) - 4 < size)
+        return false;
+    payload = buffer.mid(4, static_cast<int>(size));
+    buffer.remove(0, 4 + static_cast<int>(size));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CMapSync::apply(CMap& map, const CSyncDelta& delta)
+{
+    bool resized = map.width() != delta.width || map.height() != delta.height;
+    if (resized)
+        map.resize(delta.width, delta.height);
+    const uint32_t* src = delta.tiles.data();
+    for (const QRect& r : delta.rects) {
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            map.writeRow(y, r.x(), r.width(), src);
+            src += r.width();
+        }
+    }
+    return resized;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+//-----------------------------------------------------------------------------
+// One batch of tile writes: the sender's map size and the rects it wrote,
+// with their new tiles stored back to back in row-major order
+struct CSyncDelta
+{
+    quint32 sequence = 0;
+    int width = 0;
+    int height = 0;
+    QVector<QRect> rects;
+    std::vector<uint32_t> tiles;
+};
+
+//-----------------------------------------------------------------------------
+// Live sync of one map between editor instances, or an editor and a game
+// runner, on the same machine. The first instance on a channel hosts it and
+// relays packets between the others; a joining instance is sent the host's
+// map in full.
+//
+// Local edits are not sent one by one: mapEdited() arms a zero timeout, and
+// once per event-loop tick the chunks whose CMap revision moved are compared
+// with a shadow copy of what the peers already have. Every dirty chunk gives
+// one tight rect of new tiles, and all of them leave as a single packet.
+// Received packets are written row by row and reported through
+// regionsChanged() for repainting; they bypass the undo stack.
+class CMapSync : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CMapSync(QObject* parent = nullptr);
+    ~CMapSync() override;
+
+    // Joins the channel, or hosts it when nobody else does
+    bool start(const QString& channel, CMap* map, QString* error = nullptr);
+    void stop();
+
+    bool isActive() const { return m_map != nullptr; }
+    bool isHost() const { return m_server != nullptr; }
+    const QString& channel() const { return m_channel; }
+    CMap* map() const { return m_map; }
+    int peerCount() const { return m_peers.size(); }
+
+    void mapEdited();
+    // Sends the whole map, for when it was replaced rather than edited
+    void resync();
+
+    // Wire format, shared with the command-line listener. A packet is a
+    // quint32 payload size followed by the payload; tiles are raw, in the
+    // byte order of the machine both ends run on.
+    static QByteArray encode(const CSyncDelta& delta);
+    static bool decode(const QByteArray& payload, CSyncDelta& delta);
+    // Cuts the next complete packet off the front of buffer; a size no
+    // packet can have sets invalid, as the stream cannot be resynchronised
+    static bool takePacket(QByteArray& buffer, QByteArray& payload, bool* invalid = nullptr);
+    // Resizes the map first when the sender's size differs; returns whether it did
+    static bool apply(CMap& map, const CSyncDelta& delta);
+
+signals:
+    void regionsChanged(const QVector<QRect>& rects, bool resized);
+    void peersChanged(int count);
+    void stopped(const QString& reason);
+
+private:
+    void flush();
+    void addPeer(QLocalSocket* socket);
+    void removePeer(QLocalSocket* socket);
+    void receive(QLocalSocket* socket);
+    void send(const QByteArray& packet, QLocalSocket* except = nullptr);
+    QByteArray snapshot();
+    void resetShadow();
+
+    QLocalServer* m_server = nullptr;
+    QVector<QLocalSocket*> m_peers;
+    QHash<QLocalSocket*, QByteArray> m_buffers;
+    QTimer* m_flushTimer = nullptr;
+    CMap* m_map = nullptr;
+    QString m_channel;
+    quint32 m_sequence = 0;
+
+    // What the peers have; compared per chunk against the map on flush
+    std::vector<uint32_t> m_shadow;
+    int m_shadowWidth = 0;
+    int m_shadowHeight = 0;
+    std::vector<uint64_t> m_chunkSeen;
+};
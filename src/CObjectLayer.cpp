@@ -0,0 +1,286 @@
+#include "CObjectLayer.h"
+#include "Constants.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+namespace {
+    int floorDiv(int v, int d)
+    {
+        return v >= 0 ? v / d : -((-v + d - 1) / d);
+    }
+
+    // Point objects (empty rects) occupy the pixel at their origin, so they
+    // are bucketed, queried and hit like a 1x1 object there
+    QRect footprint(const QRect& rect)
+    {
+        return rect.isEmpty() ? QRect(rect.topLeft(), QSize(1, 1)) : rect;
+    }
+
+    // Objects covering more grid cells than this go to one shared list
+    // rather than into every bucket they overlap
+    bool spansTooManyCells(const QRect& cells)
+    {
+        return static_cast<int64_t>(cells.width()) * cells.height() > Constants::OBJECT_MAX_BUCKET_CELLS;
+    }
+}
+
+//-----------------------------------------------------------------------------
+int64_t CObjectLayer::cellKey(int cx, int cy)
+{
+    return (static_cast<int64_t>(cy) << 32) | static_cast<uint32_t>(cx);
+}
+
+//-----------------------------------------------------------------------------
+QRect CObjectLayer::cellRange(const QRect& rect)
+{
+    const int cell = Constants::OBJECT_GRID_CELL_SIZE;
+    int x0 = floorDiv(rect.left(), cell);
+    int y0 = floorDiv(rect.top(), cell);
+    int x1 = floorDiv(rect.right(), cell);
+    int y1 = floorDiv(rect.bottom(), cell);
+    return QRect(QPoint(x0, y0), QPoint(x1, y1));
+}
+
+//-----------------------------------------------------------------------------
+void CObjectLayer::insertIntoBuckets(const CMapObject& obj)
+{
+    QRect cells = cellRange(footprint(obj.rect));
+    if (spansTooManyCells(cells)) {
+        m_large.push_back(obj.id);
+        return;
+    }
+    for (int cy = cells.top(); cy <= cells.bottom(); ++cy)
+        for (int cx = cells.left(); cx <= cells.right(); ++cx)
+            m_buckets[cellKey(cx, cy)].push_back(obj.id);
+}
+
+//-----------------------------------------------------------------------------
+void CObjectLayer::removeFromBuckets(const CMapObject& obj)
+{
+    QRect cells = cellRange(footprint(obj.rect));
+    if (spansTooManyCells(cells)) {
+        auto pos = std::find(m_large.begin(), m_large.end(), obj.id);
+        if (pos != m_large.end()) {
+            *pos = m_large.back();
+            m_large.pop_back();
+        }
+        return;
+    }
+    for (int cy = cells.top(); cy <= cells.bottom(); ++cy) {
+        for (int cx = cells.left(); cx <= cells.right(); ++cx) {
+            auto it = m_buckets.find(cellKey(cx, cy));
+            if (it == m_buckets.end())
+                continue;
+            std::vector<uint32_t>& ids = it->second;
+            auto pos = std::find(ids.begin(), ids.end(), obj.id);
+            if (pos != ids.end()) {
+                *pos = ids.back();
+                ids.pop_back();
+            }
+            if (ids.empty())
+                m_buckets.erase(it);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+const CMapObject* CObjectLayer::object(uint32_t id) const
+{
+    auto it = m_indexById.find(id);
+    if (it == m_indexById.end()) return nullptr;
+    return &m_objects[it->second];
+}
+
+//-----------------------------------------------------------------------------
+// The first unused id from m_nextId on, wrapping past the largest one
+uint32_t CObjectLayer::freeId() const
+{
+    uint32_t id = m_nextId;
+    while (id == 0 || m_indexById.count(id))
+        ++id;
+    return id;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CObjectLayer::add(CMapObject obj)
+{
+    if (obj.id == 0 || m_indexById.count(obj.id))
+        obj.id = freeId();
+    // Wraps to 0 after the largest id; freeId() skips it
+    if (obj.id >= m_nextId)
+        m_nextId = obj.id + 1;
+
+    m_indexById[obj.id] = static_cast<int>(m_objects.size());
+    insertIntoBuckets(obj);
+    m_objects.push_back(std::move(obj));
+    return m_objects.back().id;
+}
+
+//-----------------------------------------------------------------------------
+bool CObjectLayer::remove(uint32_t id)
+{
+    auto it = m_indexById.find(id);
+    if (it == m_indexById.end()) return false;
+
+    int index = it->second;
+    removeFromBuckets(m_objects[index]);
+    m_indexById.erase(it);
+
+    // Swap-remove keeps the array dense; patch the moved object's index
+    int last = static_cast<int>(m_objects.size()) - 1;
+    if (index != last) {
+        m_objects[index] = std::move(m_objects[last]);
+        m_indexById[m_objects[index].id] = index;
+    }
+    m_objects.pop_back();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CObjectLayer::replace(const CMapObject& obj)
+{
+    auto it = m_indexById.find(obj.id);
+    if (it == m_indexById.end()) return false;
+
+    CMapObject& current = m_objects[it->second];
+    if (current.rect != obj.rect) {
+        removeFromBuckets(current);
+        insertIntoBuckets(obj);
+    }
+    current = obj;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CObjectLayer::clear()
+{
+    m_objects.clear();
+    m_indexById.clear();
+    m_buckets.clear();
+    m_large.clear();
+    m_nextId = 1;
+}
+
+//-----------------------------------------------------------------------------
+void CObjectLayer::translate(int dx, int dy)
+{
+    if (dx == 0 && dy == 0) return;
+    m_buckets.clear();
+    m_large.clear();
+    for (CMapObject& obj : m_objects) {
+        obj.rect.translate(dx, dy);
+        insertIntoBuckets(obj);
+    }
+}
+
+//-----------------------------------------------------------------------------
+QVector<uint32_t> CObjectLayer::query(const QRect& area) const
+{
+    QVector<uint32_t> result;
+    if (area.isEmpty() || m_objects.empty())
+        return result;
+
+    for (uint32_t id : m_large) {
+        if (footprint(m_objects[m_indexById.at(id)].rect).intersects(area))
+            result.append(id);
+    }
+
+    const QRect cells = cellRange(area);
+    auto collect = [&](int cx, int cy, const std::vector<uint32_t>& ids) {
+        for (uint32_t id : ids) {
+            QRect inter = footprint(m_objects[m_indexById.at(id)].rect).intersected(area);
+            if (inter.isEmpty())
+                continue;
+            // An object spanning several cells is reported only by the
+            // cell that holds the top-left corner of the overlap
+            QRect home = cellRange(QRect(inter.topLeft(), QSize(1, 1)));
+            if (home.left() == cx && home.top() == cy)
+                result.append(id);
+        }
+    };
+
+    // Walks the grid cells under the area, or the occupied buckets when
+    // there are fewer of those
+    if (static_cast<int64_t>(cells.width()) * cells.height() <= static_cast<int64_t>(m_buckets.size())) {
+        for (int cy = cells.top(); cy <= cells.bottom(); ++cy) {
+            for (int cx = cells.left(); cx <= cells.right(); ++cx) {
+                auto it = m_buckets.find(cellKey(cx, cy));
+                if (it != m_buckets.end())
+                    collect(cx, cy, it->second);
+            }
+        }
+    } else {
+        for (const auto& bucket : m_buckets) {
+            const int cx = static_cast<int32_t>(static_cast<uint32_t>(bucket.first));
+            const int cy = static_cast<int>(bucket.first >> 32);
+            if (cells.contains(cx, cy))
+                collect(cx, cy, bucket.second);
+        }
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CObjectLayer::hitTest(const QPoint& pos) const
+{
+    // Later objects are drawn on top, so the highest id wins
+    uint32_t best = 0;
+    for (uint32_t id : m_large) {
+        if (id > best && footprint(m_objects[m_indexById.at(id)].rect).contains(pos))
+            best = id;
+    }
+
+    QRect cells = cellRange(QRect(pos, QSize(1, 1)));
+    auto it = m_buckets.find(cellKey(cells.left(), cells.top()));
+    if (it == m_buckets.end()) return best;
+
+    for (uint32_t id : it->second) {
+        if (id > best && footprint(m_objects[m_indexById.at(id)].rect).contains(pos))
+            best = id;
+    }
+    return best;
+}
+
+//-----------------------------------------------------------------------------
+QJsonArray CObjectLayer::toJson() const
+{
+    QJsonArray arr;
+    for (const CMapObject& obj : m_objects) {
+        QJsonObject o;
+        o["id"] = static_cast<qint64>(obj.id);
+        o["x"] = obj.rect.x();
+        o["y"] = obj.rect.y();
+        o["w"] = obj.rect.width();
+        o["h"] = obj.rect.height();
+        o["type"] = obj.type;
+        if (!obj.properties.isEmpty())
+            o["properties"] = QJsonObject::fromVariantMap(obj.properties);
+        arr.append(o);
+    }
+    return arr;
+}
+
+//-----------------------------------------------------------------------------
+bool CObjectLayer::fromJson(const QJsonArray& arr)
+{
+    clear();
+    m_objects.reserve(arr.size());
+    for (const QJsonValue& v : arr) {
+        if (!v.isObject()) return false;
+        QJsonObject o = v.toObject();
+        CMapObject obj;
+        // Missing or out-of-range ids get a fresh one
+        const qint64 id = o["id"].toInteger();
+        obj.id = id > 0 && id <= std::numeric_limits<uint32_t>::max() ? static_cast<uint32_t>(id) : 0;
+        obj.rect = QRect(o["x"].toInt(), o["y"].toInt(), o["w"].toInt(), o["h"].toInt());
+        obj.type = o["type"].toString();
+        obj.properties = o["properties"].toObject().toVariantMap();
+        add(std::move(obj));
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class QJsonArray;
+
+//-----------------------------------------------------------------------------
+struct CMapObject
+{
+    uint32_t id = 0;
+    QRect rect;                 // in scene (pixel) coordinates; empty for a point object
+    QString type;
+    QVariantMap properties;
+};
+
+//-----------------------------------------------------------------------------
+// Free-placed objects (spawns, triggers, lights) attached to a map. Objects are
+// kept in a flat array and indexed by a uniform grid of buckets, so queries
+// only visit the cells covering the requested area. Point objects are
+// bucketed at their origin; objects covering more than
+// OBJECT_MAX_BUCKET_CELLS cells are kept in one list checked by every query.
+class CObjectLayer
+{
+public:
+    CObjectLayer() = default;
+
+    int count() const { return static_cast<int>(m_objects.size()); }
+    const std::vector<CMapObject>& objects() const { return m_objects; }
+    const CMapObject* object(uint32_t id) const;
+
+    uint32_t add(CMapObject obj);
+    bool remove(uint32_t id);
+    // Replaces the object with obj's id, e.g. after editing its properties
+    bool replace(const CMapObject& obj);
+    void clear();
+    void translate(int dx, int dy);
+
+    QVector<uint32_t> query(const QRect& area) const;
+    uint32_t hitTest(const QPoint& pos) const;
+
+    QJsonArray toJson() const;
+    bool fromJson(const QJsonArray& arr);
+
+private:
+    std::vector<CMapObject> m_objects;
+    std::unordered_map<uint32_t, int> m_indexById;
+    std::unordered_map<int64_t, std::vector<uint32_t>> m_buckets;
+    std::vector<uint32_t> m_large;
+    uint32_t m_nextId = 1;
+
+    static int64_t cellKey(int cx, int cy);
+    static QRect cellRange(const QRect& rect);
+    uint32_t freeId() const;
+    void insertIntoBuckets(const CMapObject& obj);
+    void removeFromBuckets(const CMapObject& obj);
+};
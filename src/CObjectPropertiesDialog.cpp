@@ -0,0 +1,100 @@
+#include "CObjectPropertiesDialog.h"
+#include "Constants.h"
+
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+//-----------------------------------------------------------------------------
+CObjectPropertiesDialog::CObjectPropertiesDialog(const CMapObject& object, QWidget* parent)
+: QDialog(parent)
+, m_object(object)
+{
+    setWindowTitle(tr("Object %1 Properties").arg(object.id));
+
+    m_typeCombo = new QComboBox(this);
+    m_typeCombo->setEditable(true);
+    for (const char* type : Constants::OBJECT_TYPES)
+        m_typeCombo->addItem(QString::fromLatin1(type));
+    m_typeCombo->setCurrentText(object.type);
+
+    m_table = new QTableWidget(0, 2, this);
+    m_table->setHorizontalHeaderLabels({ tr("Name"), tr("Value") });
+    m_table->horizontalHeader()->setStretchLastSection(true);
+    m_table->verticalHeader()->hide();
+    for (auto it = object.properties.constBegin(); it != object.properties.constEnd(); ++it) {
+        int row = m_table->rowCount();
+        m_table->insertRow(row);
+        m_table->setItem(row, 0, new QTableWidgetItem(it.key()));
+        m_table->setItem(row, 1, new QTableWidgetItem(it.value().toString()));
+    }
+
+    QPushButton* addButton = new QPushButton(tr("&Add"), this);
+    connect(addButton, &QPushButton::clicked, this, &CObjectPropertiesDialog::onAddProperty);
+    QPushButton* removeButton = new QPushButton(tr("&Remove"), this);
+    connect(removeButton, &QPushButton::clicked, this, &CObjectPropertiesDialog::onRemoveProperty);
+
+    QHBoxLayout* tableButtons = new QHBoxLayout;
+    tableButtons->addWidget(addButton);
+    tableButtons->addWidget(removeButton);
+    tableButtons->addStretch();
+
+    QFormLayout* formLayout = new QFormLayout;
+    formLayout->addRow(tr("Type:"), m_typeCombo);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addLayout(formLayout);
+    mainLayout->addWidget(m_table);
+    mainLayout->addLayout(tableButtons);
+    mainLayout->addWidget(buttonBox);
+}
+
+//-----------------------------------------------------------------------------
+CMapObject CObjectPropertiesDialog::object() const
+{
+    CMapObject result = m_object;
+    QString type = m_typeCombo->currentText().trimmed();
+    if (!type.isEmpty())
+        result.type = type;
+
+    result.properties.clear();
+    for (int row = 0; row < m_table->rowCount(); ++row) {
+        const QTableWidgetItem* nameItem = m_table->item(row, 0);
+        const QTableWidgetItem* valueItem = m_table->item(row, 1);
+        QString name = nameItem ? nameItem->text().trimmed() : QString();
+        if (name.isEmpty())
+            continue;
+        QString text = valueItem ? valueItem->text() : QString();
+        QVariant previous = m_object.properties.value(name);
+        result.properties.insert(name, previous.isValid() && previous.toString() == text ? previous : QVariant(text));
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+void CObjectPropertiesDialog::onAddProperty()
+{
+    int row = m_table->rowCount();
+    m_table->insertRow(row);
+    m_table->setItem(row, 0, new QTableWidgetItem);
+    m_table->setItem(row, 1, new QTableWidgetItem);
+    m_table->setCurrentCell(row, 0);
+    m_table->editItem(m_table->item(row, 0));
+}
+
+//-----------------------------------------------------------------------------
+void CObjectPropertiesDialog::onRemoveProperty()
+{
+    int row = m_table->currentRow();
+    if (row >= 0)
+        m_table->removeRow(row);
+}
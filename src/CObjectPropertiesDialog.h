@@ -0,0 +1,31 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+#include "CObjectLayer.h"
+
+#include <QDialog>
+
+//-----------------------------------------------------------------------------
+class QComboBox;
+class QTableWidget;
+
+//-----------------------------------------------------------------------------
+// Edits the type and the free-form properties of one map object. Values are
+// kept as typed in, except those left unchanged, which keep their type.
+class CObjectPropertiesDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit CObjectPropertiesDialog(const CMapObject& object, QWidget* parent = nullptr);
+
+    CMapObject object() const;
+
+private slots:
+    void onAddProperty();
+    void onRemoveProperty();
+
+private:
+    CMapObject m_object;
+    QComboBox* m_typeCombo = nullptr;
+    QTableWidget* m_table = nullptr;
+};
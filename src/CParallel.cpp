@@ -0,0 +1,43 @@
+#include "CParallel.h"
+
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+int CParallel::bandCount(int count, int minBand)
+{
+    if (count <= 0) return 0;
+    int threads = std::max(1, QThread::idealThreadCount());
+    int bands = count / std::max(1, minBand);
+    return std::clamp(bands, 1, threads);
+}
+
+//-----------------------------------------------------------------------------
+void CParallel::forBands(int count, int minBand, const std::function<void(int band, int begin, int end)>& fn)
+{
+    int bands = bandCount(count, minBand);
+    if (bands == 0) return;
+    if (bands == 1) {
+        fn(0, 0, count);
+        return;
+    }
+
+    QSemaphore done;
+    int started = 0;
+    for (int band = 1; band < bands; ++band) {
+        int begin = static_cast<int>(static_cast<long long>(count) * band / bands);
+        int end = static_cast<int>(static_cast<long long>(count) * (band + 1) / bands);
+        bool queued = QThreadPool::globalInstance()->tryStart([&fn, &done, band, begin, end]() {
+            fn(band, begin, end);
+            done.release();
+        });
+        if (queued)
+            ++started;
+        else
+            fn(band, begin, end);
+    }
+    fn(0, 0, static_cast<int>(static_cast<long long>(count) / bands));
+    done.acquire(started);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+
+//-----------------------------------------------------------------------------
+// Splits [0, count) into contiguous bands and runs them on the global
+// QThreadPool, with the calling thread taking the first band. Falls back to
+// running inline when the work is small or the pool is saturated, so it is
+// safe to call from pool threads.
+namespace CParallel {
+    int bandCount(int count, int minBand);
+    void forBands(int count, int minBand, const std::function<void(int band, int begin, int end)>& fn);
+}
@@ -0,0 +1,63 @@
+#include "CPathCheckDialog.h"
+#include "CPathfinder.h"
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QRegularExpression>
+#include <QVBoxLayout>
+
+//-----------------------------------------------------------------------------
+CPathCheckDialog::CPathCheckDialog(const QString& blockedIds, const QString& markerTypes, QWidget* parent)
+: QDialog(parent)
+{
+    setWindowTitle(tr("Check Paths"));
+
+    m_blockedEdit = new QLineEdit(blockedIds, this);
+    m_blockedEdit->setPlaceholderText(tr("e.g. 1, 4, 10-12"));
+
+    m_typesEdit = new QLineEdit(markerTypes, this);
+    m_typesEdit->setPlaceholderText(tr("e.g. spawn, exit"));
+
+    QLabel* hint = new QLabel(tr("Every pair of marked objects must be connected by walkable tiles."), this);
+    hint->setWordWrap(true);
+
+    QFormLayout* formLayout = new QFormLayout;
+    formLayout->addRow(tr("Blocked tile ids:"), m_blockedEdit);
+    formLayout->addRow(tr("Marker object types:"), m_typesEdit);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addWidget(hint);
+    mainLayout->addLayout(formLayout);
+    mainLayout->addWidget(buttonBox);
+}
+
+//-----------------------------------------------------------------------------
+QString CPathCheckDialog::blockedIdsText() const
+{
+    return m_blockedEdit->text();
+}
+
+//-----------------------------------------------------------------------------
+QString CPathCheckDialog::markerTypesText() const
+{
+    return m_typesEdit->text();
+}
+
+//-----------------------------------------------------------------------------
+QSet<uint32_t> CPathCheckDialog::blockedIds() const
+{
+    return CPathfinder::parseIdList(m_blockedEdit->text());
+}
+
+//-----------------------------------------------------------------------------
+QStringList CPathCheckDialog::markerTypes() const
+{
+    static const QRegularExpression separatorRe("[,\\s]+");
+    return m_typesEdit->text().split(separatorRe, Qt::SkipEmptyParts);
+}
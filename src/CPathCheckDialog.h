@@ -0,0 +1,28 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+#include <QDialog>
+#include <QSet>
+#include <QStringList>
+
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+class QLineEdit;
+
+//-----------------------------------------------------------------------------
+class CPathCheckDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    CPathCheckDialog(const QString& blockedIds, const QString& markerTypes, QWidget* parent = nullptr);
+
+    QString blockedIdsText() const;
+    QString markerTypesText() const;
+    QSet<uint32_t> blockedIds() const;
+    QStringList markerTypes() const;
+
+private:
+    QLineEdit* m_blockedEdit = nullptr;
+    QLineEdit* m_typesEdit = nullptr;
+};
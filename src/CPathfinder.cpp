@@ -0,0 +1,370 @@
+#include "CPathfinder.h"
+#include "CMap.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const double SQRT2 = 1.41421356237309504880;
+
+    double octile(const QPoint& a, const QPoint& b)
+    {
+        int dx = std::abs(a.x() - b.x());
+        int dy = std::abs(a.y() - b.y());
+        return std::max(dx, dy) + (SQRT2 - 1.0) * std::min(dx, dy);
+    }
+
+    int sign(int v)
+    {
+        return (v > 0) - (v < 0);
+    }
+
+    struct Node {
+        double g = 0.0;
+        int64_t parent = -1;
+        bool closed = false;
+    };
+
+    struct OpenEntry {
+        double f;
+        double g;
+        int64_t key;
+        bool operator<(const OpenEntry& o) const { return f > o.f || (f == o.f && g < o.g); }
+    };
+
+    // Marks every tile reachable from start, one bit per tile
+    std::vector<uint64_t> floodFill(const CWalkability& grid, const QPoint& start)
+    {
+        const size_t count = static_cast<size_t>(grid.width()) * grid.height();
+        std::vector<uint64_t> visited((count + 63) / 64, 0);
+        if (!grid.walkable(start.x(), start.y()))
+            return visited;
+
+        auto mark = [&](int x, int y) {
+            size_t i = static_cast<size_t>(y) * grid.width() + x;
+            uint64_t bit = uint64_t(1) << (i & 63);
+            if (visited[i >> 6] & bit) return false;
+            visited[i >> 6] |= bit;
+            return true;
+        };
+        std::vector<QPoint> stack;
+        stack.push_back(start);
+        mark(start.x(), start.y());
+        while (!stack.empty()) {
+            QPoint p = stack.back();
+            stack.pop_back();
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = p.x() + dx;
+                    int ny = p.y() + dy;
+                    if ((dx == 0 && dy == 0) || !grid.walkable(nx, ny))
+                        continue;
+                    if (dx && dy && !(grid.walkable(p.x() + dx, p.y()) && grid.walkable(p.x(), p.y() + dy)))
+                        continue;
+                    if (mark(nx, ny))
+                        stack.push_back(QPoint(nx, ny));
+                }
+            }
+        }
+        return visited;
+    }
+}
+
+//-----------------------------------------------------------------------------
+CWalkability::CWalkability(const CMap& map, const QSet<uint32_t>& blockedIds)
+: m_width(map.width()), m_height(map.height()), m_stride((map.width() + 63) / 64)
+{
+    m_bits.assign(static_cast<size_t>(m_stride) * m_height, 0);
+
+    // Clamped lookup table, the trailing entry covers every larger id
+    uint32_t maxId = 0;
+    for (uint32_t id : blockedIds)
+        maxId = std::max(maxId, id);
+    std::vector<uint8_t> walk(static_cast<size_t>(maxId) + 2, 1);
+    for (uint32_t id : blockedIds)
+        walk[id] = 0;
+    const uint32_t last = maxId + 1;
+
+    map.visitCells([&](const auto* tiles) {
+        CParallel::forBands(m_height, 64, [&](int, int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                const auto* row = tiles + static_cast<size_t>(y) * m_width;
+                uint64_t* bits = m_bits.data() + static_cast<size_t>(y) * m_stride;
+                for (int x = 0; x < m_width; ++x)
+                    bits[x >> 6] |= static_cast<uint64_t>(walk[std::min<uint32_t>(row[x], last)]) << (x & 63);
+            }
+        });
+    });
+}
+
+//-----------------------------------------------------------------------------
+bool CPathfinder::jumpStraight(int x, int y, int dx, int dy, QPoint& out) const
+{
+    const CWalkability& g = m_grid;
+    for (;;) {
+        if (!g.walkable(x, y))
+            return false;
+        if (x == m_goal.x() && y == m_goal.y())
+            break;
+        // A side opening right past a wall is a forced neighbour
+        if (dx) {
+            if ((g.walkable(x, y - 1) && !g.walkable(x - dx, y - 1)) ||
+                (g.walkable(x, y + 1) && !g.walkable(x - dx, y + 1)))
+                break;
+        } else {
+            if ((g.walkable(x - 1, y) && !g.walkable(x - 1, y - dy)) ||
+                (g.walkable(x + 1, y) && !g.walkable(x + 1, y - dy)))
+                break;
+        }
+        x += dx;
+        y += dy;
+    }
+    out = QPoint(x, y);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CPathfinder::jumpDiagonal(int x, int y, int dx, int dy, QPoint& out) const
+{
+    const CWalkability& g = m_grid;
+    QPoint unused;
+    for (;;) {
+        if (!g.walkable(x, y))
+            return false;
+        if ((x == m_goal.x() && y == m_goal.y()) ||
+            jumpStraight(x + dx, y, dx, 0, unused) || jumpStraight(x, y + dy, 0, dy, unused))
+            break;
+        if (!g.walkable(x + dx, y) || !g.walkable(x, y + dy))
+            return false;
+        x += dx;
+        y += dy;
+    }
+    out = QPoint(x, y);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Pruned neighbours: the natural continuation of the move from the parent
+// plus forced neighbours; the start node expands in all directions.
+void CPathfinder::neighbours(const QPoint& node, const QPoint& parent, bool hasParent, QVector<QPoint>& out) const
+{
+    const CWalkability& g = m_grid;
+    const int x = node.x();
+    const int y = node.y();
+    out.clear();
+
+    if (!hasParent) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                if ((dx == 0 && dy == 0) || !g.walkable(x + dx, y + dy))
+                    continue;
+                if (dx && dy && !(g.walkable(x + dx, y) && g.walkable(x, y + dy)))
+                    continue;
+                out.append(QPoint(x + dx, y + dy));
+            }
+        }
+        return;
+    }
+
+    const int dx = sign(x - parent.x());
+    const int dy = sign(y - parent.y());
+    if (dx && dy) {
+        bool vertical = g.walkable(x, y + dy);
+        bool horizontal = g.walkable(x + dx, y);
+        if (vertical) out.append(QPoint(x, y + dy));
+        if (horizontal) out.append(QPoint(x + dx, y));
+        if (vertical && horizontal) out.append(QPoint(x + dx, y + dy));
+    } else if (dx) {
+        bool next = g.walkable(x + dx, y);
+        bool below = g.walkable(x, y + 1);
+        bool above = g.walkable(x, y - 1);
+        if (next) {
+            out.append(QPoint(x + dx, y));
+            if (below) out.append(QPoint(x + dx, y + 1));
+            if (above) out.append(QPoint(x + dx, y - 1));
+        }
+        if (below) out.append(QPoint(x, y + 1));
+        if (above) out.append(QPoint(x, y - 1));
+    } else {
+        bool next = g.walkable(x, y + dy);
+        bool right = g.walkable(x + 1, y);
+        bool left = g.walkable(x - 1, y);
+        if (next) {
+            out.append(QPoint(x, y + dy));
+            if (right) out.append(QPoint(x + 1, y + dy));
+            if (left) out.append(QPoint(x - 1, y + dy));
+        }
+        if (right) out.append(QPoint(x + 1, y));
+        if (left) out.append(QPoint(x - 1, y));
+    }
+}
+
+//-----------------------------------------------------------------------------
+CPathResult CPathfinder::findPath(const QPoint& start, const QPoint& goal)
+{
+    CPathResult result;
+    if (!m_grid.walkable(start.x(), start.y()) || !m_grid.walkable(goal.x(), goal.y()))
+        return result;
+
+    m_goal = goal;
+    const int64_t w = m_grid.width();
+    auto keyOf = [w](const QPoint& p) { return static_cast<int64_t>(p.y()) * w + p.x(); };
+    auto pointOf = [w](int64_t key) { return QPoint(static_cast<int>(key % w), static_cast<int>(key / w)); };
+
+    std::unordered_map<int64_t, Node> nodes;
+    std::priority_queue<OpenEntry> open;
+    const int64_t startKey = keyOf(start);
+    const int64_t goalKey = keyOf(goal);
+    nodes[startKey] = Node();
+    open.push({octile(start, goal), 0.0, startKey});
+
+    QVector<QPoint> next;
+    bool found = false;
+    while (!open.empty()) {
+        OpenEntry entry = open.top();
+        open.pop();
+        Node& node = nodes[entry.key];
+        if (node.closed || entry.g > node.g)
+            continue;
+        node.closed = true;
+        if (entry.key == goalKey) {
+            found = true;
+            break;
+        }
+
+        QPoint p = pointOf(entry.key);
+        bool hasParent = node.parent >= 0;
+        QPoint parent = hasParent ? pointOf(node.parent) : p;
+        double g = node.g;
+        neighbours(p, parent, hasParent, next);
+        for (const QPoint& n : next) {
+            int dx = sign(n.x() - p.x());
+            int dy = sign(n.y() - p.y());
+            QPoint jump;
+            bool ok = (dx && dy) ? jumpDiagonal(n.x(), n.y(), dx, dy, jump)
+                                 : jumpStraight(n.x(), n.y(), dx, dy, jump);
+            if (!ok)
+                continue;
+            int64_t key = keyOf(jump);
+            double cost = g + octile(p, jump);
+            auto it = nodes.find(key);
+            if (it != nodes.end() && (it->second.closed || it->second.g <= cost))
+                continue;
+            Node& target = nodes[key];
+            target.g = cost;
+            target.parent = entry.key;
+            open.push({cost + octile(jump, goal), cost, key});
+        }
+    }
+    if (!found)
+        return result;
+
+    // Walk back over the jump points and fill in the straight or diagonal
+    // runs between them
+    QVector<QPoint> jumps;
+    for (int64_t key = goalKey; key >= 0; key = nodes[key].parent)
+        jumps.append(pointOf(key));
+    std::reverse(jumps.begin(), jumps.end());
+
+    result.path.append(jumps.first());
+    for (int i = 1; i < jumps.size(); ++i) {
+        QPoint a = jumps[i - 1];
+        const QPoint& b = jumps[i];
+        int dx = sign(b.x() - a.x());
+        int dy = sign(b.y() - a.y());
+        while (a != b) {
+            a += QPoint(dx, dy);
+            result.path.append(a);
+        }
+    }
+    result.reachable = true;
+    result.length = nodes[goalKey].g;
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+QVector<CPathResult> CPathfinder::checkAllPairs(const CWalkability& grid, const QVector<QPoint>& points)
+{
+    const int n = points.size();
+
+    // Component id per point; blocked points get none
+    QVector<int> component(n, -1);
+    int components = 0;
+    for (int i = 0; i < n; ++i) {
+        if (component[i] >= 0 || !grid.walkable(points[i].x(), points[i].y()))
+            continue;
+        std::vector<uint64_t> visited = floodFill(grid, points[i]);
+        for (int j = i; j < n; ++j) {
+            const QPoint& p = points[j];
+            if (!grid.walkable(p.x(), p.y()))
+                continue;
+            size_t index = static_cast<size_t>(p.y()) * grid.width() + p.x();
+            if ((visited[index >> 6] >> (index & 63)) & 1)
+                component[j] = components;
+        }
+        ++components;
+    }
+
+    QVector<CPathResult> results;
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            CPathResult r;
+            r.from = i;
+            r.to = j;
+            results.append(r);
+        }
+    }
+
+    CPathResult* out = results.data();
+    CParallel::forBands(results.size(), 1, [&](int, int begin, int end) {
+        CPathfinder finder(grid);
+        for (int k = begin; k < end; ++k) {
+            CPathResult& r = out[k];
+            if (component[r.from] < 0 || component[r.from] != component[r.to])
+                continue;
+            CPathResult found = finder.findPath(points[r.from], points[r.to]);
+            found.from = r.from;
+            found.to = r.to;
+            r = std::move(found);
+        }
+    });
+    return results;
+}
+
+//-----------------------------------------------------------------------------
+QVector<QPoint> CPathfinder::markerTiles(const CMap& map, const QStringList& types, QVector<uint32_t>* objectIds)
+{
+    QVector<QPoint> tiles;
+    for (const CMapObject& obj : map.objects().objects()) {
+        if (!types.contains(obj.type))
+            continue;
+        QPoint centre = obj.rect.center();
+        tiles.append(QPoint(centre.x() / Constants::DEFAULT_TILE_SIZE, centre.y() / Constants::DEFAULT_TILE_SIZE));
+        if (objectIds)
+            objectIds->append(obj.id);
+    }
+    return tiles;
+}
+
+//-----------------------------------------------------------------------------
+QSet<uint32_t> CPathfinder::parseIdList(const QString& text)
+{
+    QSet<uint32_t> ids;
+    static const QRegularExpression itemRe("(\\d+)(?:\\s*-\\s*(\\d+))?");
+    auto it = itemRe.globalMatch(text);
+    while (it.hasNext()) {
+        QRegularExpressionMatch m = it.next();
+        uint32_t first = m.captured(1).toUInt();
+        uint32_t last = m.captured(2).isEmpty() ? first : m.captured(2).toUInt();
+        for (uint32_t id = first; id <= last && id <= 65535; ++id)
+            ids.insert(id);
+    }
+    return ids;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <QPoint>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+class CMap;
+
+//-----------------------------------------------------------------------------
+// Packed walkability bitmap, one bit per tile, 64 tiles per word per row.
+class CWalkability
+{
+public:
+    CWalkability() = default;
+    CWalkability(const CMap& map, const QSet<uint32_t>& blockedIds);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    bool walkable(int x, int y) const
+    {
+        if (x < 0 || y < 0 || x >= m_width || y >= m_height) return false;
+        return (m_bits[static_cast<size_t>(y) * m_stride + (x >> 6)] >> (x & 63)) & 1;
+    }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_stride = 0;
+    std::vector<uint64_t> m_bits;
+};
+
+//-----------------------------------------------------------------------------
+struct CPathResult
+{
+    int from = 0;               // indices into the checked point list
+    int to = 0;
+    bool reachable = false;
+    double length = 0.0;        // octile distance in tiles
+    QVector<QPoint> path;       // every tile from start to goal
+};
+
+//-----------------------------------------------------------------------------
+// A* with jump point search on an 8-connected grid where diagonal steps may
+// not cut corners. Only jump points enter the open list, and node state is
+// kept sparse, so a search costs memory in proportion to what it visits.
+class CPathfinder
+{
+public:
+    explicit CPathfinder(const CWalkability& grid) : m_grid(grid) {}
+
+    CPathResult findPath(const QPoint& start, const QPoint& goal);
+
+    // Checks every unordered pair of points, in parallel. Pairs in different
+    // walkable areas are rejected by a flood fill before any search runs.
+    static QVector<CPathResult> checkAllPairs(const CWalkability& grid, const QVector<QPoint>& points);
+
+    // Tiles under the centres of objects whose type is listed
+    static QVector<QPoint> markerTiles(const CMap& map, const QStringList& types, QVector<uint32_t>* objectIds = nullptr);
+    // Parses "1, 4, 10-12" into a set of tile ids
+    static QSet<uint32_t> parseIdList(const QString& text);
+
+private:
+    const CWalkability& m_grid;
+    QPoint m_goal;
+
+    bool jumpStraight(int x, int y, int dx, int dy, QPoint& out) const;
+    bool jumpDiagonal(int x, int y, int dx, int dy, QPoint& out) const;
+    void neighbours(const QPoint& node, const QPoint& parent, bool hasParent, QVector<QPoint>& out) const;
+};
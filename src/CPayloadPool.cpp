@@ -0,0 +1,168 @@
+#include "CPayloadPool.h"
+#include "Constants.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <new>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    constexpr int classCount()
+    {
+        int count = 1;
+        for (long long size = Constants::ALLOC_POOL_MIN_BLOCK; size < Constants::ALLOC_POOL_MAX_BLOCK; size *= 2)
+            ++count;
+        return count;
+    }
+
+    constexpr int CLASS_COUNT = classCount();
+
+    struct Pools
+    {
+        QMutex mutex;
+        std::vector<void*> free[CLASS_COUNT];
+        qint64 cached = 0;
+        CAllocStats::Counters counters[CAllocStats::POOL_COUNT];
+
+        ~Pools()
+        {
+            for (auto& list : free) {
+                for (void* block : list)
+                    ::operator delete(block);
+            }
+        }
+    };
+
+    Pools& pools()
+    {
+        static Pools instance;
+        return instance;
+    }
+
+    // -1 for blocks too large to pool
+    int classFor(size_t bytes)
+    {
+        size_t size = static_cast<size_t>(Constants::ALLOC_POOL_MIN_BLOCK);
+        for (int index = 0; index < CLASS_COUNT; ++index, size *= 2) {
+            if (bytes <= size)
+                return index;
+        }
+        return -1;
+    }
+
+    size_t classSize(int index)
+    {
+        return static_cast<size_t>(Constants::ALLOC_POOL_MIN_BLOCK) << index;
+    }
+}
+
+//-----------------------------------------------------------------------------
+CAllocStats::Counters CAllocStats::counters(Pool pool)
+{
+    Pools& p = pools();
+    QMutexLocker lock(&p.mutex);
+    return p.counters[pool];
+}
+
+//-----------------------------------------------------------------------------
+void CAllocStats::record(Pool pool, qint64 bytes)
+{
+    Pools& p = pools();
+    QMutexLocker lock(&p.mutex);
+    ++p.counters[pool].allocations;
+    p.counters[pool].bytes += bytes;
+}
+
+//-----------------------------------------------------------------------------
+void CAllocStats::reset()
+{
+    Pools& p = pools();
+    QMutexLocker lock(&p.mutex);
+    for (Counters& counters : p.counters) {
+        counters.allocations = 0;
+        counters.bytes = 0;
+        counters.reused = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+QString CAllocStats::summary()
+{
+    const char* names[POOL_COUNT] = { "undo payload", "scratch" };
+    QStringList parts;
+    for (int pool = 0; pool < POOL_COUNT; ++pool) {
+        const Counters c = counters(static_cast<Pool>(pool));
+        parts.append(QString("%1: %2 allocations (%3 KB), %4 reused, %5 KB live")
+                         .arg(names[pool]).arg(c.allocations).arg(c.bytes / 1024).arg(c.reused).arg(c.liveBytes / 1024));
+    }
+    return parts.join("; ");
+}
+
+//-----------------------------------------------------------------------------
+void* CPayloadPool::allocate(size_t bytes, CAllocStats::Pool pool, size_t* capacity)
+{
+    Pools& p = pools();
+    const int index = classFor(bytes);
+    const size_t size = index >= 0 ? classSize(index) : bytes;
+    *capacity = size;
+    {
+        QMutexLocker lock(&p.mutex);
+        CAllocStats::Counters& counters = p.counters[pool];
+        counters.liveBytes += static_cast<qint64>(size);
+        if (index >= 0 && !p.free[index].empty()) {
+            void* block = p.free[index].back();
+            p.free[index].pop_back();
+            p.cached -= static_cast<qint64>(size);
+            ++counters.reused;
+            return block;
+        }
+        ++counters.allocations;
+        counters.bytes += static_cast<qint64>(size);
+    }
+    return ::operator new(size);
+}
+
+//-----------------------------------------------------------------------------
+void CPayloadPool::release(void* block, size_t capacity, CAllocStats::Pool pool)
+{
+    Pools& p = pools();
+    const int index = classFor(capacity);
+    {
+        QMutexLocker lock(&p.mutex);
+        p.counters[pool].liveBytes -= static_cast<qint64>(capacity);
+        if (index >= 0 && classSize(index) == capacity
+                && p.cached + static_cast<qint64>(capacity) <= Constants::ALLOC_POOL_CACHE_MB * 1024 * 1024) {
+            p.free[index].push_back(block);
+            p.cached += static_cast<qint64>(capacity);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+//-----------------------------------------------------------------------------
+void CPayloadPool::trim()
+{
+    std::vector<void*> blocks;
+    {
+        Pools& p = pools();
+        QMutexLocker lock(&p.mutex);
+        for (auto& list : p.free) {
+            blocks.insert(blocks.end(), list.begin(), list.end());
+            std::vector<void*>().swap(list);
+        }
+        p.cached = 0;
+    }
+    for (void* block : blocks)
+        ::operator delete(block);
+}
+
+//-----------------------------------------------------------------------------
+qint64 CPayloadPool::cachedBytes()
+{
+    Pools& p = pools();
+    QMutexLocker lock(&p.mutex);
+    return p.cached;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <QString>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+// Allocation counters per pool. allocations and bytes count requests that
+// had to go to the heap, reused the ones served from a free list, so a hot
+// path is allocation-free when allocations does not move across it.
+namespace CAllocStats {
+    enum Pool {
+        UNDO_PAYLOAD,               // arrays owned by undo commands
+        SCRATCH,                    // per-operation buffers reused by tools
+        POOL_COUNT
+    };
+
+    struct Counters
+    {
+        qint64 allocations = 0;
+        qint64 bytes = 0;
+        qint64 reused = 0;
+        qint64 liveBytes = 0;       // handed out and not yet returned
+    };
+
+    Counters counters(Pool pool);
+    // For buffers that keep their own storage, e.g. a reused QVector that
+    // had to grow
+    void record(Pool pool, qint64 bytes);
+    // Zeroes everything but liveBytes, e.g. at the start of a benchmark
+    void reset();
+    QString summary();
+}
+
+//-----------------------------------------------------------------------------
+// Process-wide pool of raw blocks in power-of-two size classes. Freed blocks
+// go to a free list of their class, up to ALLOC_POOL_CACHE_MB in total, and
+// are handed out again before anything new is allocated, so commands and
+// scratch buffers that come and go at a steady size stop reaching the heap.
+// Blocks larger than the biggest class are not pooled. Thread-safe.
+namespace CPayloadPool {
+    // capacity receives the usable size, at least bytes
+    void* allocate(size_t bytes, CAllocStats::Pool pool, size_t* capacity);
+    void release(void* block, size_t capacity, CAllocStats::Pool pool);
+    // Frees the cached blocks
+    void trim();
+    qint64 cachedBytes();
+}
+
+//-----------------------------------------------------------------------------
+// Array of trivially copyable values in a pooled block. Covers what the
+// undo payload helpers need of a container; clear() keeps the block, so a
+// buffer kept across operations allocates only while it is still growing.
+template<typename T>
+class CPooledArray
+{
+    static_assert(std::is_trivially_copyable<T>::value, "pooled arrays copy with memcpy");
+
+public:
+    using value_type = T;
+
+    explicit CPooledArray(CAllocStats::Pool pool = CAllocStats::UNDO_PAYLOAD) : m_pool(pool) {}
+    CPooledArray(CPooledArray&& other) noexcept { swap(other); }
+    CPooledArray& operator=(CPooledArray&& other) noexcept { CPooledArray(std::move(other)).swap(*this); return *this; }
+    CPooledArray(const CPooledArray&) = delete;
+    CPooledArray& operator=(const CPooledArray&) = delete;
+    ~CPooledArray() { if (m_data) CPayloadPool::release(m_data, m_bytes, m_pool); }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+    const T* constData() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool isEmpty() const { return m_size == 0; }
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_size; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+
+    void clear() { m_size = 0; }
+    void reserve(size_t n) { if (n > m_capacity) grow(n); }
+    // New elements are left uninitialised
+    void resize(size_t n) { reserve(n); m_size = n; }
+    void append(const T& value)
+    {
+        if (m_size == m_capacity)
+            grow(m_size + 1);
+        m_data[m_size++] = value;
+    }
+    T takeLast() { return m_data[--m_size]; }
+
+    void swap(CPooledArray& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_bytes, other.m_bytes);
+        std::swap(m_pool, other.m_pool);
+    }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+    size_t m_bytes = 0;             // block size as allocated, which T may not divide
+    CAllocStats::Pool m_pool = CAllocStats::UNDO_PAYLOAD;
+
+    void grow(size_t n)
+    {
+        size_t bytes = 0;
+        T* data = static_cast<T*>(CPayloadPool::allocate(std::max(n, m_capacity * 2) * sizeof(T), m_pool, &bytes));
+        if (m_size)
+            std::memcpy(data, m_data, m_size * sizeof(T));
+        if (m_data)
+            CPayloadPool::release(m_data, m_bytes, m_pool);
+        m_data = data;
+        m_bytes = bytes;
+        m_capacity = bytes / sizeof(T);
+    }
+};
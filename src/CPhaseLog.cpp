@@ -0,0 +1,25 @@
+#include "CPhaseLog.h"
+
+#include <QDebug>
+
+//-----------------------------------------------------------------------------
+CPhaseLog::CPhaseLog(const QString& name)
+    : m_name(name)
+{
+    m_timer.start();
+}
+
+//-----------------------------------------------------------------------------
+void CPhaseLog::mark(const QString& phase)
+{
+    qint64 now = m_timer.nsecsElapsed();
+    qInfo().noquote() << QString("%1: %2 %3 ms (total %4 ms)").arg(m_name, phase)
+        .arg((now - m_lastNs) / 1.0e6, 0, 'f', 1).arg(now / 1.0e6, 0, 'f', 1);
+    m_lastNs = now;
+}
+
+//-----------------------------------------------------------------------------
+double CPhaseLog::totalMs() const
+{
+    return m_timer.nsecsElapsed() / 1.0e6;
+}
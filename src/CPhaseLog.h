@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+
+//-----------------------------------------------------------------------------
+// Times the phases of a longer operation such as startup. Each mark() logs
+// how long the phase took and the total so far:
+//   startup: session read 12.4 ms (total 48.9 ms)
+class CPhaseLog
+{
+public:
+    explicit CPhaseLog(const QString& name);
+
+    void mark(const QString& phase);
+    double totalMs() const;
+
+private:
+    QString m_name;
+    QElapsedTimer m_timer;
+    qint64 m_lastNs = 0;
+};
@@ -0,0 +1,114 @@
+#include "CReplaceTilesDialog.h"
+
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLineEdit>
+#include <QMessageBox>
+#include <QRegularExpression>
+#include <QSpinBox>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <limits>
+
+//-----------------------------------------------------------------------------
+CReplaceTilesDialog::CReplaceTilesDialog(uint32_t fromTile, uint32_t toTile, uint32_t maxTileId, bool hasSelection, QWidget* parent)
+: QDialog(parent)
+{
+    setWindowTitle(tr("Replace Tiles"));
+
+    // QSpinBox holds an int, so ids past INT_MAX go through the mapping table
+    const int maxId = static_cast<int>(std::min<uint32_t>(maxTileId, std::numeric_limits<int>::max()));
+
+    m_fromSpinBox = new QSpinBox(this);
+    m_fromSpinBox->setRange(0, maxId);
+    m_fromSpinBox->setValue(static_cast<int>(std::min<uint32_t>(fromTile, maxId)));
+
+    m_toSpinBox = new QSpinBox(this);
+    m_toSpinBox->setRange(0, maxId);
+    m_toSpinBox->setValue(static_cast<int>(std::min<uint32_t>(toTile, maxId)));
+
+    m_mappingEdit = new QLineEdit(this);
+    m_mappingEdit->setPlaceholderText(tr("e.g. 1:5, 2:6 (overrides From/To)"));
+
+    m_selectionCheckBox = new QCheckBox(this);
+    m_selectionCheckBox->setEnabled(hasSelection);
+    m_selectionCheckBox->setChecked(hasSelection);
+
+    QFormLayout* formLayout = new QFormLayout;
+    formLayout->addRow(tr("From:"), m_fromSpinBox);
+    formLayout->addRow(tr("To:"), m_toSpinBox);
+    formLayout->addRow(tr("Mapping table:"), m_mappingEdit);
+    formLayout->addRow(tr("Selection only:"), m_selectionCheckBox);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addLayout(formLayout);
+    mainLayout->addWidget(buttonBox);
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CReplaceTilesDialog::fromTile() const
+{
+    return static_cast<uint32_t>(m_fromSpinBox->value());
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CReplaceTilesDialog::toTile() const
+{
+    return static_cast<uint32_t>(m_toSpinBox->value());
+}
+
+//-----------------------------------------------------------------------------
+bool CReplaceTilesDialog::mapping(QMap<uint32_t, uint32_t>& result, QString* error) const
+{
+    // Pairs are written as "from:to", separated by commas or spaces; anything
+    // else is an error rather than skipped, so a typo cannot turn a table
+    // into a partial replace
+    result.clear();
+    static const QRegularExpression pairRe("[\\s,]*(\\d+)\\s*[:=]\\s*(\\d+)(?=[\\s,]|$)");
+    static const QRegularExpression tailRe("^[\\s,]*$");
+    const QString text = m_mappingEdit->text();
+    qsizetype pos = 0;
+    while (!tailRe.match(text.mid(pos)).hasMatch()) {
+        QRegularExpressionMatch m = pairRe.match(text, pos, QRegularExpression::NormalMatch,
+                                                 QRegularExpression::AnchorAtOffsetMatchOption);
+        if (!m.hasMatch()) {
+            if (error) *error = tr("Cannot read the mapping table at \"%1\". Write pairs as from:to, e.g. 1:5, 2:6.")
+                                    .arg(text.mid(pos).trimmed());
+            return false;
+        }
+        bool fromOk = false, toOk = false;
+        uint32_t from = m.captured(1).toUInt(&fromOk);
+        uint32_t to = m.captured(2).toUInt(&toOk);
+        if (!fromOk || !toOk) {
+            if (error) *error = tr("Tile id out of range in \"%1\"").arg(m.captured(0).trimmed());
+            return false;
+        }
+        result.insert(from, to);
+        pos = m.capturedEnd(0);
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CReplaceTilesDialog::accept()
+{
+    QMap<uint32_t, uint32_t> table;
+    QString error;
+    if (!mapping(table, &error)) {
+        QMessageBox::warning(this, windowTitle(), error);
+        m_mappingEdit->setFocus();
+        return;
+    }
+    QDialog::accept();
+}
+
+//-----------------------------------------------------------------------------
+bool CReplaceTilesDialog::selectionOnly() const
+{
+    return m_selectionCheckBox->isChecked();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+#include <QDialog>
+#include <QMap>
+
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+class QCheckBox;
+class QLineEdit;
+class QSpinBox;
+
+//-----------------------------------------------------------------------------
+class CReplaceTilesDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    // The spin boxes go up to maxTileId; the mapping table takes any uint32 id
+    CReplaceTilesDialog(uint32_t fromTile, uint32_t toTile, uint32_t maxTileId, bool hasSelection, QWidget* parent = nullptr);
+
+    uint32_t fromTile() const;
+    uint32_t toTile() const;
+    // False with an error message if the mapping table does not parse
+    bool mapping(QMap<uint32_t, uint32_t>& result, QString* error = nullptr) const;
+    bool selectionOnly() const;
+
+public slots:
+    void accept() override;
+
+private:
+    QSpinBox* m_fromSpinBox = nullptr;
+    QSpinBox* m_toSpinBox = nullptr;
+    QLineEdit* m_mappingEdit = nullptr;
+    QCheckBox* m_selectionCheckBox = nullptr;
+};
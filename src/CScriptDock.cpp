@@ -0,0 +1,77 @@
+#include "CScriptDock.h"
+
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QShortcut>
+#include <QSplitter>
+#include <QVBoxLayout>
+
+//-----------------------------------------------------------------------------
+CScriptDock::CScriptDock(QWidget* parent)
+: QDockWidget(tr("Script"), parent)
+{
+    setObjectName("ScriptDock");
+    QWidget* content = new QWidget(this);
+    const QFont mono = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+
+    m_editor = new QPlainTextEdit(content);
+    m_editor->setFont(mono);
+    m_editor->setPlaceholderText(tr(
+        "// map.width, map.height\n"
+        "// map.tileAt(x, y), map.setTile(x, y, id), map.fillRect(x, y, w, h, id)\n"
+        "// map.readRegion(x, y, w, h) -> Uint32Array, row-major\n"
+        "// map.writeRegion(x, y, w, h, tiles)\n"
+        "// print(...)\n"
+        "var t = map.readRegion(0, 0, map.width, map.height);\n"
+        "for (var i = 0; i < t.length; ++i)\n"
+        "    if (t[i] === 1) t[i] = 2;\n"
+        "map.writeRegion(0, 0, map.width, map.height, t);"));
+
+    m_output = new QPlainTextEdit(content);
+    m_output->setFont(mono);
+    m_output->setReadOnly(true);
+
+    QSplitter* splitter = new QSplitter(Qt::Vertical, content);
+    splitter->addWidget(m_editor);
+    splitter->addWidget(m_output);
+    splitter->setStretchFactor(0, 3);
+    splitter->setStretchFactor(1, 1);
+
+    m_runButton = new QPushButton(tr("Run"), content);
+    m_runButton->setToolTip(tr("Run the script as one undoable edit (Ctrl+Return)"));
+    m_stopButton = new QPushButton(tr("Stop"), content);
+    m_stopButton->setEnabled(false);
+    connect(m_runButton, &QPushButton::clicked, this, [this]() {
+        emit runRequested(m_editor->toPlainText());
+    });
+    connect(m_stopButton, &QPushButton::clicked, this, &CScriptDock::stopRequested);
+    QShortcut* runShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_Return), m_editor);
+    runShortcut->setContext(Qt::WidgetShortcut);
+    connect(runShortcut, &QShortcut::activated, m_runButton, &QPushButton::click);
+
+    QHBoxLayout* buttons = new QHBoxLayout;
+    buttons->addWidget(m_runButton);
+    buttons->addWidget(m_stopButton);
+    buttons->addStretch();
+
+    QVBoxLayout* layout = new QVBoxLayout(content);
+    layout->addWidget(splitter);
+    layout->addLayout(buttons);
+    setWidget(content);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptDock::setRunning(bool running)
+{
+    m_runButton->setEnabled(!running);
+    m_stopButton->setEnabled(running);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptDock::showResult(const QString& output, const QString& status)
+{
+    m_output->setPlainText(output);
+    m_output->appendPlainText(status);
+}
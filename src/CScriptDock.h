@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QDockWidget>
+
+//-----------------------------------------------------------------------------
+class QPlainTextEdit;
+class QPushButton;
+
+//-----------------------------------------------------------------------------
+// Script console: an editor, Run/Stop buttons and the output of the last
+// run. The main window runs the script and reports back.
+class CScriptDock : public QDockWidget
+{
+    Q_OBJECT
+public:
+    explicit CScriptDock(QWidget* parent = nullptr);
+
+    void setRunning(bool running);
+    void showResult(const QString& output, const QString& status);
+
+signals:
+    void runRequested(const QString& source);
+    void stopRequested();
+
+private:
+    QPlainTextEdit* m_editor = nullptr;
+    QPlainTextEdit* m_output = nullptr;
+    QPushButton* m_runButton = nullptr;
+    QPushButton* m_stopButton = nullptr;
+};
@@ -0,0 +1,169 @@
+#include "CScriptRunner.h"
+#include "CMap.h"
+
+#include <QElapsedTimer>
+#include <QJSEngine>
+#include <QMutexLocker>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Wraps the native object in a plain JS object, so region access takes
+    // and returns typed arrays and print() accepts any values
+    const char* PRELUDE = R"JS(
+(function (native) {
+    return {
+        get width() { return native.width; },
+        get height() { return native.height; },
+        tileAt: function (x, y) { return native.tileAt(x, y); },
+        setTile: function (x, y, id) { native.setTile(x, y, id); },
+        fillRect: function (x, y, w, h, id) { native.fillRect(x, y, w, h, id); },
+        readRegion: function (x, y, w, h) {
+            return new Uint32Array(native.readBytes(x, y, w, h));
+        },
+        writeRegion: function (x, y, w, h, tiles) {
+            if (!(tiles instanceof Uint32Array))
+                tiles = Uint32Array.from(tiles);
+            var whole = tiles.byteOffset === 0 && tiles.byteLength === tiles.buffer.byteLength;
+            native.writeBytes(x, y, w, h, whole ? tiles.buffer
+                              : tiles.buffer.slice(tiles.byteOffset, tiles.byteOffset + tiles.byteLength));
+        },
+        print: function () {
+            native.print(Array.prototype.map.call(arguments, String).join(" "));
+        }
+    };
+})
+)JS";
+}
+
+//-----------------------------------------------------------------------------
+int CScriptMap::width() const
+{
+    return m_map->width();
+}
+
+//-----------------------------------------------------------------------------
+int CScriptMap::height() const
+{
+    return m_map->height();
+}
+
+//-----------------------------------------------------------------------------
+uint CScriptMap::tileAt(int x, int y) const
+{
+    return m_map->tileAt(x, y);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptMap::setTile(int x, int y, uint value)
+{
+    m_map->setTile(x, y, value);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptMap::fillRect(int x, int y, int w, int h, uint value)
+{
+    m_map->fillRect(x, y, w, h, value);
+}
+
+//-----------------------------------------------------------------------------
+bool CScriptMap::checkRect(int x, int y, int w, int h) const
+{
+    if (x >= 0 && y >= 0 && w > 0 && h > 0 && x + w <= m_map->width() && y + h <= m_map->height())
+        return true;
+    qjsEngine(this)->throwError(QJSValue::RangeError,
+        QString("Region %1,%2 %3x%4 is not inside the %5x%6 map").arg(x).arg(y).arg(w).arg(h)
+            .arg(m_map->width()).arg(m_map->height()));
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+QByteArray CScriptMap::readBytes(int x, int y, int w, int h) const
+{
+    if (!checkRect(x, y, w, h))
+        return QByteArray();
+    CTileRegion region = m_map->copyRegion(x, y, w, h);
+    return QByteArray(reinterpret_cast<const char*>(region.tiles.data()),
+                      static_cast<int>(region.tiles.size() * sizeof(uint32_t)));
+}
+
+//-----------------------------------------------------------------------------
+void CScriptMap::writeBytes(int x, int y, int w, int h, const QByteArray& bytes)
+{
+    if (!checkRect(x, y, w, h))
+        return;
+    CTileRegion region;
+    region.width = w;
+    region.height = h;
+    region.tiles.resize(static_cast<size_t>(w) * h);
+    if (static_cast<size_t>(bytes.size()) != region.tiles.size() * sizeof(uint32_t)) {
+        qjsEngine(this)->throwError(QJSValue::RangeError,
+            QString("writeRegion expects %1 tiles, got %2").arg(region.tiles.size()).arg(bytes.size() / 4));
+        return;
+    }
+    std::memcpy(region.tiles.data(), bytes.constData(), bytes.size());
+    m_map->blitRegion(x, y, region);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptMap::print(const QString& text)
+{
+    m_output += text;
+    m_output += '\n';
+}
+
+//-----------------------------------------------------------------------------
+CScriptRunner::Result CScriptRunner::run(const QString& source, CMap& map)
+{
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+
+    QJSEngine engine;
+    CScriptMap native(&map);
+    QJSEngine::setObjectOwnership(&native, QJSEngine::CppOwnership);
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_cancelled) {
+            result.error = "Cancelled";
+            return result;
+        }
+        m_engine = &engine;
+    }
+
+    QJSValue api = engine.evaluate(PRELUDE).call({ engine.newQObject(&native) });
+    engine.globalObject().setProperty("map", api);
+    engine.globalObject().setProperty("print", api.property("print"));
+    QJSValue value = engine.evaluate(source, "script");
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_engine = nullptr;
+    }
+    result.ms = timer.nsecsElapsed() / 1.0e6;
+    result.output = native.output();
+    if (engine.isInterrupted())
+        result.error = "Interrupted";
+    else if (value.isError())
+        result.error = QString("Line %1: %2").arg(value.property("lineNumber").toInt()).arg(value.toString());
+    else
+        result.ok = true;
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+void CScriptRunner::interrupt()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_engine)
+        m_engine->setInterrupted(true);
+}
+
+//-----------------------------------------------------------------------------
+void CScriptRunner::cancel()
+{
+    QMutexLocker lock(&m_mutex);
+    m_cancelled = true;
+    if (m_engine)
+        m_engine->setInterrupted(true);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QJSEngine;
+
+//-----------------------------------------------------------------------------
+// The map as scripts see it. Bulk reads and writes move whole regions as
+// ArrayBuffers, which the script prelude wraps in Uint32Arrays, so a script
+// pays one copy per region instead of one call per tile.
+class CScriptMap : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int width READ width CONSTANT)
+    Q_PROPERTY(int height READ height CONSTANT)
+public:
+    explicit CScriptMap(CMap* map) : m_map(map) {}
+
+    int width() const;
+    int height() const;
+    const QString& output() const { return m_output; }
+
+    Q_INVOKABLE uint tileAt(int x, int y) const;
+    Q_INVOKABLE void setTile(int x, int y, uint value);
+    Q_INVOKABLE void fillRect(int x, int y, int w, int h, uint value);
+    Q_INVOKABLE QByteArray readBytes(int x, int y, int w, int h) const;
+    Q_INVOKABLE void writeBytes(int x, int y, int w, int h, const QByteArray& bytes);
+    Q_INVOKABLE void print(const QString& text);
+
+private:
+    bool checkRect(int x, int y, int w, int h) const;
+
+    CMap* m_map;
+    QString m_output;
+};
+
+//-----------------------------------------------------------------------------
+// Runs a script against a map with a fresh QJSEngine per run. run() is meant
+// for a worker thread and edits only the map it is given; interrupt() may be
+// called from any thread to stop a runaway script, cancel() also refuses
+// runs that have not started yet, e.g. ones still queued at shutdown.
+class CScriptRunner
+{
+public:
+    struct Result {
+        bool ok = false;
+        QString output;
+        QString error;
+        double ms = 0;
+    };
+
+    Result run(const QString& source, CMap& map);
+    void interrupt();
+    void cancel();
+
+private:
+    QMutex m_mutex;
+    QJSEngine* m_engine = nullptr;
+    bool m_cancelled = false;
+};
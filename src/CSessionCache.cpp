@@ -0,0 +1,254 @@
+#include "CSessionCache.h"
+#include "CDocument.h"
+#include "CMainView.h"
+#include "CMapHash.h"
+#include "Constants.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const quint32 SESSION_MAGIC = 0x5345534d;  // "MSES" in file order
+    const quint16 SESSION_VERSION = 1;
+    const int MAX_TILESET_TILE_SIZE = 1024;
+    const quint32 MAX_TILESET_TILES = 1u << 20;
+
+    bool fail(QString* error, const QString& message)
+    {
+        if (error)
+            *error = message;
+        return false;
+    }
+
+    void writeTileset(QDataStream& out, const CTileset& tileset)
+    {
+        const int ts = tileset.tileSize;
+        out << tileset.path << CMapHash::fileStamp(tileset.path) << qint32(ts) << quint32(tileset.tiles.size());
+        for (const QPixmap& tile : tileset.tiles) {
+            QImage img = tile.toImage().convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            if (img.width() != ts || img.height() != ts)
+                img = img.copy(0, 0, ts, ts);
+            for (int y = 0; y < ts; ++y)
+                out.writeRawData(reinterpret_cast<const char*>(img.constScanLine(y)), ts * 4);
+        }
+    }
+
+    std::shared_ptr<const CTileset> readTileset(QDataStream& in)
+    {
+        QString path, stamp;
+        qint32 ts = 0;
+        quint32 count = 0;
+        in >> path >> stamp >> ts >> count;
+        if (in.status() != QDataStream::Ok || ts <= 0 || ts > MAX_TILESET_TILE_SIZE || count > MAX_TILESET_TILES) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            return nullptr;
+        }
+
+        const qint64 tileBytes = static_cast<qint64>(ts) * ts * 4;
+        if (stamp.isEmpty() || stamp != CMapHash::fileStamp(path)) {
+            in.skipRawData(tileBytes * count);
+            return QFileInfo::exists(path) ? CTilesetCache::acquire(path, ts) : nullptr;
+        }
+
+        QVector<QPixmap> tiles;
+        tiles.reserve(static_cast<int>(count));
+        for (quint32 i = 0; i < count; ++i) {
+            QImage img(ts, ts, QImage::Format_ARGB32_Premultiplied);
+            for (int y = 0; y < ts; ++y)
+                in.readRawData(reinterpret_cast<char*>(img.scanLine(y)), ts * 4);
+            tiles.append(QPixmap::fromImage(std::move(img)));
+        }
+        return CTilesetCache::adopt(path, ts, tiles);
+    }
+
+    void writeMap(QDataStream& out, const CMap& map, uint64_t hash)
+    {
+        out << qint32(map.width()) << qint32(map.height()) << qint32(map.cellBytes()) << quint64(hash);
+        const qint64 bytes = static_cast<qint64>(map.tileCount()) * map.cellBytes();
+        map.visitCells([&](const auto* cells) {
+            out.writeRawData(reinterpret_cast<const char*>(cells), bytes);
+        });
+        QByteArray objects;
+        if (map.objects().count() > 0)
+            objects = QJsonDocument(map.objects().toJson()).toJson(QJsonDocument::Compact);
+        out << objects;
+    }
+
+    // Reads the map when load is set and skips over it otherwise
+    std::unique_ptr<CMap> readMap(QDataStream& in, bool load, uint64_t& hash)
+    {
+        qint32 w = 0, h = 0, cellBytes = 0;
+        quint64 storedHash = 0;
+        in >> w >> h >> cellBytes >> storedHash;
+        // Any size a map file could have loaded is fine; the preferences
+        // limit only applies to maps made in the editor
+        if (in.status() != QDataStream::Ok || w < Constants::MIN_MAP_WIDTH || h < Constants::MIN_MAP_HEIGHT
+            || (cellBytes != 1 && cellBytes != 2 && cellBytes != 4)) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            return nullptr;
+        }
+
+        // A truncated cache must not size a map it cannot fill. The tile
+        // count is compared before multiplying by the cell width, which
+        // could overflow for the largest sizes.
+        const qint64 tiles = static_cast<qint64>(w) * h;
+        if (tiles > in.device()->bytesAvailable() / cellBytes) {
+            in.setStatus(QDataStream::ReadPastEnd);
+            return nullptr;
+        }
+        const qint64 bytes = tiles * cellBytes;
+        std::unique_ptr<CMap> map;
+        if (load) {
+            map = std::make_unique<CMap>(w, h);
+            map->reserveCellBytes(cellBytes);
+            const qint64 read = map->visitCells([&](auto* cells) {
+                return static_cast<qint64>(in.readRawData(reinterpret_cast<char*>(cells), bytes));
+            });
+            if (read != bytes) {
+                in.setStatus(QDataStream::ReadPastEnd);
+                return nullptr;
+            }
+            map->touchRect(0, 0, w, h);
+        } else {
+            in.skipRawData(bytes);
+        }
+
+        QByteArray objects;
+        in >> objects;
+        if (map && !objects.isEmpty())
+            map->objects().fromJson(QJsonDocument::fromJson(objects).array());
+        hash = storedHash;
+        return map;
+    }
+}
+
+//-----------------------------------------------------------------------------
+QString CSessionCache::defaultFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + Constants::SESSION_CACHE_FILE;
+}
+
+//-----------------------------------------------------------------------------
+bool CSessionCache::write(const QString& file, const QVector<const CDocument*>& documents, int active,
+                          QString* error)
+{
+    QVector<const CDocument*> stored;
+    int storedActive = 0;
+    for (int i = 0; i < documents.size(); ++i) {
+        if (documents[i]->path.isEmpty())
+            continue;
+        if (i == active)
+            storedActive = stored.size();
+        stored.append(documents[i]);
+    }
+
+    // Documents on the same tileset share one stored copy of it
+    QVector<const CTileset*> tilesets;
+    auto tilesetIndex = [&](const std::shared_ptr<const CTileset>& tileset) {
+        if (!tileset)
+            return -1;
+        int index = tilesets.indexOf(tileset.get());
+        if (index < 0) {
+            index = tilesets.size();
+            tilesets.append(tileset.get());
+        }
+        return index;
+    };
+    QVector<qint32> documentTilesets;
+    for (const CDocument* doc : stored)
+        documentTilesets.append(tilesetIndex(doc->tileset));
+    const CDocument* activeDoc = documents.value(active);
+    qint32 activeTileset = activeDoc ? tilesetIndex(activeDoc->tileset) : -1;
+
+    QDir().mkpath(QFileInfo(file).path());
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly))
+        return fail(error, QString("Cannot write %1: %2").arg(file, out.errorString()));
+    QDataStream stream(&out);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << SESSION_MAGIC << SESSION_VERSION;
+
+    stream << quint32(tilesets.size());
+    for (const CTileset* tileset : tilesets)
+        writeTileset(stream, *tileset);
+
+    stream << quint32(stored.size());
+    for (int i = 0; i < stored.size(); ++i) {
+        const CDocument* doc = stored[i];
+        stream << doc->path << CMapHash::fileStamp(doc->path) << documentTilesets[i] << qint32(doc->tileCount)
+               << doc->view->zoom() << doc->view->viewCenter() << !doc->modified;
+        if (!doc->modified)
+            writeMap(stream, *doc->map, doc->savedHash);
+    }
+    stream << qint32(storedActive) << activeTileset << qint32(activeDoc ? activeDoc->tileCount : 0);
+
+    if (stream.status() != QDataStream::Ok || !out.commit())
+        return fail(error, QString("Cannot write %1: %2").arg(file, out.errorString()));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CSessionCache::read(const QString& file, CSession& session, QString* error)
+{
+    session = CSession();
+    QFile in(file);
+    if (!in.exists())
+        return false;
+    if (!in.open(QIODevice::ReadOnly))
+        return fail(error, QString("Cannot open %1: %2").arg(file, in.errorString()));
+    QDataStream stream(&in);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    stream >> magic >> version;
+    if (magic != SESSION_MAGIC || version != SESSION_VERSION)
+        return fail(error, QString("%1 is not a session cache of this version").arg(file));
+
+    quint32 tilesetCount = 0;
+    stream >> tilesetCount;
+    std::vector<std::shared_ptr<const CTileset>> tilesets;
+    for (quint32 i = 0; i < tilesetCount && stream.status() == QDataStream::Ok; ++i)
+        tilesets.push_back(readTileset(stream));
+    auto tilesetAt = [&](qint32 index) {
+        return index >= 0 && index < static_cast<qint32>(tilesets.size()) ? tilesets[index] : nullptr;
+    };
+
+    quint32 documentCount = 0;
+    stream >> documentCount;
+    for (quint32 i = 0; i < documentCount && stream.status() == QDataStream::Ok; ++i) {
+        CSessionDocument doc;
+        QString stamp;
+        qint32 tileset = -1, tileCount = 0;
+        bool cached = false;
+        stream >> doc.path >> stamp >> tileset >> tileCount >> doc.zoom >> doc.center >> cached;
+        if (cached)
+            doc.map = readMap(stream, !stamp.isEmpty() && stamp == CMapHash::fileStamp(doc.path), doc.hash);
+        doc.tileset = tilesetAt(tileset);
+        doc.tileCount = tileCount;
+        session.documents.push_back(std::move(doc));
+    }
+
+    qint32 active = 0, activeTileset = -1, activeTileCount = 0;
+    stream >> active >> activeTileset >> activeTileCount;
+    if (stream.status() != QDataStream::Ok) {
+        session = CSession();
+        return fail(error, QString("%1 is corrupt").arg(file));
+    }
+    session.active = active;
+    session.tileset = tilesetAt(activeTileset);
+    session.tileCount = activeTileCount;
+    return true;
+}
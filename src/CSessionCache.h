@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CMap.h"
+#include "CTilesetCache.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+struct CDocument;
+
+//-----------------------------------------------------------------------------
+struct CSessionDocument
+{
+    QString path;
+    std::unique_ptr<CMap> map;      // null when the file must be read again
+    uint64_t hash = 0;              // content hash of map
+    std::shared_ptr<const CTileset> tileset;
+    int tileCount = 0;
+    double zoom = 1.0;
+    QPointF center;
+};
+
+//-----------------------------------------------------------------------------
+struct CSession
+{
+    std::vector<CSessionDocument> documents;
+    int active = 0;
+    // Tileset of the active document, for when no document was restored
+    std::shared_ptr<const CTileset> tileset;
+    int tileCount = 0;
+};
+
+//-----------------------------------------------------------------------------
+// The last session as one binary file in the cache directory: the open map
+// files with their tiles as raw cells, and their tilesets already sliced
+// into raw tile pixels. Restoring it needs neither JSON parsing nor image
+// decoding. Every file is stored with its modification time and size; a file
+// changed since then is read from disk again instead.
+//
+// Only documents bound to a file are stored, and the tiles only of those
+// without unsaved changes.
+namespace CSessionCache {
+    QString defaultFile();
+
+    bool write(const QString& file, const QVector<const CDocument*>& documents, int active,
+               QString* error = nullptr);
+    // False without an error when there is no cache
+    bool read(const QString& file, CSession& session, QString* error = nullptr);
+}
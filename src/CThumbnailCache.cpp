@@ -0,0 +1,164 @@
+#include "CThumbnailCache.h"
+#include "Constants.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const QRgb EMPTY_COLOR = 0xffd8d8d8;
+
+    QString fileKey(const QFileInfo& fi)
+    {
+        return QString("%1|%2|%3").arg(fi.absoluteFilePath()).arg(fi.size())
+            .arg(fi.lastModified().toMSecsSinceEpoch());
+    }
+
+    int imageCost(const QImage& image)
+    {
+        return std::max(1, static_cast<int>(image.sizeInBytes() / 1024));
+    }
+
+    QString sha1(const QString& text)
+    {
+        return QCryptographicHash::hash(text.toUtf8(), QCryptographicHash::Sha1).toHex();
+    }
+}
+
+//-----------------------------------------------------------------------------
+CThumbnailCache::CThumbnailCache(QObject* parent)
+: QObject(parent)
+{
+    m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+    m_memory.setMaxCost(Constants::THUMBNAIL_MEMORY_KB);
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + Constants::THUMBNAIL_CACHE_DIR;
+    QDir().mkpath(m_directory);
+    m_pool.start([this]() { trimDisk(); }, 0);
+}
+
+//-----------------------------------------------------------------------------
+CThumbnailCache::~CThumbnailCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+//-----------------------------------------------------------------------------
+QImage CThumbnailCache::thumbnail(const QString& path, bool prefetch)
+{
+    QFileInfo fi(path);
+    if (!fi.isFile())
+        return QImage();
+    const QString key = fileKey(fi);
+    if (QImage* cached = m_memory.object(key))
+        return *cached;
+    if (m_pending.contains(key) || m_failed.value(path) == key)
+        return QImage();
+    m_pending.insert(key);
+
+    // <path hash>-<version hash>.png, so the versions of a path can be found
+    const QString pathPrefix = sha1(fi.absoluteFilePath()) + "-";
+    const QString cacheFile = m_directory + "/" + pathPrefix + sha1(key) + ".png";
+    m_pool.start([this, path, key, pathPrefix, cacheFile]() {
+        QImage image(cacheFile);
+        if (!image.isNull()) {
+            // Recently used for the size trim
+            QFile f(cacheFile);
+            if (f.open(QFile::Append))
+                f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        } else {
+            QFile f(path);
+            if (f.open(QFile::ReadOnly)) {
+                QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+                if (doc.isObject())
+                    image = render(doc.object(), Constants::THUMBNAIL_SIZE);
+            }
+            if (!image.isNull()) {
+                const QDir dir(m_directory);
+                for (const QString& old : dir.entryList({ pathPrefix + "*.png" }, QDir::Files))
+                    dir.remove(old);
+                image.save(cacheFile, "PNG");
+                trimDisk();
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, path, key, image]() {
+            m_pending.remove(key);
+            if (image.isNull()) {
+                if (m_failed.size() >= Constants::THUMBNAIL_FAILED_MAX)
+                    m_failed.clear();
+                m_failed.insert(path, key);
+                emit thumbnailFailed(path);
+                return;
+            }
+            m_failed.remove(path);
+            m_memory.insert(key, new QImage(image), imageCost(image));
+            emit thumbnailReady(path, image);
+        }, Qt::QueuedConnection);
+    }, prefetch ? 0 : 1);
+    return QImage();
+}
+
+//-----------------------------------------------------------------------------
+bool CThumbnailCache::hasFailed(const QString& path) const
+{
+    QFileInfo fi(path);
+    return fi.isFile() && m_failed.value(path) == fileKey(fi);
+}
+
+//-----------------------------------------------------------------------------
+// Runs on the pool. Deletes the least recently used thumbnails until the
+// directory is back under its limit. Trims after concurrent saves take turns,
+// so two of them never count and delete the same files.
+void CThumbnailCache::trimDisk() const
+{
+    QMutexLocker lock(&m_trimMutex);
+    const QDir dir(m_directory);
+    const QFileInfoList files = dir.entryInfoList({ "*.png" }, QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (const QFileInfo& file : files)
+        total += file.size();
+    const qint64 limit = static_cast<qint64>(Constants::THUMBNAIL_DISK_CACHE_MB) * 1024 * 1024;
+    for (const QFileInfo& file : files) {
+        if (total <= limit)
+            break;
+        if (dir.remove(file.fileName()))
+            total -= file.size();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reads only the tiles that land on a thumbnail pixel, straight from the JSON
+// array, so no map is built
+QImage CThumbnailCache::render(const QJsonObject& map, int size)
+{
+    const int w = map["width"].toInt();
+    const int h = map["height"].toInt();
+    const QJsonArray tiles = map["tiles"].toArray();
+    if (w <= 0 || h <= 0 || tiles.size() != static_cast<qsizetype>(w) * h || size <= 0)
+        return QImage();
+
+    const double scale = std::max(1.0, std::max(w, h) / static_cast<double>(size));
+    const int tw = std::max(1, static_cast<int>(w / scale));
+    const int th = std::max(1, static_cast<int>(h / scale));
+    QImage image(tw, th, QImage::Format_RGB32);
+    for (int ty = 0; ty < th; ++ty) {
+        const int y = std::min(h - 1, static_cast<int>((ty + 0.5) * scale));
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(ty));
+        for (int tx = 0; tx < tw; ++tx) {
+            const int x = std::min(w - 1, static_cast<int>((tx + 0.5) * scale));
+            const qint64 tile = tiles.at(static_cast<qsizetype>(y) * w + x).toInteger();
+            line[tx] = tile > 0 ? Constants::TILE_COLORS[(tile - 1) % Constants::TILE_COLOR_COUNT] : EMPTY_COLOR;
+        }
+    }
+    return image;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+//-----------------------------------------------------------------------------
+class QJsonObject;
+
+//-----------------------------------------------------------------------------
+// Small previews of map files. Thumbnails are made on a private thread pool
+// and kept in memory and on disk under a key of path, size and modification
+// time, so a map is parsed once per version; a rewritten file gets a new key
+// and its older thumbnail is dropped from disk. The disk cache is kept under
+// THUMBNAIL_DISK_CACHE_MB, least recently used first. The GUI thread only
+// ever stats files and reads the memory cache.
+class CThumbnailCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CThumbnailCache(QObject* parent = nullptr);
+    ~CThumbnailCache() override;
+
+    // The thumbnail for the file as it is now, or a null image while it is
+    // made; thumbnailReady() or thumbnailFailed() follows. Prefetches queue
+    // behind requests.
+    QImage thumbnail(const QString& path, bool prefetch = false);
+    // Whether the file as it is now could not be read as a map
+    bool hasFailed(const QString& path) const;
+
+    // Nearest-tile downsample of a map's JSON to at most size pixels a side
+    static QImage render(const QJsonObject& map, int size);
+
+signals:
+    void thumbnailReady(const QString& path, const QImage& image);
+    void thumbnailFailed(const QString& path);
+
+private:
+    QThreadPool m_pool;
+    QCache<QString, QImage> m_memory;   // by key, cost in KB
+    QSet<QString> m_pending;
+    QHash<QString, QString> m_failed;   // key of the unreadable version by path
+    QString m_directory;
+    mutable QMutex m_trimMutex;         // one trim at a time across the pool
+
+    void trimDisk() const;
+};
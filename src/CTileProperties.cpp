@@ -0,0 +1,182 @@
+#include "CTileProperties.h"
+#include "CMap.h"
+#include "Constants.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+void CTileProperties::resize(int count)
+{
+    size_t n = static_cast<size_t>(std::max(0, count));
+    m_flags.resize(n, 0);
+    m_damage.resize(n, 0);
+    m_cost.resize(n, 1.0f);
+}
+
+//-----------------------------------------------------------------------------
+void CTileProperties::clear()
+{
+    m_flags.clear();
+    m_damage.clear();
+    m_cost.clear();
+}
+
+//-----------------------------------------------------------------------------
+uint8_t CTileProperties::flags(uint32_t id) const
+{
+    return id < m_flags.size() ? m_flags[id] : 0;
+}
+
+//-----------------------------------------------------------------------------
+void CTileProperties::setFlags(uint32_t id, uint8_t flags)
+{
+    if (id >= m_flags.size()) resize(static_cast<int>(id) + 1);
+    m_flags[id] = flags;
+}
+
+//-----------------------------------------------------------------------------
+int32_t CTileProperties::damage(uint32_t id) const
+{
+    return id < m_damage.size() ? m_damage[id] : 0;
+}
+
+//-----------------------------------------------------------------------------
+void CTileProperties::setDamage(uint32_t id, int32_t damage)
+{
+    if (id >= m_damage.size()) resize(static_cast<int>(id) + 1);
+    m_damage[id] = damage;
+}
+
+//-----------------------------------------------------------------------------
+float CTileProperties::cost(uint32_t id) const
+{
+    return id < m_cost.size() ? m_cost[id] : 1.0f;
+}
+
+//-----------------------------------------------------------------------------
+void CTileProperties::setCost(uint32_t id, float cost)
+{
+    if (id >= m_cost.size()) resize(static_cast<int>(id) + 1);
+    m_cost[id] = cost;
+}
+
+//-----------------------------------------------------------------------------
+// One byte (0/1) per id plus a trailing zero entry that every out-of-range id
+// is clamped onto, so lookups need no bounds branch.
+std::vector<uint8_t> CTileProperties::flagLut(uint8_t flag) const
+{
+    std::vector<uint8_t> lut(m_flags.size() + 1, 0);
+    for (size_t i = 0; i < m_flags.size(); ++i)
+        lut[i] = (m_flags[i] & flag) ? 1 : 0;
+    return lut;
+}
+
+//-----------------------------------------------------------------------------
+size_t CTileProperties::countFlag(const CMap& map, uint8_t flag) const
+{
+    const std::vector<uint8_t> lut = flagLut(flag);
+    const uint8_t* table = lut.data();
+    const uint32_t last = static_cast<uint32_t>(lut.size() - 1);
+    const size_t n = map.tileCount();
+
+    return map.visitCells([&](const auto* tiles) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i)
+            count += table[std::min<uint32_t>(tiles[i], last)];
+        return count;
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CTileProperties::markFlag(const CMap& map, uint8_t flag, std::vector<uint8_t>& out) const
+{
+    const std::vector<uint8_t> lut = flagLut(flag);
+    const uint8_t* table = lut.data();
+    const uint32_t last = static_cast<uint32_t>(lut.size() - 1);
+    const size_t n = map.tileCount();
+
+    out.resize(n);
+    uint8_t* dst = out.data();
+    map.visitCells([&](const auto* tiles) {
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = table[std::min<uint32_t>(tiles[i], last)];
+    });
+}
+
+//-----------------------------------------------------------------------------
+// Packs FLAG_SOLID into one bit per tile in row-major order, 64 tiles per word.
+void CTileProperties::collisionMask(const CMap& map, std::vector<uint64_t>& out) const
+{
+    const std::vector<uint8_t> lut = flagLut(FLAG_SOLID);
+    const uint8_t* table = lut.data();
+    const uint32_t last = static_cast<uint32_t>(lut.size() - 1);
+    const size_t n = map.tileCount();
+    const size_t fullWords = n / 64;
+
+    out.assign((n + 63) / 64, 0);
+    map.visitCells([&](const auto* tiles) {
+        for (size_t w = 0; w < fullWords; ++w) {
+            const auto* src = tiles + w * 64;
+            uint64_t bits = 0;
+            for (int b = 0; b < 64; ++b)
+                bits |= static_cast<uint64_t>(table[std::min<uint32_t>(src[b], last)]) << b;
+            out[w] = bits;
+        }
+        for (size_t i = fullWords * 64; i < n; ++i)
+            out[i / 64] |= static_cast<uint64_t>(table[std::min<uint32_t>(tiles[i], last)]) << (i % 64);
+    });
+}
+
+//-----------------------------------------------------------------------------
+QJsonObject CTileProperties::toJson() const
+{
+    // Only ids that differ from the defaults are written
+    QJsonArray arr;
+    for (size_t i = 0; i < m_flags.size(); ++i) {
+        if (m_flags[i] == 0 && m_damage[i] == 0 && m_cost[i] == 1.0f)
+            continue;
+        QJsonObject t;
+        t["id"] = static_cast<qint64>(i);
+        t["solid"] = (m_flags[i] & FLAG_SOLID) != 0;
+        t["water"] = (m_flags[i] & FLAG_WATER) != 0;
+        t["damage"] = m_damage[i];
+        t["cost"] = static_cast<double>(m_cost[i]);
+        arr.append(t);
+    }
+    QJsonObject obj;
+    obj["count"] = size();
+    obj["tiles"] = arr;
+    return obj;
+}
+
+//-----------------------------------------------------------------------------
+bool CTileProperties::fromJson(const QJsonObject& obj)
+{
+    if (!obj.contains("tiles"))
+        return false;
+    clear();
+    resize(std::min(obj["count"].toInt(), Constants::MAX_TILE_PROPERTY_ID + 1));
+    for (const QJsonValue& v : obj["tiles"].toArray()) {
+        QJsonObject t = v.toObject();
+        int id = t["id"].toInt(-1);
+        if (id < 0 || id > Constants::MAX_TILE_PROPERTY_ID) return false;
+        uint8_t flags = 0;
+        if (t["solid"].toBool()) flags |= FLAG_SOLID;
+        if (t["water"].toBool()) flags |= FLAG_WATER;
+        setFlags(id, flags);
+        setDamage(id, t["damage"].toInt());
+        setCost(id, static_cast<float>(t["cost"].toDouble(1.0)));
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+QString CTileProperties::sidecarPath(const QString& tilesetPath)
+{
+    QFileInfo fi(tilesetPath);
+    return fi.dir().filePath(fi.completeBaseName() + ".tiles.json");
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <QString>
+
+//-----------------------------------------------------------------------------
+class CMap;
+class QJsonObject;
+
+//-----------------------------------------------------------------------------
+// Per-tile-id metadata stored as struct-of-arrays columns indexed by tile id.
+// Whole-map queries translate ids through a flat lookup table so the scans
+// over the map's tile buffer stay branch-free and vectorizable.
+class CTileProperties
+{
+public:
+    enum Flag : uint8_t {
+        FLAG_SOLID = 1 << 0,
+        FLAG_WATER = 1 << 1
+    };
+
+    int size() const { return static_cast<int>(m_flags.size()); }
+    void resize(int count);
+    void clear();
+
+    uint8_t flags(uint32_t id) const;
+    void setFlags(uint32_t id, uint8_t flags);
+    int32_t damage(uint32_t id) const;
+    void setDamage(uint32_t id, int32_t damage);
+    float cost(uint32_t id) const;
+    void setCost(uint32_t id, float cost);
+
+    size_t countFlag(const CMap& map, uint8_t flag) const;
+    void markFlag(const CMap& map, uint8_t flag, std::vector<uint8_t>& out) const;
+    void collisionMask(const CMap& map, std::vector<uint64_t>& out) const;
+
+    QJsonObject toJson() const;
+    // Keeps every entry, whether or not the current tileset has that many
+    // tiles; fails on ids outside 0..MAX_TILE_PROPERTY_ID
+    bool fromJson(const QJsonObject& obj);
+
+    static QString sidecarPath(const QString& tilesetPath);
+
+private:
+    std::vector<uint8_t> m_flags;
+    std::vector<int32_t> m_damage;
+    std::vector<float> m_cost;
+
+    std::vector<uint8_t> flagLut(uint8_t flag) const;
+};
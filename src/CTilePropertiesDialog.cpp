@@ -0,0 +1,66 @@
+#include "CTilePropertiesDialog.h"
+#include "CTileProperties.h"
+
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QVBoxLayout>
+
+//-----------------------------------------------------------------------------
+CTilePropertiesDialog::CTilePropertiesDialog(uint32_t tileId, uint8_t flags, int damage, float cost, QWidget* parent)
+: QDialog(parent)
+{
+    setWindowTitle(tr("Tile %1 Properties").arg(tileId));
+
+    m_solidCheckBox = new QCheckBox(this);
+    m_solidCheckBox->setChecked(flags & CTileProperties::FLAG_SOLID);
+
+    m_waterCheckBox = new QCheckBox(this);
+    m_waterCheckBox->setChecked(flags & CTileProperties::FLAG_WATER);
+
+    m_damageSpinBox = new QSpinBox(this);
+    m_damageSpinBox->setRange(-1000, 1000);
+    m_damageSpinBox->setValue(damage);
+
+    m_costSpinBox = new QDoubleSpinBox(this);
+    m_costSpinBox->setRange(0.0, 1000.0);
+    m_costSpinBox->setDecimals(2);
+    m_costSpinBox->setValue(cost);
+
+    QFormLayout* formLayout = new QFormLayout;
+    formLayout->addRow(tr("Solid:"), m_solidCheckBox);
+    formLayout->addRow(tr("Water:"), m_waterCheckBox);
+    formLayout->addRow(tr("Damage:"), m_damageSpinBox);
+    formLayout->addRow(tr("Cost:"), m_costSpinBox);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    mainLayout->addLayout(formLayout);
+    mainLayout->addWidget(buttonBox);
+}
+
+//-----------------------------------------------------------------------------
+uint8_t CTilePropertiesDialog::flags() const
+{
+    uint8_t flags = 0;
+    if (m_solidCheckBox->isChecked()) flags |= CTileProperties::FLAG_SOLID;
+    if (m_waterCheckBox->isChecked()) flags |= CTileProperties::FLAG_WATER;
+    return flags;
+}
+
+//-----------------------------------------------------------------------------
+int CTilePropertiesDialog::damage() const
+{
+    return m_damageSpinBox->value();
+}
+
+//-----------------------------------------------------------------------------
+float CTilePropertiesDialog::cost() const
+{
+    return static_cast<float>(m_costSpinBox->value());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+#include <QDialog>
+
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+class QCheckBox;
+class QDoubleSpinBox;
+class QSpinBox;
+
+//-----------------------------------------------------------------------------
+class CTilePropertiesDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    CTilePropertiesDialog(uint32_t tileId, uint8_t flags, int damage, float cost, QWidget* parent = nullptr);
+
+    uint8_t flags() const;
+    int damage() const;
+    float cost() const;
+
+private:
+    QCheckBox* m_solidCheckBox = nullptr;
+    QCheckBox* m_waterCheckBox = nullptr;
+    QSpinBox* m_damageSpinBox = nullptr;
+    QDoubleSpinBox* m_costSpinBox = nullptr;
+};
@@ -0,0 +1,166 @@
+#include "CTileReplace.h"
+#include "CMap.h"
+#include "CParallel.h"
+#include "Constants.h"
+
+#include <QtAlgorithms>
+#include <algorithm>
+#include <type_traits>
+
+//-----------------------------------------------------------------------------
+CTileReplace CTileReplace::single(uint32_t from, uint32_t to)
+{
+    CTileReplace r;
+    r.m_single = true;
+    r.m_from = from;
+    r.m_to = to;
+    return r;
+}
+
+//-----------------------------------------------------------------------------
+CTileReplace CTileReplace::table(const QMap<uint32_t, uint32_t>& mapping)
+{
+    CTileReplace r;
+    r.m_single = false;
+    if (mapping.isEmpty())
+        return r;
+    r.m_lut.resize(std::min<size_t>(static_cast<size_t>(mapping.lastKey()) + 1, Constants::REPLACE_MAX_LUT_SIZE));
+    for (size_t i = 0; i < r.m_lut.size(); ++i)
+        r.m_lut[i] = static_cast<uint32_t>(i);
+    // QMap iterates in key order, so the keys past the table come out sorted
+    for (auto it = mapping.cbegin(); it != mapping.cend(); ++it) {
+        if (it.key() < r.m_lut.size())
+            r.m_lut[it.key()] = it.value();
+        else
+            r.m_sparse.emplace_back(it.key(), it.value());
+        r.m_maxTo = std::max(r.m_maxTo, it.value());
+    }
+    return r;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CTileReplace::lookupSparse(uint32_t id) const
+{
+    auto it = std::lower_bound(m_sparse.begin(), m_sparse.end(), std::make_pair(id, uint32_t(0)));
+    return it != m_sparse.end() && it->first == id ? it->second : id;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+uint64_t CTileReplace::replaceSingle(T* row, int count) const
+{
+    const uint32_t from = m_from;
+    const T to = static_cast<T>(m_to);
+    uint64_t bits = 0;
+    for (int i = 0; i < count; ++i) {
+        T t = row[i];
+        uint64_t hit = t == from;
+        row[i] = hit ? to : t;
+        bits |= hit << i;
+    }
+    return bits;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+uint64_t CTileReplace::replaceTable(T* row, int count, std::vector<uint32_t>& oldValues) const
+{
+    const uint32_t* lut = m_lut.data();
+    const uint32_t n = static_cast<uint32_t>(m_lut.size());
+    uint64_t bits = 0;
+    for (int i = 0; i < count; ++i) {
+        uint32_t t = row[i];
+        uint32_t v = t < n ? lut[t] : m_sparse.empty() ? t : lookupSparse(t);
+        if (v != t) {
+            oldValues.push_back(t);
+            row[i] = static_cast<T>(v);
+            bits |= uint64_t(1) << i;
+        }
+    }
+    return bits;
+}
+
+//-----------------------------------------------------------------------------
+size_t CTileReplace::apply(CMap& map, const QRect& area)
+{
+    m_area = area.intersected(QRect(0, 0, map.width(), map.height()));
+    m_stride = (m_area.width() + 63) / 64;
+    m_mask.assign(static_cast<size_t>(m_stride) * m_area.height(), 0);
+    m_oldValues.clear();
+    m_changed = 0;
+    if (m_area.isEmpty() || (m_single && m_from == m_to) || (!m_single && m_lut.empty()))
+        return 0;
+
+    const int mapWidth = map.width();
+    const int width = m_area.width();
+    const int rows = m_area.height();
+
+    // New ids must fit the cells before the typed pass; the pass itself is
+    // instantiated once per cell width
+    map.reserveValue(m_single ? m_to : m_maxTo);
+
+    // Each band writes its own mask rows; old values are gathered per band
+    // and concatenated in band order so they stay row-major
+    int bands = CParallel::bandCount(rows, Constants::PARALLEL_MIN_ROWS);
+    std::vector<std::vector<uint32_t>> bandOld(bands);
+    std::vector<size_t> bandChanged(bands, 0);
+    map.visitCells([&](auto* tiles) {
+        CParallel::forBands(rows, Constants::PARALLEL_MIN_ROWS, [&](int band, int begin, int end) {
+            size_t changed = 0;
+            for (int r = begin; r < end; ++r) {
+                auto* row = tiles + static_cast<size_t>(m_area.y() + r) * mapWidth + m_area.x();
+                uint64_t* maskRow = &m_mask[static_cast<size_t>(r) * m_stride];
+                for (int w = 0; w < m_stride; ++w) {
+                    int base = w * 64;
+                    int count = std::min(64, width - base);
+                    uint64_t bits = m_single ? replaceSingle(row + base, count)
+                                             : replaceTable(row + base, count, bandOld[band]);
+                    maskRow[w] = bits;
+                    changed += qPopulationCount(bits);
+                }
+            }
+            bandChanged[band] = changed;
+        });
+    });
+
+    for (int band = 0; band < bands; ++band) {
+        m_changed += bandChanged[band];
+        m_oldValues.insert(m_oldValues.end(), bandOld[band].begin(), bandOld[band].end());
+    }
+    if (m_changed)
+        map.touchRect(m_area.x(), m_area.y(), m_area.width(), m_area.height());
+    return m_changed;
+}
+
+//-----------------------------------------------------------------------------
+void CTileReplace::revert(CMap& map) const
+{
+    // Old ids were read from these cells, so they still fit
+    const int mapWidth = map.width();
+    map.visitCells([&](auto* tiles) {
+        using T = std::remove_pointer_t<decltype(tiles)>;
+        size_t next = 0;
+        for (int r = 0; r < m_area.height(); ++r) {
+            T* row = tiles + static_cast<size_t>(m_area.y() + r) * mapWidth + m_area.x();
+            const uint64_t* maskRow = &m_mask[static_cast<size_t>(r) * m_stride];
+            for (int w = 0; w < m_stride; ++w) {
+                uint64_t bits = maskRow[w];
+                while (bits) {
+                    int x = w * 64 + qCountTrailingZeroBits(bits);
+                    row[x] = static_cast<T>(m_single ? m_from : m_oldValues[next++]);
+                    bits &= bits - 1;
+                }
+            }
+        }
+    });
+    if (m_changed)
+        map.touchRect(m_area.x(), m_area.y(), m_area.width(), m_area.height());
+}
+
+//-----------------------------------------------------------------------------
+size_t CTileReplace::byteSize() const
+{
+    return sizeof(*this) + m_mask.size() * sizeof(uint64_t)
+        + m_oldValues.size() * sizeof(uint32_t) + m_lut.size() * sizeof(uint32_t)
+        + m_sparse.size() * sizeof(m_sparse[0]);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <QMap>
+#include <QRect>
+
+//-----------------------------------------------------------------------------
+class CMap;
+
+//-----------------------------------------------------------------------------
+// Replaces tile ids inside an area of a map, either one id with another or
+// through a mapping table. The pass is a branch-free compare-and-blend over
+// each row, split across threads by row bands. Changed positions are kept as
+// a per-row bitmask; old values are only stored for mapping tables, since a
+// single-id replacement always restores the same id. Mapping tables look
+// ids up in a flat table up to REPLACE_MAX_LUT_SIZE and binary search the
+// rare keys past it, so any uint32 id can be mapped.
+class CTileReplace
+{
+public:
+    static CTileReplace single(uint32_t from, uint32_t to);
+    static CTileReplace table(const QMap<uint32_t, uint32_t>& mapping);
+
+    size_t apply(CMap& map, const QRect& area);
+    void revert(CMap& map) const;
+
+    size_t changedCount() const { return m_changed; }
+    size_t byteSize() const;
+
+private:
+    bool m_single = true;
+    uint32_t m_from = 0;
+    uint32_t m_to = 0;
+    std::vector<uint32_t> m_lut;        // table mode: new id per old id
+    std::vector<std::pair<uint32_t, uint32_t>> m_sparse;   // table mode: keys past m_lut, sorted
+    uint32_t m_maxTo = 0;               // table mode: largest new id
+
+    QRect m_area;
+    int m_stride = 0;                   // mask words per row
+    std::vector<uint64_t> m_mask;
+    std::vector<uint32_t> m_oldValues;  // table mode only, in row-major order
+    size_t m_changed = 0;
+
+    template <typename T> uint64_t replaceSingle(T* row, int count) const;
+    uint32_t lookupSparse(uint32_t id) const;
+    template <typename T> uint64_t replaceTable(T* row, int count, std::vector<uint32_t>& oldValues) const;
+};
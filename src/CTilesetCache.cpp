@@ -0,0 +1,126 @@
+#include "CTilesetCache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+
+//-----------------------------------------------------------------------------
+namespace {
+    struct Entry {
+        QString fileKey;
+        int tileSize = 0;
+        std::weak_ptr<const CTileset> tileset;
+    };
+
+    QHash<QString, Entry>& entries()
+    {
+        static QHash<QString, Entry> s_entries;
+        return s_entries;
+    }
+
+    QString fileKey(const QString& path)
+    {
+        QFileInfo fi(path);
+        return QString("%1|%2|%3").arg(fi.absoluteFilePath())
+            .arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.size());
+    }
+
+    void purgeExpired()
+    {
+        QHash<QString, Entry>& all = entries();
+        for (auto it = all.begin(); it != all.end();) {
+            if (it->tileset.expired())
+                it = all.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Any live entry for the same file version already holds the decoded
+    // image; QImage copies share its pixels
+    QImage liveImage(const QString& key)
+    {
+        for (const Entry& entry : entries()) {
+            if (entry.fileKey != key)
+                continue;
+            std::shared_ptr<const CTileset> tileset = entry.tileset.lock();
+            if (tileset && !tileset->image.isNull())
+                return tileset->image;
+        }
+        return QImage();
+    }
+}
+
+//-----------------------------------------------------------------------------
+const QPixmap* CTileset::tile(uint32_t id) const
+{
+    if (id == 0 || id > static_cast<uint32_t>(tiles.size()))
+        return nullptr;
+    return &tiles[static_cast<int>(id - 1)];
+}
+
+//-----------------------------------------------------------------------------
+QImage CTilesetCache::image(const QString& path)
+{
+    QImage img = liveImage(fileKey(path));
+    return img.isNull() ? QImage(path) : img;
+}
+
+//-----------------------------------------------------------------------------
+std::shared_ptr<const CTileset> CTilesetCache::acquire(const QString& path, int tileSize, const QImage& decoded)
+{
+    if (tileSize <= 0)
+        return nullptr;
+    purgeExpired();
+
+    QString key = fileKey(path);
+    QString entryKey = key + '|' + QString::number(tileSize);
+    auto it = entries().find(entryKey);
+    if (it != entries().end()) {
+        if (std::shared_ptr<const CTileset> tileset = it->tileset.lock())
+            return tileset;
+    }
+
+    QImage img = decoded.isNull() ? liveImage(key) : decoded;
+    if (img.isNull())
+        img = QImage(path);
+    if (img.isNull())
+        return nullptr;
+
+    auto tileset = std::make_shared<CTileset>();
+    tileset->path = path;
+    tileset->image = img;
+    tileset->tileSize = tileSize;
+    const int perRow = img.width() / tileSize;
+    const int rows = img.height() / tileSize;
+    tileset->tiles.reserve(perRow * rows);
+    for (int ty = 0; ty < rows; ++ty)
+        for (int tx = 0; tx < perRow; ++tx)
+            tileset->tiles.append(QPixmap::fromImage(img.copy(tx * tileSize, ty * tileSize, tileSize, tileSize)));
+
+    entries().insert(entryKey, Entry{ key, tileSize, tileset });
+    return tileset;
+}
+
+//-----------------------------------------------------------------------------
+std::shared_ptr<const CTileset> CTilesetCache::adopt(const QString& path, int tileSize, const QVector<QPixmap>& tiles)
+{
+    if (tileSize <= 0)
+        return nullptr;
+    purgeExpired();
+
+    QString key = fileKey(path);
+    QString entryKey = key + '|' + QString::number(tileSize);
+    auto it = entries().find(entryKey);
+    if (it != entries().end()) {
+        if (std::shared_ptr<const CTileset> tileset = it->tileset.lock())
+            return tileset;
+    }
+
+    auto tileset = std::make_shared<CTileset>();
+    tileset->path = path;
+    tileset->tileSize = tileSize;
+    tileset->tiles = tiles;
+    entries().insert(entryKey, Entry{ key, tileSize, tileset });
+    return tileset;
+}
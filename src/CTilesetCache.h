@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <QImage>
+#include <QPixmap>
+#include <QString>
+#include <QVector>
+
+//-----------------------------------------------------------------------------
+// A decoded tileset image and its tiles sliced at one tile size. Instances
+// are immutable and shared by every document that shows the tileset.
+struct CTileset
+{
+    QString path;
+    QImage image;               // null when restored from the session cache
+    int tileSize = 0;
+    QVector<QPixmap> tiles;     // tile id n is tiles[n - 1]
+
+    const QPixmap* tile(uint32_t id) const;
+};
+
+//-----------------------------------------------------------------------------
+// Process-wide cache of decoded tilesets keyed by file path and modification
+// time. Entries stay alive while any document holds them, so opening more
+// maps on the same tileset neither decodes nor slices it again; a rewritten
+// file gets a new key and is decoded once more. GUI thread only, since the
+// slices are pixmaps.
+namespace CTilesetCache {
+    // Decoded image for the file as it is now, shared with any live entry
+    QImage image(const QString& path);
+
+    // Pass an image already decoded from path to skip decoding it again
+    std::shared_ptr<const CTileset> acquire(const QString& path, int tileSize, const QImage& decoded = QImage());
+
+    // Registers tiles sliced earlier from the file as it is now, e.g. read
+    // back from the session cache, without decoding the image
+    std::shared_ptr<const CTileset> adopt(const QString& path, int tileSize, const QVector<QPixmap>& tiles);
+}
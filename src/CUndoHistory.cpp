@@ -0,0 +1,308 @@
+#include "CUndoHistory.h"
+#include "Constants.h"
+
+#include <QDebug>
+#include <QUndoStack>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // A macro is a plain QUndoCommand whose children are the edits
+    void forEachCommand(const QUndoCommand* command, const std::function<void(CUndoCommand*)>& visit)
+    {
+        if (!command) return;
+        if (auto* cmd = dynamic_cast<CUndoCommand*>(const_cast<QUndoCommand*>(command)))
+            visit(cmd);
+        for (int i = 0; i < command->childCount(); ++i)
+            forEachCommand(command->child(i), visit);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// First fit among the free ranges, otherwise at the end of the file
+qint64 CUndoLedger::allocate(qint64 length)
+{
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        if (it->second < length)
+            continue;
+        qint64 offset = it->first;
+        qint64 rest = it->second - length;
+        freeRanges.erase(it);
+        if (rest > 0)
+            freeRanges.emplace(offset + length, rest);
+        return offset;
+    }
+    return spillFile.size();
+}
+
+//-----------------------------------------------------------------------------
+void CUndoLedger::release(qint64 offset, qint64 length)
+{
+    if (length <= 0) return;
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + length == next->first) {
+        length += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            length += prev->second;
+            freeRanges.erase(prev);
+        }
+    }
+    if (offset + length >= spillFile.size())
+        spillFile.resize(offset);
+    else
+        freeRanges.emplace(offset, length);
+}
+
+//-----------------------------------------------------------------------------
+CUndoCommand::CUndoCommand()
+    : m_handle(std::make_shared<CUndoCommand*>(this))
+{
+}
+
+//-----------------------------------------------------------------------------
+CUndoCommand::~CUndoCommand()
+{
+    // In-flight compression jobs check the handle before touching us
+    *m_handle = nullptr;
+    if (m_storage == Storage::Spilled)
+        m_ledger->release(m_spillOffset, m_spillLength);
+    settle(true);
+}
+
+//-----------------------------------------------------------------------------
+// Undo and redo may change the payload size, e.g. by recording old values
+void CUndoCommand::undo()
+{
+    if (m_lost || !ensureResident()) {
+        reportLost();
+        return;
+    }
+    ++m_serial;
+    doUndo();
+    settle();
+}
+
+//-----------------------------------------------------------------------------
+void CUndoCommand::redo()
+{
+    if (m_lost || !ensureResident()) {
+        reportLost();
+        return;
+    }
+    ++m_serial;
+    doRedo();
+    settle();
+}
+
+//-----------------------------------------------------------------------------
+void CUndoCommand::settle(bool leaving)
+{
+    if (!m_ledger) return;
+    if (m_account)
+        *m_account -= m_accounted;
+    m_account = nullptr;
+    m_accounted = 0;
+    if (leaving) return;
+
+    switch (m_storage) {
+    case Storage::Compressed:
+        m_account = &m_ledger->compressed;
+        m_accounted = m_compressed.size();
+        break;
+    case Storage::Spilled:
+        m_account = &m_ledger->spilled;
+        m_accounted = m_spillLength;
+        break;
+    default:
+        m_account = &m_ledger->resident;
+        m_accounted = static_cast<qint64>(byteSize());
+        break;
+    }
+    *m_account += m_accounted;
+}
+
+//-----------------------------------------------------------------------------
+size_t CUndoCommand::byteSize() const
+{
+    switch (m_storage) {
+    case Storage::Compressed: return sizeof(*this) + m_compressed.size();
+    case Storage::Spilled: return sizeof(*this);
+    default: return sizeof(*this) + payloadSize();
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool CUndoCommand::ensureResident()
+{
+    if (m_storage == Storage::Resident)
+        return true;
+
+    QByteArray compressed = m_compressed;
+    bool ok = true;
+    if (m_storage == Storage::Spilled) {
+        QTemporaryFile& file = m_ledger->spillFile;
+        ok = file.seek(m_spillOffset);
+        compressed = ok ? file.read(m_spillLength) : QByteArray();
+        ok = ok && compressed.size() == m_spillLength;
+        m_ledger->release(m_spillOffset, m_spillLength);
+    }
+    // Only payloads of UNDO_MIN_COMPRESS_SIZE and up are compressed, so an
+    // empty result is a failure
+    QByteArray raw = ok ? qUncompress(compressed) : QByteArray();
+    ok = ok && !raw.isEmpty();
+    if (ok) {
+        QDataStream in(raw);
+        readPayload(in);
+        ok = in.status() == QDataStream::Ok;
+    }
+    if (!ok) {
+        releasePayload();
+        m_lost = true;
+    }
+    m_compressed.clear();
+    m_storage = Storage::Resident;
+    settle();
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
+// The command cannot run, and the ones around it no longer match the map;
+// the history clears its stack once the stack is done with this call
+void CUndoCommand::reportLost()
+{
+    if (m_ledger && m_ledger->payloadLost)
+        m_ledger->payloadLost();
+}
+
+//-----------------------------------------------------------------------------
+CUndoHistory::CUndoHistory(QUndoStack* stack, QObject* parent)
+    : QObject(parent),
+      m_stack(stack),
+      m_budget(Constants::UNDO_MEMORY_BUDGET),
+      m_spillThreshold(Constants::UNDO_SPILL_THRESHOLD)
+{
+    m_pool.setMaxThreadCount(1);
+    connect(m_stack, &QUndoStack::indexChanged, this, &CUndoHistory::rebalance);
+    m_ledger->payloadLost = [this]() {
+        QMetaObject::invokeMethod(this, &CUndoHistory::discard, Qt::QueuedConnection);
+    };
+}
+
+//-----------------------------------------------------------------------------
+CUndoHistory::~CUndoHistory()
+{
+    m_ledger->payloadLost = nullptr;
+    m_pool.waitForDone();
+}
+
+//-----------------------------------------------------------------------------
+void CUndoHistory::discard()
+{
+    if (m_stack->count() == 0)
+        return;
+    qWarning() << "Undo history cleared: a compressed or spilled edit could not be read back";
+    m_stack->clear();
+    emit historyLost();
+}
+
+//-----------------------------------------------------------------------------
+// Commands enter the stack on top, so the one below the new index is the
+// only one that can be new; deleted commands settle their own share
+void CUndoHistory::track(const QUndoCommand* command)
+{
+    forEachCommand(command, [this](CUndoCommand* cmd) {
+        if (cmd->m_ledger) return;
+        cmd->m_ledger = m_ledger;
+        cmd->settle();
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CUndoHistory::rebalance()
+{
+    const int count = m_stack->count();
+    const int current = m_stack->index();
+    if (current > 0)
+        track(m_stack->command(current - 1));
+
+    // Oldest first, leaving the commands around the current index alone so
+    // that a few steps of undo/redo never wait for a reload. The stack is
+    // only walked while something is over its limit.
+    qint64 resident = m_ledger->resident;
+    qint64 compressed = m_ledger->compressed;
+    for (int i = 0; i < count && (resident > m_budget || compressed > m_spillThreshold); ++i) {
+        if (std::abs(i - current) < Constants::UNDO_KEEP_RECENT)
+            continue;
+        forEachCommand(m_stack->command(i), [&](CUndoCommand* cmd) {
+            if (resident > m_budget && cmd->m_storage == CUndoCommand::Storage::Resident && !cmd->m_pending
+                && cmd->compressible() && cmd->payloadSize() >= static_cast<size_t>(Constants::UNDO_MIN_COMPRESS_SIZE)) {
+                resident -= cmd->payloadSize();
+                compress(cmd);
+            } else if (compressed > m_spillThreshold && cmd->m_storage == CUndoCommand::Storage::Compressed) {
+                compressed -= cmd->m_compressed.size();
+                spill(cmd);
+            }
+        });
+    }
+
+    emit memoryChanged(m_ledger->resident, m_ledger->compressed, m_ledger->spilled);
+}
+
+//-----------------------------------------------------------------------------
+void CUndoHistory::compress(CUndoCommand* cmd)
+{
+    // Serializing is a plain copy and stays on the GUI thread; the costly
+    // compression runs on the worker and is swapped in only if the command
+    // still exists and has not been undone or redone in the meantime
+    QByteArray raw;
+    {
+        QDataStream out(&raw, QIODevice::WriteOnly);
+        cmd->writePayload(out);
+    }
+    cmd->m_pending = true;
+    std::shared_ptr<CUndoCommand*> handle = cmd->m_handle;
+    uint64_t serial = cmd->m_serial;
+
+    m_pool.start([this, raw, handle, serial]() {
+        QByteArray compressed = qCompress(raw, Constants::UNDO_COMPRESSION_LEVEL);
+        QMetaObject::invokeMethod(this, [this, compressed, handle, serial]() {
+            CUndoCommand* cmd = *handle;
+            if (!cmd) return;
+            cmd->m_pending = false;
+            if (cmd->m_serial != serial || cmd->m_storage != CUndoCommand::Storage::Resident)
+                return;
+            cmd->releasePayload();
+            cmd->m_compressed = compressed;
+            cmd->m_storage = CUndoCommand::Storage::Compressed;
+            cmd->settle();
+            rebalance();
+        }, Qt::QueuedConnection);
+    });
+}
+
+//-----------------------------------------------------------------------------
+void CUndoHistory::spill(CUndoCommand* cmd)
+{
+    QTemporaryFile& file = m_ledger->spillFile;
+    if (!file.isOpen() && !file.open())
+        return;
+    const qint64 length = cmd->m_compressed.size();
+    qint64 offset = m_ledger->allocate(length);
+    if (!file.seek(offset) || file.write(cmd->m_compressed) != length) {
+        m_ledger->release(offset, length);
+        return;
+    }
+    cmd->m_spillOffset = offset;
+    cmd->m_spillLength = cmd->m_compressed.size();
+    cmd->m_compressed.clear();
+    cmd->m_compressed.squeeze();
+    cmd->m_storage = CUndoCommand::Storage::Spilled;
+    cmd->settle();
+}
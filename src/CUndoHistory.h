@@ -0,0 +1,152 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QObject>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <QUndoCommand>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+
+//-----------------------------------------------------------------------------
+class QUndoStack;
+
+//-----------------------------------------------------------------------------
+// Byte totals and spill file of the commands a history manages. Commands
+// settle their share here whenever their storage changes, and on deletion,
+// which may come after the history is gone, so the ledger is shared with
+// them. Spill file space given back by reloaded or deleted commands is kept
+// as free ranges and reused first; free space at the end is truncated.
+struct CUndoLedger
+{
+    qint64 resident = 0;
+    qint64 compressed = 0;
+    qint64 spilled = 0;
+
+    QTemporaryFile spillFile;
+    std::map<qint64, qint64> freeRanges;    // offset -> length
+    std::function<void()> payloadLost;      // set while the history exists
+
+    qint64 allocate(qint64 length);
+    void release(qint64 offset, qint64 length);
+};
+
+//-----------------------------------------------------------------------------
+// Base for all map edit commands. Reports its memory footprint and lets the
+// history manager compress or spill its payload; undo/redo reload the payload
+// transparently before running.
+class CUndoCommand : public QUndoCommand
+{
+public:
+    enum class Storage { Resident, Compressed, Spilled };
+
+    CUndoCommand();
+    ~CUndoCommand() override;
+
+    void undo() final;
+    void redo() final;
+
+    size_t byteSize() const;
+    Storage storage() const { return m_storage; }
+
+protected:
+    virtual void doUndo() = 0;
+    virtual void doRedo() = 0;
+
+    // Payload hooks; commands without bulk data keep the defaults
+    virtual size_t payloadSize() const { return 0; }
+    virtual bool compressible() const { return false; }
+    virtual void writePayload(QDataStream&) const {}
+    virtual void readPayload(QDataStream&) {}
+    virtual void releasePayload() {}
+
+    template<typename Container>
+    static void writeRaw(QDataStream& out, const Container& c);
+    template<typename Container>
+    static void readRaw(QDataStream& in, Container& c);
+    template<typename Container>
+    static void releaseRaw(Container& c) { Container().swap(c); }
+
+private:
+    friend class CUndoHistory;
+
+    Storage m_storage = Storage::Resident;
+    QByteArray m_compressed;
+    qint64 m_spillOffset = 0;
+    qint64 m_spillLength = 0;
+    uint64_t m_serial = 0;
+    bool m_pending = false;
+    bool m_lost = false;                      // payload could not be reloaded
+    std::shared_ptr<CUndoCommand*> m_handle;
+    std::shared_ptr<CUndoLedger> m_ledger;   // set once a history tracks the command
+    qint64* m_account = nullptr;              // ledger total holding our bytes
+    qint64 m_accounted = 0;
+
+    // False if a compressed or spilled payload could not be read back
+    bool ensureResident();
+    void reportLost();
+    // Books the command's current bytes in the ledger in place of what was
+    // booked before; leaving only takes them out, as payloadSize() is no
+    // longer callable in the destructor
+    void settle(bool leaving = false);
+};
+
+//-----------------------------------------------------------------------------
+template<typename Container>
+void CUndoCommand::writeRaw(QDataStream& out, const Container& c)
+{
+    out << quint64(c.size());
+    out.writeRawData(reinterpret_cast<const char*>(c.data()), static_cast<int>(c.size() * sizeof(typename Container::value_type)));
+}
+
+//-----------------------------------------------------------------------------
+template<typename Container>
+void CUndoCommand::readRaw(QDataStream& in, Container& c)
+{
+    quint64 n = 0;
+    in >> n;
+    c.resize(n);
+    in.readRawData(reinterpret_cast<char*>(c.data()), static_cast<int>(n * sizeof(typename Container::value_type)));
+}
+
+//-----------------------------------------------------------------------------
+// Keeps the undo history of a QUndoStack under a memory budget. Past the
+// budget, old commands are compressed on a worker thread; past the spill
+// threshold, compressed payloads move to a temporary file.
+class CUndoHistory : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CUndoHistory(QUndoStack* stack, QObject* parent = nullptr);
+    ~CUndoHistory() override;
+
+    void setMemoryBudget(qint64 bytes) { m_budget = bytes; rebalance(); }
+    void setSpillThreshold(qint64 bytes) { m_spillThreshold = bytes; rebalance(); }
+
+    qint64 residentBytes() const { return m_ledger->resident; }
+    qint64 compressedBytes() const { return m_ledger->compressed; }
+    qint64 spilledBytes() const { return m_ledger->spilled; }
+
+signals:
+    void memoryChanged(qint64 resident, qint64 compressed, qint64 spilled);
+    // A payload could not be reloaded and the stack was cleared
+    void historyLost();
+
+private:
+    QUndoStack* m_stack = nullptr;
+    QThreadPool m_pool;
+    qint64 m_budget = 0;
+    qint64 m_spillThreshold = 0;
+    std::shared_ptr<CUndoLedger> m_ledger = std::make_shared<CUndoLedger>();
+
+    void rebalance();
+    void discard();
+    void track(const QUndoCommand* command);
+    void compress(CUndoCommand* cmd);
+    void spill(CUndoCommand* cmd);
+};
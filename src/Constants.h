@@ -12,6 +12,15 @@ namespace Constants {
     // Tile settings
     constexpr int DEFAULT_TILE_SIZE = 32;
     constexpr int PALETTE_TILE_COUNT = 12;
+    constexpr int MAX_PALETTE_TILE_COUNT = 128;
+    constexpr int MAX_TILE_PROPERTY_ID = 65535;     // bounds the property table read from a sidecar file
+    // ARGB colours tiles 1..n are drawn with while no tileset is loaded,
+    // repeating past the end
+    constexpr unsigned int TILE_COLORS[] = {
+        0xffffffff, 0xff000000, 0xffff0000, 0xff00ff00, 0xff0000ff, 0xffffff00,
+        0xff00ffff, 0xffff00ff, 0xffa0a0a4, 0xff800000, 0xff008000, 0xff000080
+    };
+    constexpr int TILE_COLOR_COUNT = sizeof(TILE_COLORS) / sizeof(TILE_COLORS[0]);
 
     // Window settings
     constexpr int DEFAULT_WINDOW_WIDTH = 800;
@@ -24,8 +33,86 @@ namespace Constants {
     constexpr double ZOOM_STEP = 1.25;
     constexpr double MIN_ZOOM = 0.25;
     constexpr double MAX_ZOOM = 4.0;
+    constexpr double INPUT_DEFAULT_REFRESH_HZ = 60.0;
+
+    // Progressive rendering
+    constexpr int RENDER_CHUNK_TILES = 16;
+    constexpr int RENDER_MAX_LEVEL = 2;            // chunk images down to 1/4 scale
+    constexpr int RENDER_CACHE_KB = 256 * 1024;
+    constexpr int RENDER_IDLE_MS = 30;
     
     // Tools
     constexpr int TOOL_PAINT = 0;
     constexpr int TOOL_FILL = 1;
+    constexpr int TOOL_OBJECT = 2;
+    constexpr int TOOL_SELECT = 3;
+    constexpr int TOOL_STAMP = 4;
+
+    // Object layer
+    constexpr int OBJECT_GRID_CELL_SIZE = 256;
+    constexpr int OBJECT_MAX_BUCKET_CELLS = 256;
+    constexpr const char* DEFAULT_OBJECT_TYPE = "spawn";
+    constexpr const char* OBJECT_TYPES[] = { "spawn", "exit", "trigger", "light" };
+
+    // Map storage
+    constexpr int MAP_CHUNK_SIZE = 64;
+    constexpr int FILE_WATCH_DELAY_MS = 200;
+    constexpr const char* SESSION_CACHE_FILE = "session.bin";
+
+    // Thumbnails and recent files
+    constexpr int THUMBNAIL_SIZE = 128;
+    constexpr int THUMBNAIL_MEMORY_KB = 32 * 1024;
+    constexpr const char* THUMBNAIL_CACHE_DIR = "thumbnails";
+    constexpr int THUMBNAIL_DISK_CACHE_MB = 64;
+    constexpr int THUMBNAIL_FAILED_MAX = 256;      // versions remembered as unreadable
+    constexpr int RECENT_FILES_MAX = 10;
+
+    // Edit recordings
+    constexpr const char* RECORDING_FILE_SUFFIX = "mrec";
+
+    // Parallel kernels
+    constexpr int PARALLEL_MIN_ROWS = 64;
+    constexpr int REPLACE_MAX_LUT_SIZE = 65536;
+
+    // Procedural generation
+    constexpr int GENERATOR_PREVIEW_SIZE = 256;
+    constexpr int GENERATOR_PREVIEW_DELAY_MS = 30;
+
+    // Map analysis
+    constexpr int ANALYSIS_BAND_ROWS = 32;
+    constexpr int ANALYSIS_DELAY_MS = 150;
+    constexpr int ANALYSIS_OVERLAY_ALPHA = 110;
+
+    // Path checks
+    constexpr const char* DEFAULT_PATH_MARKER_TYPES = "spawn, exit";
+
+    // Map diff and merge
+    constexpr int DIFF_BLOCK_SIZE = 16;
+
+    // Live sync
+    constexpr const char* DEFAULT_SYNC_CHANNEL = "mapeditor-sync";
+    constexpr int SYNC_CONNECT_TIMEOUT_MS = 500;
+    constexpr int SYNC_MAX_PACKET_BYTES = 512 * 1024 * 1024;
+
+    // Runtime packs
+    constexpr int PACK_MIN_CHUNK_SIZE = 8;
+    constexpr int PACK_MAX_CHUNK_SIZE = 256;
+    constexpr int PACK_COMPRESSION_LEVEL = 6;
+    constexpr const char* PACK_FILE_SUFFIX = "mpak";
+
+    // Undo history
+    constexpr long long UNDO_MEMORY_BUDGET = 64LL * 1024 * 1024;
+    constexpr long long UNDO_SPILL_THRESHOLD = 128LL * 1024 * 1024;
+    constexpr int UNDO_KEEP_RECENT = 16;
+    constexpr int UNDO_MIN_COMPRESS_SIZE = 4096;
+    constexpr int UNDO_COMPRESSION_LEVEL = 1;
+    constexpr int UNDO_MAX_LIMIT_MB = 16 * 1024;    // for the preferences
+
+    // Payload pool
+    constexpr long long ALLOC_POOL_MIN_BLOCK = 64;
+    constexpr long long ALLOC_POOL_MAX_BLOCK = 64LL * 1024 * 1024;
+    constexpr long long ALLOC_POOL_CACHE_MB = 16;
+
+    // Clipboard
+    constexpr const char* REGION_MIME_TYPE = "application/x-mapeditor-region";
 }
@@ -1,16 +1,68 @@
+#include "CCommandLine.h"
 #include "CMainWindow.h"
+#include "CPhaseLog.h"
+#include "Constants.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
 #include <QIcon>
+#include <QImageReader>
 
 //-----------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
+	// Headless commands never create a GUI, so they run on CI machines
+	if (CCommandLine::isCommand(argc, argv)) {
+		if (CCommandLine::usesWidgets(argc, argv)) {
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+			QApplication app(argc, argv);
+			return CCommandLine::run(app.arguments());
+		}
+		QCoreApplication app(argc, argv);
+		return CCommandLine::run(app.arguments());
+	}
+
+	CPhaseLog startup("startup");
 	QApplication app(argc, argv);
+	app.setOrganizationName("MapEditor");
+	app.setApplicationName("MapEditor");
 	app.setWindowIcon(QIcon(":/icon.png"));
 
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Tile map editor. Without files, the last session is restored.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("files", "Map files (JSON) and at most one tileset image.", "[files...]");
+	QCommandLineOption tileSizeOption("tile-size", "Tile size of the tileset in pixels.", "px",
+	                                  QString::number(Constants::DEFAULT_TILE_SIZE));
+	QCommandLineOption tileCountOption("tile-count", "Tiles shown in the palette (default: all, up to 128).", "n");
+	parser.addOptions({tileSizeOption, tileCountOption});
+	parser.process(app);
+
+	// Images are told apart from maps by what Qt can decode
+	QStringList maps;
+	QString tileset;
+	const QList<QByteArray> imageFormats = QImageReader::supportedImageFormats();
+	for (const QString& path : parser.positionalArguments()) {
+		if (imageFormats.contains(QFileInfo(path).suffix().toLower().toUtf8()))
+			tileset = path;
+		else
+			maps.append(path);
+	}
+	startup.mark("application");
+
 	CMainWindow w;
+	startup.mark("window");
+	if (maps.isEmpty() && tileset.isEmpty())
+		w.restoreSession(&startup);
+	else
+		w.openFiles(maps, tileset, parser.value(tileSizeOption).toInt(), parser.value(tileCountOption).toInt(), &startup);
+	// The first paint of the map view, however many events come before it
+	QObject::connect(&w, &CMainWindow::framePainted, &w, [&startup]() { startup.mark("first frame"); },
+	                 Qt::SingleShotConnection);
 	w.show();
+	startup.mark("shown");
 
 	return app.exec();
 }
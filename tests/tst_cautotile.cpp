@@ -0,0 +1,216 @@
+#include "CAutotile.h"
+#include "CMap.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSet>
+#include <QtTest>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const int TILE_COUNT = 128;
+    const uint32_t GRASS = 1;       // variants 1..47
+    const uint32_t WATER = 51;      // variants 51..97
+
+    QJsonObject terrain(const QString& name, uint32_t first)
+    {
+        QJsonArray tiles;
+        for (int i = 0; i < CAutotile::BLOB_VARIANTS; ++i)
+            tiles.append(static_cast<qint64>(first + i));
+        QJsonObject t;
+        t["name"] = name;
+        t["tiles"] = tiles;
+        return t;
+    }
+
+    QJsonObject rules(const QJsonArray& terrains)
+    {
+        QJsonObject obj;
+        obj["terrains"] = terrains;
+        return obj;
+    }
+
+    CAutotile grassAndWater()
+    {
+        CAutotile autotile;
+        autotile.fromJson(rules({ terrain("grass", GRASS), terrain("water", WATER) }), TILE_COUNT);
+        return autotile;
+    }
+
+    uint32_t variant(uint32_t first, uint8_t mask)
+    {
+        return first + static_cast<uint32_t>(CAutotile::blobIndex(mask));
+    }
+
+    // Grass blobs in a field of water and empty tiles
+    CMap randomMap(uint32_t seed)
+    {
+        CMap map(30, 20);
+        for (int y = 0; y < map.height(); ++y) {
+            for (int x = 0; x < map.width(); ++x) {
+                seed = seed * 1103515245u + 12345u;
+                const uint32_t r = (seed >> 16) % 10;
+                map.setTile(x, y, r < 5 ? GRASS : r < 8 ? WATER : 0);
+            }
+        }
+        return map;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCAutotile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void blobIndex();
+    void loadsRules();
+    void rejectsBadRules();
+    void variants();
+    void mapBorderCountsAsSame();
+    void tilesMatchRect();
+    void incrementalEdit();
+};
+
+//-----------------------------------------------------------------------------
+void TestCAutotile::blobIndex()
+{
+    QSet<int> indices;
+    for (int m = 0; m < 256; ++m) {
+        const int index = CAutotile::blobIndex(static_cast<uint8_t>(m));
+        QVERIFY(index >= 0 && index < CAutotile::BLOB_VARIANTS);
+        indices.insert(index);
+    }
+    QCOMPARE(indices.size(), CAutotile::BLOB_VARIANTS);
+    QCOMPARE(CAutotile::blobIndex(0), 0);
+    QCOMPARE(CAutotile::blobIndex(0xff), CAutotile::BLOB_VARIANTS - 1);
+    // A corner without both of its edges does not change the variant
+    QCOMPARE(CAutotile::blobIndex(CAutotile::N | CAutotile::NE), CAutotile::blobIndex(CAutotile::N));
+    QVERIFY(CAutotile::blobIndex(CAutotile::N | CAutotile::E | CAutotile::NE)
+            != CAutotile::blobIndex(CAutotile::N | CAutotile::E));
+}
+
+//-----------------------------------------------------------------------------
+void TestCAutotile::loadsRules()
+{
+    const CAutotile autotile = grassAndWater();
+    QVERIFY(autotile.hasRules());
+    QCOMPARE(autotile.terrainOf(GRASS), 0);
+    QCOMPARE(autotile.terrainOf(GRASS + 46), 0);
+    QCOMPARE(autotile.terrainOf(WATER + 10), 1);
+    QCOMPARE(autotile.terrainOf(0), -1);
+    QCOMPARE(autotile.terrainOf(48), -1);
+    QCOMPARE(autotile.terrainOf(100000), -1);
+}
+
+//-----------------------------------------------------------------------------
+void TestCAutotile::rejectsBadRules()
+{
+    CAutotile autotile;
+    QVERIFY(!autotile.fromJson(QJsonObject(), TILE_COUNT));
+    QVERIFY(!autotile.fromJson(rules({}), TILE_COUNT));
+
+    // The empty tile cannot be a variant
+    QVERIFY(!autotile.fromJson(rules({ terrain("grass", 0) }), TILE_COUNT));
+    QVERIFY(!autotile.hasRules());
+    // Nor can ids past the tileset
+    QVERIFY(!autotile.fromJson(rules({ terrain("grass", TILE_COUNT - 45) }), TILE_COUNT));
+    QVERIFY(autotile.fromJson(rules({ terrain("grass", TILE_COUNT - 46) }), TILE_COUNT));
+
+    QJsonObject shortTerrain = terrain("grass", GRASS);
+    QJsonArray tiles = shortTerrain["tiles"].toArray();
+    tiles.removeLast();
+    shortTerrain["tiles"] = tiles;
+    QVERIFY(!autotile.fromJson(rules({ terrain("water", WATER), shortTerrain }), TILE_COUNT));
+    QVERIFY(!autotile.hasRules());
+
+    QJsonObject text = terrain("grass", GRASS);
+    tiles = text["tiles"].toArray();
+    tiles[3] = "four";
+    text["tiles"] = tiles;
+    QVERIFY(!autotile.fromJson(rules({ text }), TILE_COUNT));
+}
+
+//-----------------------------------------------------------------------------
+void TestCAutotile::variants()
+{
+    const CAutotile autotile = grassAndWater();
+    CMap map(9, 9);
+    // A lone tile and a 3x3 block, away from the border
+    map.setTile(1, 1, GRASS + 20);
+    map.fillRect(4, 4, 3, 3, GRASS);
+    map.setTile(8, 8, WATER);
+    autotile.applyRect(map, QRect(0, 0, 9, 9));
+
+    QCOMPARE(map.tileAt(1, 1), variant(GRASS, 0));
+    QCOMPARE(map.tileAt(5, 5), variant(GRASS, 0xff));
+    QCOMPARE(map.tileAt(4, 4), variant(GRASS, CAutotile::E | CAutotile::SE | CAutotile::S));
+    QCOMPARE(map.tileAt(5, 4), variant(GRASS, CAutotile::E | CAutotile::SE | CAutotile::S | CAutotile::SW | CAutotile::W));
+    QCOMPARE(map.tileAt(6, 6), variant(GRASS, CAutotile::N | CAutotile::NW | CAutotile::W));
+    // Other terrains and empty tiles are not neighbours of the same kind
+    QCOMPARE(map.tileAt(0, 0), 0u);
+    QCOMPARE(autotile.terrainOf(map.tileAt(8, 8)), 1);
+}
+
+//-----------------------------------------------------------------------------
+void TestCAutotile::mapBorderCountsAsSame()
+{
+    const CAutotile autotile = grassAndWater();
+    CMap map(5, 5);
+    map.setTile(0, 0, GRASS);
+    map.fillRect(0, 4, 5, 1, WATER);
+    autotile.applyRect(map, QRect(0, 0, 5, 5));
+
+    const uint8_t outside = CAutotile::N | CAutotile::NE | CAutotile::SW | CAutotile::W | CAutotile::NW;
+    QCOMPARE(map.tileAt(0, 0), variant(GRASS, outside));
+    // A row along the bottom edge is closed on every side but the top
+    const uint8_t bottom = static_cast<uint8_t>(~(CAutotile::N | CAutotile::NE | CAutotile::NW));
+    QCOMPARE(map.tileAt(2, 4), variant(WATER, bottom));
+}
+
+//-----------------------------------------------------------------------------
+// Evaluating every tile through applyTiles() gives what a whole-map pass does
+void TestCAutotile::tilesMatchRect()
+{
+    const CAutotile autotile = grassAndWater();
+    CMap whole = randomMap(5);
+    CMap tiles = whole;
+    autotile.applyRect(whole, QRect(0, 0, whole.width(), whole.height()));
+
+    QVector<QPair<int, int>> all;
+    for (int y = 0; y < tiles.height(); ++y)
+        for (int x = 0; x < tiles.width(); ++x)
+            all.append({ x, y });
+    autotile.applyTiles(tiles, all);
+    QCOMPARE(tiles.contentHash(), whole.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+// Re-evaluating only the edited tiles and their border catches every variant
+// the edit changed
+void TestCAutotile::incrementalEdit()
+{
+    const CAutotile autotile = grassAndWater();
+    CMap map = randomMap(11);
+    autotile.applyRect(map, QRect(0, 0, map.width(), map.height()));
+
+    const QVector<QPair<int, int>> edits = { { 0, 0 }, { 10, 10 }, { 11, 10 }, { 29, 19 } };
+    for (const auto& edit : edits)
+        map.setTile(edit.first, edit.second, autotile.terrainOf(map.tileAt(edit.first, edit.second)) == 0 ? WATER : GRASS);
+    CMap reference = map;
+    autotile.applyTiles(map, edits);
+    autotile.applyRect(reference, QRect(0, 0, reference.width(), reference.height()));
+    QCOMPARE(map.contentHash(), reference.contentHash());
+
+    // applyRect() on the edited rect does the same
+    CMap rect = randomMap(11);
+    autotile.applyRect(rect, QRect(0, 0, rect.width(), rect.height()));
+    rect.fillRect(3, 4, 5, 2, WATER);
+    reference = rect;
+    autotile.applyRect(rect, QRect(3, 4, 5, 2));
+    autotile.applyRect(reference, QRect(0, 0, reference.width(), reference.height()));
+    QCOMPARE(rect.contentHash(), reference.contentHash());
+}
+
+QTEST_GUILESS_MAIN(TestCAutotile)
+#include "tst_cautotile.moc"
@@ -0,0 +1,98 @@
+#include "CGenerator.h"
+
+#include <QtTest>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const QRect MAP(0, 0, 120, 90);
+
+    CGeneratorSettings caveSettings()
+    {
+        CGeneratorSettings s;
+        s.mode = CGeneratorSettings::MODE_CAVE;
+        s.seed = 7;
+        s.lowTile = 0;
+        s.highTile = 3;
+        return s;
+    }
+
+    // The tiles of whole lying inside area, every step-th one
+    CTileRegion cut(const CTileRegion& whole, const QRect& area, int step)
+    {
+        CTileRegion region;
+        region.width = (area.width() + step - 1) / step;
+        region.height = (area.height() + step - 1) / step;
+        for (int y = 0; y < region.height; ++y)
+            for (int x = 0; x < region.width; ++x)
+                region.tiles.push_back(whole.tiles[static_cast<size_t>(area.top() + y * step) * whole.width + area.left() + x * step]);
+        return region;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCGenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void selectionMatchesWholeMap_data();
+    void selectionMatchesWholeMap();
+    void previewMatchesWholeMap();
+    void caveWalledAtMapEdge();
+};
+
+//-----------------------------------------------------------------------------
+void TestCGenerator::selectionMatchesWholeMap_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::addColumn<QRect>("area");
+    QTest::newRow("value") << int(CGeneratorSettings::MODE_VALUE_NOISE) << QRect(30, 20, 40, 25);
+    QTest::newRow("simplex") << int(CGeneratorSettings::MODE_SIMPLEX_NOISE) << QRect(30, 20, 40, 25);
+    QTest::newRow("cave inside") << int(CGeneratorSettings::MODE_CAVE) << QRect(30, 20, 40, 25);
+    QTest::newRow("cave at edge") << int(CGeneratorSettings::MODE_CAVE) << QRect(0, 2, 17, 88);
+    QTest::newRow("cave single tile") << int(CGeneratorSettings::MODE_CAVE) << QRect(60, 45, 1, 1);
+}
+
+//-----------------------------------------------------------------------------
+void TestCGenerator::selectionMatchesWholeMap()
+{
+    QFETCH(int, mode);
+    QFETCH(QRect, area);
+    CGeneratorSettings s = caveSettings();
+    s.mode = static_cast<CGeneratorSettings::Mode>(mode);
+
+    const CTileRegion whole = CGenerator::generate(s, MAP, MAP);
+    const CTileRegion selection = CGenerator::generate(s, area, MAP);
+    QCOMPARE(selection.width, area.width());
+    QCOMPARE(selection.height, area.height());
+    QCOMPARE(selection.tiles, cut(whole, area, 1).tiles);
+}
+
+//-----------------------------------------------------------------------------
+// A sampled preview shows the tiles the real run will write
+void TestCGenerator::previewMatchesWholeMap()
+{
+    const CGeneratorSettings s = caveSettings();
+    const CTileRegion whole = CGenerator::generate(s, MAP, MAP);
+    for (int step : { 2, 3, 7 }) {
+        const CTileRegion preview = CGenerator::generate(s, MAP, MAP, step);
+        QCOMPARE(preview.tiles, cut(whole, MAP, step).tiles);
+    }
+    const QRect area(11, 5, 50, 31);
+    QCOMPARE(CGenerator::generate(s, area, MAP, 4).tiles, cut(whole, area, 4).tiles);
+}
+
+//-----------------------------------------------------------------------------
+void TestCGenerator::caveWalledAtMapEdge()
+{
+    CGeneratorSettings s = caveSettings();
+    s.fillPercent = 0;
+    s.iterations = 3;
+    const CTileRegion region = CGenerator::generate(s, MAP, MAP);
+    // Open ground everywhere except where the wall border reaches in
+    QCOMPARE(region.tiles[0], s.highTile);
+    QCOMPARE(region.tiles[static_cast<size_t>(MAP.height() / 2) * region.width + MAP.width() / 2], s.lowTile);
+}
+
+QTEST_GUILESS_MAIN(TestCGenerator)
+#include "tst_cgenerator.moc"
@@ -0,0 +1,254 @@
+#include "CMap.h"
+#include "Constants.h"
+
+#include <QtTest>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Every tile a distinct id, so misplaced copies show
+    CMap numbered(int w, int h)
+    {
+        CMap map(w, h);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                map.setTile(x, y, static_cast<uint32_t>(1 + (y * w + x) % 250));
+        return map;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMap : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void copyRegion();
+    void copyRegionClips();
+    void blitRegion();
+    void blitRegionClips();
+    void fillRect();
+    void regionOpsTouchRevisions();
+    void setTiles();
+    void setTilesSkipsPastEnd();
+    void cellWidthGrows();
+    void loadingNarrowsCells();
+};
+
+//-----------------------------------------------------------------------------
+void TestCMap::copyRegion()
+{
+    const CMap map = numbered(10, 8);
+    const CTileRegion region = map.copyRegion(2, 3, 4, 2);
+    QCOMPARE(region.width, 4);
+    QCOMPARE(region.height, 2);
+    QCOMPARE(region.tiles.size(), size_t(8));
+    for (int y = 0; y < 2; ++y)
+        for (int x = 0; x < 4; ++x)
+            QCOMPARE(region.tiles[y * 4 + x], map.tileAt(2 + x, 3 + y));
+}
+
+//-----------------------------------------------------------------------------
+// A copied region starts at the first map tile inside the requested rect
+void TestCMap::copyRegionClips()
+{
+    const CMap map = numbered(10, 8);
+    const CTileRegion corner = map.copyRegion(-2, -1, 5, 4);
+    QCOMPARE(corner.width, 3);
+    QCOMPARE(corner.height, 3);
+    QCOMPARE(corner.tiles.front(), map.tileAt(0, 0));
+    QCOMPARE(corner.tiles.back(), map.tileAt(2, 2));
+
+    const CTileRegion edge = map.copyRegion(8, 6, 10, 10);
+    QCOMPARE(edge.width, 2);
+    QCOMPARE(edge.height, 2);
+    QCOMPARE(edge.tiles.back(), map.tileAt(9, 7));
+
+    QVERIFY(map.copyRegion(10, 0, 3, 3).isEmpty());
+    QVERIFY(map.copyRegion(0, 0, 0, 5).isEmpty());
+    QVERIFY(map.copyRegion(-5, -5, 5, 5).isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCMap::blitRegion()
+{
+    const CMap source = numbered(10, 8);
+    const CTileRegion region = source.copyRegion(1, 1, 3, 3);
+    CMap map(10, 8);
+    map.blitRegion(5, 2, region);
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 10; ++x) {
+            const bool inside = x >= 5 && x < 8 && y >= 2 && y < 5;
+            QCOMPARE(map.tileAt(x, y), inside ? source.tileAt(x - 4, y - 1) : 0u);
+        }
+    }
+
+    // Copy and blit back is a no-op
+    CMap copy = numbered(10, 8);
+    copy.blitRegion(0, 0, copy.copyRegion(0, 0, 10, 8));
+    QCOMPARE(copy.contentHash(), source.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+// Parts of the region outside the map are dropped, on every side
+void TestCMap::blitRegionClips()
+{
+    const CMap source = numbered(4, 4);
+    const CTileRegion region = source.copyRegion(0, 0, 4, 4);
+
+    CMap map(6, 6);
+    map.blitRegion(-1, -2, region);
+    QCOMPARE(map.tileAt(0, 0), source.tileAt(1, 2));
+    QCOMPARE(map.tileAt(2, 1), source.tileAt(3, 3));
+    QCOMPARE(map.tileAt(3, 0), 0u);
+    QCOMPARE(map.tileAt(0, 2), 0u);
+
+    map.clear();
+    map.blitRegion(4, 5, region);
+    QCOMPARE(map.tileAt(4, 5), source.tileAt(0, 0));
+    QCOMPARE(map.tileAt(5, 5), source.tileAt(1, 0));
+    QCOMPARE(map.tileAt(3, 5), 0u);
+    QCOMPARE(map.tileAt(4, 4), 0u);
+
+    // Entirely outside, or empty: nothing changes
+    map.clear();
+    const uint64_t revision = map.revision();
+    map.blitRegion(6, 0, region);
+    map.blitRegion(-4, 0, region);
+    map.blitRegion(0, 0, CTileRegion());
+    QCOMPARE(map.revision(), revision);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMap::fillRect()
+{
+    CMap map(10, 8);
+    map.fillRect(-3, 6, 5, 10, 9);
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 10; ++x)
+            QCOMPARE(map.tileAt(x, y), x < 2 && y >= 6 ? 9u : 0u);
+
+    const uint64_t revision = map.revision();
+    map.fillRect(0, 0, 0, 4, 3);
+    map.fillRect(10, 0, 2, 2, 3);
+    QCOMPARE(map.revision(), revision);
+}
+
+//-----------------------------------------------------------------------------
+// Observers find region edits through the row and chunk revisions
+void TestCMap::regionOpsTouchRevisions()
+{
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    CMap map(3 * chunk, 2 * chunk);
+    const uint64_t before = map.revision();
+
+    map.fillRect(chunk + 1, 2, 4, 3, 5);
+    QVERIFY(map.revision() > before);
+    QCOMPARE(map.rowRevision(2), map.revision());
+    QCOMPARE(map.rowRevision(4), map.revision());
+    QVERIFY(map.rowRevision(5) < map.revision());
+    QCOMPARE(map.chunkRevision(1, 0), map.revision());
+    QVERIFY(map.chunkRevision(0, 0) < map.revision());
+
+    // A blit across a chunk corner touches all four chunks
+    const CTileRegion region = map.copyRegion(chunk, 0, 8, 8);
+    map.blitRegion(2 * chunk - 4, chunk - 4, region);
+    for (int cy = 0; cy < 2; ++cy)
+        for (int cx = 1; cx < 3; ++cx)
+            QCOMPARE(map.chunkRevision(cx, cy), map.revision());
+    QVERIFY(map.chunkRevision(0, 1) < map.revision());
+}
+
+//-----------------------------------------------------------------------------
+void TestCMap::setTiles()
+{
+    const int chunk = Constants::MAP_CHUNK_SIZE;
+    CMap map(2 * chunk, 2 * chunk);
+    const uint32_t positions[] = { 0, 5, static_cast<uint32_t>(chunk + 1) * map.width() + chunk + 3 };
+    const uint32_t values[] = { 7, 8, 9 };
+    const uint64_t before = map.revision();
+
+    map.setTiles(positions, 3, values);
+    QCOMPARE(map.tileAt(0, 0), 7u);
+    QCOMPARE(map.tileAt(5, 0), 8u);
+    QCOMPARE(map.tileAt(chunk + 3, chunk + 1), 9u);
+    QCOMPARE(map.tileAt(1, 0), 0u);
+    QCOMPARE(map.rowRevision(chunk + 1), map.revision());
+    QCOMPARE(map.chunkRevision(1, 1), map.revision());
+    QVERIFY(map.chunkRevision(1, 0) <= before);
+
+    map.setTiles(positions, 2, 4u);
+    QCOMPARE(map.tileAt(0, 0), 4u);
+    QCOMPARE(map.tileAt(5, 0), 4u);
+    QCOMPARE(map.tileAt(chunk + 3, chunk + 1), 9u);
+}
+
+//-----------------------------------------------------------------------------
+// Positions recorded before the map shrank are dropped, not written
+void TestCMap::setTilesSkipsPastEnd()
+{
+    CMap map(4, 3);
+    const uint32_t positions[] = { 11, 12, 4000000000u, 2 };
+    const uint32_t values[] = { 5, 6, 7, 8 };
+    map.setTiles(positions, 4, values);
+    QCOMPARE(map.tileAt(3, 2), 5u);
+    QCOMPARE(map.tileAt(2, 0), 8u);
+
+    map.setTiles(positions + 1, 2, 9u);
+    QCOMPARE(map.tileAt(3, 2), 5u);
+    QCOMPARE(map.tileCount(), size_t(12));
+}
+
+//-----------------------------------------------------------------------------
+// Cells widen to the first id that needs it and keep every id they held
+void TestCMap::cellWidthGrows()
+{
+    CMap map = numbered(20, 10);
+    QCOMPARE(map.cellBytes(), 1);
+    map.setTile(3, 3, 255);
+    QCOMPARE(map.cellBytes(), 1);
+
+    map.setTile(4, 4, 256);
+    QCOMPARE(map.cellBytes(), 2);
+    const uint32_t position = 2 * 20 + 7;
+    map.setTiles(&position, 1, 70000u);
+    QCOMPARE(map.cellBytes(), 4);
+    const uint32_t row[] = { 0xffffffffu, 1 };
+    map.writeRow(9, 18, 2, row);
+    QCOMPARE(map.cellBytes(), 4);
+
+    CMap reference = numbered(20, 10);
+    reference.reserveCellBytes(4);
+    reference.setTile(3, 3, 255);
+    reference.setTile(4, 4, 256);
+    reference.setTile(7, 2, 70000);
+    reference.setTile(18, 9, 0xffffffffu);
+    reference.setTile(19, 9, 1);
+    for (int y = 0; y < map.height(); ++y)
+        for (int x = 0; x < map.width(); ++x)
+            QCOMPARE(map.tileAt(x, y), reference.tileAt(x, y));
+
+    // Writing small ids again does not narrow
+    map.fillRect(0, 0, 20, 10, 1);
+    QCOMPARE(map.cellBytes(), 4);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMap::loadingNarrowsCells()
+{
+    CMap map = numbered(20, 10);
+    map.setTile(0, 0, 70000);
+    QCOMPARE(map.cellBytes(), 4);
+    map.setTile(0, 0, 300);
+
+    CMap loaded(1, 1);
+    QVERIFY(loaded.fromJson(map.toJson()));
+    QCOMPARE(loaded.cellBytes(), 2);
+    QCOMPARE(loaded.contentHash(), map.contentHash());
+    map.setTile(0, 0, 1);
+    QVERIFY(loaded.fromJson(map.toJson()));
+    QCOMPARE(loaded.cellBytes(), 1);
+    QCOMPARE(loaded.tileAt(0, 0), 1u);
+}
+
+QTEST_GUILESS_MAIN(TestCMap)
+#include "tst_cmap.moc"
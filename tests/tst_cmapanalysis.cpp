@@ -0,0 +1,214 @@
+#include "CMap.h"
+#include "CMapAnalysis.h"
+#include "Constants.h"
+
+#include <QtTest>
+#include <map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Region statistics by flood fill, for comparison
+    std::map<uint32_t, CTileStats> referenceStats(const CMap& map)
+    {
+        std::map<uint32_t, CTileStats> stats;
+        const int w = map.width();
+        std::vector<bool> seen(map.tileCount(), false);
+        std::vector<QPoint> stack;
+        for (int y = 0; y < map.height(); ++y) {
+            for (int x = 0; x < w; ++x) {
+                if (seen[static_cast<size_t>(y) * w + x])
+                    continue;
+                const uint32_t id = map.tileAt(x, y);
+                uint64_t size = 0;
+                seen[static_cast<size_t>(y) * w + x] = true;
+                stack.push_back(QPoint(x, y));
+                while (!stack.empty()) {
+                    const QPoint p = stack.back();
+                    stack.pop_back();
+                    ++size;
+                    const QPoint next[] = { p + QPoint(1, 0), p - QPoint(1, 0), p + QPoint(0, 1), p - QPoint(0, 1) };
+                    for (const QPoint& n : next) {
+                        if (n.x() < 0 || n.y() < 0 || n.x() >= w || n.y() >= map.height())
+                            continue;
+                        const size_t i = static_cast<size_t>(n.y()) * w + n.x();
+                        if (seen[i] || map.tileAt(n.x(), n.y()) != id)
+                            continue;
+                        seen[i] = true;
+                        stack.push_back(n);
+                    }
+                }
+                CTileStats& s = stats[id];
+                s.tiles += size;
+                ++s.regions;
+                s.largestRegion = std::max(s.largestRegion, size);
+            }
+        }
+        return stats;
+    }
+
+    bool sameStats(const std::map<uint32_t, CTileStats>& a, const std::map<uint32_t, CTileStats>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (auto ia = a.begin(), ib = b.begin(); ia != a.end(); ++ia, ++ib) {
+            if (ia->first != ib->first || ia->second.tiles != ib->second.tiles ||
+                ia->second.regions != ib->second.regions || ia->second.largestRegion != ib->second.largestRegion)
+                return false;
+        }
+        return true;
+    }
+
+    CAnalysisResult analyse(const CMap& map, bool overlay = false)
+    {
+        CMapAnalysis analysis;
+        analysis.sync(map);
+        return analysis.run(overlay);
+    }
+
+    // A U of id 1, four tiles wide, so the inner column of id 0 and both
+    // arms run through every band
+    CMap uShape()
+    {
+        CMap map(4, 70);
+        map.fillRect(0, 0, 1, 70, 1);
+        map.fillRect(3, 0, 1, 70, 1);
+        map.fillRect(1, 69, 2, 1, 1);
+        return map;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMapAnalysis : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void uniformMap();
+    void checkerboard();
+    void regionsAcrossBands();
+    void separateColumns();
+    void matchesFloodFill();
+    void incremental();
+    void overlay();
+};
+
+//-----------------------------------------------------------------------------
+void TestCMapAnalysis::uniformMap()
+{
+    CMap map(50, 100);
+    map.clear(7);
+    const CAnalysisResult result = analyse(map);
+    QCOMPARE(result.regionCount, 1);
+    QCOMPARE(result.bandCount, 4);
+    QCOMPARE(result.tiles.size(), size_t(1));
+    QCOMPARE(result.tiles.at(7).tiles, uint64_t(5000));
+    QCOMPARE(result.tiles.at(7).largestRegion, uint64_t(5000));
+}
+
+//-----------------------------------------------------------------------------
+// Diagonal neighbours are not connected
+void TestCMapAnalysis::checkerboard()
+{
+    CMap map(6, 6);
+    for (int y = 0; y < 6; ++y)
+        for (int x = 0; x < 6; ++x)
+            map.setTile(x, y, (x + y) % 2);
+    const CAnalysisResult result = analyse(map);
+    QCOMPARE(result.regionCount, 36);
+    QCOMPARE(result.tiles.at(0).regions, 18);
+    QCOMPARE(result.tiles.at(1).largestRegion, uint64_t(1));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapAnalysis::regionsAcrossBands()
+{
+    const CAnalysisResult result = analyse(uShape());
+    QCOMPARE(result.bandCount, (70 + Constants::ANALYSIS_BAND_ROWS - 1) / Constants::ANALYSIS_BAND_ROWS);
+    QCOMPARE(result.regionCount, 2);
+    QCOMPARE(result.tiles.at(1).regions, 1);
+    QCOMPARE(result.tiles.at(1).tiles, uint64_t(142));
+    QCOMPARE(result.tiles.at(1).largestRegion, uint64_t(142));
+    QCOMPARE(result.tiles.at(0).regions, 1);
+    QCOMPARE(result.tiles.at(0).largestRegion, uint64_t(138));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapAnalysis::separateColumns()
+{
+    CMap map(5, 70);
+    map.fillRect(1, 0, 1, 70, 1);
+    map.fillRect(3, 0, 1, 70, 1);
+    const CAnalysisResult result = analyse(map);
+    QCOMPARE(result.tiles.at(1).regions, 2);
+    QCOMPARE(result.tiles.at(1).largestRegion, uint64_t(70));
+    QCOMPARE(result.tiles.at(0).regions, 3);
+    QCOMPARE(result.regionCount, 5);
+}
+
+//-----------------------------------------------------------------------------
+// Few ids on maps several bands high, so regions wind across band borders
+void TestCMapAnalysis::matchesFloodFill()
+{
+    uint32_t seed = 7;
+    auto random = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 16;
+    };
+    for (int round = 0; round < 30; ++round) {
+        CMap map(1 + random() % 60, 1 + random() % 130);
+        const uint32_t ids = 2 + random() % 2;
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, random() % ids);
+        const CAnalysisResult result = analyse(map);
+        const std::map<uint32_t, CTileStats> expected = referenceStats(map);
+        int regions = 0;
+        for (const auto& entry : expected)
+            regions += entry.second.regions;
+        QCOMPARE(result.regionCount, regions);
+        QVERIFY2(sameStats(result.tiles, expected), qPrintable(QString("round %1").arg(round)));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapAnalysis::incremental()
+{
+    CMap map = uShape();
+    CMapAnalysis analysis;
+    QVERIFY(analysis.sync(map));
+    QCOMPARE(analysis.run(false).bandsRelabeled, 3);
+    QVERIFY(!analysis.sync(map));
+    QCOMPARE(analysis.run(false).bandsRelabeled, 0);
+
+    // Cutting the bottom of the U splits id 1 in two
+    map.setTile(1, 69, 0);
+    map.setTile(2, 69, 0);
+    QVERIFY(analysis.sync(map));
+    const CAnalysisResult result = analysis.run(false);
+    QCOMPARE(result.bandsRelabeled, 1);
+    QCOMPARE(result.tiles.at(1).regions, 2);
+    QCOMPARE(result.tiles.at(1).largestRegion, uint64_t(70));
+    QVERIFY(sameStats(result.tiles, analyse(map).tiles));
+
+    // A resize starts over
+    map.resize(4, 40);
+    QVERIFY(analysis.sync(map));
+    QCOMPARE(analysis.run(false).bandCount, 2);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapAnalysis::overlay()
+{
+    const CMap map = uShape();
+    QVERIFY(analyse(map).overlay.isNull());
+    const QImage image = analyse(map, true).overlay;
+    QCOMPARE(image.size(), QSize(map.width(), map.height()));
+    // One colour per region
+    QCOMPARE(image.pixel(0, 0), image.pixel(3, 0));
+    QCOMPARE(image.pixel(1, 0), image.pixel(2, 68));
+    QVERIFY(image.pixel(0, 0) != image.pixel(1, 0));
+}
+
+QTEST_GUILESS_MAIN(TestCMapAnalysis)
+#include "tst_cmapanalysis.moc"
@@ -0,0 +1,254 @@
+#include "CMap.h"
+#include "CMapDiff.h"
+#include "Constants.h"
+
+#include <QtTest>
+
+//-----------------------------------------------------------------------------
+namespace {
+    void paint(CMap& map)
+    {
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, static_cast<uint32_t>((x + y * 3) % 11));
+    }
+
+    bool covered(const QVector<QRect>& regions, int x, int y)
+    {
+        for (const QRect& r : regions) {
+            if (r.contains(x, y))
+                return true;
+        }
+        return false;
+    }
+
+    CMapObject object(const QRect& rect, const QString& type, uint32_t id = 0)
+    {
+        CMapObject obj;
+        obj.id = id;
+        obj.rect = rect;
+        obj.type = type;
+        return obj;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMapDiff : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void identicalMaps();
+    void singleTile();
+    void acrossBlockBorder();
+    void regionsCoverEveryChange();
+    void cellWidthsCompareByValue();
+    void sizeChange();
+    void mergeDisjointEdits();
+    void mergeConflicts();
+    void mergeRejectsSizeMismatch();
+    void mergeObjects();
+};
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::identicalMaps()
+{
+    CMap a(70, 50);
+    paint(a);
+    CMap b(a);
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QVERIFY(diff.isEmpty());
+    QVERIFY(diff.regions.isEmpty());
+    QVERIFY(!diff.sizeChanged);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::singleTile()
+{
+    CMap a(70, 50);
+    paint(a);
+    CMap b(a);
+    b.setTile(33, 47, 99);
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QCOMPARE(diff.changedTiles, size_t(1));
+    QCOMPARE(diff.regions.size(), 1);
+    QCOMPARE(diff.regions.first(), QRect(33, 47, 1, 1));
+}
+
+//-----------------------------------------------------------------------------
+// Neighbouring flagged blocks are joined, then tightened to the tiles
+void TestCMapDiff::acrossBlockBorder()
+{
+    const int border = Constants::DIFF_BLOCK_SIZE;
+    CMap a(70, 50);
+    CMap b(a);
+    b.setTile(border - 1, 5, 1);
+    b.setTile(border, 6, 1);
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QCOMPARE(diff.changedTiles, size_t(2));
+    QCOMPARE(diff.regions.size(), 1);
+    QCOMPARE(diff.regions.first(), QRect(border - 1, 5, 2, 2));
+}
+
+//-----------------------------------------------------------------------------
+// A map size that is not a multiple of the block size, so the edge blocks
+// are partial
+void TestCMapDiff::regionsCoverEveryChange()
+{
+    CMap a(101, 67);
+    paint(a);
+    CMap b(a);
+    size_t changed = 0;
+    uint32_t seed = 12345;
+    for (int i = 0; i < 300; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        const int x = static_cast<int>((seed >> 8) % 101);
+        const int y = static_cast<int>((seed >> 20) % 67);
+        if (b.tileAt(x, y) == a.tileAt(x, y)) {
+            b.setTile(x, y, a.tileAt(x, y) + 20);
+            ++changed;
+        }
+    }
+
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QCOMPARE(diff.changedTiles, changed);
+    const QRect bounds(0, 0, a.width(), a.height());
+    for (const QRect& r : diff.regions)
+        QVERIFY(bounds.contains(r));
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            if (a.tileAt(x, y) != b.tileAt(x, y))
+                QVERIFY2(covered(diff.regions, x, y), qPrintable(QString("%1,%2").arg(x).arg(y)));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::cellWidthsCompareByValue()
+{
+    CMap a(40, 40);
+    paint(a);
+    CMap b(a);
+    b.reserveCellBytes(2);
+    QVERIFY(CMapDiff::diff(a, b).isEmpty());
+
+    b.setTile(3, 3, 300);
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QCOMPARE(diff.changedTiles, size_t(1));
+    QCOMPARE(diff.regions.first(), QRect(3, 3, 1, 1));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::sizeChange()
+{
+    CMap a(10, 10);
+    CMap b(12, 10);
+    b.setTile(4, 4, 1);
+    const CMapDiffResult diff = CMapDiff::diff(a, b);
+    QVERIFY(diff.sizeChanged);
+    QVERIFY(!diff.isEmpty());
+    QCOMPARE(diff.changedTiles, size_t(1 + 2 * 10));
+    QVERIFY(diff.regions.contains(QRect(4, 4, 1, 1)));
+    QVERIFY(diff.regions.contains(QRect(10, 0, 2, 10)));
+
+    const CMapDiffResult taller = CMapDiff::diff(CMap(10, 10), CMap(10, 13));
+    QCOMPARE(taller.changedTiles, size_t(30));
+    QVERIFY(taller.regions.contains(QRect(0, 10, 10, 3)));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::mergeDisjointEdits()
+{
+    CMap base(50, 40);
+    paint(base);
+    CMap ours(base);
+    CMap theirs(base);
+    ours.setTile(1, 1, 90);
+    theirs.setTile(45, 35, 91);
+    theirs.setTile(2, 2, 300);      // wider cells on one side only
+
+    CMapMergeResult result;
+    QVERIFY(CMapDiff::merge(base, ours, theirs, result));
+    QVERIFY(result.isClean());
+    QCOMPARE(result.tilesFromTheirs, size_t(2));
+    QCOMPARE(result.merged.tileAt(1, 1), uint32_t(90));
+    QCOMPARE(result.merged.tileAt(45, 35), uint32_t(91));
+    QCOMPARE(result.merged.tileAt(2, 2), uint32_t(300));
+
+    CMap expected(base);
+    expected.setTile(1, 1, 90);
+    expected.setTile(45, 35, 91);
+    expected.setTile(2, 2, 300);
+    QVERIFY(CMapDiff::diff(result.merged, expected).isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::mergeConflicts()
+{
+    CMap base(50, 40);
+    CMap ours(base);
+    CMap theirs(base);
+    ours.setTile(20, 20, 1);
+    theirs.setTile(20, 20, 2);
+    // The same change on both sides is not a conflict
+    ours.setTile(30, 5, 7);
+    theirs.setTile(30, 5, 7);
+
+    CMapMergeResult result;
+    QVERIFY(CMapDiff::merge(base, ours, theirs, result));
+    QVERIFY(!result.isClean());
+    QCOMPARE(result.conflictTiles, size_t(1));
+    QCOMPARE(result.conflicts.size(), 1);
+    QCOMPARE(result.conflicts.first(), QRect(20, 20, 1, 1));
+    QCOMPARE(result.merged.tileAt(20, 20), uint32_t(1));
+    QCOMPARE(result.merged.tileAt(30, 5), uint32_t(7));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::mergeRejectsSizeMismatch()
+{
+    CMapMergeResult result;
+    QString error;
+    QVERIFY(!CMapDiff::merge(CMap(10, 10), CMap(10, 10), CMap(11, 10), result, &error));
+    QVERIFY(!error.isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapDiff::mergeObjects()
+{
+    CMap base(20, 20);
+    const uint32_t shared = base.objects().add(object(QRect(0, 0, 32, 32), "spawn"));
+    const uint32_t removed = base.objects().add(object(QRect(64, 0, 32, 32), "exit"));
+    CMap ours(base);
+    CMap theirs(base);
+
+    // Both add an object under the same new id: both are kept
+    ours.objects().add(object(QRect(100, 100, 16, 16), "light", 10));
+    theirs.objects().add(object(QRect(200, 200, 16, 16), "trigger", 10));
+    // Theirs deletes one the other side left alone
+    theirs.objects().remove(removed);
+
+    CMapMergeResult result;
+    QVERIFY(CMapDiff::merge(base, ours, theirs, result));
+    QCOMPARE(result.objectConflicts, 0);
+    QCOMPARE(result.merged.objects().count(), 3);
+    QVERIFY(result.merged.objects().object(shared));
+    QVERIFY(!result.merged.objects().object(removed));
+    QCOMPARE(result.merged.objects().object(10)->type, QString("light"));
+    bool renumbered = false;
+    for (const CMapObject& obj : result.merged.objects().objects())
+        renumbered |= obj.type == "trigger" && obj.id != 10;
+    QVERIFY(renumbered);
+
+    // Both change the same object differently: a conflict that keeps ours
+    CMap ours2(base);
+    CMap theirs2(base);
+    ours2.objects().replace(object(QRect(0, 0, 64, 64), "spawn", shared));
+    theirs2.objects().replace(object(QRect(0, 0, 16, 16), "spawn", shared));
+    QVERIFY(CMapDiff::merge(base, ours2, theirs2, result));
+    QCOMPARE(result.objectConflicts, 1);
+    QCOMPARE(result.merged.objects().object(shared)->rect, QRect(0, 0, 64, 64));
+}
+
+QTEST_GUILESS_MAIN(TestCMapDiff)
+#include "tst_cmapdiff.moc"
@@ -0,0 +1,162 @@
+#include "CMap.h"
+#include "CMapHash.h"
+#include "Constants.h"
+
+#include <QByteArray>
+#include <QtTest>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+namespace {
+    QByteArray pattern(int size)
+    {
+        QByteArray bytes(size, '\0');
+        for (int i = 0; i < size; ++i)
+            bytes[i] = static_cast<char>(i * 7 % 251);
+        return bytes;
+    }
+
+    void paint(CMap& map)
+    {
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, static_cast<uint32_t>((x * 3 + y * 5) % 17));
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMapHash : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void referenceVectors();
+    void streamingMatchesOneShot();
+    void equalMapsHashEqual();
+    void editsAreTracked();
+    void cellWidthDoesNotMatter();
+    void sizeAndObjectsCount();
+    void hexRoundTrip();
+};
+
+//-----------------------------------------------------------------------------
+// Digests from the reference xxHash implementation
+void TestCMapHash::referenceVectors()
+{
+    QCOMPARE(CXxHash64::hash("", 0), uint64_t(0xef46db3751d8e999ULL));
+    QCOMPARE(CXxHash64::hash("abc", 3), uint64_t(0x44bc2cf5ad770999ULL));
+
+    const QByteArray data = pattern(1000);
+    QCOMPARE(CXxHash64::hash(data.constData(), data.size()), uint64_t(0x023fd2ed1ff957d5ULL));
+    QCOMPARE(CXxHash64::hash(data.constData(), data.size(), 42), uint64_t(0x72a2dda94eec1e7eULL));
+}
+
+//-----------------------------------------------------------------------------
+// Updates of every size around the 32-byte stripe, including empty ones
+void TestCMapHash::streamingMatchesOneShot()
+{
+    const QByteArray data = pattern(1000);
+    const uint64_t expected = CXxHash64::hash(data.constData(), data.size());
+
+    const int sizes[] = { 1, 3, 0, 31, 32, 33, 64, 100, 5 };
+    CXxHash64 hash;
+    int offset = 0;
+    for (int step = 0; offset < data.size(); ++step) {
+        const int size = std::min(sizes[step % 9], static_cast<int>(data.size()) - offset);
+        hash.update(data.constData() + offset, size);
+        offset += size;
+    }
+    QCOMPARE(hash.digest(), expected);
+    // digest() does not consume the state
+    QCOMPARE(hash.digest(), expected);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapHash::equalMapsHashEqual()
+{
+    CMap a(150, 90);
+    CMap b(150, 90);
+    paint(a);
+    paint(b);
+    QCOMPARE(a.contentHash(), b.contentHash());
+
+    CMap copy(a);
+    QCOMPARE(copy.contentHash(), a.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+// Only the touched chunks are hashed again, so a stale cache would show here
+void TestCMapHash::editsAreTracked()
+{
+    CMap map(150, 90);
+    paint(map);
+    CMapHash hash;
+    const uint64_t before = hash.digest(map);
+    QCOMPARE(hash.chunks().size(), static_cast<size_t>(map.chunksX()) * map.chunksY());
+
+    const uint32_t old = map.tileAt(140, 80);
+    map.setTile(140, 80, old + 1);
+    const uint64_t edited = hash.digest(map);
+    QVERIFY(edited != before);
+    QCOMPARE(CMapHash().digest(map), edited);
+
+    map.setTile(140, 80, old);
+    QCOMPARE(hash.digest(map), before);
+
+    map.fillRect(0, 0, 70, 70, 3);
+    QCOMPARE(hash.digest(map), CMapHash().digest(map));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapHash::cellWidthDoesNotMatter()
+{
+    CMap narrow(100, 100);
+    paint(narrow);
+    CMap wide(narrow);
+    wide.reserveCellBytes(4);
+    QCOMPARE(narrow.cellBytes(), 1);
+    QCOMPARE(wide.cellBytes(), 4);
+    QCOMPARE(CMapHash().digest(wide), CMapHash().digest(narrow));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapHash::sizeAndObjectsCount()
+{
+    QVERIFY(CMapHash().digest(CMap(4, 8)) != CMapHash().digest(CMap(8, 4)));
+
+    CMap map(40, 40);
+    CMapHash hash;
+    const uint64_t empty = hash.digest(map);
+    CMapObject object;
+    object.rect = QRect(10, 10, 20, 20);
+    object.type = Constants::DEFAULT_OBJECT_TYPE;
+    const uint32_t id = map.objects().add(object);
+    const uint64_t withObject = hash.digest(map);
+    QVERIFY(withObject != empty);
+
+    object.id = id;
+    object.properties.insert("radius", 3);
+    map.objects().replace(object);
+    QVERIFY(hash.digest(map) != withObject);
+
+    map.objects().remove(id);
+    QCOMPARE(hash.digest(map), empty);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapHash::hexRoundTrip()
+{
+    const uint64_t value = 0x00f0e1d2c3b4a596ULL;
+    const QString hex = CMapHash::toHex(value);
+    QCOMPARE(hex, QString("00f0e1d2c3b4a596"));
+    uint64_t parsed = 0;
+    QVERIFY(CMapHash::fromHex(hex, parsed));
+    QCOMPARE(parsed, value);
+
+    QVERIFY(!CMapHash::fromHex("f0e1d2c3b4a596", parsed));
+    QVERIFY(!CMapHash::fromHex("00f0e1d2c3b4a59x", parsed));
+    QCOMPARE(parsed, value);
+}
+
+QTEST_GUILESS_MAIN(TestCMapHash)
+#include "tst_cmaphash.moc"
@@ -0,0 +1,231 @@
+#include "CMap.h"
+#include "CMapPack.h"
+#include "Constants.h"
+
+#include <QBuffer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QtTest>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const int CHUNK = 16;
+
+    // 70 x 50 in chunks of 16: chunk (0, 0) empty, chunk (1, 0) uniform and
+    // the partial corner chunk uniform in its map cells only; the rest
+    // patterned with ids that need the given cell width
+    CMap testMap(int cellBytes)
+    {
+        const uint32_t scale = cellBytes == 1 ? 1 : cellBytes == 2 ? 300 : 70000;
+        CMap map(70, 50);
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, static_cast<uint32_t>((x * 7 + y * 13) % 200) * scale);
+        map.fillRect(0, 0, CHUNK, CHUNK, 0);
+        map.fillRect(CHUNK, 0, CHUNK, CHUNK, 5);
+        map.fillRect(4 * CHUNK, 3 * CHUNK, CHUNK, CHUNK, 9);
+        return map;
+    }
+
+    bool readPack(QBuffer& buffer, CMapPackHeader& header, QVector<CMapPackChunk>& index)
+    {
+        if (!CMapPack::readIndex(buffer, header, index))
+            return false;
+        for (CMapPackChunk& chunk : index) {
+            if (chunk.flags & CMapPack::CHUNK_UNIFORM)
+                continue;
+            if (!buffer.seek(chunk.offset))
+                return false;
+            chunk.data = buffer.read(chunk.size);
+        }
+        return true;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMapPack : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void rejectsBadOptions();
+    void rejectsBadInput();
+    void storesObjects();
+};
+
+//-----------------------------------------------------------------------------
+void TestCMapPack::roundTrip_data()
+{
+    QTest::addColumn<int>("cellBytes");
+    QTest::addColumn<int>("level");
+    for (int cellBytes : { 1, 2, 4 }) {
+        QTest::addRow("%d byte cells, raw", cellBytes) << cellBytes << 0;
+        QTest::addRow("%d byte cells, zlib", cellBytes) << cellBytes << 6;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapPack::roundTrip()
+{
+    QFETCH(int, cellBytes);
+    QFETCH(int, level);
+    const CMap map = testMap(cellBytes);
+    QCOMPARE(map.cellBytes(), cellBytes);
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    CMapPackOptions options;
+    options.chunkSize = CHUNK;
+    options.compressionLevel = level;
+    CMapPackStats stats;
+    QString error;
+    QVERIFY2(CMapPack::write(map, buffer, options, &stats, &error), qPrintable(error));
+
+    QCOMPARE(stats.chunks, 20);
+    QCOMPARE(stats.emptyChunks, 1);
+    QCOMPARE(stats.uniformChunks, 2);
+    QCOMPARE(stats.bytes, buffer.size());
+    if (level == 0)
+        QCOMPARE(stats.compressedChunks, 0);
+
+    CMapPackHeader header;
+    QVector<CMapPackChunk> index;
+    QVERIFY(readPack(buffer, header, index));
+    QCOMPARE(header.cellBytes, cellBytes);
+    QCOMPARE(header.width, 70);
+    QCOMPARE(header.height, 50);
+    QCOMPARE(header.chunkSize, CHUNK);
+    QCOMPARE(header.chunksX, 5);
+    QCOMPARE(header.chunksY, 4);
+    QCOMPARE(header.compressed, level > 0);
+    QCOMPARE(header.objectsOffset, qint64(0));
+    QCOMPARE(index.size(), 20);
+
+    QCOMPARE(index[0].flags, quint32(CMapPack::CHUNK_UNIFORM | CMapPack::CHUNK_EMPTY));
+    QCOMPARE(index[1].flags, quint32(CMapPack::CHUNK_UNIFORM));
+    QCOMPARE(index[1].value, quint32(5));
+    QCOMPARE(index[19].flags, quint32(CMapPack::CHUNK_UNIFORM));
+    QCOMPARE(index[19].value, quint32(9));
+    QCOMPARE(index[1].size, quint32(0));
+
+    std::vector<uint32_t> cells(CHUNK * CHUNK);
+    for (int cy = 0; cy < header.chunksY; ++cy) {
+        for (int cx = 0; cx < header.chunksX; ++cx) {
+            const CMapPackChunk& chunk = index[cy * header.chunksX + cx];
+            QVERIFY(CMapPack::decodeChunk(header, chunk, cells.data()));
+            const bool uniform = chunk.flags & CMapPack::CHUNK_UNIFORM;
+            for (int y = 0; y < CHUNK; ++y) {
+                for (int x = 0; x < CHUNK; ++x) {
+                    const int mx = cx * CHUNK + x;
+                    const int my = cy * CHUNK + y;
+                    const bool inside = mx < map.width() && my < map.height();
+                    // Stored chunks are padded with 0 past the map edge
+                    const uint32_t expected = inside ? map.tileAt(mx, my) : uniform ? chunk.value : 0;
+                    QCOMPARE(cells[y * CHUNK + x], expected);
+                }
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapPack::rejectsBadOptions()
+{
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    CMapPackOptions options;
+    QString error;
+
+    options.chunkSize = Constants::PACK_MIN_CHUNK_SIZE / 2;
+    QVERIFY(!CMapPack::write(CMap(10, 10), buffer, options, nullptr, &error));
+    QVERIFY(!error.isEmpty());
+    options.chunkSize = Constants::PACK_MAX_CHUNK_SIZE * 2;
+    QVERIFY(!CMapPack::write(CMap(10, 10), buffer, options));
+
+    options.chunkSize = CHUNK;
+    error.clear();
+    QVERIFY(!CMapPack::write(CMap(), buffer, options, nullptr, &error));
+    QVERIFY(!error.isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapPack::rejectsBadInput()
+{
+    CMapPackHeader header;
+    QVector<CMapPackChunk> index;
+    QString error;
+
+    QByteArray garbage("not a pack at all, just some bytes that are long enough for a header");
+    QBuffer text(&garbage);
+    QVERIFY(text.open(QIODevice::ReadOnly));
+    QVERIFY(!CMapPack::readIndex(text, header, index, &error));
+    QVERIFY(!error.isEmpty());
+
+    QByteArray empty;
+    QBuffer none(&empty);
+    QVERIFY(none.open(QIODevice::ReadOnly));
+    QVERIFY(!CMapPack::readIndex(none, header, index));
+
+    // The last stored chunk runs past the end
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    CMapPackOptions options;
+    options.chunkSize = CHUNK;
+    QVERIFY(CMapPack::write(testMap(1), buffer, options));
+    QByteArray truncated = buffer.data();
+    QVERIFY(readPack(buffer, header, index));
+    truncated.chop(1);
+    QBuffer cut(&truncated);
+    QVERIFY(cut.open(QIODevice::ReadOnly));
+    QVERIFY(!CMapPack::readIndex(cut, header, index));
+
+    // A stored chunk whose bytes do not expand to a full chunk
+    QVERIFY(readPack(buffer, header, index));
+    CMapPackChunk chunk = index[2];
+    QVERIFY(!(chunk.flags & CMapPack::CHUNK_UNIFORM));
+    chunk.data.chop(1);
+    std::vector<uint32_t> cells(CHUNK * CHUNK);
+    QVERIFY(!CMapPack::decodeChunk(header, chunk, cells.data()));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapPack::storesObjects()
+{
+    CMap map(20, 20);
+    CMapObject object;
+    object.rect = QRect(8, 16, 32, 24);
+    object.type = "trigger";
+    object.properties.insert("target", "door");
+    map.objects().add(object);
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    CMapPackOptions options;
+    options.chunkSize = CHUNK;
+    CMapPackStats stats;
+    QVERIFY(CMapPack::write(map, buffer, options, &stats));
+    QCOMPARE(stats.emptyChunks, 4);
+
+    CMapPackHeader header;
+    QVector<CMapPackChunk> index;
+    QVERIFY(CMapPack::readIndex(buffer, header, index));
+    QVERIFY(header.objectsOffset > 0);
+    QCOMPARE(header.objectsOffset + header.objectsSize, buffer.size());
+
+    QVERIFY(buffer.seek(header.objectsOffset));
+    const QJsonDocument doc = QJsonDocument::fromJson(buffer.read(header.objectsSize));
+    QVERIFY(doc.isArray());
+    CObjectLayer layer;
+    QVERIFY(layer.fromJson(doc.array()));
+    QCOMPARE(layer.count(), 1);
+    const CMapObject& read = layer.objects().front();
+    QCOMPARE(read.rect, object.rect);
+    QCOMPARE(read.type, object.type);
+    QCOMPARE(read.properties.value("target").toString(), QString("door"));
+}
+
+QTEST_GUILESS_MAIN(TestCMapPack)
+#include "tst_cmappack.moc"
@@ -0,0 +1,182 @@
+#include "CMap.h"
+#include "CMapSync.h"
+#include "Constants.h"
+
+#include <QDataStream>
+#include <QtTest>
+#include <limits>
+
+//-----------------------------------------------------------------------------
+namespace {
+    struct Rect { qint32 x, y, w, h; };
+
+    // A payload built field by field, so headers encode() never writes can
+    // be tried
+    QByteArray rawPayload(qint32 width, qint32 height, const QVector<Rect>& rects, int tileCount)
+    {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out << quint32(0x4d535943) << quint16(1) << quint32(7) << width << height
+            << static_cast<quint32>(rects.size());
+        for (const Rect& r : rects)
+            out << r.x << r.y << r.w << r.h;
+        for (int i = 0; i < tileCount; ++i)
+            out << quint32(i);
+        return payload;
+    }
+
+    QByteArray unframe(QByteArray packet)
+    {
+        QByteArray payload;
+        return CMapSync::takePacket(packet, payload) && packet.isEmpty() ? payload : QByteArray();
+    }
+
+    CSyncDelta testDelta()
+    {
+        CSyncDelta delta;
+        delta.sequence = 42;
+        delta.width = 40;
+        delta.height = 30;
+        delta.rects = { QRect(0, 0, 3, 2), QRect(37, 28, 3, 2) };
+        for (uint32_t i = 0; i < 12; ++i)
+            delta.tiles.push_back(i * 100000u + 1);
+        return delta;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCMapSync : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void applyResizes();
+    void rejectsBadMapSize_data();
+    void rejectsBadMapSize();
+    void rejectsBadRects_data();
+    void rejectsBadRects();
+    void rejectsWrongTileBytes();
+    void takePacket();
+};
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::roundTrip()
+{
+    const CSyncDelta delta = testDelta();
+    CSyncDelta decoded;
+    QVERIFY(CMapSync::decode(unframe(CMapSync::encode(delta)), decoded));
+    QCOMPARE(decoded.sequence, delta.sequence);
+    QCOMPARE(decoded.width, delta.width);
+    QCOMPARE(decoded.height, delta.height);
+    QCOMPARE(decoded.rects, delta.rects);
+    QCOMPARE(decoded.tiles, delta.tiles);
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::applyResizes()
+{
+    const CSyncDelta delta = testDelta();
+    CMap map(10, 10);
+    map.setTile(1, 5, 9);
+    QVERIFY(CMapSync::apply(map, delta));
+    QCOMPARE(map.width(), 40);
+    QCOMPARE(map.height(), 30);
+    QCOMPARE(map.tileAt(1, 5), 9u);
+    QCOMPARE(map.tileAt(2, 1), delta.tiles[5]);
+    QCOMPARE(map.tileAt(39, 29), delta.tiles[11]);
+    QVERIFY(!CMapSync::apply(map, delta));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::rejectsBadMapSize_data()
+{
+    const qint32 maxInt = std::numeric_limits<qint32>::max();
+    const qint32 maxTiles = Constants::SYNC_MAX_PACKET_BYTES / 4;
+    QTest::addColumn<qint32>("width");
+    QTest::addColumn<qint32>("height");
+    QTest::newRow("zero width") << 0 << 10;
+    QTest::newRow("zero height") << 10 << 0;
+    QTest::newRow("negative") << -5 << 10;
+    QTest::newRow("product overflows") << 65536 << 65536;
+    QTest::newRow("largest") << maxInt << maxInt;
+    QTest::newRow("more than one packet holds") << maxTiles << 2;
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::rejectsBadMapSize()
+{
+    QFETCH(qint32, width);
+    QFETCH(qint32, height);
+    CSyncDelta delta;
+    QVERIFY(!CMapSync::decode(rawPayload(width, height, {}, 0), delta));
+    // A large map the whole of which still fits a packet is fine
+    QVERIFY(CMapSync::decode(rawPayload(Constants::MAX_MAP_WIDTH * 4, Constants::MAX_MAP_HEIGHT, {}, 0), delta));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::rejectsBadRects_data()
+{
+    const qint32 maxInt = std::numeric_limits<qint32>::max();
+    QTest::addColumn<qint32>("x");
+    QTest::addColumn<qint32>("y");
+    QTest::addColumn<qint32>("w");
+    QTest::addColumn<qint32>("h");
+    QTest::newRow("empty") << 0 << 0 << 0 << 1;
+    QTest::newRow("negative origin") << -1 << 0 << 1 << 1;
+    QTest::newRow("past the right") << 18 << 0 << 3 << 1;
+    QTest::newRow("past the bottom") << 0 << 9 << 1 << 2;
+    QTest::newRow("x + w overflows") << maxInt - 1 << 0 << 4 << 1;
+    QTest::newRow("y + h overflows") << 0 << maxInt << 1 << maxInt;
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::rejectsBadRects()
+{
+    QFETCH(qint32, x);
+    QFETCH(qint32, y);
+    QFETCH(qint32, w);
+    QFETCH(qint32, h);
+    CSyncDelta delta;
+    QVERIFY(!CMapSync::decode(rawPayload(20, 10, { { x, y, w, h } }, 4), delta));
+    QVERIFY(CMapSync::decode(rawPayload(20, 10, { { 18, 8, 2, 2 } }, 4), delta));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::rejectsWrongTileBytes()
+{
+    CSyncDelta delta;
+    QVERIFY(!CMapSync::decode(rawPayload(20, 10, { { 0, 0, 2, 2 } }, 3), delta));
+    QVERIFY(!CMapSync::decode(rawPayload(20, 10, { { 0, 0, 2, 2 } }, 5), delta));
+    QByteArray truncated = rawPayload(20, 10, { { 0, 0, 2, 2 } }, 4);
+    truncated.chop(1);
+    QVERIFY(!CMapSync::decode(truncated, delta));
+    QVERIFY(!CMapSync::decode(truncated.left(10), delta));
+    QVERIFY(!CMapSync::decode(QByteArray(), delta));
+}
+
+//-----------------------------------------------------------------------------
+void TestCMapSync::takePacket()
+{
+    const QByteArray packet = CMapSync::encode(testDelta());
+    QByteArray buffer = packet + packet.left(10);
+    QByteArray payload;
+    bool invalid = false;
+    QVERIFY(CMapSync::takePacket(buffer, payload, &invalid));
+    QCOMPARE(payload, packet.mid(4));
+    // The second packet has not fully arrived yet
+    QVERIFY(!CMapSync::takePacket(buffer, payload, &invalid));
+    QVERIFY(!invalid);
+    QCOMPARE(buffer.size(), 10);
+
+    QByteArray oversized;
+    QDataStream out(&oversized, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << static_cast<quint32>(Constants::SYNC_MAX_PACKET_BYTES) + 1;
+    QVERIFY(!CMapSync::takePacket(oversized, payload, &invalid));
+    QVERIFY(invalid);
+}
+
+QTEST_GUILESS_MAIN(TestCMapSync)
+#include "tst_cmapsync.moc"
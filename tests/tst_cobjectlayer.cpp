@@ -0,0 +1,231 @@
+#include "CObjectLayer.h"
+#include "Constants.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QtTest>
+#include <algorithm>
+#include <limits>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const int CELL = Constants::OBJECT_GRID_CELL_SIZE;
+
+    CMapObject makeObject(const QRect& rect, const QString& type = "spawn", uint32_t id = 0)
+    {
+        CMapObject obj;
+        obj.id = id;
+        obj.rect = rect;
+        obj.type = type;
+        return obj;
+    }
+
+    QVector<uint32_t> sorted(QVector<uint32_t> ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    // Every object whose rect, or origin pixel for a point object, meets area
+    QVector<uint32_t> referenceQuery(const CObjectLayer& layer, const QRect& area)
+    {
+        QVector<uint32_t> ids;
+        for (const CMapObject& obj : layer.objects()) {
+            const QRect footprint = obj.rect.isEmpty() ? QRect(obj.rect.topLeft(), QSize(1, 1)) : obj.rect;
+            if (footprint.intersects(area))
+                ids.append(obj.id);
+        }
+        return sorted(ids);
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCObjectLayer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void addRemoveReplace();
+    void pointObjects();
+    void largeObjects();
+    void queryMatchesScan();
+    void hitTestTopmost();
+    void translate();
+    void idsWrap();
+    void jsonRoundTrip();
+};
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::addRemoveReplace()
+{
+    CObjectLayer layer;
+    const uint32_t a = layer.add(makeObject(QRect(10, 10, 20, 20)));
+    const uint32_t b = layer.add(makeObject(QRect(300, 10, 20, 20), "exit"));
+    QCOMPARE(a, uint32_t(1));
+    QCOMPARE(b, uint32_t(2));
+    QCOMPARE(layer.count(), 2);
+
+    // A taken id is replaced by a fresh one
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 4, 4), "light", a)), uint32_t(3));
+
+    CMapObject moved = *layer.object(b);
+    moved.rect.moveTo(2 * CELL + 5, 5);
+    QVERIFY(layer.replace(moved));
+    QVERIFY(layer.query(QRect(300, 10, 20, 20)).isEmpty());
+    QCOMPARE(layer.query(QRect(2 * CELL, 0, 64, 64)), QVector<uint32_t>({ b }));
+    QVERIFY(!layer.replace(makeObject(QRect(0, 0, 1, 1), "spawn", 99)));
+
+    QVERIFY(layer.remove(a));
+    QVERIFY(!layer.remove(a));
+    QVERIFY(!layer.object(a));
+    QCOMPARE(layer.object(b)->type, QString("exit"));
+    QCOMPARE(layer.count(), 2);
+
+    layer.clear();
+    QCOMPARE(layer.count(), 0);
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1))), uint32_t(1));
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::pointObjects()
+{
+    CObjectLayer layer;
+    const uint32_t point = layer.add(makeObject(QRect(CELL + 7, 9, 0, 0)));
+    QVERIFY(point != 0);
+    QCOMPARE(layer.query(QRect(CELL, 0, 16, 16)), QVector<uint32_t>({ point }));
+    QVERIFY(layer.query(QRect(CELL + 8, 0, 16, 16)).isEmpty());
+    QCOMPARE(layer.hitTest(QPoint(CELL + 7, 9)), point);
+    QCOMPARE(layer.hitTest(QPoint(CELL + 8, 9)), uint32_t(0));
+
+    // Editing a point object keeps it a point
+    CMapObject edited = *layer.object(point);
+    edited.properties.insert("team", 2);
+    QVERIFY(layer.replace(edited));
+    QCOMPARE(layer.object(point)->properties.value("team").toInt(), 2);
+
+    QVERIFY(layer.remove(point));
+    QVERIFY(layer.query(QRect(0, 0, 4 * CELL, 4 * CELL)).isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::largeObjects()
+{
+    CObjectLayer layer;
+    const uint32_t huge = layer.add(makeObject(QRect(-1000000, -1000000, 2000000, 2000000), "trigger"));
+    const uint32_t small = layer.add(makeObject(QRect(40, 40, 8, 8)));
+    QCOMPARE(sorted(layer.query(QRect(0, 0, 64, 64))), QVector<uint32_t>({ huge, small }));
+    QCOMPARE(layer.query(QRect(900000, 900000, 4, 4)), QVector<uint32_t>({ huge }));
+    QVERIFY(layer.query(QRect(1000000, 0, 4, 4)).isEmpty());
+    QCOMPARE(layer.hitTest(QPoint(500000, -500000)), huge);
+    QCOMPARE(layer.hitTest(QPoint(41, 41)), small);
+
+    // Shrinking it moves it into the grid
+    CMapObject shrunk = *layer.object(huge);
+    shrunk.rect = QRect(100, 100, 10, 10);
+    QVERIFY(layer.replace(shrunk));
+    QVERIFY(layer.query(QRect(900000, 900000, 4, 4)).isEmpty());
+    QCOMPARE(sorted(layer.query(QRect(0, 0, 256, 256))), QVector<uint32_t>({ huge, small }));
+    QVERIFY(layer.remove(huge));
+    QCOMPARE(layer.query(QRect(0, 0, 256, 256)), QVector<uint32_t>({ small }));
+}
+
+//-----------------------------------------------------------------------------
+// Small and huge query areas take different paths through the index; both
+// must report each intersecting object exactly once
+void TestCObjectLayer::queryMatchesScan()
+{
+    uint32_t seed = 3;
+    auto random = [&seed](int range) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 8) % static_cast<uint32_t>(range));
+    };
+
+    CObjectLayer layer;
+    for (int i = 0; i < 300; ++i) {
+        const int size = i % 50 == 0 ? 20 * CELL : i % 7 == 0 ? 0 : 1 + random(3 * CELL);
+        layer.add(makeObject(QRect(random(40 * CELL) - 20 * CELL, random(40 * CELL) - 20 * CELL, size, size)));
+    }
+    for (int i = 0; i < 200; ++i) {
+        const int size = i % 10 == 0 ? 200 * CELL : 1 + random(6 * CELL);
+        const QRect area(random(50 * CELL) - 25 * CELL, random(50 * CELL) - 25 * CELL, size, size);
+        const QVector<uint32_t> ids = sorted(layer.query(area));
+        QVERIFY2(std::adjacent_find(ids.begin(), ids.end()) == ids.end(), qPrintable(QString("area %1").arg(i)));
+        QCOMPARE(ids, referenceQuery(layer, area));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::hitTestTopmost()
+{
+    CObjectLayer layer;
+    layer.add(makeObject(QRect(0, 0, 100, 100)));
+    const uint32_t top = layer.add(makeObject(QRect(50, 50, 100, 100)));
+    QCOMPARE(layer.hitTest(QPoint(60, 60)), top);
+    QCOMPARE(layer.hitTest(QPoint(10, 10)), uint32_t(1));
+    QCOMPARE(layer.hitTest(QPoint(-5, 10)), uint32_t(0));
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::translate()
+{
+    CObjectLayer layer;
+    const uint32_t box = layer.add(makeObject(QRect(10, 10, 20, 20)));
+    const uint32_t point = layer.add(makeObject(QRect(15, 15, 0, 0)));
+    layer.translate(-3 * CELL, CELL);
+    QCOMPARE(layer.object(box)->rect, QRect(10 - 3 * CELL, 10 + CELL, 20, 20));
+    QVERIFY(layer.query(QRect(0, 0, 64, 64)).isEmpty());
+    QCOMPARE(sorted(layer.query(QRect(-3 * CELL, CELL, 64, 64))), QVector<uint32_t>({ box, point }));
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::idsWrap()
+{
+    const uint32_t last = std::numeric_limits<uint32_t>::max();
+    CObjectLayer layer;
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1), "spawn", 1)), uint32_t(1));
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1), "spawn", last - 1)), last - 1);
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1))), last);
+    // Past the largest id, numbering starts over at the first free one
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1))), uint32_t(2));
+    QCOMPARE(layer.add(makeObject(QRect(0, 0, 1, 1))), uint32_t(3));
+    QCOMPARE(layer.count(), 5);
+}
+
+//-----------------------------------------------------------------------------
+void TestCObjectLayer::jsonRoundTrip()
+{
+    CObjectLayer layer;
+    CMapObject box = makeObject(QRect(8, 16, 32, 24), "trigger", 7);
+    box.properties.insert("target", "door");
+    layer.add(box);
+    layer.add(makeObject(QRect(100, 50, 0, 0), "spawn", 3));
+
+    CObjectLayer read;
+    QVERIFY(read.fromJson(layer.toJson()));
+    QCOMPARE(read.count(), 2);
+    QCOMPARE(read.object(7)->rect, box.rect);
+    QCOMPARE(read.object(7)->properties.value("target").toString(), QString("door"));
+    QCOMPARE(read.object(3)->rect, QRect(100, 50, 0, 0));
+    QCOMPARE(read.query(QRect(96, 48, 8, 8)), QVector<uint32_t>({ 3 }));
+    QCOMPARE(read.add(makeObject(QRect(0, 0, 1, 1))), uint32_t(8));
+
+    // Ids that are missing or out of range get fresh ones
+    QJsonArray arr;
+    QJsonObject o;
+    o["x"] = 1;
+    o["y"] = 2;
+    o["w"] = 3;
+    o["h"] = 4;
+    o["type"] = "light";
+    arr.append(o);
+    o["id"] = qint64(1) << 40;
+    arr.append(o);
+    QVERIFY(read.fromJson(arr));
+    QCOMPARE(sorted(read.query(QRect(0, 0, 8, 8))), QVector<uint32_t>({ 1, 2 }));
+
+    arr.append(QJsonValue(5));
+    QVERIFY(!read.fromJson(arr));
+}
+
+QTEST_GUILESS_MAIN(TestCObjectLayer)
+#include "tst_cobjectlayer.moc"
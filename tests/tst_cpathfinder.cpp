@@ -0,0 +1,257 @@
+#include "CMap.h"
+#include "CPathfinder.h"
+#include "Constants.h"
+
+#include <QtTest>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const uint32_t WALL = 1;
+    const double SQRT2 = std::sqrt(2.0);
+
+    CWalkability grid(const CMap& map)
+    {
+        return CWalkability(map, { WALL });
+    }
+
+    bool cutsCorner(const CWalkability& g, const QPoint& a, int dx, int dy)
+    {
+        return dx && dy && !(g.walkable(a.x() + dx, a.y()) && g.walkable(a.x(), a.y() + dy));
+    }
+
+    // Plain Dijkstra over the same moves, -1 if the goal is unreachable
+    double referenceLength(const CWalkability& g, const QPoint& start, const QPoint& goal)
+    {
+        if (!g.walkable(start.x(), start.y()) || !g.walkable(goal.x(), goal.y()))
+            return -1.0;
+        const int w = g.width();
+        std::vector<double> dist(static_cast<size_t>(w) * g.height(), -1.0);
+        using Entry = std::pair<double, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        dist[start.y() * w + start.x()] = 0.0;
+        open.push({ 0.0, start.y() * w + start.x() });
+        while (!open.empty()) {
+            const Entry entry = open.top();
+            open.pop();
+            if (entry.first > dist[entry.second])
+                continue;
+            const QPoint p(entry.second % w, entry.second / w);
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if ((!dx && !dy) || !g.walkable(p.x() + dx, p.y() + dy) || cutsCorner(g, p, dx, dy))
+                        continue;
+                    const int next = (p.y() + dy) * w + p.x() + dx;
+                    const double cost = entry.first + (dx && dy ? SQRT2 : 1.0);
+                    if (dist[next] < 0 || cost < dist[next] - 1e-12) {
+                        dist[next] = cost;
+                        open.push({ cost, next });
+                    }
+                }
+            }
+        }
+        return dist[goal.y() * w + goal.x()];
+    }
+
+    // Every step goes to a walkable neighbour without cutting a corner, and
+    // the steps add up to the reported length
+    bool validPath(const CWalkability& g, const CPathResult& result, const QPoint& start, const QPoint& goal)
+    {
+        if (result.path.isEmpty() || result.path.first() != start || result.path.last() != goal)
+            return false;
+        double length = 0.0;
+        for (int i = 1; i < result.path.size(); ++i) {
+            const QPoint a = result.path[i - 1];
+            const int dx = result.path[i].x() - a.x();
+            const int dy = result.path[i].y() - a.y();
+            if (std::abs(dx) > 1 || std::abs(dy) > 1 || (!dx && !dy))
+                return false;
+            if (!g.walkable(a.x() + dx, a.y() + dy) || cutsCorner(g, a, dx, dy))
+                return false;
+            length += dx && dy ? SQRT2 : 1.0;
+        }
+        return std::abs(length - result.length) < 1e-9;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCPathfinder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void openDiagonal();
+    void sameTile();
+    void blockedEndpoints();
+    void wall();
+    void noCornerCutting();
+    void matchesDijkstra();
+    void allPairs();
+    void markerTiles();
+    void parseIdList();
+};
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::openDiagonal()
+{
+    CMap map(10, 10);
+    const CWalkability g = grid(map);
+    const CPathResult result = CPathfinder(g).findPath(QPoint(0, 0), QPoint(9, 9));
+    QVERIFY(result.reachable);
+    QCOMPARE(result.path.size(), 10);
+    QVERIFY(qFuzzyCompare(result.length, 9 * SQRT2));
+    QVERIFY(validPath(g, result, QPoint(0, 0), QPoint(9, 9)));
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::sameTile()
+{
+    CMap map(5, 5);
+    const CWalkability g = grid(map);
+    const CPathResult result = CPathfinder(g).findPath(QPoint(2, 3), QPoint(2, 3));
+    QVERIFY(result.reachable);
+    QCOMPARE(result.length, 0.0);
+    QCOMPARE(result.path, QVector<QPoint>({ QPoint(2, 3) }));
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::blockedEndpoints()
+{
+    CMap map(5, 5);
+    map.setTile(4, 4, WALL);
+    const CWalkability g = grid(map);
+    CPathfinder finder(g);
+    QVERIFY(!finder.findPath(QPoint(0, 0), QPoint(4, 4)).reachable);
+    QVERIFY(!finder.findPath(QPoint(4, 4), QPoint(0, 0)).reachable);
+    QVERIFY(!finder.findPath(QPoint(-1, 0), QPoint(0, 0)).reachable);
+    QVERIFY(!finder.findPath(QPoint(0, 0), QPoint(5, 0)).reachable);
+    QVERIFY(finder.findPath(QPoint(0, 0), QPoint(4, 4)).path.isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::wall()
+{
+    CMap map(10, 10);
+    map.fillRect(5, 0, 1, 10, WALL);
+    QVERIFY(!CPathfinder(grid(map)).findPath(QPoint(0, 0), QPoint(9, 0)).reachable);
+
+    map.setTile(5, 9, 0);
+    const CWalkability g = grid(map);
+    const CPathResult result = CPathfinder(g).findPath(QPoint(0, 0), QPoint(9, 0));
+    QVERIFY(result.reachable);
+    QVERIFY(result.path.contains(QPoint(5, 9)));
+    QVERIFY(validPath(g, result, QPoint(0, 0), QPoint(9, 0)));
+    QVERIFY(qFuzzyCompare(result.length, referenceLength(g, QPoint(0, 0), QPoint(9, 0))));
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::noCornerCutting()
+{
+    CMap map(3, 3);
+    map.setTile(1, 0, WALL);
+    const CPathResult around = CPathfinder(grid(map)).findPath(QPoint(0, 0), QPoint(1, 1));
+    QVERIFY(around.reachable);
+    QCOMPARE(around.length, 2.0);
+    QCOMPARE(around.path, QVector<QPoint>({ QPoint(0, 0), QPoint(0, 1), QPoint(1, 1) }));
+
+    // Walled in on both sides: the diagonal squeezes between two corners
+    map.setTile(0, 1, WALL);
+    QVERIFY(!CPathfinder(grid(map)).findPath(QPoint(0, 0), QPoint(1, 1)).reachable);
+}
+
+//-----------------------------------------------------------------------------
+// Random grids of varying density; jump point search must find paths exactly
+// as short as a full search does
+void TestCPathfinder::matchesDijkstra()
+{
+    uint32_t seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 16;
+    };
+
+    int reachable = 0;
+    for (int round = 0; round < 40; ++round) {
+        CMap map(20 + random() % 40, 20 + random() % 40);
+        const uint32_t density = 15 + random() % 25;
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, random() % 100 < density ? WALL : 0);
+        const CWalkability g = grid(map);
+        CPathfinder finder(g);
+
+        for (int i = 0; i < 25; ++i) {
+            const QPoint start(random() % map.width(), random() % map.height());
+            const QPoint goal(random() % map.width(), random() % map.height());
+            const double expected = referenceLength(g, start, goal);
+            const CPathResult result = finder.findPath(start, goal);
+            const QByteArray where = QString("round %1, (%2,%3) to (%4,%5)").arg(round)
+                .arg(start.x()).arg(start.y()).arg(goal.x()).arg(goal.y()).toLatin1();
+            QVERIFY2(result.reachable == (expected >= 0), where.constData());
+            if (!result.reachable)
+                continue;
+            ++reachable;
+            QVERIFY2(std::abs(result.length - expected) < 1e-9, where.constData());
+            QVERIFY2(validPath(g, result, start, goal), where.constData());
+        }
+    }
+    QVERIFY(reachable > 100);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::allPairs()
+{
+    CMap map(20, 10);
+    map.fillRect(10, 0, 1, 10, WALL);
+    const CWalkability g = grid(map);
+    const QVector<QPoint> points = { QPoint(1, 1), QPoint(5, 8), QPoint(15, 2), QPoint(10, 4) };
+    const QVector<CPathResult> results = CPathfinder::checkAllPairs(g, points);
+
+    QCOMPARE(results.size(), 6);
+    for (const CPathResult& r : results) {
+        const bool sameRoom = r.from == 0 && r.to == 1;
+        QCOMPARE(r.reachable, sameRoom);
+        if (sameRoom) {
+            QVERIFY(validPath(g, r, points[0], points[1]));
+            QVERIFY(qFuzzyCompare(r.length, referenceLength(g, points[0], points[1])));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::markerTiles()
+{
+    const int ts = Constants::DEFAULT_TILE_SIZE;
+    CMap map(10, 10);
+    CMapObject spawn;
+    spawn.rect = QRect(2 * ts + 4, 3 * ts + 4, 8, 8);
+    spawn.type = "spawn";
+    const uint32_t spawnId = map.objects().add(spawn);
+    CMapObject light;
+    light.rect = QRect(0, 0, 8, 8);
+    light.type = "light";
+    map.objects().add(light);
+
+    QVector<uint32_t> ids;
+    QCOMPARE(CPathfinder::markerTiles(map, { "spawn" }, &ids), QVector<QPoint>({ QPoint(2, 3) }));
+    QCOMPARE(ids, QVector<uint32_t>({ spawnId }));
+    QCOMPARE(CPathfinder::markerTiles(map, { "spawn", "light" }).size(), 2);
+    QVERIFY(CPathfinder::markerTiles(map, { "exit" }).isEmpty());
+}
+
+//-----------------------------------------------------------------------------
+void TestCPathfinder::parseIdList()
+{
+    QCOMPARE(CPathfinder::parseIdList("1, 4, 10-12"), QSet<uint32_t>({ 1, 4, 10, 11, 12 }));
+    QCOMPARE(CPathfinder::parseIdList("7 - 8,7"), QSet<uint32_t>({ 7, 8 }));
+    QVERIFY(CPathfinder::parseIdList("").isEmpty());
+    QVERIFY(CPathfinder::parseIdList("5-3").isEmpty());
+    // Ids stop at 65535
+    QCOMPARE(CPathfinder::parseIdList("65534-70000"), QSet<uint32_t>({ 65534, 65535 }));
+}
+
+QTEST_GUILESS_MAIN(TestCPathfinder)
+#include "tst_cpathfinder.moc"
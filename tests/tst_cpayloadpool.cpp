@@ -0,0 +1,277 @@
+#include "CPayloadPool.h"
+#include "Constants.h"
+
+#include <QtTest>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    const size_t MB = 1024 * 1024;
+
+    size_t capacityFor(size_t bytes)
+    {
+        size_t capacity = 0;
+        void* block = CPayloadPool::allocate(bytes, CAllocStats::SCRATCH, &capacity);
+        CPayloadPool::release(block, capacity, CAllocStats::SCRATCH);
+        return capacity;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// The pool is process-wide, so every test starts from an empty cache and
+// zeroed counters and compares live bytes against where it started
+class TestCPayloadPool : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void sizeClasses();
+    void reusesFreedBlocks();
+    void oversizedBlocksAreNotCached();
+    void cacheIsCapped();
+    void liveBytes();
+    void resetKeepsLiveBytes();
+    void recordAndSummary();
+    void pooledArray();
+    void pooledArrayOfOddSize();
+    void threads();
+};
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::init()
+{
+    CPayloadPool::trim();
+    CAllocStats::reset();
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::cleanup()
+{
+    CPayloadPool::trim();
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::sizeClasses()
+{
+    const size_t smallest = static_cast<size_t>(Constants::ALLOC_POOL_MIN_BLOCK);
+    const size_t largest = static_cast<size_t>(Constants::ALLOC_POOL_MAX_BLOCK);
+    QCOMPARE(capacityFor(0), smallest);
+    QCOMPARE(capacityFor(1), smallest);
+    QCOMPARE(capacityFor(smallest), smallest);
+    QCOMPARE(capacityFor(smallest + 1), 2 * smallest);
+    QCOMPARE(capacityFor(1000), size_t(1024));
+    QCOMPARE(capacityFor(largest), largest);
+    // Too large to pool: exactly what was asked for
+    QCOMPARE(capacityFor(largest + 1), largest + 1);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::reusesFreedBlocks()
+{
+    size_t capacity = 0;
+    void* block = CPayloadPool::allocate(100, CAllocStats::UNDO_PAYLOAD, &capacity);
+    QCOMPARE(capacity, size_t(128));
+    CPayloadPool::release(block, capacity, CAllocStats::UNDO_PAYLOAD);
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(128));
+
+    // Any size of the same class gets the cached block
+    CAllocStats::reset();
+    size_t again = 0;
+    void* reused = CPayloadPool::allocate(120, CAllocStats::UNDO_PAYLOAD, &again);
+    QCOMPARE(reused, block);
+    QCOMPARE(again, capacity);
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(0));
+    const CAllocStats::Counters counters = CAllocStats::counters(CAllocStats::UNDO_PAYLOAD);
+    QCOMPARE(counters.allocations, qint64(0));
+    QCOMPARE(counters.bytes, qint64(0));
+    QCOMPARE(counters.reused, qint64(1));
+
+    // A different class does not
+    size_t other = 0;
+    void* fresh = CPayloadPool::allocate(300, CAllocStats::UNDO_PAYLOAD, &other);
+    QCOMPARE(CAllocStats::counters(CAllocStats::UNDO_PAYLOAD).allocations, qint64(1));
+    CPayloadPool::release(fresh, other, CAllocStats::UNDO_PAYLOAD);
+    CPayloadPool::release(reused, again, CAllocStats::UNDO_PAYLOAD);
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(512 + 128));
+
+    CPayloadPool::trim();
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(0));
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::oversizedBlocksAreNotCached()
+{
+    const size_t bytes = static_cast<size_t>(Constants::ALLOC_POOL_MAX_BLOCK) + 1;
+    size_t capacity = 0;
+    void* block = CPayloadPool::allocate(bytes, CAllocStats::SCRATCH, &capacity);
+    CPayloadPool::release(block, capacity, CAllocStats::SCRATCH);
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(0));
+
+    block = CPayloadPool::allocate(bytes, CAllocStats::SCRATCH, &capacity);
+    const CAllocStats::Counters counters = CAllocStats::counters(CAllocStats::SCRATCH);
+    QCOMPARE(counters.allocations, qint64(2));
+    QCOMPARE(counters.reused, qint64(0));
+    CPayloadPool::release(block, capacity, CAllocStats::SCRATCH);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::cacheIsCapped()
+{
+    const qint64 cap = Constants::ALLOC_POOL_CACHE_MB * 1024 * 1024;
+    const int count = static_cast<int>(cap / MB) + 4;
+    std::vector<void*> blocks;
+    size_t capacity = 0;
+    for (int i = 0; i < count; ++i)
+        blocks.push_back(CPayloadPool::allocate(MB, CAllocStats::SCRATCH, &capacity));
+    QCOMPARE(capacity, MB);
+    for (void* block : blocks)
+        CPayloadPool::release(block, capacity, CAllocStats::SCRATCH);
+    QCOMPARE(CPayloadPool::cachedBytes(), cap);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::liveBytes()
+{
+    const qint64 before = CAllocStats::counters(CAllocStats::SCRATCH).liveBytes;
+    size_t a = 0, b = 0;
+    void* first = CPayloadPool::allocate(100, CAllocStats::SCRATCH, &a);
+    void* second = CPayloadPool::allocate(5000, CAllocStats::SCRATCH, &b);
+    QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).liveBytes, before + 128 + 8192);
+    CPayloadPool::release(first, a, CAllocStats::SCRATCH);
+    QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).liveBytes, before + 8192);
+    CPayloadPool::release(second, b, CAllocStats::SCRATCH);
+    QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).liveBytes, before);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::resetKeepsLiveBytes()
+{
+    const qint64 before = CAllocStats::counters(CAllocStats::UNDO_PAYLOAD).liveBytes;
+    size_t capacity = 0;
+    void* block = CPayloadPool::allocate(64, CAllocStats::UNDO_PAYLOAD, &capacity);
+    CAllocStats::reset();
+    const CAllocStats::Counters counters = CAllocStats::counters(CAllocStats::UNDO_PAYLOAD);
+    QCOMPARE(counters.allocations, qint64(0));
+    QCOMPARE(counters.bytes, qint64(0));
+    QCOMPARE(counters.liveBytes, before + 64);
+    CPayloadPool::release(block, capacity, CAllocStats::UNDO_PAYLOAD);
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::recordAndSummary()
+{
+    CAllocStats::record(CAllocStats::SCRATCH, 500);
+    CAllocStats::record(CAllocStats::SCRATCH, 2048);
+    const CAllocStats::Counters scratch = CAllocStats::counters(CAllocStats::SCRATCH);
+    QCOMPARE(scratch.allocations, qint64(2));
+    QCOMPARE(scratch.bytes, qint64(2548));
+    QCOMPARE(CAllocStats::counters(CAllocStats::UNDO_PAYLOAD).allocations, qint64(0));
+
+    const QString summary = CAllocStats::summary();
+    QVERIFY(summary.contains("undo payload: 0 allocations"));
+    QVERIFY(summary.contains("scratch: 2 allocations (2 KB)"));
+}
+
+//-----------------------------------------------------------------------------
+void TestCPayloadPool::pooledArray()
+{
+    CPooledArray<uint32_t> array(CAllocStats::SCRATCH);
+    QVERIFY(array.isEmpty());
+    QVERIFY(!array.data());
+    for (uint32_t i = 0; i < 1000; ++i)
+        array.append(i * 3);
+    QCOMPARE(array.size(), size_t(1000));
+    QVERIFY(array.capacity() >= 1000);
+    for (uint32_t i = 0; i < 1000; ++i)
+        QCOMPARE(array[i], i * 3);
+    QCOMPARE(array.takeLast(), uint32_t(999 * 3));
+
+    // A cleared array keeps its block, so refilling it allocates nothing
+    const size_t capacity = array.capacity();
+    array.clear();
+    QCOMPARE(array.capacity(), capacity);
+    CAllocStats::reset();
+    for (uint32_t i = 0; i < 1000; ++i)
+        array.append(i);
+    QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).allocations, qint64(0));
+
+    CPooledArray<uint32_t> moved(std::move(array));
+    QCOMPARE(moved.size(), size_t(1000));
+    QCOMPARE(moved[999], uint32_t(999));
+    QVERIFY(!array.data());
+    QCOMPARE(array.size(), size_t(0));
+
+    array = std::move(moved);
+    QCOMPARE(array.size(), size_t(1000));
+    QVERIFY(!moved.data());
+
+    // Freed with the array, then handed to the next one of its class
+    const void* block = array.data();
+    const size_t bytes = array.capacity() * sizeof(uint32_t);
+    array = CPooledArray<uint32_t>(CAllocStats::SCRATCH);
+    CPooledArray<uint32_t> next(CAllocStats::SCRATCH);
+    next.resize(bytes / sizeof(uint32_t));
+    QCOMPARE(static_cast<const void*>(next.data()), block);
+}
+
+//-----------------------------------------------------------------------------
+// Twelve bytes do not divide a size class, so the array must give its block
+// back at the size it was handed out with
+void TestCPayloadPool::pooledArrayOfOddSize()
+{
+    struct Cell { uint32_t x, y, value; };
+    const qint64 before = CAllocStats::counters(CAllocStats::SCRATCH).liveBytes;
+    {
+        CPooledArray<Cell> array(CAllocStats::SCRATCH);
+        for (uint32_t i = 0; i < 500; ++i)
+            array.append({ i, i + 1, i + 2 });
+        QCOMPARE(array.capacity(), size_t(8192 / sizeof(Cell)));
+        QCOMPARE(array[499].value, uint32_t(501));
+        QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).liveBytes, before + 8192);
+    }
+    QCOMPARE(CAllocStats::counters(CAllocStats::SCRATCH).liveBytes, before);
+    QCOMPARE(CPayloadPool::cachedBytes(), qint64(8192 + 4096 + 2048 + 1024 + 512 + 256 + 128 + 64));
+}
+
+//-----------------------------------------------------------------------------
+// Threads allocating and freeing mixed sizes must leave the books balanced
+void TestCPayloadPool::threads()
+{
+    const qint64 before = CAllocStats::counters(CAllocStats::SCRATCH).liveBytes;
+    const int threadCount = 4;
+    const int rounds = 5000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([t]() {
+            uint32_t seed = 17u + t;
+            std::vector<std::pair<void*, size_t>> held;
+            for (int i = 0; i < rounds; ++i) {
+                seed = seed * 1103515245u + 12345u;
+                if (held.size() < 16 && (seed >> 30) != 0) {
+                    size_t capacity = 0;
+                    void* block = CPayloadPool::allocate((seed >> 8) % 100000, CAllocStats::SCRATCH, &capacity);
+                    static_cast<char*>(block)[0] = static_cast<char>(t);
+                    held.emplace_back(block, capacity);
+                } else if (!held.empty()) {
+                    CPayloadPool::release(held.back().first, held.back().second, CAllocStats::SCRATCH);
+                    held.pop_back();
+                }
+            }
+            for (const auto& entry : held)
+                CPayloadPool::release(entry.first, entry.second, CAllocStats::SCRATCH);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    const CAllocStats::Counters counters = CAllocStats::counters(CAllocStats::SCRATCH);
+    QCOMPARE(counters.liveBytes, before);
+    QVERIFY(counters.reused > 0);
+    QVERIFY(CPayloadPool::cachedBytes() <= Constants::ALLOC_POOL_CACHE_MB * 1024 * 1024);
+}
+
+QTEST_GUILESS_MAIN(TestCPayloadPool)
+#include "tst_cpayloadpool.moc"
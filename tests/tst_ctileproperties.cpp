@@ -0,0 +1,175 @@
+#include "CMap.h"
+#include "CTileProperties.h"
+#include "Constants.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QtTest>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Solid: 2 and 300; water: 3 and 300. Ids past the table count as nothing.
+    CTileProperties testProperties()
+    {
+        CTileProperties properties;
+        properties.setFlags(2, CTileProperties::FLAG_SOLID);
+        properties.setFlags(3, CTileProperties::FLAG_WATER);
+        properties.setFlags(300, CTileProperties::FLAG_SOLID | CTileProperties::FLAG_WATER);
+        return properties;
+    }
+
+    // 67 x 5, so rows do not line up with mask words; the largest id decides
+    // the cell width
+    CMap testMap(uint32_t largest)
+    {
+        CMap map(67, 5);
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, static_cast<uint32_t>((x * 7 + y * 3) % 5));
+        map.setTile(66, 4, largest);
+        map.setTile(10, 1, largest);
+        return map;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCTileProperties : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void columns();
+    void masks_data();
+    void masks();
+    void jsonRoundTrip();
+    void keepsIdsPastTheTileset();
+    void rejectsBadIds();
+};
+
+//-----------------------------------------------------------------------------
+void TestCTileProperties::columns()
+{
+    CTileProperties properties;
+    QCOMPARE(properties.size(), 0);
+    QCOMPARE(properties.flags(5), uint8_t(0));
+    QCOMPARE(properties.cost(5), 1.0f);
+    properties.setDamage(5, 12);
+    QCOMPARE(properties.size(), 6);
+    QCOMPARE(properties.damage(5), 12);
+    QCOMPARE(properties.cost(5), 1.0f);
+    properties.setCost(2, 3.5f);
+    QCOMPARE(properties.cost(2), 3.5f);
+    QCOMPARE(properties.size(), 6);
+    properties.clear();
+    QCOMPARE(properties.damage(5), 0);
+}
+
+//-----------------------------------------------------------------------------
+void TestCTileProperties::masks_data()
+{
+    QTest::addColumn<uint>("largest");
+    QTest::addRow("1 byte cells") << 200u;
+    QTest::addRow("2 byte cells") << 300u;
+    QTest::addRow("4 byte cells") << 70000u;
+}
+
+//-----------------------------------------------------------------------------
+// The lookup table scans must agree with asking per tile
+void TestCTileProperties::masks()
+{
+    QFETCH(uint, largest);
+    const CMap map = testMap(largest);
+    const CTileProperties properties = testProperties();
+    QCOMPARE(map.cellBytes(), cellBytesFor(largest));
+
+    std::vector<uint8_t> water;
+    std::vector<uint64_t> solid;
+    properties.markFlag(map, CTileProperties::FLAG_WATER, water);
+    properties.collisionMask(map, solid);
+    QCOMPARE(water.size(), map.tileCount());
+    QCOMPARE(solid.size(), (map.tileCount() + 63) / 64);
+
+    size_t solidCount = 0;
+    for (int y = 0; y < map.height(); ++y) {
+        for (int x = 0; x < map.width(); ++x) {
+            const size_t i = static_cast<size_t>(y) * map.width() + x;
+            const uint8_t flags = properties.flags(map.tileAt(x, y));
+            const bool isSolid = flags & CTileProperties::FLAG_SOLID;
+            QCOMPARE(water[i], uint8_t((flags & CTileProperties::FLAG_WATER) ? 1 : 0));
+            QCOMPARE(bool((solid[i / 64] >> (i % 64)) & 1), isSolid);
+            solidCount += isSolid;
+        }
+    }
+    // Bits past the last tile stay clear
+    QCOMPARE(solid.back() >> (map.tileCount() % 64), uint64_t(0));
+    QCOMPARE(properties.countFlag(map, CTileProperties::FLAG_SOLID), solidCount);
+    QVERIFY(properties.countFlag(map, CTileProperties::FLAG_WATER) > 0);
+}
+
+//-----------------------------------------------------------------------------
+void TestCTileProperties::jsonRoundTrip()
+{
+    CTileProperties properties = testProperties();
+    properties.setDamage(3, 7);
+    properties.setCost(4, 2.5f);
+
+    CTileProperties read;
+    QVERIFY(read.fromJson(properties.toJson()));
+    QCOMPARE(read.size(), properties.size());
+    for (uint32_t id = 0; id < static_cast<uint32_t>(properties.size()); ++id) {
+        QCOMPARE(read.flags(id), properties.flags(id));
+        QCOMPARE(read.damage(id), properties.damage(id));
+        QCOMPARE(read.cost(id), properties.cost(id));
+    }
+    // Only ids that differ from the defaults are written
+    QCOMPARE(properties.toJson()["tiles"].toArray().size(), 4);
+}
+
+//-----------------------------------------------------------------------------
+// A sidecar written for a larger tileset loads whole; lookups past the table
+// read as defaults
+void TestCTileProperties::keepsIdsPastTheTileset()
+{
+    QJsonObject tile;
+    tile["id"] = Constants::MAX_PALETTE_TILE_COUNT + 50;
+    tile["solid"] = true;
+    QJsonObject obj;
+    obj["count"] = 2;
+    obj["tiles"] = QJsonArray({ tile });
+
+    CTileProperties properties;
+    QVERIFY(properties.fromJson(obj));
+    QCOMPARE(properties.size(), Constants::MAX_PALETTE_TILE_COUNT + 51);
+    QCOMPARE(properties.flags(Constants::MAX_PALETTE_TILE_COUNT + 50), uint8_t(CTileProperties::FLAG_SOLID));
+    QCOMPARE(properties.flags(100000), uint8_t(0));
+
+    // A count larger than any id is bounded
+    obj["count"] = 1 << 30;
+    QVERIFY(properties.fromJson(obj));
+    QCOMPARE(properties.size(), Constants::MAX_TILE_PROPERTY_ID + 1);
+}
+
+//-----------------------------------------------------------------------------
+void TestCTileProperties::rejectsBadIds()
+{
+    CTileProperties properties;
+    QVERIFY(!properties.fromJson(QJsonObject()));
+
+    QJsonObject tile;
+    QJsonObject obj;
+    tile["id"] = -1;
+    obj["tiles"] = QJsonArray({ tile });
+    QVERIFY(!properties.fromJson(obj));
+
+    tile["id"] = Constants::MAX_TILE_PROPERTY_ID + 1;
+    obj["tiles"] = QJsonArray({ tile });
+    QVERIFY(!properties.fromJson(obj));
+
+    tile["id"] = Constants::MAX_TILE_PROPERTY_ID;
+    obj["tiles"] = QJsonArray({ tile });
+    QVERIFY(properties.fromJson(obj));
+}
+
+QTEST_GUILESS_MAIN(TestCTileProperties)
+#include "tst_ctileproperties.moc"
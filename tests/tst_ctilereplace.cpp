@@ -0,0 +1,141 @@
+#include "CMap.h"
+#include "CTileReplace.h"
+#include "Constants.h"
+
+#include <QtTest>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Ids 0 to 9, wider than one mask word and tall enough for several bands
+    CMap testMap()
+    {
+        CMap map(150, 3 * Constants::PARALLEL_MIN_ROWS + 5);
+        for (int y = 0; y < map.height(); ++y)
+            for (int x = 0; x < map.width(); ++x)
+                map.setTile(x, y, static_cast<uint32_t>((x + 3 * y) % 10));
+        return map;
+    }
+
+    // Applies mapping by hand inside area, returning the tiles changed
+    size_t expected(CMap& map, const QMap<uint32_t, uint32_t>& mapping, const QRect& area)
+    {
+        size_t changed = 0;
+        const QRect clipped = area.intersected(QRect(0, 0, map.width(), map.height()));
+        for (int y = clipped.top(); y <= clipped.bottom(); ++y) {
+            for (int x = clipped.left(); x <= clipped.right(); ++x) {
+                const uint32_t id = map.tileAt(x, y);
+                const uint32_t to = mapping.value(id, id);
+                if (to != id) {
+                    map.setTile(x, y, to);
+                    ++changed;
+                }
+            }
+        }
+        return changed;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCTileReplace : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void single();
+    void table();
+    void tableWithLargeIds();
+    void promotesCells();
+    void nothingToDo();
+};
+
+//-----------------------------------------------------------------------------
+void TestCTileReplace::single()
+{
+    CMap map = testMap();
+    const CMap original = testMap();
+    CMap reference = testMap();
+    const QRect area(10, 20, 100, 150);
+
+    CTileReplace replace = CTileReplace::single(4, 7);
+    const size_t changed = replace.apply(map, area);
+    QCOMPARE(changed, expected(reference, { { 4, 7 } }, area));
+    QCOMPARE(replace.changedCount(), changed);
+    QCOMPARE(map.contentHash(), reference.contentHash());
+    QCOMPARE(map.tileAt(4, 0), 4u);
+
+    replace.revert(map);
+    QCOMPARE(map.contentHash(), original.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+// Swaps and chains apply once, from the original ids
+void TestCTileReplace::table()
+{
+    CMap map = testMap();
+    const CMap original = testMap();
+    CMap reference = testMap();
+    const QMap<uint32_t, uint32_t> mapping = { { 1, 2 }, { 2, 1 }, { 3, 4 }, { 4, 5 } };
+    const QRect area(-5, -5, 200, 1000);
+
+    CTileReplace replace = CTileReplace::table(mapping);
+    QCOMPARE(replace.apply(map, area), expected(reference, mapping, area));
+    QCOMPARE(map.contentHash(), reference.contentHash());
+    replace.revert(map);
+    QCOMPARE(map.contentHash(), original.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+// Keys past the lookup table are found by search, so any id can be mapped
+// without a table that size
+void TestCTileReplace::tableWithLargeIds()
+{
+    const uint32_t huge = 4000000000u;
+    CMap map = testMap();
+    map.setTile(0, 0, huge);
+    map.setTile(5, 5, 70000);
+    const CMap original = map;
+    CMap reference = map;
+    const QMap<uint32_t, uint32_t> mapping = { { 2, 90000 }, { 70000, 3 }, { huge, 1 } };
+    const QRect area(0, 0, map.width(), map.height());
+
+    CTileReplace replace = CTileReplace::table(mapping);
+    QVERIFY(replace.byteSize() < 2 * Constants::REPLACE_MAX_LUT_SIZE * sizeof(uint32_t) + 4096);
+    QCOMPARE(replace.apply(map, area), expected(reference, mapping, area));
+    QCOMPARE(map.tileAt(0, 0), 1u);
+    QCOMPARE(map.tileAt(5, 5), 3u);
+    QCOMPARE(map.contentHash(), reference.contentHash());
+    replace.revert(map);
+    QCOMPARE(map.contentHash(), original.contentHash());
+}
+
+//-----------------------------------------------------------------------------
+void TestCTileReplace::promotesCells()
+{
+    CMap map = testMap();
+    const CMap original = testMap();
+    QCOMPARE(map.cellBytes(), 1);
+    CTileReplace replace = CTileReplace::single(9, 300);
+    QVERIFY(replace.apply(map, QRect(0, 0, 20, 20)) > 0);
+    QCOMPARE(map.cellBytes(), 2);
+    QCOMPARE(map.tileAt(9, 0), 300u);
+
+    // Undo restores the ids; the cells stay wide
+    replace.revert(map);
+    QCOMPARE(map.contentHash(), original.contentHash());
+    QCOMPARE(map.cellBytes(), 2);
+}
+
+//-----------------------------------------------------------------------------
+void TestCTileReplace::nothingToDo()
+{
+    CMap map = testMap();
+    const uint64_t revision = map.revision();
+    QCOMPARE(CTileReplace::single(3, 3).apply(map, QRect(0, 0, 50, 50)), size_t(0));
+    QCOMPARE(CTileReplace::single(42, 1).apply(map, QRect(0, 0, 50, 50)), size_t(0));
+    QCOMPARE(CTileReplace::single(3, 1).apply(map, QRect(500, 0, 50, 50)), size_t(0));
+    QCOMPARE(CTileReplace::table({}).apply(map, QRect(0, 0, 50, 50)), size_t(0));
+    QCOMPARE(map.revision(), revision);
+}
+
+QTEST_GUILESS_MAIN(TestCTileReplace)
+#include "tst_ctilereplace.moc"
@@ -0,0 +1,165 @@
+#include "CUndoHistory.h"
+#include "Constants.h"
+
+#include <QUndoStack>
+#include <QtTest>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace {
+    // Runs of 16 equal values, so payloads compress well
+    std::vector<uint32_t> payload(int seed)
+    {
+        std::vector<uint32_t> values(4096);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = static_cast<uint32_t>(i / 16 * 31 + seed);
+        return values;
+    }
+
+    // Sets a target array to one of two payloads, like a tile edit does
+    class ArrayCommand : public CUndoCommand
+    {
+    public:
+        ArrayCommand(std::vector<uint32_t>* target, int seed)
+            : m_target(target), m_old(payload(seed - 1)), m_new(payload(seed)) {}
+
+    protected:
+        void doUndo() override { *m_target = m_old; }
+        void doRedo() override { *m_target = m_new; }
+
+        size_t payloadSize() const override { return (m_old.size() + m_new.size()) * sizeof(uint32_t); }
+        bool compressible() const override { return true; }
+        void writePayload(QDataStream& out) const override { writeRaw(out, m_old); writeRaw(out, m_new); }
+        void readPayload(QDataStream& in) override { readRaw(in, m_old); readRaw(in, m_new); }
+        void releasePayload() override { releaseRaw(m_old); releaseRaw(m_new); }
+
+    private:
+        std::vector<uint32_t>* m_target;
+        std::vector<uint32_t> m_old;
+        std::vector<uint32_t> m_new;
+    };
+
+    int countStored(const QUndoStack& stack, CUndoCommand::Storage storage)
+    {
+        int count = 0;
+        for (int i = 0; i < stack.count(); ++i) {
+            auto* cmd = dynamic_cast<const CUndoCommand*>(stack.command(i));
+            count += cmd && cmd->storage() == storage;
+        }
+        return count;
+    }
+}
+
+//-----------------------------------------------------------------------------
+class TestCUndoHistory : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void spillRoundTrip();
+    void ledgerTotals();
+    void freeRanges();
+};
+
+//-----------------------------------------------------------------------------
+// With no budget everything but the UNDO_KEEP_RECENT commands around the
+// index is compressed and, with no threshold, spilled; undo and redo must
+// read every payload back intact
+void TestCUndoHistory::spillRoundTrip()
+{
+    QUndoStack stack;
+    CUndoHistory history(&stack);
+    history.setMemoryBudget(0);
+    history.setSpillThreshold(0);
+
+    std::vector<uint32_t> target;
+    const int count = 40;
+    for (int k = 1; k <= count; ++k)
+        stack.push(new ArrayCommand(&target, k));
+    QVERIFY(target == payload(count));
+
+    const int kept = Constants::UNDO_KEEP_RECENT - 1;
+    QTRY_COMPARE(countStored(stack, CUndoCommand::Storage::Spilled), count - kept);
+    QTRY_COMPARE(history.compressedBytes(), qint64(0));
+    QVERIFY(history.spilledBytes() > 0);
+
+    for (int k = count; k >= 1; --k) {
+        stack.undo();
+        QVERIFY2(target == payload(k - 1), qPrintable(QString("undo %1").arg(k)));
+    }
+    // Now the oldest commands are the recent ones
+    QTRY_COMPARE(countStored(stack, CUndoCommand::Storage::Spilled), count - Constants::UNDO_KEEP_RECENT);
+
+    for (int k = 1; k <= count; ++k) {
+        stack.redo();
+        QVERIFY2(target == payload(k), qPrintable(QString("redo %1").arg(k)));
+    }
+
+    stack.clear();
+    QCOMPARE(history.residentBytes(), qint64(0));
+    QCOMPARE(history.compressedBytes(), qint64(0));
+    QCOMPARE(history.spilledBytes(), qint64(0));
+}
+
+//-----------------------------------------------------------------------------
+// The children of a macro are booked one by one
+void TestCUndoHistory::ledgerTotals()
+{
+    QUndoStack stack;
+    CUndoHistory history(&stack);
+
+    std::vector<uint32_t> target;
+    auto* one = new ArrayCommand(&target, 1);
+    stack.push(one);
+    const qint64 size = static_cast<qint64>(one->byteSize());
+    QCOMPARE(history.residentBytes(), size);
+
+    stack.beginMacro("macro");
+    stack.push(new ArrayCommand(&target, 2));
+    stack.push(new ArrayCommand(&target, 3));
+    stack.endMacro();
+    QCOMPARE(history.residentBytes(), 3 * size);
+
+    stack.undo();
+    QVERIFY(target == payload(1));
+    QCOMPARE(history.residentBytes(), 3 * size);
+
+    stack.clear();
+    QCOMPARE(history.residentBytes(), qint64(0));
+}
+
+//-----------------------------------------------------------------------------
+void TestCUndoHistory::freeRanges()
+{
+    CUndoLedger ledger;
+    QVERIFY(ledger.spillFile.open());
+    QVERIFY(ledger.spillFile.resize(300));
+    using Ranges = std::map<qint64, qint64>;
+
+    // Nothing free yet: appended
+    QCOMPARE(ledger.allocate(10), qint64(300));
+
+    // Neighbouring ranges join
+    ledger.release(100, 50);
+    ledger.release(150, 50);
+    QVERIFY(ledger.freeRanges == (Ranges{ { 100, 100 } }));
+
+    // First fit, the rest stays free
+    QCOMPARE(ledger.allocate(60), qint64(100));
+    QVERIFY(ledger.freeRanges == (Ranges{ { 160, 40 } }));
+    QCOMPARE(ledger.allocate(50), qint64(300));
+
+    // Free space reaching the end truncates the file
+    ledger.release(200, 100);
+    QVERIFY(ledger.freeRanges.empty());
+    QCOMPARE(ledger.spillFile.size(), qint64(160));
+
+    ledger.release(0, 100);
+    QCOMPARE(ledger.spillFile.size(), qint64(160));
+    ledger.release(100, 60);
+    QVERIFY(ledger.freeRanges.empty());
+    QCOMPARE(ledger.spillFile.size(), qint64(0));
+}
+
+QTEST_GUILESS_MAIN(TestCUndoHistory)
+#include "tst_cundohistory.moc"